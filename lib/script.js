@@ -3,8 +3,27 @@ const currentUrl = window.location.hostname;
 const statusElement = document.getElementById('status');
 const flashButton = document.getElementById("toggleFlash");
 const frameSizeSelect = document.getElementById("frameSize");
+const autoQualityButton = document.getElementById("autoQuality");
 const streamElement = document.getElementById('stream');
 
+// Binary command frame, see src/CarProtocol.h
+const PROTOCOL_VERSION = 1;
+const OPCODE = { ping: 0x01, toggleFlash: 0x02, move: 0x03, camera: 0x04, drive: 0x08 };
+let commandSeq = 0;
+
+function encodeCommand(opcode, a = 0, b = 0) {
+  const frame = new DataView(new ArrayBuffer(8));
+
+  frame.setUint8(0, PROTOCOL_VERSION);
+  frame.setUint8(1, opcode);
+  frame.setUint16(2, commandSeq, true);
+  frame.setInt16(4, a, true);
+  frame.setInt16(6, b, true);
+  commandSeq = (commandSeq + 1) & 0xffff;
+
+  return frame.buffer;
+}
+
 // UI functions
 function handleRotationScreen() {
   const checkOrientation = () => {
@@ -50,6 +69,20 @@ function showStatus(isConnected) {
   statusElement.classList.add("disconnected");
 }
 
+function showNotice(text) {
+  if (lastStatus === false) {
+    return;
+  }
+
+  clearTimeout(statusElement._hideTimer);
+  statusElement.textContent = text;
+  statusElement.classList.add("visible");
+
+  statusElement._hideTimer = setTimeout(() => {
+    statusElement.classList.remove("visible");
+  }, 3000);
+}
+
 function updateWiFiIndicator(rssi) {
   const indicator = document.getElementById('wifiIndicator');
   const rssiValue = document.getElementById('rssiValue');
@@ -119,7 +152,7 @@ function handleWebSocket() {
 
     heartbeatInterval = setInterval(() => {
       try {
-        ws.send('ping');
+        ws.send(encodeCommand(OPCODE.ping));
       } catch (error) {
         location.reload();
       }
@@ -168,6 +201,30 @@ function handleWebSocket() {
       frameSizeSelect.value = frameSize;
     }
 
+    if (event.data.startsWith("AUTOQ-")) {
+      // Format: AUTOQ-<enabled>-<frameSize>-<quality>-<reason>
+      const [, enabled, frameSize] = event.data.split("-");
+
+      autoQualityButton.classList.toggle("turned-off", enabled !== "1");
+      frameSizeSelect.value = frameSize;
+    }
+
+    if (event.data.startsWith("AUTOSTOP-")) {
+      // Format: AUTOSTOP-<silence ms>-<deadline ms>-<mean interval ms>-<jitter ms>
+      const [, silence] = event.data.split("-");
+
+      showNotice(`⚠️ No commands for ${silence} ms, car stopped`);
+    }
+
+    if (event.data.startsWith("MOTION-") && event.data !== "MOTION-END") {
+      // Format: MOTION-<blocks>-<x %>-<y %>-<w %>-<h %>
+      showNotice("👀 Sentry: motion detected");
+    }
+
+    if (event.data === "RECORD-FAIL") {
+      showNotice("⚠️ SD recording stopped: no card or write failed");
+    }
+
     if (event.data.startsWith("WIFI-")) {
       const toggleWifiModeButton = document.getElementById("toggleWifiMode");
       const acModeScreen = document.getElementById("ac-mode");
@@ -221,132 +278,171 @@ function handleWebSocket() {
 
 // car control functions
 function handleCarMovement() {
-  const DATA_SEND_INTERVAL = 100;
+  const DRIVE_MAX = 127;
+  // Unchanged input is repeated this often to keep the car's dead-man watchdog
+  // fed. The watchdog learns this cadence from the repeats, so holding a key
+  // or a stick costs about 3 messages per second.
+  const KEEPALIVE_INTERVAL = 300;
+  // Steering used when a turn key is held together with forward or backward
+  const COMBINED_STEER = 48;
+  const GAMEPAD_DEADZONE = 0.12;
   const controllers = document.querySelectorAll('.movement-controller');
-  const intervals = {};
   const activeKeys = new Set();
   const keyMap = { w: "forward", s: "backward", a: "left", d: "right" };
+  const touchAxes = new Map(); // touch identifier -> joystick element
+  const analog = { throttle: 0, steer: 0 };
+  let lastSent = { throttle: 0, steer: 0, at: 0 };
+
+  const clampInput = (value) => Math.max(-DRIVE_MAX, Math.min(DRIVE_MAX, Math.round(value * DRIVE_MAX)));
 
-  const moveCar = () => {
-    const directions = Array.from(activeKeys);
-    let output = "";
+  const digitalInput = () => {
+    const throttle = (activeKeys.has("forward") ? DRIVE_MAX : 0) - (activeKeys.has("backward") ? DRIVE_MAX : 0);
+    const turn = (activeKeys.has("right") ? 1 : 0) - (activeKeys.has("left") ? 1 : 0);
 
-    if (directions.length === 1) {
-      output = directions[0];
-    } else if (directions.length === 2) {
-      const x = directions.find(direction => direction === "forward" || direction === "backward");
-      const y = directions.find(direction => direction === "left" || direction === "right");
+    return { throttle, steer: turn * (throttle ? COMBINED_STEER : DRIVE_MAX) };
+  }
 
-      if (x && y) {
-        output = `${x}-${y}`;
+  const gamepadInput = () => {
+    const pads = navigator.getGamepads ? navigator.getGamepads() : [];
+    const axis = (value = 0) => Math.abs(value) < GAMEPAD_DEADZONE ? 0 : clampInput(value);
+
+    for (const pad of pads) {
+      if (!pad) {
+        continue;
       }
-    }
 
-    if (output) {
-      ws.sendData(output);
+      // Left stick drives, the right stick steers (the left one on single-stick pads)
+      const throttle = -axis(pad.axes[1]);
+      const steer = axis(pad.axes.length > 2 ? pad.axes[2] : pad.axes[0]);
 
-      return
+      if (throttle || steer) {
+        return { throttle, steer };
+      }
     }
 
-    ws.sendData("stop");
+    return null;
   }
 
-  const startAction = (elementId) => {
-    if (intervals[elementId]) {
-      return;
+  const currentInput = () => {
+    if (analog.throttle || analog.steer) {
+      return analog;
     }
 
-    activeKeys.add(elementId);
+    return gamepadInput() || digitalInput();
+  }
 
-    const activeElement = document.getElementById(elementId);
+  const highlight = ({ throttle, steer }) => {
+    document.getElementById("forward").classList.toggle("active", throttle > 0);
+    document.getElementById("backward").classList.toggle("active", throttle < 0);
+    document.getElementById("left").classList.toggle("active", steer < 0);
+    document.getElementById("right").classList.toggle("active", steer > 0);
+  }
 
-    if (activeElement) {
-      activeElement.classList.add("active");
-    }
+  // Sends only when the input changes, plus a keepalive while moving
+  const update = (now) => {
+    const input = currentInput();
+    const changed = input.throttle !== lastSent.throttle || input.steer !== lastSent.steer;
+    const moving = input.throttle !== 0 || input.steer !== 0;
 
-    moveCar();
+    if (changed || (moving && now - lastSent.at >= KEEPALIVE_INTERVAL)) {
+      ws.sendData(encodeCommand(OPCODE.drive, input.throttle, input.steer));
+      lastSent = { throttle: input.throttle, steer: input.steer, at: now };
+      highlight(input);
+    }
 
-    intervals[elementId] = setTimeout(function repeat() {
-      moveCar();
-      intervals[elementId] = setTimeout(repeat, DATA_SEND_INTERVAL);
-    }, DATA_SEND_INTERVAL);
+    requestAnimationFrame(update);
   }
 
-  const stopAction = (elementId) => {
-    if (!intervals[elementId]) {
+  // Position of a touch inside a joystick, -1..1 from its centre
+  const trackTouch = (touch, joystick) => {
+    const rect = joystick.getBoundingClientRect();
+
+    if (joystick.classList.contains("vertical")) {
+      analog.throttle = clampInput((rect.top + rect.height / 2 - touch.clientY) / (rect.height / 2));
       return;
     }
 
-    activeKeys.delete(elementId);
+    analog.steer = clampInput((touch.clientX - rect.left - rect.width / 2) / (rect.width / 2));
+  }
 
-    const activeElement = document.getElementById(elementId);
+  const releaseTouch = (touch) => {
+    const joystick = touchAxes.get(touch.identifier);
 
-    if (activeElement) {
-      activeElement.classList.remove("active");
+    if (!joystick) {
+      return;
     }
 
-    clearTimeout(intervals[elementId]);
-    delete intervals[elementId];
+    touchAxes.delete(touch.identifier);
 
-    moveCar();
+    if (joystick.classList.contains("vertical")) {
+      analog.throttle = 0;
+      return;
+    }
+
+    analog.steer = 0;
   }
 
   const attachHandlers = () => {
     // mouse
-    controllers.forEach(elementId => {
-      elementId.addEventListener("mousedown", () => startAction(elementId.id));
-      elementId.addEventListener("mouseup", () => stopAction(elementId.id));
-      elementId.addEventListener("mouseleave", () => stopAction(elementId.id));
+    controllers.forEach(element => {
+      element.addEventListener("mousedown", () => activeKeys.add(element.id));
+      element.addEventListener("mouseup", () => activeKeys.delete(element.id));
+      element.addEventListener("mouseleave", () => activeKeys.delete(element.id));
     });
 
     // keyboard
     document.addEventListener("keydown", e => {
-      const elementId = keyMap[e.key.toLowerCase()];
-      if (elementId) startAction(elementId);
+      const direction = keyMap[e.key.toLowerCase()];
+      if (direction) activeKeys.add(direction);
     });
     document.addEventListener("keyup", e => {
-      const elementId = keyMap[e.key.toLowerCase()];
-      if (elementId) stopAction(elementId);
+      const direction = keyMap[e.key.toLowerCase()];
+      if (direction) activeKeys.delete(direction);
     });
 
-    // multitouch
+    // analog multitouch, one finger per joystick
     const joystickWrapper = document.querySelector(".joystick-wrapper");
     joystickWrapper.addEventListener("touchstart", e => {
       e.preventDefault();
 
-      for (const { target } of e.changedTouches) {
-        const controller = target.closest(".movement-controller");
+      for (const touch of e.changedTouches) {
+        const joystick = touch.target.closest(".joystick");
 
-        if (controller) {
-          startAction(controller.id);
+        if (joystick) {
+          touchAxes.set(touch.identifier, joystick);
+          trackTouch(touch, joystick);
         }
       }
     });
-    joystickWrapper.addEventListener("touchend", e => {
+    joystickWrapper.addEventListener("touchmove", e => {
       e.preventDefault();
 
-      for (const { target } of e.changedTouches) {
-        const controller = target.closest(".movement-controller");
+      for (const touch of e.changedTouches) {
+        const joystick = touchAxes.get(touch.identifier);
 
-        if (controller) {
-          stopAction(controller.id);
+        if (joystick) {
+          trackTouch(touch, joystick);
         }
       }
     });
-    joystickWrapper.addEventListener("touchcancel", e => {
+    joystickWrapper.addEventListener("touchend", e => {
       e.preventDefault();
 
-      for (const { target } of e.changedTouches) {
-        const controller = target.closest(".movement-controller");
+      for (const touch of e.changedTouches) {
+        releaseTouch(touch);
+      }
+    });
+    joystickWrapper.addEventListener("touchcancel", e => {
+      e.preventDefault();
 
-        if (controller) {
-          stopAction(controller.id);
-        }
+      for (const touch of e.changedTouches) {
+        releaseTouch(touch);
       }
     });
   }
 
   attachHandlers();
+  requestAnimationFrame(update);
 }
 
 function handleFunctions() {
@@ -378,7 +474,13 @@ function handleFunctions() {
     flashButton.addEventListener("click", () => {
       // Optimistic UI update
       flashButton.classList.toggle("turned-off");
-      ws.sendData("toggleFlash");
+      ws.sendData(encodeCommand(OPCODE.toggleFlash));
+    });
+
+    autoQualityButton.addEventListener("click", () => {
+      const enable = autoQualityButton.classList.contains("turned-off");
+
+      ws.sendData(`autoQuality_${enable ? 1 : 0}`);
     });
 
     frameSizeSelect.addEventListener("change", () => {
@@ -393,7 +495,7 @@ function handleFunctions() {
       e.preventDefault();
       // Optimistic UI update
       flashButton.classList.toggle("turned-off");
-      ws.sendData("toggleFlash");
+      ws.sendData(encodeCommand(OPCODE.toggleFlash));
     }, { passive: false });
   }
   attachHandlers();
@@ -428,7 +530,7 @@ function handleCameraDrag() {
     rangeX.style.opacity = RANGE_OPACITY;
     rangeY.style.opacity = RANGE_OPACITY;
 
-    ws.sendData(`cameraDrag_${drag.x}_${drag.y}`);
+    ws.sendData(encodeCommand(OPCODE.camera, drag.x, drag.y));
 
     clearTimeout(timeout);
     timeout = setTimeout(() => {
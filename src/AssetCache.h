@@ -0,0 +1,137 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include "esp_http_server.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct AssetVariant {
+  const uint8_t *data;
+  size_t len;
+  const char *etag; // strong, quoted
+};
+
+struct EmbeddedAsset {
+  const char *path;
+  const char *type;
+  AssetVariant plain;
+  AssetVariant gzip;
+};
+
+// Minified and gzipped copies of lib/, written by tools/embed_assets.py
+#include "generated/webAssets.h"
+
+// If-None-Match uses weak comparison: "*" or any listed tag, W/ prefix ignored
+inline bool etagMatches(const char *ifNoneMatch, const char *etag) {
+  if (!ifNoneMatch || !etag) {
+    return false;
+  }
+
+  size_t etagLen = strlen(etag);
+  const char *p = ifNoneMatch;
+
+  while (*p) {
+    while (*p == ' ' || *p == ',') {
+      p++;
+    }
+
+    if (*p == '*') {
+      return true;
+    }
+
+    if (p[0] == 'W' && p[1] == '/') {
+      p += 2;
+    }
+
+    const char *end = p;
+    while (*end && *end != ',') {
+      end++;
+    }
+
+    const char *tagEnd = end;
+    while (tagEnd > p && tagEnd[-1] == ' ') {
+      tagEnd--;
+    }
+
+    if ((size_t)(tagEnd - p) == etagLen && strncmp(p, etag, etagLen) == 0) {
+      return true;
+    }
+
+    p = end;
+  }
+
+  return false;
+}
+
+// True when gzip is listed in Accept-Encoding without q=0
+inline bool acceptsGzip(const char *acceptEncoding) {
+  if (!acceptEncoding) {
+    return false;
+  }
+
+  const char *p = strstr(acceptEncoding, "gzip");
+  if (!p) {
+    return false;
+  }
+
+  const char *end = strchr(p, ',');
+  const char *q = strstr(p, "q=");
+
+  if (q && (!end || q < end)) {
+    return atof(q + 2) > 0;
+  }
+
+  return true;
+}
+
+// Serves the web UI compiled into the firmware. Bodies live in flash, so a
+// response is a single send with no filesystem access. The gzip copy is sent
+// when the client accepts it, and a matching If-None-Match gets a 304.
+class AssetCache {
+public:
+  esp_err_t serve(httpd_req_t *req, const char *path) {
+    const EmbeddedAsset *asset = find(path);
+    if (!asset) {
+      DEBUG_PRINTF_LN("404 Not Found: %s", path);
+      httpd_resp_send_404(req);
+      return ESP_FAIL;
+    }
+
+    char header[128];
+    bool gzip = httpd_req_get_hdr_value_str(req, "Accept-Encoding", header, sizeof(header)) == ESP_OK &&
+                acceptsGzip(header);
+    const AssetVariant &body = gzip ? asset->gzip : asset->plain;
+
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "ETag", body.etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", header, sizeof(header)) == ESP_OK &&
+        etagMatches(header, body.etag)) {
+      httpd_resp_set_status(req, "304 Not Modified");
+      return httpd_resp_send(req, NULL, 0);
+    }
+
+    if (gzip) {
+      httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+
+    return httpd_resp_send(req, (const char *)body.data, body.len);
+  }
+
+private:
+  static const EmbeddedAsset *find(const char *path) {
+    for (const EmbeddedAsset &asset : WEB_ASSETS) {
+      if (strcmp(asset.path, path) == 0) {
+        return &asset;
+      }
+    }
+
+    return nullptr;
+  }
+};
+
+#endif
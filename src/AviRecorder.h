@@ -0,0 +1,338 @@
+#ifndef AVI_RECORDER_H
+#define AVI_RECORDER_H
+
+#include "AviWriter.h"
+#include <atomic>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define AVI_SECTOR_BYTES 512
+#ifndef AVI_BLOCK_BYTES
+#define AVI_BLOCK_BYTES (32 * 1024) // bytes per write, a multiple of AVI_SECTOR_BYTES
+#endif
+#define AVI_MAX_FRAMES 9000 // index entries held per file, 15 min at 10 fps
+#define AVI_ROTATE_BYTES (256UL * 1024 * 1024)
+#define AVI_ROTATE_SECONDS 300
+#define AVI_FILE_PREFIX "car_"
+
+// Offset of the 'movi' fourcc in the file, idx1 offsets count from here
+#define AVI_MOVI_START (AVI_HEADER_SIZE - 4)
+
+struct AviIndexEntry {
+  uint32_t moviOffset;
+  uint32_t len;
+};
+
+typedef void *(*AviAllocator)(size_t bytes);
+
+// Records JPEG frames into numbered MJPEG-AVI files through stdio, which is
+// the SD card's FAT volume on the car and a plain directory on the host.
+//
+// Frames are copied into one AVI_BLOCK_BYTES buffer that is written whole,
+// so every write starts on a sector boundary and the card sees few, large
+// writes. The idx1 entries stay in memory until the file is closed; then the
+// index is appended and the header written again with the final sizes. A
+// file that was never closed (power cut, card pulled) has zero sizes in its
+// header but its frames are all there.
+//
+// One task calls everything; the counters may be read from anywhere.
+class AviRecorder {
+public:
+  AviRecorder()
+      : block(nullptr),
+        index(nullptr),
+        file(nullptr),
+        blockFill(0),
+        fileBytes(0),
+        frames(0),
+        maxFrameBytes(0),
+        firstUs(0),
+        lastUs(0),
+        width(0),
+        height(0),
+        nextNumber(0),
+        rotateBytes(AVI_ROTATE_BYTES),
+        rotateUs(AVI_ROTATE_SECONDS * 1000000LL),
+        failed(false),
+        recording(false),
+        totalFrames(0),
+        totalBytes(0),
+        blockWrites(0),
+        filesClosed(0) {
+    directory[0] = '\0';
+    path[0] = '\0';
+  }
+
+  // On the car the block must be DMA-capable internal RAM, or the SD driver
+  // writes it one sector at a time; the index can live in PSRAM
+  bool begin(AviAllocator allocateBlock, AviAllocator allocateIndex) {
+    if (!block) {
+      block = (uint8_t *)allocateBlock(AVI_BLOCK_BYTES);
+    }
+
+    if (!index) {
+      index = (AviIndexEntry *)allocateIndex(AVI_MAX_FRAMES * sizeof(AviIndexEntry));
+    }
+
+    return block && index;
+  }
+
+  // Frees the buffers, after stop()
+  void end() {
+    free(block);
+    free(index);
+    block = nullptr;
+    index = nullptr;
+  }
+
+  void setRotation(uint32_t maxBytes, uint32_t maxSeconds) {
+    rotateBytes = maxBytes;
+    rotateUs = maxSeconds * 1000000LL;
+  }
+
+  // Files go to dir, numbered after the highest one already there
+  bool start(const char *dir) {
+    if (!block || recording) {
+      return false;
+    }
+
+    snprintf(directory, sizeof(directory), "%s", dir);
+    nextNumber = nextFileNumber(directory);
+    failed = false;
+    recording = true;
+    return true;
+  }
+
+  // Opens the first file with the first frame and moves to a new one when
+  // the current file reaches the size or time limit. False once a write
+  // failed; recording has stopped then.
+  bool addFrame(const uint8_t *jpeg, uint32_t len, uint16_t frameWidth, uint16_t frameHeight, int64_t capturedUs) {
+    if (!recording || failed) {
+      return false;
+    }
+
+    bool full = frames == AVI_MAX_FRAMES ||
+                fileBytes + blockFill + aviChunkBytes(len) + aviIndexBytes(frames + 1) > rotateBytes ||
+                capturedUs - firstUs >= rotateUs;
+
+    if (file && full && !closeFile()) {
+      return false;
+    }
+
+    if (!file && !openFile(frameWidth, frameHeight, capturedUs)) {
+      return fail();
+    }
+
+    uint8_t header[AVI_CHUNK_HEADER_SIZE];
+    const uint8_t pad = 0;
+
+    index[frames] = {fileBytes + blockFill - AVI_MOVI_START, len};
+    aviWriteFrameHeader(header, len);
+
+    if (!append(header, sizeof(header)) || !append(jpeg, len) || ((len & 1) && !append(&pad, 1))) {
+      return fail();
+    }
+
+    frames++;
+    maxFrameBytes = len > maxFrameBytes ? len : maxFrameBytes;
+    lastUs = capturedUs;
+    totalFrames++;
+    return true;
+  }
+
+  // Closes the current file with its index
+  bool stop() {
+    bool ok = !failed && (!file || closeFile());
+
+    if (file) {
+      fclose(file);
+      file = nullptr;
+    }
+
+    recording = false;
+    return ok;
+  }
+
+  bool isRecording() const {
+    return recording;
+  }
+
+  bool hasFailed() const {
+    return failed;
+  }
+
+  // File being written, empty between files
+  const char *getPath() const {
+    return file ? path : "";
+  }
+
+  uint32_t getTotalFrames() const {
+    return totalFrames;
+  }
+
+  uint64_t getTotalBytes() const {
+    return totalBytes;
+  }
+
+  uint32_t getBlockWrites() const {
+    return blockWrites;
+  }
+
+  uint32_t getFilesClosed() const {
+    return filesClosed;
+  }
+
+  // Highest car_NNNNN.avi in dir plus one
+  static uint32_t nextFileNumber(const char *dir) {
+    uint32_t next = 0;
+    DIR *d = opendir(dir);
+
+    if (!d) {
+      return 0;
+    }
+
+    while (dirent *entry = readdir(d)) {
+      unsigned number;
+      char suffix[5];
+
+      if (sscanf(entry->d_name, AVI_FILE_PREFIX "%5u.%4s", &number, suffix) == 2 && strcmp(suffix, "avi") == 0 &&
+          number >= next) {
+        next = number + 1;
+      }
+    }
+
+    closedir(d);
+    return next;
+  }
+
+private:
+  uint8_t *block;
+  AviIndexEntry *index;
+  FILE *file;
+  char directory[64];
+  char path[80];
+  uint32_t blockFill;
+  uint32_t fileBytes; // written to the file so far, always whole blocks
+  uint32_t frames;
+  uint32_t maxFrameBytes;
+  int64_t firstUs;
+  int64_t lastUs;
+  uint16_t width;
+  uint16_t height;
+  uint32_t nextNumber;
+  uint32_t rotateBytes;
+  int64_t rotateUs;
+  bool failed;
+  bool recording;
+  std::atomic<uint32_t> totalFrames;
+  std::atomic<uint64_t> totalBytes;
+  std::atomic<uint32_t> blockWrites;
+  std::atomic<uint32_t> filesClosed;
+
+  bool fail() {
+    failed = true;
+
+    if (file) {
+      fclose(file);
+      file = nullptr;
+    }
+
+    return false;
+  }
+
+  AviInfo info() const {
+    uint32_t usPerFrame = frames > 1 ? (lastUs - firstUs) / (frames - 1) : 100000;
+    return {width, height, usPerFrame, frames, fileBytes + blockFill - AVI_HEADER_SIZE, maxFrameBytes};
+  }
+
+  bool openFile(uint16_t frameWidth, uint16_t frameHeight, int64_t capturedUs) {
+    snprintf(path, sizeof(path), "%s/" AVI_FILE_PREFIX "%05u.avi", directory, (unsigned)nextNumber++);
+    file = fopen(path, "wb");
+
+    if (!file) {
+      return false;
+    }
+
+    // Blocks are already the right size, stdio copying them again only costs time
+    setvbuf(file, nullptr, _IONBF, 0);
+
+    width = frameWidth;
+    height = frameHeight;
+    firstUs = capturedUs;
+    lastUs = capturedUs;
+    frames = 0;
+    maxFrameBytes = 0;
+    fileBytes = 0;
+    blockFill = AVI_HEADER_SIZE;
+
+    // Provisional header, closeFile() writes the real one
+    aviWriteHeader(block, info());
+    return true;
+  }
+
+  bool closeFile() {
+    uint8_t entry[AVI_INDEX_ENTRY_SIZE];
+    AviInfo final = info();
+
+    aviWriteIndexHeader(entry, frames);
+    bool ok = append(entry, AVI_CHUNK_HEADER_SIZE);
+
+    for (uint32_t i = 0; i < frames && ok; i++) {
+      aviWriteIndexEntry(entry, index[i].moviOffset, index[i].len);
+      ok = append(entry, sizeof(entry));
+    }
+
+    // The last, partial block, then the header with the real sizes
+    ok = ok && writeBlock(blockFill);
+
+    if (ok) {
+      uint8_t header[AVI_HEADER_SIZE];
+      aviWriteHeader(header, final);
+      ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    }
+
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+
+    if (!ok) {
+      failed = true;
+      return false;
+    }
+
+    filesClosed++;
+    return true;
+  }
+
+  bool append(const uint8_t *data, uint32_t len) {
+    while (len > 0) {
+      uint32_t room = AVI_BLOCK_BYTES - blockFill;
+      uint32_t chunk = len < room ? len : room;
+
+      memcpy(block + blockFill, data, chunk);
+      blockFill += chunk;
+      data += chunk;
+      len -= chunk;
+
+      if (blockFill == AVI_BLOCK_BYTES && !writeBlock(AVI_BLOCK_BYTES)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool writeBlock(uint32_t len) {
+    if (len > 0 && fwrite(block, 1, len, file) != len) {
+      return false;
+    }
+
+    fileBytes += len;
+    totalBytes += len;
+    blockFill = 0;
+    blockWrites++;
+    return true;
+  }
+};
+
+#endif
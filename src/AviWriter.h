@@ -0,0 +1,167 @@
+#ifndef AVI_WRITER_H
+#define AVI_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// MJPEG-AVI (RIFF) layout, just enough for one video stream of JPEG frames:
+//
+//   RIFF 'AVI '
+//     LIST 'hdrl'  avih, LIST 'strl' (strh, strf)
+//     LIST 'movi'  one '00dc' chunk per frame
+//     idx1         one entry per chunk in movi
+//
+// Sizes in the headers must be known when they are written, so callers
+// either plan the whole file first (clip export) or write the header again
+// once the file is done (recorder). Nothing here touches the hardware.
+
+#define AVI_HEADER_SIZE 224 // everything before the first movi chunk
+#define AVI_CHUNK_HEADER_SIZE 8
+#define AVI_INDEX_ENTRY_SIZE 16
+#define AVI_FLAG_HAS_INDEX 0x10
+#define AVI_FLAG_KEYFRAME 0x10
+
+struct AviInfo {
+  uint16_t width;
+  uint16_t height;
+  uint32_t usPerFrame;
+  uint32_t frames;        // chunks in movi, frames and filler alike
+  uint32_t moviBytes;     // all movi chunks with their headers and padding
+  uint32_t maxFrameBytes;
+};
+
+inline void aviPut16(uint8_t *&out, uint16_t value) {
+  out[0] = value;
+  out[1] = value >> 8;
+  out += 2;
+}
+
+inline void aviPut32(uint8_t *&out, uint32_t value) {
+  out[0] = value;
+  out[1] = value >> 8;
+  out[2] = value >> 16;
+  out[3] = value >> 24;
+  out += 4;
+}
+
+inline void aviPutFourcc(uint8_t *&out, const char *fourcc) {
+  memcpy(out, fourcc, 4);
+  out += 4;
+}
+
+// Bytes a frame takes in movi: chunk header, JPEG, padding to an even size
+inline uint32_t aviChunkBytes(uint32_t len) {
+  return AVI_CHUNK_HEADER_SIZE + len + (len & 1);
+}
+
+inline uint32_t aviIndexBytes(uint32_t frames) {
+  return AVI_CHUNK_HEADER_SIZE + frames * AVI_INDEX_ENTRY_SIZE;
+}
+
+inline uint32_t aviFileBytes(const AviInfo &info) {
+  return AVI_HEADER_SIZE + info.moviBytes + aviIndexBytes(info.frames);
+}
+
+// Writes AVI_HEADER_SIZE bytes, up to and including the movi list header
+inline size_t aviWriteHeader(uint8_t *out, const AviInfo &info) {
+  uint8_t *p = out;
+  uint32_t rate = info.usPerFrame ? 1000000 / info.usPerFrame : 0;
+
+  aviPutFourcc(p, "RIFF");
+  aviPut32(p, aviFileBytes(info) - 8);
+  aviPutFourcc(p, "AVI ");
+
+  aviPutFourcc(p, "LIST");
+  aviPut32(p, 192);
+  aviPutFourcc(p, "hdrl");
+
+  aviPutFourcc(p, "avih");
+  aviPut32(p, 56);
+  aviPut32(p, info.usPerFrame);
+  aviPut32(p, info.maxFrameBytes * rate);
+  aviPut32(p, 0); // padding granularity
+  aviPut32(p, AVI_FLAG_HAS_INDEX);
+  aviPut32(p, info.frames);
+  aviPut32(p, 0); // initial frames
+  aviPut32(p, 1); // streams
+  aviPut32(p, info.maxFrameBytes);
+  aviPut32(p, info.width);
+  aviPut32(p, info.height);
+  memset(p, 0, 16); // reserved
+  p += 16;
+
+  aviPutFourcc(p, "LIST");
+  aviPut32(p, 116);
+  aviPutFourcc(p, "strl");
+
+  aviPutFourcc(p, "strh");
+  aviPut32(p, 56);
+  aviPutFourcc(p, "vids");
+  aviPutFourcc(p, "MJPG");
+  aviPut32(p, 0);  // flags
+  aviPut16(p, 0);  // priority
+  aviPut16(p, 0);  // language
+  aviPut32(p, 0);  // initial frames
+  aviPut32(p, info.usPerFrame); // scale / rate = seconds per frame
+  aviPut32(p, 1000000);
+  aviPut32(p, 0);  // start
+  aviPut32(p, info.frames);
+  aviPut32(p, info.maxFrameBytes);
+  aviPut32(p, 0xFFFFFFFF); // default quality
+  aviPut32(p, 0);  // sample size, frames vary
+  aviPut16(p, 0);  // frame rectangle
+  aviPut16(p, 0);
+  aviPut16(p, info.width);
+  aviPut16(p, info.height);
+
+  aviPutFourcc(p, "strf");
+  aviPut32(p, 40);
+  aviPut32(p, 40); // BITMAPINFOHEADER
+  aviPut32(p, info.width);
+  aviPut32(p, info.height);
+  aviPut16(p, 1);  // planes
+  aviPut16(p, 24); // bits per pixel once decoded
+  aviPutFourcc(p, "MJPG");
+  aviPut32(p, (uint32_t)info.width * info.height * 3);
+  memset(p, 0, 16); // resolution and palette
+  p += 16;
+
+  aviPutFourcc(p, "LIST");
+  aviPut32(p, 4 + info.moviBytes);
+  aviPutFourcc(p, "movi");
+
+  return p - out;
+}
+
+// Chunk header for a JPEG of len bytes; one zero byte must follow odd lengths
+inline size_t aviWriteFrameHeader(uint8_t *out, uint32_t len) {
+  aviPutFourcc(out, "00dc");
+  aviPut32(out, len);
+  return AVI_CHUNK_HEADER_SIZE;
+}
+
+// A chunk players skip, for keeping planned sizes when a frame went missing
+inline size_t aviWriteFillerHeader(uint8_t *out, uint32_t len) {
+  aviPutFourcc(out, "JUNK");
+  aviPut32(out, len);
+  return AVI_CHUNK_HEADER_SIZE;
+}
+
+inline size_t aviWriteIndexHeader(uint8_t *out, uint32_t frames) {
+  aviPutFourcc(out, "idx1");
+  aviPut32(out, frames * AVI_INDEX_ENTRY_SIZE);
+  return AVI_CHUNK_HEADER_SIZE;
+}
+
+// moviOffset is where the chunk starts, counted from the 'movi' fourcc, so
+// the first chunk is at 4
+inline size_t aviWriteIndexEntry(uint8_t *out, uint32_t moviOffset, uint32_t len, bool filler = false) {
+  aviPutFourcc(out, filler ? "JUNK" : "00dc");
+  aviPut32(out, filler ? 0 : AVI_FLAG_KEYFRAME);
+  aviPut32(out, moviOffset);
+  aviPut32(out, len);
+  return AVI_INDEX_ENTRY_SIZE;
+}
+
+#endif
@@ -1,9 +1,18 @@
 #ifndef CAR_H
 #define CAR_H
 
+#include "CommandWatchdog.h"
+#include "DriveMixer.h"
+#include "Hal.h"
 #include "Motor.h"
+#include "Perf.h"
+#include "ServoTrajectory.h"
 #include <Servo.h>
 
+#define SERVO_X_MIN_ANGLE 0
+#define SERVO_X_MAX_ANGLE 180
+#define SERVO_X_INITIAL_ANGLE 90
+
 #define SERVO_Y_MIN_ANGLE 70
 #define SERVO_Y_MAX_ANGLE 180
 #define SERVO_Y_INITIAL_ANGLE 135
@@ -35,61 +44,92 @@ static camera_config_t camera_config = {
     .fb_location = CAMERA_FB_IN_PSRAM,
     .grab_mode = CAMERA_GRAB_LATEST};
 
+typedef void (*AutoStopHandler)(uint32_t silenceUs, const CommandWatchdog &watchdog);
+
 class Car {
 public:
   Car()
       : isFlashOn(false),
-        currentAngleX(90),
-        targetAngleX(90),
-        currentAngleY(SERVO_Y_INITIAL_ANGLE),
-        targetAngleY(SERVO_Y_INITIAL_ANGLE),
-        lastUpdate(0),
-        lastCommandTime(0),
-        motorStopped(true),
+#ifdef SD_RECORDING
+        sdPinsReleased(false),
+#endif
+        panAxis(SERVO_X_MIN_ANGLE, SERVO_X_MAX_ANGLE, SERVO_X_INITIAL_ANGLE),
+        tiltAxis(SERVO_Y_MIN_ANGLE, SERVO_Y_MAX_ANGLE, SERVO_Y_INITIAL_ANGLE),
         motorL(LEFT_MOTOR_IN1, LEFT_MOTOR_IN2, LEFT_MOTOR_PWM_CHANNEL_1, LEFT_MOTOR_PWM_CHANNEL_2),
-        motorR(RIGHT_MOTOR_IN1, RIGHT_MOTOR_IN2, RIGHT_MOTOR_PWM_CHANNEL_1, RIGHT_MOTOR_PWM_CHANNEL_2) {}
+        motorR(RIGHT_MOTOR_IN1, RIGHT_MOTOR_IN2, RIGHT_MOTOR_PWM_CHANNEL_1, RIGHT_MOTOR_PWM_CHANNEL_2),
+        autoStopHandler(nullptr) {}
 
   esp_err_t init() {
     pinMode(FLASH_PIN, OUTPUT);
-    digitalWrite(FLASH_PIN, LOW);
+    halDigitalWrite(FLASH_PIN, LOW);
 
     initMotors();
 
     bool resX = servoX.attach(SERVO_X_PIN, SERVO_X_CHANNEL);
     DEBUG_PRINTF_LN("Servo X attach result: %s", resX ? "SUCCESS" : "FAILURE");
-    servoX.write(90);
+    halServoWrite(servoX, SERVO_X_CHANNEL, SERVO_X_INITIAL_ANGLE);
     delay(100);
 
     bool resY = servoY.attach(SERVO_Y_PIN, SERVO_Y_CHANNEL);
     DEBUG_PRINTF_LN("Servo Y attach result: %s", resY ? "SUCCESS" : "FAILURE");
-    servoY.write(SERVO_Y_INITIAL_ANGLE);
+    halServoWrite(servoY, SERVO_Y_CHANNEL, SERVO_Y_INITIAL_ANGLE);
     delay(100);
 
-    lastCommandTime = nowMs();
-
     return initCamera();
   }
 
-  void onCommand() {
-    lastCommandTime = nowMs();
-    motorStopped = false;
+  // Called for every movement command with the time it was received;
+  // repeat when it only resends the previous input
+  void onCommand(int64_t receivedUs, bool repeat) {
+    watchdog.onCommand(receivedUs, repeat);
+  }
+
+  // A new control session starts, its command cadence is learned from scratch
+  void resetWatchdog() {
+    watchdog.reset();
+  }
+
+  const CommandWatchdog &getWatchdog() const {
+    return watchdog;
+  }
+
+  // Called from the control task whenever the watchdog stops the car
+  void setAutoStopHandler(AutoStopHandler handler) {
+    autoStopHandler = handler;
   }
 
-  void tick() {
-    updateServos();
-    tickAutoStop();
-    motorL.tick();
-    motorR.tick();
+  // One control period: the watchdog first so a stop takes effect in the
+  // same tick, then motor ramps, then servo interpolation
+  void tick(uint32_t dtUs, int64_t nowUs) {
+#ifdef SD_RECORDING
+    if (sdPinsReleased) {
+      return;
+    }
+#endif
+
+    tickAutoStop(nowUs);
+    motorL.tick(dtUs);
+    motorR.tick(dtUs);
+    updateServos(dtUs);
+  }
+
+  // Motors have reached the effort last asked for
+  bool isDriveSettled() const {
+    return motorL.isSettled() && motorR.isSettled();
+  }
+
+  bool isCameraSettled() const {
+    return panAxis.isSettled() && tiltAxis.isSettled();
   }
 
   void toggleFlash() {
     isFlashOn = !isFlashOn;
-    digitalWrite(FLASH_PIN, isFlashOn ? HIGH : LOW);
+    halDigitalWrite(FLASH_PIN, isFlashOn ? HIGH : LOW);
   }
 
   void turnFlashOff() {
     isFlashOn = false;
-    digitalWrite(FLASH_PIN, LOW);
+    halDigitalWrite(FLASH_PIN, LOW);
   }
 
   bool getFlashState() {
@@ -97,62 +137,67 @@ public:
   }
 
   void moveForward() {
-    onCommand();
     motorL.moveForward(motorMax);
     motorR.moveForward(motorMax);
   }
 
   void moveBackward() {
-    onCommand();
     motorL.moveBackward(motorMax);
     motorR.moveBackward(motorMax);
   }
 
   void turnRight() {
-    onCommand();
     motorL.moveForward(motorMax);
     motorR.moveBackward(motorMax);
   }
 
   void turnLeft() {
-    onCommand();
     motorL.moveBackward(motorMax);
     motorR.moveForward(motorMax);
   }
 
   void moveForwardLeft() {
-    onCommand();
     motorL.moveForward(motorMax / 1.5);
     motorR.moveForward(motorMax);
   }
 
   void moveForwardRight() {
-    onCommand();
     motorL.moveForward(motorMax);
     motorR.moveForward(motorMax / 1.5);
   }
 
   void moveBackwardLeft() {
-    onCommand();
     motorL.moveBackward(motorMax / 1.5);
     motorR.moveBackward(motorMax);
   }
 
   void moveBackwardRight() {
-    onCommand();
     motorL.moveBackward(motorMax);
     motorR.moveBackward(motorMax / 1.5);
   }
 
+  // Analog drive, both in [-127, 127]; throttle > 0 is forward, steer > 0 turns right
+  void drive(int8_t throttle, int8_t steer) {
+    int16_t left, right;
+    mixer.mix(throttle, steer, left, right);
+
+    motorL.drive(left);
+    motorR.drive(right);
+
+    if (left == 0 && right == 0) {
+      watchdog.onStop();
+    }
+  }
+
   void stop() {
     motorL.stop();
     motorR.stop();
-    motorStopped = true;
+    watchdog.onStop();
   }
 
   void setCameraX(int x) {
     x = constrain(x, -100, 100);
-    targetAngleX = map(x, -100, 100, 0, 180);
+    panAxis.setTarget(map(x, -100, 100, SERVO_X_MIN_ANGLE, SERVO_X_MAX_ANGLE));
   }
 
   void setCameraY(int y) {
@@ -167,11 +212,11 @@ public:
     }
 
     angleY = constrain(angleY, SERVO_Y_MIN_ANGLE, SERVO_Y_MAX_ANGLE);
-    targetAngleY = angleY;
+    tiltAxis.setTarget(angleY);
   }
 
   void setCameraY2(int y) {
-    servoY.write(y);
+    halServoWrite(servoY, SERVO_Y_CHANNEL, y);
   }
 
   void setCameraPosition(int x, int y) {
@@ -179,106 +224,109 @@ public:
     setCameraY(y);
   }
 
+#ifdef SD_RECORDING
+  // On the AI Thinker the SD slot (1-bit mode: GPIO 2, 14, 15, DAT3 on 13)
+  // shares its pins with the pan servo and both motors, so the card and
+  // driving take turns. The control loop drops drive commands meanwhile.
+  // Control task only, like tick(), so no tick can be halfway through.
+  void releaseSdPins() {
+    if (sdPinsReleased) {
+      return;
+    }
+
+    sdPinsReleased = true;
+
+    motorL.end();
+    motorR.end();
+    servoX.detach();
+  }
+
+  void reclaimSdPins() {
+    if (!sdPinsReleased) {
+      return;
+    }
+
+    motorL.begin();
+    motorR.begin();
+    servoX.attach(SERVO_X_PIN, SERVO_X_CHANNEL);
+    halServoWrite(servoX, SERVO_X_CHANNEL, panAxis.getAngle());
+
+    sdPinsReleased = false;
+  }
+
+  bool hasReleasedSdPins() const {
+    return sdPinsReleased;
+  }
+#endif
+
   void resetCameraImmediately() {
-    servoX.write(90);
-    servoY.write(SERVO_Y_INITIAL_ANGLE);
+    halServoWrite(servoX, SERVO_X_CHANNEL, SERVO_X_INITIAL_ANGLE);
+    halServoWrite(servoY, SERVO_Y_CHANNEL, SERVO_Y_INITIAL_ANGLE);
     
-    currentAngleX = 90;
-    targetAngleX = 90;
-    currentAngleY = SERVO_Y_INITIAL_ANGLE;
-    targetAngleY = SERVO_Y_INITIAL_ANGLE;
-    
-    lastUpdate = nowMs();
+    panAxis.reset(SERVO_X_INITIAL_ANGLE);
+    tiltAxis.reset(SERVO_Y_INITIAL_ANGLE);
     
     DEBUG_PRINTLN("Camera reset to center position");
   }
 
 private:
   bool isFlashOn;
+#ifdef SD_RECORDING
+  bool sdPinsReleased;
+#endif
   Servo servoX;
   Servo servoY;
 
-  int currentAngleX;
-  int targetAngleX;
-  int currentAngleY;
-  int targetAngleY;
-  uint64_t lastUpdate;
+  ServoTrajectory panAxis;
+  ServoTrajectory tiltAxis;
 
   uint8_t motorMax = 255;
   Motor motorL;
   Motor motorR;
+  DriveMixer mixer;
 
-  uint64_t lastCommandTime;
-  bool motorStopped;
+  CommandWatchdog watchdog;
+  AutoStopHandler autoStopHandler;
 
-  void updateServos() {
-    uint64_t now = nowMs();
-    const int stepDelay = 40;
-    const int step = 2;
+  // Servo writes only when the rounded angle actually moved
+  void updateServos(uint32_t dtUs) {
+    PERF_SCOPE(perfServoUpdate);
 
-    if (now - lastUpdate < stepDelay) {
-      return;
+    if (panAxis.update(dtUs)) {
+      halServoWrite(servoX, SERVO_X_CHANNEL, panAxis.getAngle());
     }
 
-    lastUpdate = now;
-
-    // Update servo X
-    if (currentAngleX != targetAngleX) {
-
-      if (currentAngleX < targetAngleX) {
-        currentAngleX += step;
-        if (currentAngleX > targetAngleX) {
-          currentAngleX = targetAngleX;
-        }
-      } else {
-        currentAngleX -= step;
-        if (currentAngleX < targetAngleX) {
-          currentAngleX = targetAngleX;
-        }
-      }
-
-      servoX.write(currentAngleX);
+    if (tiltAxis.update(dtUs)) {
+      halServoWrite(servoY, SERVO_Y_CHANNEL, tiltAxis.getAngle());
     }
+  }
 
-    // Update servo Y
-    if (currentAngleY != targetAngleY) {
-      if (currentAngleY < targetAngleY) {
-        currentAngleY += step;
-        if (currentAngleY > targetAngleY) {
-          currentAngleY = targetAngleY;
-        }
-      } else {
-        currentAngleY -= step;
-        if (currentAngleY < targetAngleY) {
-          currentAngleY = targetAngleY;
-        }
-      }
-
-      servoY.write(currentAngleY);
+  void tickAutoStop(int64_t nowUs) {
+    if (!watchdog.check(nowUs)) {
+      return;
     }
-  }
 
-  void tickAutoStop() {
-    const uint64_t AUTOSTOP_TIMEOUT_MS = 500;
-    uint64_t now = nowMs();
+    motorL.coast();
+    motorR.coast();
 
-    int64_t diff = elapsedSince(lastCommandTime);
+    uint32_t silenceUs = nowUs - watchdog.getLastCommandUs();
+    DEBUG_PRINTF_LN("[AutoStop] No command for %u ms (deadline %d ms), ramping down", silenceUs / 1000,
+                    watchdog.getDeadlineUs() / 1000);
 
-    if (!motorStopped && (uint64_t)diff > AUTOSTOP_TIMEOUT_MS) {
-      stop();
-      DEBUG_PRINTLN("[AutoStop] No command for 500ms, stopping motors");
+    if (autoStopHandler) {
+      autoStopHandler(silenceUs, watchdog);
     }
   }
 
   esp_err_t initCamera() {
-    esp_err_t err = esp_camera_init(&camera_config);
+    esp_err_t err = halCameraInit(&camera_config);
 
     if (err != ESP_OK) {
       DEBUG_PRINTF_LN("Camera error: 0x%x", err);
       return err;
     }
 
-    sensor_t *s = esp_camera_sensor_get();
+    sensor_t *s = halCameraSensor();
     if (!s) {
       DEBUG_PRINTLN("NO SENSOR DETECTED");
       return ESP_FAIL;
@@ -294,6 +342,8 @@ private:
   void initMotors() {
     motorL.setMinPwm(200);
     motorR.setMinPwm(200);
+    motorL.setProfile(ProfileShape::S_CURVE, MOTION_DEFAULT_ACCEL, MOTION_DEFAULT_JERK);
+    motorR.setProfile(ProfileShape::S_CURVE, MOTION_DEFAULT_ACCEL, MOTION_DEFAULT_JERK);
 
     motorL.begin();
     motorR.begin();
@@ -0,0 +1,84 @@
+#ifndef CAR_PROTOCOL_H
+#define CAR_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary WebSocket command frame, little-endian, always CAR_FRAME_SIZE bytes:
+//
+//   0        1        2-3       4-5         6-7
+//   version  opcode   seq u16   operand a   operand b (both int16)
+//
+// Sent as HTTPD_WS_TYPE_BINARY next to the legacy text commands.
+#define CAR_PROTOCOL_VERSION 1
+#define CAR_FRAME_SIZE 8
+
+enum CarOpcode : uint8_t {
+  OP_PING = 0x01,
+  OP_TOGGLE_FLASH = 0x02,
+  OP_MOVE = 0x03,         // a = MoveDirection
+  OP_CAMERA = 0x04,       // a = x, b = y in [-100, 100]
+  OP_FRAME_SIZE = 0x05,   // a = framesize_t
+  OP_TARGET_FPS = 0x06,   // a = fps
+  OP_AUTO_QUALITY = 0x07, // a = 0 / 1
+  OP_DRIVE = 0x08,        // a = throttle, b = steer in [-127, 127]
+  OP_ACK = 0x09,          // a = 1 to get ACK / NACK replies for this socket's commands
+  OP_STATIC_SKIP = 0x0A,  // a = 0 / 1, slow the stream down while the scene is static
+  OP_SENTRY = 0x0B,       // a = 0 / 1, motion detection with MOTION-... events
+  OP_RECORD = 0x0C,       // a = 0 / 1, AVI recording to the SD card, driving is off meanwhile (-D SD_RECORDING)
+  OP_COUNT
+};
+
+enum MoveDirection : uint8_t {
+  MOVE_STOP = 0,
+  MOVE_FORWARD,
+  MOVE_BACKWARD,
+  MOVE_LEFT,
+  MOVE_RIGHT,
+  MOVE_FORWARD_LEFT,
+  MOVE_FORWARD_RIGHT,
+  MOVE_BACKWARD_LEFT,
+  MOVE_BACKWARD_RIGHT,
+  MOVE_COUNT
+};
+
+struct CarCommandFrame {
+  uint8_t version;
+  uint8_t opcode;
+  uint16_t seq;
+  int16_t a;
+  int16_t b;
+};
+
+inline int16_t readInt16LE(const uint8_t *p) {
+  return (int16_t)(p[0] | (p[1] << 8));
+}
+
+inline void writeInt16LE(uint8_t *p, int16_t value) {
+  p[0] = value & 0xFF;
+  p[1] = (value >> 8) & 0xFF;
+}
+
+inline bool decodeCommandFrame(const uint8_t *data, size_t len, CarCommandFrame &frame) {
+  if (!data || len != CAR_FRAME_SIZE || data[0] != CAR_PROTOCOL_VERSION || data[1] >= OP_COUNT) {
+    return false;
+  }
+
+  frame.version = data[0];
+  frame.opcode = data[1];
+  frame.seq = (uint16_t)readInt16LE(data + 2);
+  frame.a = readInt16LE(data + 4);
+  frame.b = readInt16LE(data + 6);
+
+  return true;
+}
+
+inline void encodeCommandFrame(const CarCommandFrame &frame, uint8_t *out) {
+  out[0] = frame.version;
+  out[1] = frame.opcode;
+  writeInt16LE(out + 2, (int16_t)frame.seq);
+  writeInt16LE(out + 4, frame.a);
+  writeInt16LE(out + 6, frame.b);
+}
+
+#endif
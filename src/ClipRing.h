@@ -0,0 +1,181 @@
+#ifndef CLIP_RING_H
+#define CLIP_RING_H
+
+#include "config.h"
+#include <Arduino.h>
+#include <atomic>
+
+#ifndef CLIP_RING_BYTES
+#define CLIP_RING_BYTES (1536 * 1024)
+#endif
+#define CLIP_RING_MIN_BYTES (256 * 1024) // give up below this much free PSRAM
+#ifndef CLIP_SECONDS
+#define CLIP_SECONDS 10
+#endif
+#ifndef CLIP_FPS
+#define CLIP_FPS 10
+#endif
+#define CLIP_INDEX_SIZE 512 // must be a power of two and above CLIP_SECONDS * CLIP_FPS
+
+struct ClipFrame {
+  uint32_t start;  // absolute byte position, only ever grows (mod 2^32)
+  uint32_t offset; // where the bytes are in the ring
+  uint32_t len;
+  uint16_t width;
+  uint16_t height;
+  int64_t capturedUs;
+};
+
+// The last CLIP_SECONDS of frames at up to CLIP_FPS, kept in one PSRAM block
+// with an index of offsets and capture times, so a clip can be exported
+// after the fact without having recorded anything.
+//
+// One writer (the capture task) and any number of readers, without locks:
+// the writer first moves the "oldest valid" marks past what it is about to
+// overwrite, then writes. A reader copies an index entry or frame, then
+// checks it is still at or after those marks; if not, the copy may be torn
+// and is dropped. Frames are never split across the end of the ring.
+class ClipRing {
+public:
+  ClipRing()
+      : buf(nullptr),
+        size(0),
+        head(0),
+        writeOffset(0),
+        full(false),
+        lastOfferUs(0),
+        oldestValid(0),
+        indexHead(0),
+        indexTail(0),
+        torn(0) {}
+
+  // Takes as much of bytes as PSRAM allows, halving down to CLIP_RING_MIN_BYTES
+  bool begin(size_t bytes) {
+    while (bytes >= CLIP_RING_MIN_BYTES && !(buf = (uint8_t *)ps_malloc(bytes))) {
+      bytes /= 2;
+    }
+
+    if (!buf) {
+      DEBUG_PRINTLN("Clip ring: no PSRAM");
+      return false;
+    }
+
+    size = bytes;
+    DEBUG_PRINTF_LN("Clip ring: %u KB for %d s at %d fps", size / 1024, CLIP_SECONDS, CLIP_FPS);
+    return true;
+  }
+
+  // Capture task only. Keeps at most CLIP_FPS frames per second.
+  void offer(const uint8_t *jpeg, size_t len, uint16_t width, uint16_t height, int64_t capturedUs) {
+    if (!buf || len == 0 || len > size / 4 || capturedUs - lastOfferUs < 900000 / CLIP_FPS) {
+      return;
+    }
+
+    lastOfferUs = capturedUs;
+
+    uint32_t offset = writeOffset;
+    if (offset + len > size) {
+      head += size - offset;
+      offset = 0;
+    }
+
+    uint32_t start = head;
+    full = full || writeOffset + len > size;
+    uint32_t tail = indexTail.load(std::memory_order_relaxed);
+    uint32_t next = indexHead.load(std::memory_order_relaxed);
+
+    // Bytes below start + len - size are about to be overwritten; frames
+    // older than the window and the slot about to be reused go as well
+    uint32_t overwritten = start + len - size;
+    int64_t expiredUs = capturedUs - CLIP_SECONDS * 1000000LL;
+
+    while (tail != next) {
+      const ClipFrame &oldest = index[tail & (CLIP_INDEX_SIZE - 1)];
+
+      if (next - tail < CLIP_INDEX_SIZE && oldest.capturedUs >= expiredUs &&
+          (!full || (int32_t)(oldest.start - overwritten) >= 0)) {
+        break;
+      }
+
+      tail++;
+    }
+
+    if (full) {
+      oldestValid.store(overwritten, std::memory_order_relaxed);
+    }
+    indexTail.store(tail, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy(buf + offset, jpeg, len);
+    index[next & (CLIP_INDEX_SIZE - 1)] = {start, offset, (uint32_t)len, width, height, capturedUs};
+    indexHead.store(next + 1, std::memory_order_release);
+
+    head = start + len;
+    writeOffset = offset + len;
+  }
+
+  // Frame numbers in [firstFrame(), endFrame()) may be read
+  uint32_t firstFrame() const {
+    return indexTail.load(std::memory_order_acquire);
+  }
+
+  uint32_t endFrame() const {
+    return indexHead.load(std::memory_order_acquire);
+  }
+
+  // False when the entry was dropped meanwhile
+  bool readEntry(uint32_t number, ClipFrame &out) const {
+    out = index[number & (CLIP_INDEX_SIZE - 1)];
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return (int32_t)(number - indexTail.load(std::memory_order_relaxed)) >= 0;
+  }
+
+  // Copies the JPEG to out (frame.len bytes); false when the writer got to
+  // it during the copy
+  bool copyFrame(const ClipFrame &frame, uint8_t *out) {
+    memcpy(out, buf + frame.offset, frame.len);
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if ((int32_t)(frame.start - oldestValid.load(std::memory_order_relaxed)) < 0) {
+      torn.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    return true;
+  }
+
+  size_t getCapacity() const {
+    return size;
+  }
+
+  uint32_t getFrameCount() const {
+    return endFrame() - firstFrame();
+  }
+
+  // Frames that were overwritten while a reader copied them
+  uint32_t getTornReads() const {
+    return torn.load(std::memory_order_relaxed);
+  }
+
+private:
+  uint8_t *buf;
+  size_t size;
+  uint32_t head;
+  uint32_t writeOffset;
+  bool full; // every write overwrites older bytes from here on
+  int64_t lastOfferUs;
+  std::atomic<uint32_t> oldestValid;
+  std::atomic<uint32_t> indexHead;
+  std::atomic<uint32_t> indexTail;
+  std::atomic<uint32_t> torn;
+  ClipFrame index[CLIP_INDEX_SIZE];
+};
+
+ClipRing clipRing;
+
+bool startClipRing() {
+  return clipRing.begin(CLIP_RING_BYTES);
+}
+
+#endif
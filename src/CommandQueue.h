@@ -0,0 +1,96 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded lock-free queue for many producers and a single consumer (Dmitry
+// Vyukov's array queue). Every cell carries a sequence number: a producer
+// claims a position with one CAS and publishes the cell by bumping its
+// sequence, so neither side ever blocks or allocates.
+template <typename T, size_t N>
+class MpscQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscQueue size must be a power of two");
+
+public:
+  MpscQueue()
+      : enqueuePos(0),
+        dequeuePos(0) {
+    for (size_t i = 0; i < N; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Safe from any task. Returns false when the queue is full.
+  bool push(const T &value) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+    for (;;) {
+      Cell &cell = cells[pos & (N - 1)];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = value;
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Consumer only. Returns false when nothing is published yet.
+  bool pop(T &out) {
+    Cell &cell = cells[dequeuePos & (N - 1)];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+    if ((intptr_t)sequence - (intptr_t)(dequeuePos + 1) < 0) {
+      return false;
+    }
+
+    out = cell.value;
+    cell.sequence.store(dequeuePos + N, std::memory_order_release);
+    dequeuePos++;
+
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  Cell cells[N];
+  std::atomic<size_t> enqueuePos;
+  size_t dequeuePos;
+};
+
+enum class CarCommandType : uint8_t {
+  MOVE = 0, // a = MoveDirection
+  CAMERA,   // a = x, b = y in [-100, 100]
+  SESSION,  // a driver connected
+  DRIVE,    // a = throttle, b = steer in [-127, 127]
+#ifdef SD_RECORDING
+  SD_PINS, // a = 1 hands the SD pins to the card, 0 takes them back
+#endif
+  TYPE_COUNT
+};
+
+// What network handlers hand to the control loop instead of touching Car
+struct CarCommand {
+  CarCommandType type;
+  int16_t a;
+  int16_t b;
+  int16_t replyFd; // socket that asked for an ACK, -1 for none
+  uint16_t seq;    // echoed back in the ACK
+  int64_t enqueuedUs;
+};
+
+#endif
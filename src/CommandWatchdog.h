@@ -0,0 +1,132 @@
+#ifndef COMMAND_WATCHDOG_H
+#define COMMAND_WATCHDOG_H
+
+#include <stdint.h>
+
+#define WATCHDOG_MIN_MS 150
+#define WATCHDOG_MAX_MS 800
+// Expected cadence before anything was measured: script.js repeats held input
+// every 300 ms, which frames round up to about 317 ms
+#define WATCHDOG_INITIAL_INTERVAL_MS 300
+
+// Dead-man timer that learns how often the driver sends commands. It keeps a
+// smoothed inter-arrival time and its mean deviation the same way TCP tracks
+// round trips (gains 1/8 and 1/4) and stops the car once the silence exceeds
+// mean + 4 * deviation, but at least a quarter over the mean, clamped to
+// [WATCHDOG_MIN_MS, WATCHDOG_MAX_MS]. Only repeated input teaches the cadence:
+// a client resends unchanged input as a keepalive, and those are the longest
+// gaps it leaves on purpose, while a moving stick sends every frame and would
+// talk the deadline down below the next keepalive. A trip means the deadline
+// was too short for this driver, so the gap that ended it is learned too.
+class CommandWatchdog {
+public:
+  CommandWatchdog()
+      : tripped(false),
+        trips(0) {
+    reset();
+  }
+
+  // Forget the learned cadence, e.g. when a new control session starts
+  void reset() {
+    meanUs8 = WATCHDOG_INITIAL_INTERVAL_MS * 1000L * 8;
+    deviationUs4 = WATCHDOG_INITIAL_INTERVAL_MS * 1000L / 2 * 4;
+    lastCommandUs = 0;
+    active = false;
+    tripped = false;
+  }
+
+  // A movement command arrived at nowUs; repeat when it carries the same
+  // input as the one before
+  void onCommand(int64_t nowUs, bool repeat = true) {
+    int64_t gap = nowUs - lastCommandUs;
+
+    if (active && repeat) {
+      // A gap longer than the upper bound already tripped or is a restart,
+      // it says nothing about the cadence
+      if (gap >= 0 && gap <= WATCHDOG_MAX_MS * 1000L) {
+        addSample((int32_t)gap);
+      }
+    } else if (tripped && gap >= 0) {
+      // The driver was still there, only slower than the deadline
+      addSample(gap < WATCHDOG_MAX_MS * 1000L ? (int32_t)gap : WATCHDOG_MAX_MS * 1000L);
+    }
+
+    lastCommandUs = nowUs;
+    active = true;
+    tripped = false;
+  }
+
+  // The driver stopped on purpose, the next command starts a new burst
+  void onStop() {
+    active = false;
+    tripped = false;
+  }
+
+  // Returns true once when the silence since the last command exceeds the deadline
+  bool check(int64_t nowUs) {
+    if (!active || nowUs - lastCommandUs <= getDeadlineUs()) {
+      return false;
+    }
+
+    active = false;
+    tripped = true;
+    trips++;
+
+    return true;
+  }
+
+  int32_t getMeanUs() const {
+    return meanUs8 >> 3;
+  }
+
+  int32_t getDeviationUs() const {
+    return deviationUs4 >> 2;
+  }
+
+  int32_t getDeadlineUs() const {
+    int32_t deadline = getMeanUs() + 4 * getDeviationUs();
+
+    // A steady keepalive has little deviation, arrival jitter still needs room
+    if (deadline < getMeanUs() + getMeanUs() / 4) {
+      deadline = getMeanUs() + getMeanUs() / 4;
+    }
+
+    if (deadline < WATCHDOG_MIN_MS * 1000L) {
+      return WATCHDOG_MIN_MS * 1000L;
+    }
+
+    if (deadline > WATCHDOG_MAX_MS * 1000L) {
+      return WATCHDOG_MAX_MS * 1000L;
+    }
+
+    return deadline;
+  }
+
+  int64_t getLastCommandUs() const {
+    return lastCommandUs;
+  }
+
+  uint32_t getTrips() const {
+    return trips;
+  }
+
+private:
+  int32_t meanUs8;      // mean inter-arrival, scaled by 8
+  int32_t deviationUs4; // mean deviation, scaled by 4
+  int64_t lastCommandUs;
+  bool active;
+  bool tripped; // silent since the last trip
+  uint32_t trips;
+
+  void addSample(int32_t gapUs) {
+    int32_t error = gapUs - (meanUs8 >> 3);
+
+    meanUs8 += error;
+    if (error < 0) {
+      error = -error;
+    }
+    deviationUs4 += error - (deviationUs4 >> 2);
+  }
+};
+
+#endif
@@ -0,0 +1,388 @@
+#ifndef CONTROL_LOOP_H
+#define CONTROL_LOOP_H
+
+#include "Car.h"
+#include "CarProtocol.h"
+#include "CommandQueue.h"
+#include "FrameTrace.h"
+#include "Hal.h"
+#include "esp_timer.h"
+#include <Arduino.h>
+#include <atomic>
+
+#ifndef CONTROL_RATE_HZ
+#define CONTROL_RATE_HZ 200
+#endif
+
+#define CONTROL_PERIOD_US (1000000UL / CONTROL_RATE_HZ)
+// Same core as the camera copy loop but above it, a tick is a few us of work
+#define CONTROL_TASK_CORE 1
+#define CONTROL_TASK_PRIORITY 6
+// Commands arrive at most every few ms, a tick drains them all
+#define CONTROL_QUEUE_SIZE 16
+// Commands waiting for their first output write before they are ACKed
+#define CONTROL_PENDING_ACKS 8
+#define CONTROL_ACK_TIMEOUT_US 1000000
+
+extern Car car;
+
+typedef void (Car::*CarAction)();
+
+// Indexed by MoveDirection
+static const CarAction moveActions[MOVE_COUNT] = {
+    &Car::stop,
+    &Car::moveForward,
+    &Car::moveBackward,
+    &Car::turnLeft,
+    &Car::turnRight,
+    &Car::moveForwardLeft,
+    &Car::moveForwardRight,
+    &Car::moveBackwardLeft,
+    &Car::moveBackwardRight};
+
+// Sent for commands submitted with a reply socket, once their effect reached
+// the motors or servos
+struct CommandAck {
+  int fd;
+  uint16_t seq;
+  CarCommandType type;
+  uint32_t queueUs;  // enqueued -> applied by the control task
+  int32_t actuateUs; // enqueued -> first PWM / servo write, -1 if nothing had to move
+};
+
+typedef void (*CommandAckHandler)(const CommandAck &ack);
+
+// Runs Car::tick from a periodic esp_timer instead of a spinning loop(). The
+// timer callback only wakes the task, so the tick itself never runs in the
+// esp_timer task and a late wakeup shows up as jitter instead of drift.
+class ControlLoop {
+public:
+  ControlLoop()
+      : task(nullptr),
+        timer(nullptr),
+        ticks(0),
+        overruns(0),
+        droppedCommands(0),
+#ifdef SD_RECORDING
+        handoverWaiter(nullptr),
+        handovers(0),
+        handoverRequests(0),
+#endif
+        ackHandler(nullptr) {
+    for (int i = 0; i < CONTROL_PENDING_ACKS; i++) {
+      pendingAcks[i].active = false;
+    }
+
+    lastMovement = {CarCommandType::SESSION, 0, 0, -1, 0, 0};
+  }
+
+  bool start() {
+    if (xTaskCreatePinnedToCore(taskEntry, "ControlTask", 4096, this, CONTROL_TASK_PRIORITY, &task, CONTROL_TASK_CORE) != pdPASS) {
+      DEBUG_PRINTLN("Failed to start control task");
+      return false;
+    }
+
+    esp_timer_create_args_t args = {};
+    args.callback = onTimer;
+    args.arg = task;
+    args.name = "control";
+
+    if (esp_timer_create(&args, &timer) != ESP_OK || esp_timer_start_periodic(timer, CONTROL_PERIOD_US) != ESP_OK) {
+      DEBUG_PRINTLN("Failed to start control timer");
+      return false;
+    }
+
+    DEBUG_PRINTF_LN("Control loop running at %d Hz", CONTROL_RATE_HZ);
+    return true;
+  }
+
+  // Queues a command for the next tick. Safe from any task; only the control
+  // task ever touches Car motion and camera state. With a replyFd the ack
+  // handler reports when the command reached the outputs.
+  bool submit(CarCommandType type, int16_t a = 0, int16_t b = 0, int replyFd = -1, uint16_t seq = 0) {
+    CarCommand command = {type, a, b, (int16_t)replyFd, seq, esp_timer_get_time()};
+
+    if (!commands.push(command)) {
+      droppedCommands.fetch_add(1, std::memory_order_relaxed);
+      DEBUG_PRINTF_LN("Control queue full, dropped command %d", (int)type);
+      return false;
+    }
+
+    return true;
+  }
+
+#ifdef SD_RECORDING
+  // Has the control task hand the SD pins to the card (release) or take them
+  // back, and blocks until it did. False when that took over timeoutMs. One
+  // caller at a time, the SD recorder.
+  bool handOverSdPins(bool release, uint32_t timeoutMs) {
+    handoverWaiter = xTaskGetCurrentTaskHandle();
+
+    if (!submit(CarCommandType::SD_PINS, release)) {
+      return false;
+    }
+
+    // Handovers are applied in order, so this one is done when the count
+    // reaches its number; a timed out earlier one landing late is not enough
+    uint32_t target = ++handoverRequests;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(timeoutMs);
+
+    // Other notifications wake the caller too, only the count says it is done
+    while ((int32_t)(handovers - target) < 0) {
+      TickType_t waited = xTaskGetTickCount() - start;
+
+      if (waited >= timeout) {
+        DEBUG_PRINTLN("SD pin handover timed out");
+        return false;
+      }
+
+      ulTaskNotifyTake(pdTRUE, timeout - waited);
+    }
+
+    return true;
+  }
+#endif
+
+  // Called from the control task
+  void setAckHandler(CommandAckHandler handler) {
+    ackHandler = handler;
+  }
+
+  // Deviation of each wakeup from the nominal period
+  const LatencyHistogram &getJitter() const {
+    return jitter;
+  }
+
+  // Time spent applying queued commands and running Car::tick
+  const LatencyHistogram &getTickTime() const {
+    return tickTime;
+  }
+
+  // Time commands spent in the queue before a tick applied them
+  const LatencyHistogram &getQueueDelay() const {
+    return queueDelay;
+  }
+
+  uint32_t getDroppedCommands() const {
+    return droppedCommands.load(std::memory_order_relaxed);
+  }
+
+  uint32_t getTicks() const {
+    return ticks.load(std::memory_order_relaxed);
+  }
+
+  // Periods that elapsed without a tick of their own
+  uint32_t getOverruns() const {
+    return overruns.load(std::memory_order_relaxed);
+  }
+
+  void resetStats() {
+    jitter.reset();
+    tickTime.reset();
+    queueDelay.reset();
+    overruns.store(0, std::memory_order_relaxed);
+  }
+
+  // One step over the given timer periods: drain the queue, tick the car,
+  // complete acks. The control task's; a host benchmark that never called
+  // start() may step it itself.
+  void tick(uint32_t periods, int64_t wake) {
+    drainCommands(wake);
+
+    // Integrate the nominal time so ramps don't depend on wakeup jitter
+    car.tick(CONTROL_PERIOD_US * periods, wake);
+
+    if (ackHandler) {
+      completeAcks();
+    }
+
+    tickTime.record(esp_timer_get_time() - wake);
+    ticks.fetch_add(1, std::memory_order_relaxed);
+  }
+
+private:
+  TaskHandle_t task;
+  esp_timer_handle_t timer;
+  LatencyHistogram jitter;
+  LatencyHistogram tickTime;
+  LatencyHistogram queueDelay;
+  std::atomic<uint32_t> ticks;
+  std::atomic<uint32_t> overruns;
+  std::atomic<uint32_t> droppedCommands;
+#ifdef SD_RECORDING
+  std::atomic<TaskHandle_t> handoverWaiter;
+  std::atomic<uint32_t> handovers;
+  uint32_t handoverRequests; // the handOverSdPins caller's
+#endif
+  MpscQueue<CarCommand, CONTROL_QUEUE_SIZE> commands;
+  CommandAckHandler ackHandler;
+
+  struct PendingAck {
+    CommandAck ack;
+    int64_t enqueuedUs;
+    HalOutput output;
+    uint32_t writesBefore;
+    bool active;
+  };
+
+  // Control task only
+  PendingAck pendingAcks[CONTROL_PENDING_ACKS];
+  CarCommand lastMovement;
+
+  static void onTimer(void *arg) {
+    xTaskNotifyGive((TaskHandle_t)arg);
+  }
+
+  static void taskEntry(void *arg) {
+    ((ControlLoop *)arg)->run();
+  }
+
+  // Same movement as the last one, a client keepalive
+  bool isRepeat(const CarCommand &command) {
+    bool repeat = command.type == lastMovement.type && command.a == lastMovement.a && command.b == lastMovement.b;
+    lastMovement = command;
+    return repeat;
+  }
+
+  void apply(const CarCommand &command) {
+#ifdef SD_RECORDING
+    // The card has the motor pins: a drive would arm the watchdog and leave
+    // targets the motors run off to once the pins come back
+    if (car.hasReleasedSdPins() && (command.type == CarCommandType::MOVE || command.type == CarCommandType::DRIVE)) {
+      return;
+    }
+#endif
+
+    switch (command.type) {
+    case CarCommandType::MOVE:
+      if (command.a <= MOVE_STOP || command.a >= MOVE_COUNT) {
+        car.stop();
+        break;
+      }
+
+      car.onCommand(command.enqueuedUs, isRepeat(command));
+      (car.*moveActions[command.a])();
+      break;
+    case CarCommandType::CAMERA:
+      car.setCameraPosition(command.a, command.b);
+      break;
+    case CarCommandType::DRIVE:
+      if (command.a != 0 || command.b != 0) {
+        car.onCommand(command.enqueuedUs, isRepeat(command));
+      }
+
+      car.drive(command.a, command.b);
+      break;
+    case CarCommandType::SESSION:
+      car.resetWatchdog();
+      break;
+#ifdef SD_RECORDING
+    case CarCommandType::SD_PINS:
+      if (command.a) {
+        car.releaseSdPins();
+      } else {
+        car.reclaimSdPins();
+      }
+
+      handovers++;
+      xTaskNotifyGive(handoverWaiter);
+      break;
+#endif
+    default:
+      break;
+    }
+  }
+
+  void drainCommands(int64_t now) {
+    CarCommand command;
+
+    while (commands.pop(command)) {
+      uint32_t queuedUs = now > command.enqueuedUs ? now - command.enqueuedUs : 0;
+      queueDelay.record(queuedUs);
+
+      if (command.replyFd < 0 || !ackHandler) {
+        apply(command);
+        continue;
+      }
+
+      HalOutput output = command.type == CarCommandType::CAMERA ? HalOutput::SERVO : HalOutput::PWM;
+      uint32_t writesBefore = halWriteCount(output);
+      apply(command);
+      trackAck(command, queuedUs, output, writesBefore);
+    }
+  }
+
+  // A stop writes right away; everything else is picked up after the tick
+  void trackAck(const CarCommand &command, uint32_t queuedUs, HalOutput output, uint32_t writesBefore) {
+    CommandAck ack = {command.replyFd, command.seq, command.type, queuedUs, -1};
+
+    if (halWriteCount(output) != writesBefore) {
+      ack.actuateUs = esp_timer_get_time() - command.enqueuedUs;
+      ackHandler(ack);
+      return;
+    }
+
+    for (int i = 0; i < CONTROL_PENDING_ACKS; i++) {
+      if (!pendingAcks[i].active) {
+        pendingAcks[i] = {ack, command.enqueuedUs, output, writesBefore, true};
+        return;
+      }
+    }
+
+    // No room to wait for the outputs, report it as not actuated
+    ackHandler(ack);
+  }
+
+  void completeAcks() {
+    int64_t now = esp_timer_get_time();
+
+    for (int i = 0; i < CONTROL_PENDING_ACKS; i++) {
+      PendingAck &pending = pendingAcks[i];
+
+      if (!pending.active) {
+        continue;
+      }
+
+      bool settled = pending.output == HalOutput::SERVO ? car.isCameraSettled() : car.isDriveSettled();
+
+      if (halWriteCount(pending.output) != pending.writesBefore) {
+        pending.ack.actuateUs = now - pending.enqueuedUs;
+      } else if (!settled && now - pending.enqueuedUs < CONTROL_ACK_TIMEOUT_US) {
+        continue;
+      }
+
+      pending.active = false;
+      ackHandler(pending.ack);
+    }
+  }
+
+  void run() {
+    int64_t lastWake = esp_timer_get_time();
+
+    for (;;) {
+      // The notification count tells how many periods passed since the last tick
+      uint32_t periods = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      int64_t wake = esp_timer_get_time();
+
+      if (periods > 1) {
+        overruns.fetch_add(periods - 1, std::memory_order_relaxed);
+      }
+
+      int64_t deviation = (wake - lastWake) - (int64_t)CONTROL_PERIOD_US * periods;
+      jitter.record(deviation < 0 ? -deviation : deviation);
+      lastWake = wake;
+
+      tick(periods, wake);
+    }
+  }
+
+};
+
+ControlLoop controlLoop;
+
+bool startControlLoop() {
+  return controlLoop.start();
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef DRIVE_MIXER_H
+#define DRIVE_MIXER_H
+
+#include "MotionProfile.h"
+#include <stdint.h>
+
+#define DRIVE_INPUT_MAX 127
+// Share of the cubic term in the response curve, in percent. 0 is linear;
+// more gives finer control around the centre of the stick.
+#define DRIVE_EXPO_PERCENT 30
+
+// Differential-drive mixing for an analog throttle / steer pair. Both tables
+// are filled once at startup, so mixing on the control task is two adds, two
+// multiplies and two lookups per command:
+//   left = throttle + steer, right = throttle - steer,
+//   scaled back into range by the reciprocal table when either side overflows,
+//   then shaped by the response curve into motor effort.
+class DriveMixer {
+public:
+  DriveMixer() {
+    for (int i = 0; i <= DRIVE_INPUT_MAX; i++) {
+      // Q16 reciprocal: DRIVE_INPUT_MAX / (DRIVE_INPUT_MAX + i)
+      scale[i] = ((uint32_t)DRIVE_INPUT_MAX << 16) / (DRIVE_INPUT_MAX + i);
+
+      // effort = max * ((100 - expo) * x + expo * x^3) / 100, x = i / DRIVE_INPUT_MAX
+      int64_t x = i;
+      int64_t cubic = x * x * x / ((int64_t)DRIVE_INPUT_MAX * DRIVE_INPUT_MAX);
+      curve[i] = (MOTION_MAX_EFFORT * ((100 - DRIVE_EXPO_PERCENT) * x + DRIVE_EXPO_PERCENT * cubic) +
+                  50 * DRIVE_INPUT_MAX) /
+                 (100 * DRIVE_INPUT_MAX);
+    }
+  }
+
+  // throttle > 0 drives forward, steer > 0 turns right
+  void mix(int8_t throttle, int8_t steer, int16_t &left, int16_t &right) const {
+    int16_t t = clampInput(throttle);
+    int16_t s = clampInput(steer);
+    int16_t l = t + s;
+    int16_t r = t - s;
+
+    int16_t peak = abs16(l) > abs16(r) ? abs16(l) : abs16(r);
+    if (peak > DRIVE_INPUT_MAX) {
+      uint32_t factor = scale[peak - DRIVE_INPUT_MAX];
+      l = scaleDown(l, factor);
+      r = scaleDown(r, factor);
+    }
+
+    left = shape(l);
+    right = shape(r);
+  }
+
+private:
+  uint32_t scale[DRIVE_INPUT_MAX + 1];
+  uint8_t curve[DRIVE_INPUT_MAX + 1];
+
+  static int16_t clampInput(int8_t value) {
+    return value < -DRIVE_INPUT_MAX ? -DRIVE_INPUT_MAX : value;
+  }
+
+  static int16_t abs16(int16_t value) {
+    return value < 0 ? -value : value;
+  }
+
+  // Rounded to nearest, symmetric around zero
+  static int16_t scaleDown(int16_t value, uint32_t factor) {
+    int16_t magnitude = ((uint32_t)abs16(value) * factor + 0x8000) >> 16;
+    return value < 0 ? -magnitude : magnitude;
+  }
+
+  int16_t shape(int16_t value) const {
+    if (value > DRIVE_INPUT_MAX) {
+      value = DRIVE_INPUT_MAX;
+    } else if (value < -DRIVE_INPUT_MAX) {
+      value = -DRIVE_INPUT_MAX;
+    }
+
+    return value >= 0 ? curve[value] : -curve[-value];
+  }
+};
+
+#endif
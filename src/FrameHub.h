@@ -0,0 +1,471 @@
+#ifndef FRAME_HUB_H
+#define FRAME_HUB_H
+
+#include "FramePacer.h"
+#include "FrameTrace.h"
+#include "ClipRing.h"
+#include "Hal.h"
+#include "JpegEncoder.h"
+#include "SceneDetector.h"
+#include "esp_camera.h"
+#include "utils.h"
+#include <Arduino.h>
+#include <atomic>
+
+#define FRAME_HUB_MAX_VIEWERS 4
+// Sentry and the SD recorder have slots of their own, so they never take one
+// from a browser
+#define FRAME_HUB_INTERNAL_VIEWERS 2
+#define FRAME_HUB_CONSUMERS (FRAME_HUB_MAX_VIEWERS + FRAME_HUB_INTERNAL_VIEWERS)
+// Every consumer may hold one frame while the hub keeps the latest one and the
+// producer fills another, so a stalled consumer never blocks the others.
+#define FRAME_HUB_SLOTS (FRAME_HUB_CONSUMERS + 2)
+
+// WiFi and lwip live on core 0, keep the camera copy loop off it
+#define CAPTURE_TASK_CORE 1
+#define CAPTURE_TASK_PRIORITY 5
+
+struct SharedFrame {
+  uint8_t *buf;
+  size_t len;
+  size_t capacity;
+  uint32_t seq;
+  uint16_t width;
+  uint16_t height;
+  struct timeval timestamp;
+  bool suppressed; // static scene between keep-alives, stream viewers skip it
+  std::atomic<int> refs;
+};
+
+// Lock-free latest-frame exchange. A slot is free when refs == 0; the writer,
+// the hub (for the latest frame) and every reader each hold one reference.
+class FrameHub {
+public:
+  FrameHub()
+      : producer(nullptr),
+        latest(nullptr),
+        seq(0),
+        notifying(0),
+        droppedFrames(0),
+        framePixels(0),
+        highWaterBytes(0),
+        poolBytes(0),
+        slotGrowths(0) {
+    for (int i = 0; i < FRAME_HUB_SLOTS; i++) {
+      slots[i].buf = nullptr;
+      slots[i].len = 0;
+      slots[i].capacity = 0;
+      slots[i].seq = 0;
+      slots[i].suppressed = false;
+      slots[i].refs = 0;
+    }
+
+    for (int i = 0; i < FRAME_HUB_CONSUMERS; i++) {
+      viewers[i] = nullptr;
+      viewerIntervalUs[i] = 0;
+    }
+  }
+
+  void setProducer(TaskHandle_t task) {
+    producer = task;
+  }
+
+  // Producer side
+
+  // Slot buffers are sized for the largest frame seen at the current
+  // resolution, a resolution change starts that over
+  void setFrameSize(uint16_t width, uint16_t height) {
+    uint32_t pixels = (uint32_t)width * height;
+
+    if (pixels != framePixels) {
+      framePixels = pixels;
+      highWaterBytes = 0;
+    }
+  }
+
+  SharedFrame *beginWrite(size_t len) {
+    SharedFrame *frame = claimSlot();
+
+    if (!frame) {
+      return nullptr;
+    }
+
+    noteLength(len);
+
+    if (!fit(frame, len)) {
+      DEBUG_PRINTF_LN("FrameHub: failed to grow slot to %u bytes", len);
+      abortWrite(frame);
+      return nullptr;
+    }
+
+    frame->len = len;
+    return frame;
+  }
+
+  // JPEG-encodes a raw (RGB565, YUV, grayscale) frame straight into a slot,
+  // so non-JPEG sensor modes stream without a per-frame allocation or copy
+  SharedFrame *beginEncode(camera_fb_t *fb, uint8_t quality) {
+    SharedFrame *frame = claimSlot();
+
+    if (!frame) {
+      return nullptr;
+    }
+
+    size_t expected = highWaterBytes ? highWaterBytes.load() : framePixels / JPEG_PIXELS_PER_BYTE;
+    size_t before = frame->capacity;
+    size_t len = fit(frame, expected) ? frameToJpeg(fb, quality, frame->buf, frame->capacity) : 0;
+
+    // The encoder grows the slot itself when the guess was short
+    accountGrowth(frame, before);
+
+    if (!len) {
+      abortWrite(frame);
+      return nullptr;
+    }
+
+    noteLength(len);
+    frame->len = len;
+    return frame;
+  }
+
+  void abortWrite(SharedFrame *frame) {
+    droppedFrames++;
+    release(frame);
+  }
+
+  void commit(SharedFrame *frame) {
+    frame->seq = ++seq;
+
+    // The writer reference becomes the hub reference
+    SharedFrame *previous = latest.exchange(frame);
+
+    if (previous) {
+      release(previous);
+    }
+
+    notifying++;
+    for (int i = 0; i < FRAME_HUB_CONSUMERS; i++) {
+      TaskHandle_t viewer = viewers[i];
+
+      if (viewer) {
+        xTaskNotifyGive(viewer);
+      }
+    }
+    notifying--;
+  }
+
+  // Blocks the producer while nobody is watching
+  void waitForViewers() {
+    while (viewerCount() == 0) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+  }
+
+  // Consumer side
+
+  // Takes one of the FRAME_HUB_MAX_VIEWERS stream viewer slots
+  bool subscribe(TaskHandle_t task) {
+    return claimViewer(task, 0, FRAME_HUB_MAX_VIEWERS);
+  }
+
+  // For consumers on the car itself, kept apart from the stream viewers
+  bool subscribeInternal(TaskHandle_t task) {
+    return claimViewer(task, FRAME_HUB_MAX_VIEWERS, FRAME_HUB_CONSUMERS);
+  }
+
+  bool hasInternalConsumers() {
+    for (int i = FRAME_HUB_MAX_VIEWERS; i < FRAME_HUB_CONSUMERS; i++) {
+      if (viewers[i]) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void unsubscribe(TaskHandle_t task) {
+    for (int i = 0; i < FRAME_HUB_CONSUMERS; i++) {
+      TaskHandle_t expected = task;
+      viewers[i].compare_exchange_strong(expected, nullptr);
+    }
+
+    // The task may be deleted right after this, wait out any notify in flight
+    while (notifying > 0) {
+      delay(1);
+    }
+  }
+
+  // Returns a newer frame than lastSeq or nullptr on timeout. The caller owns
+  // a reference until release().
+  SharedFrame *acquire(uint32_t lastSeq, TickType_t wait) {
+    SharedFrame *frame = tryAcquire(lastSeq);
+
+    if (frame || wait == 0) {
+      return frame;
+    }
+
+    ulTaskNotifyTake(pdTRUE, wait);
+    return tryAcquire(lastSeq);
+  }
+
+  // Lets the producer skip capturing frames nobody will send
+  void setViewerInterval(TaskHandle_t task, uint32_t intervalUs) {
+    for (int i = 0; i < FRAME_HUB_CONSUMERS; i++) {
+      if (viewers[i] == task) {
+        viewerIntervalUs[i] = intervalUs;
+      }
+    }
+  }
+
+  uint32_t captureIntervalUs() {
+    uint32_t interval = UINT32_MAX;
+
+    for (int i = 0; i < FRAME_HUB_CONSUMERS; i++) {
+      if (viewers[i] && viewerIntervalUs[i] < interval) {
+        interval = viewerIntervalUs[i];
+      }
+    }
+
+    return interval == UINT32_MAX ? 0 : interval;
+  }
+
+  void release(SharedFrame *frame) {
+    frame->refs--;
+  }
+
+  int viewerCount() {
+    int count = 0;
+
+    for (int i = 0; i < FRAME_HUB_CONSUMERS; i++) {
+      if (viewers[i]) {
+        count++;
+      }
+    }
+
+    return count;
+  }
+
+  uint32_t getDroppedFrames() {
+    return droppedFrames;
+  }
+
+  // Largest frame at the current resolution
+  size_t getHighWaterBytes() {
+    return highWaterBytes;
+  }
+
+  // PSRAM held by all slot buffers together
+  size_t getPoolBytes() {
+    return poolBytes;
+  }
+
+  uint32_t getSlotGrowths() {
+    return slotGrowths;
+  }
+
+  // CPU time the capture task spends on each frame after the sensor hands it
+  // over: the copy into a slot, or the JPEG conversion plus copy
+  LatencyHistogram &getCaptureTime() {
+    return captureTime;
+  }
+
+private:
+  TaskHandle_t producer;
+  SharedFrame slots[FRAME_HUB_SLOTS];
+  std::atomic<SharedFrame *> latest;
+  std::atomic<TaskHandle_t> viewers[FRAME_HUB_CONSUMERS];
+  std::atomic<uint32_t> viewerIntervalUs[FRAME_HUB_CONSUMERS];
+  uint32_t seq;
+  std::atomic<int> notifying;
+  std::atomic<uint32_t> droppedFrames;
+  uint32_t framePixels;
+  std::atomic<size_t> highWaterBytes;
+  std::atomic<size_t> poolBytes;
+  std::atomic<uint32_t> slotGrowths;
+  LatencyHistogram captureTime;
+
+  bool claimViewer(TaskHandle_t task, int first, int end) {
+    for (int i = first; i < end; i++) {
+      TaskHandle_t expected = nullptr;
+
+      if (viewers[i].compare_exchange_strong(expected, task)) {
+        viewerIntervalUs[i] = 1000000UL / STREAM_MAX_FPS;
+
+        if (producer) {
+          xTaskNotifyGive(producer);
+        }
+
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  SharedFrame *claimSlot() {
+    for (int i = 0; i < FRAME_HUB_SLOTS; i++) {
+      int expected = 0;
+
+      if (slots[i].refs.compare_exchange_strong(expected, 1)) {
+        return &slots[i];
+      }
+    }
+
+    droppedFrames++;
+    return nullptr;
+  }
+
+  void noteLength(size_t len) {
+    if (len > highWaterBytes) {
+      highWaterBytes = len;
+    }
+  }
+
+  // Makes room for len bytes. A slot left more than twice as large as needed
+  // by an earlier, bigger resolution gives its buffer back first.
+  bool fit(SharedFrame *frame, size_t len) {
+    size_t before = frame->capacity;
+    size_t needed = len > highWaterBytes ? len : highWaterBytes.load();
+
+    if (frame->capacity > 2 * jpegCapacityFor(needed)) {
+      free(frame->buf);
+      frame->buf = nullptr;
+      frame->capacity = 0;
+    }
+
+    bool ok = jpegReserve(frame->buf, frame->capacity, len);
+    accountGrowth(frame, before);
+    return ok;
+  }
+
+  void accountGrowth(SharedFrame *frame, size_t before) {
+    if (frame->capacity != before) {
+      poolBytes += frame->capacity - before;
+    }
+
+    if (frame->capacity > before) {
+      slotGrowths++;
+    }
+  }
+
+  SharedFrame *tryAcquire(uint32_t lastSeq) {
+    for (;;) {
+      SharedFrame *frame = latest;
+
+      if (!frame) {
+        return nullptr;
+      }
+
+      frame->refs++;
+
+      // The slot may have been recycled between the load and the increment,
+      // only keep the reference if it is still the published frame
+      if (frame == latest) {
+        if (frame->seq == lastSeq) {
+          release(frame);
+          return nullptr;
+        }
+
+        return frame;
+      }
+
+      release(frame);
+    }
+  }
+};
+
+FrameHub frameHub;
+
+void captureTask(void *param) {
+  int64_t lastCapture = 0;
+
+  for (;;) {
+    frameHub.waitForViewers();
+
+    // Capture only as fast as the fastest viewer is draining frames
+    int64_t wait = lastCapture + frameHub.captureIntervalUs() - esp_timer_get_time();
+    if (wait > 1000) {
+      delay(wait / 1000);
+    }
+
+    lastCapture = esp_timer_get_time();
+
+    camera_fb_t *fb = halCameraGrab();
+    if (!fb) {
+      delay(100);
+      continue;
+    }
+
+    int64_t grabbedUs = esp_timer_get_time();
+    int64_t capturedUs = (int64_t)fb->timestamp.tv_sec * 1000000LL + fb->timestamp.tv_usec;
+    frameHub.setFrameSize(fb->width, fb->height);
+
+    if (fb->format == PIXFORMAT_JPEG) {
+      // The clip ring keeps frames the scene detector would hold back
+      clipRing.offer(fb->buf, fb->len, fb->width, fb->height, capturedUs);
+
+      // Suppression only thins out the stream viewers; sentry and the
+      // recorder get every frame, so the copy is skipped only without them
+      bool suppressed = !sceneDetector.shouldPublish(fb->buf, fb->len, grabbedUs);
+
+      if (suppressed && !frameHub.hasInternalConsumers()) {
+        halCameraReturn(fb);
+        continue;
+      }
+
+      SharedFrame *frame = frameHub.beginWrite(fb->len);
+
+      if (frame) {
+        memcpy(frame->buf, fb->buf, fb->len);
+        frame->suppressed = suppressed;
+        frame->timestamp = fb->timestamp;
+        frame->width = fb->width;
+        frame->height = fb->height;
+        frameHub.commit(frame);
+        frameHub.getCaptureTime().record(esp_timer_get_time() - grabbedUs);
+      }
+
+      halCameraReturn(fb);
+      continue;
+    }
+
+    SharedFrame *frame = frameHub.beginEncode(fb, JPEG_ENCODE_QUALITY);
+
+    if (frame) {
+      clipRing.offer(frame->buf, frame->len, fb->width, fb->height, capturedUs);
+    }
+
+    if (frame) {
+      frame->suppressed = !sceneDetector.shouldPublish(frame->buf, frame->len, grabbedUs);
+    }
+
+    if (frame && frame->suppressed && !frameHub.hasInternalConsumers()) {
+      frameHub.release(frame);
+      frame = nullptr;
+    }
+
+    if (frame) {
+      frame->timestamp = fb->timestamp;
+      frame->width = fb->width;
+      frame->height = fb->height;
+      frameHub.commit(frame);
+      frameHub.getCaptureTime().record(esp_timer_get_time() - grabbedUs);
+    }
+
+    halCameraReturn(fb);
+  }
+}
+
+bool startFrameCapture() {
+  TaskHandle_t handle = nullptr;
+
+  if (xTaskCreatePinnedToCore(captureTask, "CaptureTask", 4096, nullptr, CAPTURE_TASK_PRIORITY, &handle, CAPTURE_TASK_CORE) != pdPASS) {
+    DEBUG_PRINTLN("Failed to start capture task");
+    return false;
+  }
+
+  frameHub.setProducer(handle);
+  return true;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STREAM_TARGET_FPS 20
+#define STREAM_MIN_FPS 1
+#define STREAM_MAX_FPS 60
+
+// Paces one MJPEG viewer. The time spent inside send() is the backpressure
+// signal: while the socket drains slower than the target rate the interval
+// stretches to the measured send time plus headroom, so the viewer simply
+// takes fewer (always the newest) frames instead of queueing them.
+class FramePacer {
+public:
+  FramePacer(uint8_t targetFps = STREAM_TARGET_FPS)
+      : _targetIntervalUs(0),
+        _sendEwmaUs(0),
+        _lastSendUs(0),
+        _bytesPerSec(0),
+        _frames(0) {
+    setTargetFps(targetFps);
+  }
+
+  void setTargetFps(uint8_t fps) {
+    if (fps < STREAM_MIN_FPS) {
+      fps = STREAM_MIN_FPS;
+    } else if (fps > STREAM_MAX_FPS) {
+      fps = STREAM_MAX_FPS;
+    }
+
+    _targetIntervalUs = 1000000UL / fps;
+  }
+
+  void onFrameSent(uint32_t sendUs, size_t bytes) {
+    _lastSendUs = sendUs;
+
+    if (_frames == 0) {
+      _sendEwmaUs = sendUs;
+    } else {
+      // EWMA with alpha = 1/8
+      _sendEwmaUs += ((int64_t)sendUs - (int64_t)_sendEwmaUs) / 8;
+    }
+
+    if (sendUs > 0) {
+      uint32_t rate = (uint32_t)((uint64_t)bytes * 1000000ULL / sendUs);
+      _bytesPerSec = _frames == 0 ? rate : _bytesPerSec + ((int64_t)rate - (int64_t)_bytesPerSec) / 8;
+    }
+
+    _frames++;
+  }
+
+  // Frame interval the link can currently sustain, never faster than the target
+  uint32_t getIntervalUs() const {
+    uint32_t linkIntervalUs = _sendEwmaUs + _sendEwmaUs / 4;
+
+    return linkIntervalUs > _targetIntervalUs ? linkIntervalUs : _targetIntervalUs;
+  }
+
+  // How long to wait after the last send before taking the next frame
+  uint32_t nextDelayUs() const {
+    uint32_t interval = getIntervalUs();
+
+    return _lastSendUs >= interval ? 0 : interval - _lastSendUs;
+  }
+
+  bool isCongested() const {
+    return getIntervalUs() > _targetIntervalUs;
+  }
+
+  uint32_t getTargetIntervalUs() const {
+    return _targetIntervalUs;
+  }
+
+  uint32_t getSendEwmaUs() const {
+    return _sendEwmaUs;
+  }
+
+  uint32_t getBytesPerSec() const {
+    return _bytesPerSec;
+  }
+
+private:
+  uint32_t _targetIntervalUs;
+  uint32_t _sendEwmaUs;
+  uint32_t _lastSendUs;
+  uint32_t _bytesPerSec;
+  uint32_t _frames;
+};
+
+#endif
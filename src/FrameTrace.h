@@ -0,0 +1,197 @@
+#ifndef FRAME_TRACE_H
+#define FRAME_TRACE_H
+
+#include <atomic>
+#include <stdint.h>
+
+#define FRAME_TRACE_RING_SIZE 64 // must be a power of two
+#define LATENCY_BUCKETS 24       // bucket i holds [2^i, 2^(i+1)) us, the last one everything above 8 s
+
+// Log2-bucketed latency histogram, safe to record from any task
+class LatencyHistogram {
+public:
+  LatencyHistogram() {
+    reset();
+  }
+
+  void record(uint32_t us) {
+    buckets[bucketFor(us)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sumUs.fetch_add(us, std::memory_order_relaxed);
+
+    uint32_t seen = maxUs.load(std::memory_order_relaxed);
+    while (us > seen && !maxUs.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {
+    }
+  }
+
+  void reset() {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+      buckets[i].store(0, std::memory_order_relaxed);
+    }
+
+    total.store(0, std::memory_order_relaxed);
+    sumUs.store(0, std::memory_order_relaxed);
+    maxUs.store(0, std::memory_order_relaxed);
+  }
+
+  static int bucketFor(uint32_t us) {
+    if (us == 0) {
+      return 0;
+    }
+
+    int bucket = 31 - __builtin_clz(us);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+  }
+
+  // Upper bound of the bucket, in us
+  static uint32_t bucketLimit(int bucket) {
+    return bucket >= LATENCY_BUCKETS - 1 ? UINT32_MAX : (2UL << bucket) - 1;
+  }
+
+  uint32_t bucketCount(int bucket) const {
+    return buckets[bucket].load(std::memory_order_relaxed);
+  }
+
+  uint32_t count() const {
+    return total.load(std::memory_order_relaxed);
+  }
+
+  uint32_t meanUs() const {
+    uint32_t n = count();
+    return n ? sumUs.load(std::memory_order_relaxed) / n : 0;
+  }
+
+  uint64_t getSumUs() const {
+    return sumUs.load(std::memory_order_relaxed);
+  }
+
+  uint32_t getMaxUs() const {
+    return maxUs.load(std::memory_order_relaxed);
+  }
+
+  // Percentile (0-100) interpolated linearly inside its log2 bucket
+  uint32_t percentileUs(uint8_t percentile) const {
+    uint32_t n = count();
+    if (n == 0) {
+      return 0;
+    }
+
+    uint64_t rank = ((uint64_t)n * percentile + 99) / 100;
+    uint64_t seen = 0;
+
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+      uint32_t inBucket = bucketCount(i);
+
+      if (inBucket == 0 || seen + inBucket < rank) {
+        seen += inBucket;
+        continue;
+      }
+
+      uint32_t low = i == 0 ? 0 : 1UL << i;
+      uint32_t high = bucketLimit(i);
+      uint32_t maximum = getMaxUs();
+
+      if (high > maximum) {
+        high = maximum;
+      }
+
+      if (high <= low) {
+        return high;
+      }
+
+      return low + (uint64_t)(high - low) * (rank - seen) / inBucket;
+    }
+
+    return getMaxUs();
+  }
+
+private:
+  std::atomic<uint32_t> buckets[LATENCY_BUCKETS];
+  std::atomic<uint32_t> total;
+  std::atomic<uint64_t> sumUs; // not lock-free on Xtensa, see Metrics.h
+  std::atomic<uint32_t> maxUs;
+};
+
+// Stage timestamps of one frame sent to one viewer, all esp_timer based
+struct FrameTraceRecord {
+  uint32_t seq;
+  uint32_t len;
+  uint8_t viewer;
+  int64_t capturedUs;
+  int64_t dequeuedUs;
+  int64_t headerSentUs;
+  int64_t payloadSentUs;
+  int64_t returnedUs;
+};
+
+class FrameTrace {
+public:
+  enum Stage : uint8_t {
+    QUEUE = 0,  // captured -> dequeued by the sender
+    HEADER,     // dequeued -> part header sent
+    PAYLOAD,    // header sent -> last payload byte sent
+    TOTAL,      // captured -> last payload byte sent
+    STAGE_COUNT
+  };
+
+  FrameTrace()
+      : next(0) {}
+
+  void record(const FrameTraceRecord &trace) {
+    uint32_t index = next.fetch_add(1, std::memory_order_relaxed) & (FRAME_TRACE_RING_SIZE - 1);
+    ring[index] = trace;
+
+    histograms[QUEUE].record(elapsed(trace.capturedUs, trace.dequeuedUs));
+    histograms[HEADER].record(elapsed(trace.dequeuedUs, trace.headerSentUs));
+    histograms[PAYLOAD].record(elapsed(trace.headerSentUs, trace.payloadSentUs));
+    histograms[TOTAL].record(elapsed(trace.capturedUs, trace.payloadSentUs));
+  }
+
+  // Copies up to FRAME_TRACE_RING_SIZE most recent records, oldest first
+  uint32_t snapshot(FrameTraceRecord *out) const {
+    uint32_t end = next.load(std::memory_order_relaxed);
+    uint32_t count = end < FRAME_TRACE_RING_SIZE ? end : FRAME_TRACE_RING_SIZE;
+
+    for (uint32_t i = 0; i < count; i++) {
+      out[i] = ring[(end - count + i) & (FRAME_TRACE_RING_SIZE - 1)];
+    }
+
+    return count;
+  }
+
+  const LatencyHistogram &histogram(Stage stage) const {
+    return histograms[stage];
+  }
+
+  void reset() {
+    for (int i = 0; i < STAGE_COUNT; i++) {
+      histograms[i].reset();
+    }
+  }
+
+  static const char *stageToString(Stage stage) {
+    switch (stage) {
+    case QUEUE:
+      return "queue";
+    case HEADER:
+      return "header";
+    case PAYLOAD:
+      return "payload";
+    case TOTAL:
+      return "capture_to_wire";
+    default:
+      return "unknown";
+    }
+  }
+
+private:
+  FrameTraceRecord ring[FRAME_TRACE_RING_SIZE];
+  LatencyHistogram histograms[STAGE_COUNT];
+  std::atomic<uint32_t> next;
+
+  static uint32_t elapsed(int64_t from, int64_t to) {
+    return to > from ? (uint32_t)(to - from) : 0;
+  }
+};
+
+#endif
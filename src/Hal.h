@@ -0,0 +1,323 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "utils.h"
+#include <Arduino.h>
+#include <Servo.h>
+#include <atomic>
+#include <sys/time.h>
+
+// Every pin write and camera frame the car code touches goes through these
+// calls. The defaults are the plain Arduino / esp32-camera ones; two build
+// flags change what sits behind them without touching Car, Motor or FrameHub:
+//
+//   -D HAL_RECORD_OUTPUTS    keeps the last HAL_RECORD_SIZE output writes with
+//                            their esp_timer time, listed under /trace
+//   -D HAL_SYNTHETIC_CAMERA  serves generated JPEG frames at HAL_SYNTHETIC_FPS
+//                            instead of the sensor, so streaming can be
+//                            measured with the camera unplugged
+
+#define HAL_RECORD_SIZE 256 // must be a power of two
+
+#ifndef HAL_SYNTHETIC_FPS
+#define HAL_SYNTHETIC_FPS 25
+#endif
+#define HAL_SYNTHETIC_FRAMES 4 // distinct frames, so every frame differs from the previous one
+
+enum class HalOutput : uint8_t {
+  PWM = 0, // channel = LEDC channel, value = duty
+  SERVO,   // channel = LEDC channel, value = degrees
+  GPIO,    // channel = pin, value = level
+  KIND_COUNT
+};
+
+// Writes per output kind since boot, lets callers tell whether an action
+// reached the hardware without hooking the writes themselves
+std::atomic<uint32_t> halWrites[(int)HalOutput::KIND_COUNT];
+
+inline uint32_t halWriteCount(HalOutput kind) {
+  return halWrites[(int)kind].load(std::memory_order_relaxed);
+}
+
+struct HalOutputEvent {
+  int64_t timeUs;
+  HalOutput kind;
+  uint8_t channel;
+  int16_t value;
+};
+
+// Ring of the most recent output writes, safe to record from any task
+class HalRecorder {
+public:
+  HalRecorder()
+      : next(0) {}
+
+  void record(HalOutput kind, uint8_t channel, int16_t value) {
+    uint32_t index = next.fetch_add(1, std::memory_order_relaxed) & (HAL_RECORD_SIZE - 1);
+    ring[index] = {esp_timer_get_time(), kind, channel, value};
+  }
+
+  // Copies the recorded events oldest first, returns how many
+  uint32_t snapshot(HalOutputEvent *out) const {
+    uint32_t end = next.load(std::memory_order_relaxed);
+    uint32_t count = end < HAL_RECORD_SIZE ? end : HAL_RECORD_SIZE;
+
+    for (uint32_t i = 0; i < count; i++) {
+      out[i] = ring[(end - count + i) & (HAL_RECORD_SIZE - 1)];
+    }
+
+    return count;
+  }
+
+  void reset() {
+    next.store(0, std::memory_order_relaxed);
+  }
+
+  static const char *kindToString(HalOutput kind) {
+    switch (kind) {
+    case HalOutput::PWM:
+      return "pwm";
+    case HalOutput::SERVO:
+      return "servo";
+    case HalOutput::GPIO:
+      return "gpio";
+    default:
+      return "unknown";
+    }
+  }
+
+private:
+  HalOutputEvent ring[HAL_RECORD_SIZE];
+  std::atomic<uint32_t> next;
+};
+
+#ifdef HAL_RECORD_OUTPUTS
+HalRecorder halRecorder;
+#define HAL_RECORD(kind, channel, value) halRecorder.record(kind, channel, value)
+#else
+#define HAL_RECORD(kind, channel, value)
+#endif
+
+inline void halPwmWrite(uint8_t channel, uint32_t duty) {
+  HAL_RECORD(HalOutput::PWM, channel, duty);
+  halWrites[(int)HalOutput::PWM].fetch_add(1, std::memory_order_relaxed);
+  ledcWrite(channel, duty);
+}
+
+inline void halServoWrite(Servo &servo, uint8_t channel, int angle) {
+  HAL_RECORD(HalOutput::SERVO, channel, angle);
+  halWrites[(int)HalOutput::SERVO].fetch_add(1, std::memory_order_relaxed);
+  servo.write(angle);
+}
+
+inline void halDigitalWrite(uint8_t pin, uint8_t level) {
+  HAL_RECORD(HalOutput::GPIO, pin, level);
+  halWrites[(int)HalOutput::GPIO].fetch_add(1, std::memory_order_relaxed);
+  digitalWrite(pin, level);
+}
+
+#ifdef HAL_SYNTHETIC_CAMERA
+
+// Stands in for the sensor: a fake sensor_t that accepts frame size and
+// quality changes, and a few grayscale test patterns encoded at the current
+// settings and handed out at a fixed frame rate. Frames are re-encoded only
+// when the settings change and no frame is out.
+class SyntheticCamera {
+public:
+  SyntheticCamera()
+      : encodedSize(FRAMESIZE_INVALID),
+        encodedQuality(-1),
+        nextFrame(0),
+        nextDueUs(0),
+        framesOut(0),
+        still(false) {
+    memset(&sensor, 0, sizeof(sensor));
+    memset(frames, 0, sizeof(frames));
+    memset(lengths, 0, sizeof(lengths));
+  }
+
+  esp_err_t init(const camera_config_t *config) {
+    sensor.pixformat = PIXFORMAT_JPEG;
+    sensor.status.framesize = config->frame_size;
+    sensor.status.quality = config->jpeg_quality;
+    sensor.set_framesize = setFramesize;
+    sensor.set_quality = setQuality;
+
+    DEBUG_PRINTF_LN("Synthetic camera at %d fps", HAL_SYNTHETIC_FPS);
+    return ESP_OK;
+  }
+
+  sensor_t *getSensor() {
+    return &sensor;
+  }
+
+  // Repeats the same picture, like a parked car facing a wall
+  void setStill(bool on) {
+    still = on;
+  }
+
+  camera_fb_t *grab() {
+    // Pace like a sensor running at a fixed frame rate
+    int64_t wait = nextDueUs - esp_timer_get_time();
+    if (wait > 1000) {
+      delay(wait / 1000);
+    }
+    nextDueUs = esp_timer_get_time() + 1000000 / HAL_SYNTHETIC_FPS;
+
+    if (framesOut.load() == 0 && !encodeIfChanged()) {
+      return nullptr;
+    }
+
+    camera_fb_t *fb = (camera_fb_t *)malloc(sizeof(camera_fb_t));
+    if (!fb) {
+      return nullptr;
+    }
+
+    framesOut++;
+
+    if (!still) {
+      nextFrame = (nextFrame + 1) % HAL_SYNTHETIC_FRAMES;
+    }
+
+    fb->buf = frames[nextFrame];
+    fb->len = lengths[nextFrame];
+    fb->width = resolution[encodedSize].width;
+    fb->height = resolution[encodedSize].height;
+    fb->format = PIXFORMAT_JPEG;
+
+    // esp32-camera stamps frames from esp_timer, not the wall clock
+    int64_t nowUs = esp_timer_get_time();
+    fb->timestamp.tv_sec = nowUs / 1000000;
+    fb->timestamp.tv_usec = nowUs % 1000000;
+
+    return fb;
+  }
+
+  void release(camera_fb_t *fb) {
+    free(fb);
+    framesOut--;
+  }
+
+private:
+  sensor_t sensor;
+  uint8_t *frames[HAL_SYNTHETIC_FRAMES];
+  size_t lengths[HAL_SYNTHETIC_FRAMES];
+  framesize_t encodedSize;
+  int encodedQuality;
+  int nextFrame;
+  int64_t nextDueUs;
+  std::atomic<int> framesOut;
+  std::atomic<bool> still;
+
+  static int setFramesize(sensor_t *s, framesize_t frameSize) {
+    if (frameSize >= FRAMESIZE_INVALID) {
+      return -1;
+    }
+
+    s->status.framesize = frameSize;
+    return 0;
+  }
+
+  static int setQuality(sensor_t *s, int quality) {
+    s->status.quality = constrain(quality, 0, 63);
+    return 0;
+  }
+
+  bool encodeIfChanged() {
+    framesize_t frameSize = sensor.status.framesize;
+    int quality = sensor.status.quality;
+
+    if (frameSize == encodedSize && quality == encodedQuality) {
+      return true;
+    }
+
+    uint16_t width = resolution[frameSize].width;
+    uint16_t height = resolution[frameSize].height;
+    uint8_t *pixels = (uint8_t *)ps_malloc((size_t)width * height);
+    if (!pixels) {
+      return false;
+    }
+
+    // Sensor quality is 0..63 with lower being better, the encoder wants 1..100
+    uint8_t jpegQuality = constrain(100 - quality * 3 / 2, 1, 100);
+    bool ok = true;
+
+    for (int i = 0; i < HAL_SYNTHETIC_FRAMES && ok; i++) {
+      drawPattern(pixels, width, height, i);
+
+      free(frames[i]);
+      frames[i] = NULL;
+      ok = fmt2jpg(pixels, (size_t)width * height, width, height, PIXFORMAT_GRAYSCALE, jpegQuality, &frames[i],
+                   &lengths[i]);
+    }
+
+    free(pixels);
+
+    if (!ok) {
+      encodedSize = FRAMESIZE_INVALID;
+      return false;
+    }
+
+    encodedSize = frameSize;
+    encodedQuality = quality;
+    DEBUG_PRINTF_LN("Synthetic frames encoded at %ux%u, %u bytes", width, height, lengths[0]);
+    return true;
+  }
+
+  // Diagonal gradient with a bright bar that moves and widens with the frame
+  // index, so consecutive frames also differ in compressed size
+  static void drawPattern(uint8_t *pixels, uint16_t width, uint16_t height, int index) {
+    uint16_t barStart = index * width / HAL_SYNTHETIC_FRAMES;
+    uint16_t barEnd = barStart + width * (index + 1) / (4 * HAL_SYNTHETIC_FRAMES);
+
+    for (uint16_t y = 0; y < height; y++) {
+      uint8_t *row = pixels + (size_t)y * width;
+
+      for (uint16_t x = 0; x < width; x++) {
+        row[x] = x >= barStart && x < barEnd ? 255 : (uint8_t)((x + y) * 3 / 4);
+      }
+    }
+  }
+};
+
+SyntheticCamera syntheticCamera;
+
+inline esp_err_t halCameraInit(const camera_config_t *config) {
+  return syntheticCamera.init(config);
+}
+
+inline sensor_t *halCameraSensor() {
+  return syntheticCamera.getSensor();
+}
+
+inline camera_fb_t *halCameraGrab() {
+  return syntheticCamera.grab();
+}
+
+inline void halCameraReturn(camera_fb_t *fb) {
+  syntheticCamera.release(fb);
+}
+
+#else
+
+inline esp_err_t halCameraInit(const camera_config_t *config) {
+  return esp_camera_init(config);
+}
+
+inline sensor_t *halCameraSensor() {
+  return esp_camera_sensor_get();
+}
+
+inline camera_fb_t *halCameraGrab() {
+  return esp_camera_fb_get();
+}
+
+inline void halCameraReturn(camera_fb_t *fb) {
+  esp_camera_fb_return(fb);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+#include "esp_camera.h"
+#include <Arduino.h>
+
+#define JPEG_ENCODE_QUALITY 80
+// Buffers grow in whole steps with some headroom, so frames whose size
+// wobbles by a few bytes do not realloc every time
+#define JPEG_BUFFER_STEP 4096
+#define JPEG_BUFFER_HEADROOM_DIV 8 // capacity = len + len / 8, rounded up to a step
+// First guess for a frame with no size history yet, in pixels per byte
+#define JPEG_PIXELS_PER_BYTE 8
+
+inline size_t jpegCapacityFor(size_t len) {
+  size_t padded = len + len / JPEG_BUFFER_HEADROOM_DIV;
+  return (padded + JPEG_BUFFER_STEP - 1) / JPEG_BUFFER_STEP * JPEG_BUFFER_STEP;
+}
+
+// Grows buf to hold at least len bytes following the step policy. The old
+// contents are kept; on failure buf and capacity are left untouched.
+inline bool jpegReserve(uint8_t *&buf, size_t &capacity, size_t len) {
+  if (capacity >= len) {
+    return true;
+  }
+
+  size_t grownCapacity = jpegCapacityFor(len);
+  uint8_t *grown = (uint8_t *)ps_realloc(buf, grownCapacity);
+
+  if (!grown) {
+    return false;
+  }
+
+  buf = grown;
+  capacity = grownCapacity;
+  return true;
+}
+
+struct JpegSink {
+  uint8_t *&buf;
+  size_t &capacity;
+  size_t len;
+  bool failed;
+};
+
+static size_t writeJpegSink(void *arg, size_t index, const void *data, size_t len) {
+  JpegSink *sink = (JpegSink *)arg;
+
+  if (sink->failed || !jpegReserve(sink->buf, sink->capacity, index + len)) {
+    sink->failed = true;
+    return 0;
+  }
+
+  memcpy(sink->buf + index, data, len);
+  sink->len = index + len;
+  return len;
+}
+
+// frame2jpg() that encodes into a caller-owned buffer instead of returning a
+// fresh malloc per frame. buf may be NULL; it is grown in place when the frame
+// does not fit. Returns the JPEG length, 0 on failure.
+inline size_t frameToJpeg(camera_fb_t *fb, uint8_t quality, uint8_t *&buf, size_t &capacity) {
+  JpegSink sink = {buf, capacity, 0, false};
+
+  if (!frame2jpg_cb(fb, quality, writeJpegSink, &sink) || sink.failed) {
+    return 0;
+  }
+
+  return sink.len;
+}
+
+#endif
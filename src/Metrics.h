@@ -0,0 +1,177 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "FrameTrace.h"
+#include <atomic>
+#include <stdint.h>
+
+// Process-wide metrics, served in Prometheus text format on /metrics.
+//
+// Every metric links itself into the registry when it is constructed, which
+// happens once during static initialisation, so the list is never modified
+// while tasks run. After that an update is a relaxed atomic: no allocation,
+// safe from any task or core. Counters, gauges and histogram buckets are
+// 32-bit and lock-free. A histogram's sum is 64-bit, which Xtensa cannot
+// update in one instruction; the toolchain's atomic helpers take a spinlock
+// with interrupts masked for those few cycles. Values that some other module
+// already tracks are exposed as readouts, functions called at scrape time,
+// instead of being counted twice.
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "32-bit metric updates must be lock-free");
+
+enum class MetricType : uint8_t {
+  COUNTER = 0,
+  GAUGE,
+  HISTOGRAM
+};
+
+typedef int64_t (*MetricReadout)();
+
+class Metric {
+public:
+  Metric(const char *metricName, const char *metricHelp, MetricType metricType)
+      : name(metricName),
+        help(metricHelp),
+        type(metricType),
+        next(nullptr) {
+    link(this);
+  }
+
+  const char *getName() const {
+    return name;
+  }
+
+  const char *getHelp() const {
+    return help;
+  }
+
+  MetricType getType() const {
+    return type;
+  }
+
+  const Metric *getNext() const {
+    return next;
+  }
+
+  // Current value of a counter or gauge, histograms are read through get()
+  virtual int64_t getValue() const {
+    return 0;
+  }
+
+  static const Metric *first() {
+    return head();
+  }
+
+  static const char *typeToString(MetricType type) {
+    switch (type) {
+    case MetricType::COUNTER:
+      return "counter";
+    case MetricType::GAUGE:
+      return "gauge";
+    case MetricType::HISTOGRAM:
+      return "histogram";
+    default:
+      return "untyped";
+    }
+  }
+
+private:
+  const char *name;
+  const char *help;
+  MetricType type;
+  Metric *next;
+
+  static Metric *&head() {
+    static Metric *list = nullptr;
+    return list;
+  }
+
+  // Appends, so /metrics lists metrics in declaration order
+  static void link(Metric *metric) {
+    Metric **tail = &head();
+
+    while (*tail) {
+      tail = &(*tail)->next;
+    }
+
+    *tail = metric;
+  }
+};
+
+// Monotonic 32-bit counter; a wrap looks like a counter reset to Prometheus
+class CounterMetric : public Metric {
+public:
+  CounterMetric(const char *name, const char *help)
+      : Metric(name, help, MetricType::COUNTER),
+        value(0) {}
+
+  void inc(uint32_t amount = 1) {
+    value.fetch_add(amount, std::memory_order_relaxed);
+  }
+
+  uint32_t get() const {
+    return value.load(std::memory_order_relaxed);
+  }
+
+  int64_t getValue() const override {
+    return get();
+  }
+
+private:
+  std::atomic<uint32_t> value;
+};
+
+class GaugeMetric : public Metric {
+public:
+  GaugeMetric(const char *name, const char *help)
+      : Metric(name, help, MetricType::GAUGE),
+        value(0) {}
+
+  void set(int32_t newValue) {
+    value.store(newValue, std::memory_order_relaxed);
+  }
+
+  int32_t get() const {
+    return value.load(std::memory_order_relaxed);
+  }
+
+  int64_t getValue() const override {
+    return get();
+  }
+
+private:
+  std::atomic<int32_t> value;
+};
+
+// Counter or gauge whose value lives elsewhere and is read on scrape
+class ReadoutMetric : public Metric {
+public:
+  ReadoutMetric(const char *name, const char *help, MetricType type, MetricReadout readout)
+      : Metric(name, help, type),
+        read(readout) {}
+
+  int64_t getValue() const override {
+    return read();
+  }
+
+private:
+  MetricReadout read;
+};
+
+// Exposes a LatencyHistogram. Its log2 buckets become cumulative le buckets
+// in seconds, so the usual histogram_quantile() queries work unchanged.
+class HistogramMetric : public Metric {
+public:
+  HistogramMetric(const char *name, const char *help, const LatencyHistogram &source)
+      : Metric(name, help, MetricType::HISTOGRAM),
+        histogram(source) {}
+
+  const LatencyHistogram &get() const {
+    return histogram;
+  }
+
+private:
+  const LatencyHistogram &histogram;
+};
+
+#endif
@@ -0,0 +1,345 @@
+#ifndef MOTION_DETECTOR_H
+#define MOTION_DETECTOR_H
+
+#include "FrameHub.h"
+#include "FrameTrace.h"
+#include "MotionKernel.h"
+#include "esp_jpg_decode.h"
+#include <Arduino.h>
+#include <atomic>
+
+#define MOTION_FPS 5
+#define MOTION_TASK_CORE 1
+#define MOTION_TASK_PRIORITY 2 // below capture, the stream comes first
+#define MOTION_EVENT_INTERVAL_US 500000 // repeat the event this often while motion lasts
+#define MOTION_QUIET_US 2000000 // no motion for this long ends the event
+
+// Events handed to the handler:
+//   MOTION-<active blocks>-<x>-<y>-<w>-<h>   box in percent of the frame
+//   MOTION-END
+typedef void (*MotionEventHandler)(const char *message);
+
+// Sentry mode: watches the hub's frames for motion while the car is parked.
+// Each JPEG is decoded at 1/2..1/8 scale (the smallest that still covers
+// the motion grid), reduced to MOTION_WIDTH x MOTION_HEIGHT 7-bit luma and
+// fed to MotionModel. While enabled the task counts as a hub viewer, so the
+// camera keeps running with nobody watching the stream.
+class MotionDetector {
+public:
+  MotionDetector()
+      : task(nullptr),
+        enabled(false),
+        rebasePending(false),
+        eventHandler(nullptr),
+        decoded(nullptr),
+        decodedCapacity(0),
+        decodedWidth(0),
+        decodedHeight(0),
+        jpeg(nullptr),
+        jpegLen(0),
+        frames(0),
+        events(0),
+        inEvent(false),
+        lastMotionUs(0),
+        lastEventUs(0) {}
+
+  bool start() {
+    if (xTaskCreatePinnedToCore(taskEntry, "MotionTask", 4096, this, MOTION_TASK_PRIORITY, &task, MOTION_TASK_CORE) != pdPASS) {
+      DEBUG_PRINTLN("Failed to start motion task");
+      return false;
+    }
+
+    return true;
+  }
+
+  void setEventHandler(MotionEventHandler handler) {
+    eventHandler = handler;
+  }
+
+  void setEnabled(bool on) {
+    enabled = on;
+
+    if (on && task) {
+      xTaskNotifyGive(task);
+    }
+  }
+
+  bool isEnabled() const {
+    return enabled;
+  }
+
+  // The camera or the car moved, the background no longer fits
+  void rebase() {
+    rebasePending = true;
+  }
+
+  uint32_t getFrames() const {
+    return frames;
+  }
+
+  uint32_t getEvents() const {
+    return events;
+  }
+
+  // JPEG decode and luma reduction per frame
+  const LatencyHistogram &getDecodeTime() const {
+    return decodeTime;
+  }
+
+  // Background model update per frame
+  const LatencyHistogram &getDetectTime() const {
+    return detectTime;
+  }
+
+private:
+  TaskHandle_t task;
+  std::atomic<bool> enabled;
+  std::atomic<bool> rebasePending;
+  MotionEventHandler eventHandler;
+  MotionModel model;
+  alignas(4) uint8_t luma[MOTION_WIDTH * MOTION_HEIGHT];
+  uint8_t *decoded;
+  size_t decodedCapacity;
+  uint16_t decodedWidth;
+  uint16_t decodedHeight;
+  const uint8_t *jpeg;
+  size_t jpegLen;
+  std::atomic<uint32_t> frames;
+  std::atomic<uint32_t> events;
+  bool inEvent;
+  int64_t lastMotionUs;
+  int64_t lastEventUs;
+  LatencyHistogram decodeTime;
+  LatencyHistogram detectTime;
+
+  static void taskEntry(void *arg) {
+    ((MotionDetector *)arg)->run();
+  }
+
+  void run() {
+    for (;;) {
+      if (!enabled) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        continue;
+      }
+
+      if (!frameHub.subscribeInternal(task)) {
+        DEBUG_PRINTLN("Sentry: no free hub consumer slot");
+        delay(1000);
+        continue;
+      }
+
+      frameHub.setViewerInterval(task, 1000000UL / MOTION_FPS);
+      model.reset();
+      DEBUG_PRINTLN("Sentry mode on");
+
+      uint32_t lastSeq = 0;
+      int64_t nextFrameUs = 0;
+
+      while (enabled) {
+        int64_t wait = nextFrameUs - esp_timer_get_time();
+        if (wait > 1000) {
+          delay(wait / 1000);
+        }
+
+        SharedFrame *frame = frameHub.acquire(lastSeq, pdMS_TO_TICKS(1000));
+        if (!frame) {
+          continue;
+        }
+
+        nextFrameUs = esp_timer_get_time() + 1000000UL / MOTION_FPS;
+        lastSeq = frame->seq;
+
+        int64_t startUs = esp_timer_get_time();
+        bool ok = toLuma(frame->buf, frame->len);
+        frameHub.release(frame);
+
+        if (ok) {
+          decodeTime.record(esp_timer_get_time() - startUs);
+          detect();
+        }
+      }
+
+      frameHub.unsubscribe(task);
+      endEvent();
+      DEBUG_PRINTLN("Sentry mode off");
+    }
+  }
+
+  void detect() {
+    if (rebasePending.exchange(false)) {
+      model.reset();
+    }
+
+    int64_t startUs = esp_timer_get_time();
+    MotionResult result = model.update(luma);
+    int64_t nowUs = esp_timer_get_time();
+
+    detectTime.record(nowUs - startUs);
+    frames++;
+
+    if (!result.isMotion()) {
+      if (inEvent && nowUs - lastMotionUs >= MOTION_QUIET_US) {
+        endEvent();
+      }
+
+      return;
+    }
+
+    lastMotionUs = nowUs;
+
+    if (inEvent && nowUs - lastEventUs < MOTION_EVENT_INTERVAL_US) {
+      return;
+    }
+
+    inEvent = true;
+    lastEventUs = nowUs;
+    events++;
+
+    char message[48];
+    snprintf(message, sizeof(message), "MOTION-%u-%d-%d-%d-%d", result.activeBlocks,
+             result.left * 100 / MOTION_BLOCKS_X, result.top * 100 / MOTION_BLOCKS_Y,
+             (result.right - result.left + 1) * 100 / MOTION_BLOCKS_X,
+             (result.bottom - result.top + 1) * 100 / MOTION_BLOCKS_Y);
+    notify(message);
+  }
+
+  void endEvent() {
+    if (inEvent) {
+      inEvent = false;
+      notify("MOTION-END");
+    }
+  }
+
+  void notify(const char *message) {
+    if (eventHandler) {
+      eventHandler(message);
+    }
+  }
+
+  bool toLuma(const uint8_t *buf, size_t len) {
+    uint16_t width, height;
+    if (!readJpegSize(buf, len, width, height)) {
+      return false;
+    }
+
+    // Smallest decode that still has a pixel for every grid pixel
+    int shift = 3;
+    while (shift > 0 && ((width >> shift) < MOTION_WIDTH || (height >> shift) < MOTION_HEIGHT)) {
+      shift--;
+    }
+
+    jpeg = buf;
+    jpegLen = len;
+    decodedWidth = 0;
+    decodedHeight = 0;
+
+    if (esp_jpg_decode(len, (jpg_scale_t)shift, readJpeg, writeLuma, this) != ESP_OK || !decodedWidth) {
+      return false;
+    }
+
+    // Nearest-neighbour reduction onto the grid
+    for (int y = 0; y < MOTION_HEIGHT; y++) {
+      const uint8_t *row = decoded + (size_t)(y * decodedHeight / MOTION_HEIGHT) * decodedWidth;
+
+      for (int x = 0; x < MOTION_WIDTH; x++) {
+        luma[y * MOTION_WIDTH + x] = row[x * decodedWidth / MOTION_WIDTH];
+      }
+    }
+
+    return true;
+  }
+
+  static size_t readJpeg(void *arg, size_t index, uint8_t *buf, size_t len) {
+    MotionDetector *self = (MotionDetector *)arg;
+
+    if (index + len > self->jpegLen) {
+      len = index < self->jpegLen ? self->jpegLen - index : 0;
+    }
+
+    if (buf) {
+      memcpy(buf, self->jpeg + index, len);
+    }
+
+    return len;
+  }
+
+  // Receives RGB888 blocks; a NULL block at 0,0 announces the output size
+  static bool writeLuma(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+    MotionDetector *self = (MotionDetector *)arg;
+
+    if (!data) {
+      if (x == 0 && y == 0) {
+        return self->prepareDecode(w, h);
+      }
+
+      return true;
+    }
+
+    if (x >= self->decodedWidth) {
+      return true;
+    }
+
+    uint16_t columns = x + w > self->decodedWidth ? self->decodedWidth - x : w;
+
+    for (uint16_t j = 0; j < h && y + j < self->decodedHeight; j++) {
+      const uint8_t *in = data + (size_t)j * w * 3;
+      uint8_t *out = self->decoded + (size_t)(y + j) * self->decodedWidth + x;
+
+      for (uint16_t i = 0; i < columns; i++, in += 3) {
+        out[i] = (in[0] * 77 + in[1] * 150 + in[2] * 29) >> 9; // 7-bit luma
+      }
+    }
+
+    return true;
+  }
+
+  bool prepareDecode(uint16_t width, uint16_t height) {
+    size_t needed = (size_t)width * height;
+
+    if (needed > decodedCapacity) {
+      uint8_t *grown = (uint8_t *)ps_realloc(decoded, needed);
+      if (!grown) {
+        return false;
+      }
+
+      decoded = grown;
+      decodedCapacity = needed;
+    }
+
+    decodedWidth = width;
+    decodedHeight = height;
+    return true;
+  }
+
+  // Frame size from the SOF header
+  static bool readJpegSize(const uint8_t *buf, size_t len, uint16_t &width, uint16_t &height) {
+    size_t i = 2;
+
+    while (i + 8 < len && buf[i] == 0xFF) {
+      uint8_t marker = buf[i + 1];
+
+      if (marker >= 0xC0 && marker <= 0xC2) {
+        height = (buf[i + 5] << 8) | buf[i + 6];
+        width = (buf[i + 7] << 8) | buf[i + 8];
+        return width && height;
+      }
+
+      if (marker == 0xDA) {
+        break;
+      }
+
+      i += 2 + ((buf[i + 2] << 8) | buf[i + 3]);
+    }
+
+    return false;
+  }
+};
+
+MotionDetector motionDetector;
+
+bool startMotionDetector() {
+  return motionDetector.start();
+}
+
+#endif
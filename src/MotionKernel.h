@@ -0,0 +1,189 @@
+#ifndef MOTION_KERNEL_H
+#define MOTION_KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Motion detection on a small grayscale frame: a block grid of sums of
+// absolute differences against an adaptive background. Nothing here touches
+// the camera or FreeRTOS, so tools/motion_bench.cpp builds it on the host.
+
+#define MOTION_WIDTH 96
+#define MOTION_HEIGHT 72
+#define MOTION_BLOCK 8
+#define MOTION_BLOCKS_X (MOTION_WIDTH / MOTION_BLOCK)
+#define MOTION_BLOCKS_Y (MOTION_HEIGHT / MOTION_BLOCK)
+#define MOTION_BLOCKS (MOTION_BLOCKS_X * MOTION_BLOCKS_Y)
+
+#define MOTION_WARMUP_FRAMES 8 // frames to learn the background before reporting anything
+#define MOTION_LEARN_SHIFT 4   // background follows quiet pixels at 1/16 per frame
+#define MOTION_HOLD_SHIFT 7    // and moving ones at 1/128, so a parked object fades in
+#define MOTION_NOISE_SHIFT 4   // block noise floor follows quiet SADs at 1/16
+#define MOTION_NOISE_FACTOR 3  // a block is active above 3x its noise floor
+#define MOTION_MIN_SAD (MOTION_BLOCK * MOTION_BLOCK * 5) // and a mean difference of 5 of 127 levels
+#define MOTION_MIN_BLOCKS 2    // single noisy blocks are not motion
+
+// Frames hold 7-bit luma (0..127). Motion does not need the eighth bit, and
+// with it clear a byte lane can be subtracted without borrowing from the next.
+#define MOTION_LUMA_MAX 127
+
+// SAD of an 8x8 block, one byte at a time. The reference for the SWAR kernel.
+inline uint32_t motionBlockSadScalar(const uint8_t *a, const uint8_t *b, size_t stride) {
+  uint32_t sum = 0;
+
+  for (int y = 0; y < MOTION_BLOCK; y++) {
+    for (int x = 0; x < MOTION_BLOCK; x++) {
+      sum += a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+    }
+
+    a += stride;
+    b += stride;
+  }
+
+  return sum;
+}
+
+// |a - b| in each byte of two words of 7-bit pixels. a | 0x80 - b keeps every
+// lane in 1..255, its high bit tells whether a >= b; the lanes where it is
+// clear are negated with ~x + 1, which cannot carry either.
+inline uint32_t swarAbsDiff7(uint32_t a, uint32_t b) {
+  const uint32_t high = 0x80808080;
+
+  uint32_t biased = (a | high) - b;
+  uint32_t below = (~biased & high) >> 7; // 1 in lanes where a < b
+  uint32_t diff = biased ^ high;           // a - b per lane, two's complement
+
+  return (diff ^ (below * 0xFF)) + below;
+}
+
+inline uint32_t loadWord(const uint8_t *p) {
+  uint32_t word;
+  memcpy(&word, __builtin_assume_aligned(p, 4), sizeof(word));
+  return word;
+}
+
+// Same result as motionBlockSadScalar, four pixels per 32-bit operation. The
+// ESP32 has no SIMD unit, so this is its vector kernel. Rows must be 4-byte
+// aligned: MOTION_WIDTH and MOTION_BLOCK keep them so in aligned frames.
+inline uint32_t motionBlockSadSwar(const uint8_t *a, const uint8_t *b, size_t stride) {
+  // Two 16-bit lanes, at most 8 rows * 2 bytes * 254 = 4064 each
+  uint32_t lanes = 0;
+
+  for (int y = 0; y < MOTION_BLOCK; y++) {
+    // Differences are at most 127, so the two halves of a row share a byte
+    // lane before being widened
+    uint32_t row = swarAbsDiff7(loadWord(a), loadWord(b)) + swarAbsDiff7(loadWord(a + 4), loadWord(b + 4));
+
+    lanes += (row & 0x00FF00FF) + ((row >> 8) & 0x00FF00FF);
+    a += stride;
+    b += stride;
+  }
+
+  return (lanes & 0xFFFF) + (lanes >> 16);
+}
+
+typedef uint32_t (*MotionSadKernel)(const uint8_t *a, const uint8_t *b, size_t stride);
+
+// Active blocks and their bounding box, in block coordinates (inclusive)
+struct MotionResult {
+  uint16_t activeBlocks;
+  uint8_t left;
+  uint8_t top;
+  uint8_t right;
+  uint8_t bottom;
+
+  bool isMotion() const {
+    return activeBlocks >= MOTION_MIN_BLOCKS;
+  }
+};
+
+// Running-average background with a per-block noise floor. Blocks that see
+// steady flicker (foliage, a screen) raise their own threshold instead of
+// reporting motion forever.
+class MotionModel {
+public:
+  MotionModel(MotionSadKernel sadKernel = motionBlockSadSwar)
+      : kernel(sadKernel) {
+    reset();
+  }
+
+  // Forgets the background, e.g. after the camera moved
+  void reset() {
+    frames = 0;
+    memset(noise, 0, sizeof(noise));
+  }
+
+  bool isLearning() const {
+    return frames < MOTION_WARMUP_FRAMES;
+  }
+
+  // luma is MOTION_WIDTH x MOTION_HEIGHT of 7-bit values, 4-byte aligned
+  MotionResult update(const uint8_t *luma) {
+    MotionResult result = {0, MOTION_BLOCKS_X, MOTION_BLOCKS_Y, 0, 0};
+
+    if (frames == 0) {
+      for (int i = 0; i < MOTION_WIDTH * MOTION_HEIGHT; i++) {
+        background[i] = luma[i];
+        backgroundFixed[i] = luma[i] << 8;
+      }
+    }
+
+    for (int by = 0; by < MOTION_BLOCKS_Y; by++) {
+      for (int bx = 0; bx < MOTION_BLOCKS_X; bx++) {
+        int block = by * MOTION_BLOCKS_X + bx;
+        size_t offset = (size_t)by * MOTION_BLOCK * MOTION_WIDTH + bx * MOTION_BLOCK;
+        uint32_t sad = kernel(luma + offset, background + offset, MOTION_WIDTH);
+        uint32_t threshold = noise[block] * MOTION_NOISE_FACTOR;
+        bool active = !isLearning() && sad > (threshold > MOTION_MIN_SAD ? threshold : MOTION_MIN_SAD);
+
+        sads[block] = sad;
+
+        if (!active) {
+          noise[block] += ((int32_t)sad - (int32_t)noise[block]) >> MOTION_NOISE_SHIFT;
+          learn(luma, offset, MOTION_LEARN_SHIFT);
+          continue;
+        }
+
+        learn(luma, offset, MOTION_HOLD_SHIFT);
+        result.activeBlocks++;
+        result.left = bx < result.left ? bx : result.left;
+        result.top = by < result.top ? by : result.top;
+        result.right = bx > result.right ? bx : result.right;
+        result.bottom = by > result.bottom ? by : result.bottom;
+      }
+    }
+
+    if (frames < MOTION_WARMUP_FRAMES) {
+      frames++;
+    }
+
+    return result;
+  }
+
+  uint32_t blockSad(int block) const {
+    return sads[block];
+  }
+
+private:
+  MotionSadKernel kernel;
+  uint32_t frames;
+  alignas(4) uint8_t background[MOTION_WIDTH * MOTION_HEIGHT];
+  uint16_t backgroundFixed[MOTION_WIDTH * MOTION_HEIGHT]; // 8.8 fixed point
+  uint32_t noise[MOTION_BLOCKS];
+  uint32_t sads[MOTION_BLOCKS];
+
+  void learn(const uint8_t *luma, size_t offset, int shift) {
+    for (int y = 0; y < MOTION_BLOCK; y++) {
+      size_t row = offset + (size_t)y * MOTION_WIDTH;
+
+      for (int x = 0; x < MOTION_BLOCK; x++) {
+        uint16_t &fixed = backgroundFixed[row + x];
+        fixed += ((int32_t)(luma[row + x] << 8) - fixed) >> shift;
+        background[row + x] = fixed >> 8;
+      }
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#include <stdint.h>
+
+// Effort is a signed drive command in [-MOTION_MAX_EFFORT, MOTION_MAX_EFFORT],
+// linear in what the motor should deliver. Mapping it onto PWM (and around
+// the deadband) is left to the caller.
+#define MOTION_MAX_EFFORT 255
+#define MOTION_DEFAULT_ACCEL 2500  // effort / s
+#define MOTION_DEFAULT_JERK 25000  // effort / s^2
+
+// Integer square root, bit by bit
+inline uint32_t isqrt64(uint64_t value) {
+  uint64_t result = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+
+  while (bit > value) {
+    bit >>= 2;
+  }
+
+  while (bit) {
+    if (value >= result + bit) {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return (uint32_t)result;
+}
+
+enum class ProfileShape : uint8_t {
+  TRAPEZOID = 0, // constant acceleration
+  S_CURVE        // acceleration itself ramps with a jerk limit
+};
+
+// Fixed-point velocity profiler driven by elapsed time. Velocity is kept in
+// 1/256 effort units and acceleration in 1/256 effort per second, so a 5 ms
+// control tick still moves by fractions of one effort step.
+class MotionProfile {
+public:
+  MotionProfile()
+      : shape(ProfileShape::S_CURVE),
+        maxAccel(MOTION_DEFAULT_ACCEL * 256L),
+        jerk(MOTION_DEFAULT_JERK * 256L),
+        velocity(0),
+        accel(0),
+        target(0) {}
+
+  void configure(ProfileShape profileShape, int32_t maxAccelPerSec, int32_t jerkPerSec2) {
+    shape = profileShape;
+    maxAccel = (maxAccelPerSec > 0 ? maxAccelPerSec : 1) * 256L;
+    jerk = (jerkPerSec2 > 0 ? jerkPerSec2 : 1) * 256L;
+  }
+
+  void setTarget(int16_t effort) {
+    target = clampEffort(effort) * 256L;
+  }
+
+  // Jumps to effort without a ramp
+  void reset(int16_t effort = 0) {
+    target = clampEffort(effort) * 256L;
+    velocity = target;
+    accel = 0;
+  }
+
+  // Advances the profile by dtUs and returns the effort to apply
+  int16_t update(uint32_t dtUs) {
+    int32_t error = target - velocity;
+
+    if (error == 0) {
+      accel = 0;
+      return getEffort();
+    }
+
+    int32_t meanAccel;
+
+    if (shape == ProfileShape::TRAPEZOID) {
+      accel = error > 0 ? maxAccel : -maxAccel;
+      meanAccel = accel;
+    } else {
+      // Largest acceleration that can still be ramped back to zero by the
+      // time the velocity reaches the target: a^2 / (2 * jerk) <= |error|,
+      // less what the current acceleration adds during this tick
+      int32_t remaining = (error > 0 ? error : -error) - (int64_t)(accel > 0 ? accel : -accel) * dtUs / 1000000;
+      int32_t wanted = remaining > 0 ? isqrt64((uint64_t)2 * jerk * (uint32_t)remaining) : 0;
+      if (wanted > maxAccel) {
+        wanted = maxAccel;
+      }
+      if (error < 0) {
+        wanted = -wanted;
+      }
+
+      int32_t jerkStep = (int64_t)jerk * dtUs / 1000000;
+      if (jerkStep < 1) {
+        jerkStep = 1;
+      }
+
+      int32_t previousAccel = accel;
+
+      if (accel < wanted) {
+        accel = accel + jerkStep < wanted ? accel + jerkStep : wanted;
+      } else if (accel > wanted) {
+        accel = accel - jerkStep > wanted ? accel - jerkStep : wanted;
+      }
+
+      // Mean over the tick, or the velocity runs ahead of the jerk ramp
+      meanAccel = previousAccel / 2 + accel / 2;
+    }
+
+    int32_t step = (int64_t)meanAccel * dtUs / 1000000;
+    if (step == 0) {
+      step = error > 0 ? 1 : -1;
+    }
+
+    velocity += step;
+
+    // Never overshoot, land on the target and drop the acceleration
+    if ((error > 0 && velocity >= target) || (error < 0 && velocity <= target)) {
+      velocity = target;
+      accel = 0;
+    }
+
+    return getEffort();
+  }
+
+  int16_t getEffort() const {
+    // Ceiling of the magnitude: any velocity off rest reports at least one
+    // effort step, so the profile reports zero only at rest
+    return velocity >= 0 ? (velocity + 255) >> 8 : -((-velocity + 255) >> 8);
+  }
+
+  int16_t getTarget() const {
+    return target / 256;
+  }
+
+  bool isSettled() const {
+    return velocity == target;
+  }
+
+private:
+  ProfileShape shape;
+  int32_t maxAccel; // 1/256 effort per second
+  int32_t jerk;     // 1/256 effort per second^2
+  int32_t velocity; // 1/256 effort
+  int32_t accel;    // 1/256 effort per second
+  int32_t target;   // 1/256 effort
+
+  static int16_t clampEffort(int16_t effort) {
+    if (effort > MOTION_MAX_EFFORT) {
+      return MOTION_MAX_EFFORT;
+    }
+    if (effort < -MOTION_MAX_EFFORT) {
+      return -MOTION_MAX_EFFORT;
+    }
+
+    return effort;
+  }
+};
+
+#endif
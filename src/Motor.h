@@ -1,8 +1,12 @@
 #pragma once
+#include "Hal.h"
+#include "MotionProfile.h"
+#include "Perf.h"
 #include "utils.h"
 #include <Arduino.h>
 
 #define MOTOR_PWM_FREQ 1000
+#define MOTOR_OUTPUT_UNKNOWN 256 // outside the signed PWM range, forces the first write
 class Motor {
 public:
   enum class Direction : uint8_t {
@@ -15,12 +19,7 @@ public:
       : _pinIN1(pinIN1), _pinIN2(pinIN2),
         _pwmChannel1(pwmChannel1), _pwmChannel2(pwmChannel2),
         _minPwm(0),
-        _currentSpeed(0),
-        _targetSpeed(0),
-        _direction(Direction::STOP),
-        _accelStep(5),
-        _updateInterval(30),
-        _lastUpdate(0) {}
+        _output(MOTOR_OUTPUT_UNKNOWN) {}
 
   void begin() {
     pinMode(_pinIN1, OUTPUT);
@@ -35,84 +34,98 @@ public:
     stop();
   }
 
+  // Hands the pins to another peripheral; begin() takes them back. Both
+  // inputs are left low, so the driver coasts until the new owner takes over.
+  void end() {
+    stop();
+    ledcDetachPin(_pinIN1);
+    ledcDetachPin(_pinIN2);
+    halDigitalWrite(_pinIN1, LOW);
+    halDigitalWrite(_pinIN2, LOW);
+  }
+
+  // Lowest PWM that still turns the wheels. Any non-zero effort starts here,
+  // so the profile never spends time ramping through the dead zone.
   void setMinPwm(uint8_t minPwm) {
-    _minPwm = constrain(minPwm, 0, 255);
+    _minPwm = constrain(minPwm, 0, 254);
   }
 
-  void setRamp(uint8_t accelStep, uint16_t updateInterval) {
-    _accelStep = constrain(accelStep, 1, 50);
-    _updateInterval = constrain(updateInterval, 5, 100);
+  void setProfile(ProfileShape shape, int32_t maxAccelPerSec, int32_t jerkPerSec2) {
+    _profile.configure(shape, maxAccelPerSec, jerkPerSec2);
   }
 
+  // Speeds are PWM duties; anything below the deadband runs at _minPwm
   void moveForward(uint8_t targetSpeed = 255) {
-    _direction = Direction::FORWARD;
-    _targetSpeed = constrain(targetSpeed, _minPwm, 255);
+    _profile.setTarget(effortFor(targetSpeed));
   }
 
   void moveBackward(uint8_t targetSpeed = 255) {
-    _direction = Direction::BACKWARD;
-    _targetSpeed = constrain(targetSpeed, _minPwm, 255);
+    _profile.setTarget(-effortFor(targetSpeed));
+  }
+
+  // Signed effort in [-MOTION_MAX_EFFORT, MOTION_MAX_EFFORT], 0 ramps down
+  void drive(int16_t effort) {
+    _profile.setTarget(effort);
+  }
+
+  // Ramps down to zero along the profile
+  void coast() {
+    _profile.setTarget(0);
   }
 
+  // Cuts the output right away
   void stop() {
-    _direction = Direction::STOP;
-    _targetSpeed = 0;
-    _currentSpeed = 0;
+    _profile.reset(0);
+    apply(0);
   }
 
-  void tick() {
-    int64_t diff = elapsedSince(_lastUpdate);
+  // Called by the control loop with the time since its previous tick.
+  // Reversals pass through zero along the profile instead of flipping polarity.
+  void tick(uint32_t dtUs) {
+    PERF_SCOPE(perfMotorTick);
+    apply(_profile.update(dtUs));
+  }
 
-    if (diff < _updateInterval) {
-      return;
-    }
+  bool isSettled() const {
+    return _profile.isSettled();
+  }
 
-    _lastUpdate = nowMs();
+private:
+  int _pinIN1, _pinIN2;
+  int _pwmChannel1, _pwmChannel2;
 
-    if (_direction == Direction::STOP) {
-      ledcWrite(_pwmChannel1, 0);
-      ledcWrite(_pwmChannel2, 0);
-      _currentSpeed = 0;
+  uint8_t _minPwm;
+  int16_t _output; // signed PWM currently on the pins
+  MotionProfile _profile;
 
-      return;
+  // Inverse of pwmFor: the smallest effort that yields a PWM >= speed
+  int16_t effortFor(uint8_t speed) const {
+    if (speed <= _minPwm) {
+      return 1;
     }
 
-    if (_currentSpeed == 0 && _targetSpeed > 0) {
-      _currentSpeed = _minPwm;
-    }
+    return 1 + ((int32_t)(speed - _minPwm) * (MOTION_MAX_EFFORT - 1) + (255 - _minPwm) - 1) / (255 - _minPwm);
+  }
 
-    if (_currentSpeed < _targetSpeed) {
-      _currentSpeed = std::min<uint8_t>(_currentSpeed + _accelStep, _targetSpeed);
-    } else if (_currentSpeed > _targetSpeed) {
-      _currentSpeed = std::max<uint8_t>(_currentSpeed - _accelStep, _targetSpeed);
+  // Effort 1..MOTION_MAX_EFFORT maps linearly onto _minPwm..255
+  uint8_t pwmFor(int16_t effort) const {
+    if (effort <= 0) {
+      return 0;
     }
 
-    switch (_direction) {
-    case Direction::FORWARD:
-      ledcWrite(_pwmChannel1, _currentSpeed);
-      ledcWrite(_pwmChannel2, 0);
-      DEBUG_PRINTF_LN("Motor FORWARD - Speed: %d", _currentSpeed);
-      break;
-    case Direction::BACKWARD:
-      ledcWrite(_pwmChannel1, 0);
-      ledcWrite(_pwmChannel2, _currentSpeed);
-      DEBUG_PRINTF_LN("Motor BACKWARD - Speed: %d", _currentSpeed);
-      break;
-    default:
-      break;
-    }
+    return _minPwm + (int32_t)(effort - 1) * (255 - _minPwm) / (MOTION_MAX_EFFORT - 1);
   }
 
-private:
-  int _pinIN1, _pinIN2;
-  int _pwmChannel1, _pwmChannel2;
+  void apply(int16_t effort) {
+    int16_t output = effort >= 0 ? pwmFor(effort) : -pwmFor(-effort);
 
-  uint8_t _minPwm;
-  uint8_t _currentSpeed;
-  uint8_t _targetSpeed;
-  Direction _direction;
+    if (output == _output) {
+      return;
+    }
 
-  uint8_t _accelStep;
-  uint16_t _updateInterval;
-  unsigned long _lastUpdate;
+    _output = output;
+    halPwmWrite(_pwmChannel1, output > 0 ? output : 0);
+    halPwmWrite(_pwmChannel2, output < 0 ? -output : 0);
+    DEBUG_PRINTF_LN("Motor output: %d", output);
+  }
 };
@@ -0,0 +1,160 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Per-call cost probes for the control hot paths, listed under "perf" in
+// /trace. Off by default; the probes compile to nothing unless built with
+//
+//   -D PERF_PROBES                CPU cycles and DEBUG_PRINT* calls per call
+//   -D PERF_COUNT_ALLOCS          also heap allocations per call, needs
+//      -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+//
+// Allocation and print counters are global, so a task preempting a probed
+// call is counted against it; that is rare for calls this short.
+
+#define PERF_PROBE_COUNT 5
+
+#ifdef PERF_COUNT_ALLOCS
+std::atomic<uint32_t> perfAllocations(0);
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  perfAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  perfAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  perfAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __real_realloc(ptr, size);
+}
+}
+#endif
+
+std::atomic<uint32_t> perfDebugPrints(0);
+
+// Called by the DEBUG_PRINT* macros in probe builds
+void perfCountDebugPrint() {
+  perfDebugPrints.fetch_add(1, std::memory_order_relaxed);
+}
+
+class PerfProbe {
+public:
+  explicit PerfProbe(const char *probeName)
+      : name(probeName) {
+    reset();
+  }
+
+  void record(uint32_t cycles, uint32_t allocs, uint32_t prints) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    totalCycles.fetch_add(cycles, std::memory_order_relaxed);
+    totalAllocs.fetch_add(allocs, std::memory_order_relaxed);
+    totalPrints.fetch_add(prints, std::memory_order_relaxed);
+
+    uint32_t seen = maxCycles.load(std::memory_order_relaxed);
+    while (cycles > seen && !maxCycles.compare_exchange_weak(seen, cycles, std::memory_order_relaxed)) {
+    }
+  }
+
+  void reset() {
+    calls = 0;
+    totalCycles = 0;
+    maxCycles = 0;
+    totalAllocs = 0;
+    totalPrints = 0;
+  }
+
+  const char *getName() const {
+    return name;
+  }
+
+  uint32_t getCalls() const {
+    return calls;
+  }
+
+  uint32_t getMeanCycles() const {
+    uint32_t n = calls;
+    return n ? totalCycles / n : 0;
+  }
+
+  uint32_t getMaxCycles() const {
+    return maxCycles;
+  }
+
+  // Per call, in hundredths so rare prints or allocations still show up
+  uint32_t getAllocsPer100() const {
+    uint32_t n = calls;
+    return n ? (uint64_t)totalAllocs * 100 / n : 0;
+  }
+
+  uint32_t getPrintsPer100() const {
+    uint32_t n = calls;
+    return n ? (uint64_t)totalPrints * 100 / n : 0;
+  }
+
+private:
+  const char *name;
+  std::atomic<uint32_t> calls;
+  std::atomic<uint64_t> totalCycles;
+  std::atomic<uint32_t> maxCycles;
+  std::atomic<uint32_t> totalAllocs;
+  std::atomic<uint32_t> totalPrints;
+};
+
+// Measures the enclosing block into a probe
+class PerfScope {
+public:
+  explicit PerfScope(PerfProbe &target)
+      : probe(target),
+        startAllocs(allocations()),
+        startPrints(perfDebugPrints.load(std::memory_order_relaxed)),
+        startCycles(ESP.getCycleCount()) {}
+
+  ~PerfScope() {
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+    probe.record(cycles, allocations() - startAllocs, perfDebugPrints.load(std::memory_order_relaxed) - startPrints);
+  }
+
+private:
+  PerfProbe &probe;
+  uint32_t startAllocs;
+  uint32_t startPrints;
+  uint32_t startCycles;
+
+  static uint32_t allocations() {
+#ifdef PERF_COUNT_ALLOCS
+    return perfAllocations.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+  }
+};
+
+#ifdef PERF_PROBES
+PerfProbe perfTextCommand("text_command");
+PerfProbe perfBinaryCommand("binary_command");
+PerfProbe perfFrameSizeLookup("frame_size_lookup");
+PerfProbe perfMotorTick("motor_tick");
+PerfProbe perfServoUpdate("servo_update");
+
+PerfProbe *const perfProbes[PERF_PROBE_COUNT] = {&perfTextCommand, &perfBinaryCommand, &perfFrameSizeLookup,
+                                                 &perfMotorTick, &perfServoUpdate};
+
+#define PERF_SCOPE_NAME(line) perfScope##line
+#define PERF_SCOPE_AT(probe, line) PerfScope PERF_SCOPE_NAME(line)(probe)
+#define PERF_SCOPE(probe) PERF_SCOPE_AT(probe, __LINE__)
+#else
+#define PERF_SCOPE(probe)
+#endif
+
+#endif
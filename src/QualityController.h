@@ -0,0 +1,199 @@
+#ifndef QUALITY_CONTROLLER_H
+#define QUALITY_CONTROLLER_H
+
+#include "esp_camera.h"
+#include <stdint.h>
+
+#define QUALITY_WINDOW_MS 1000
+#define QUALITY_DOWN_WINDOWS 2   // consecutive bad windows before stepping down
+#define QUALITY_UP_WINDOWS 5     // consecutive good windows before stepping up
+#define QUALITY_HOLDOFF_WINDOWS 10 // good windows required right after a step down
+#define QUALITY_RSSI_WEAK -80
+#define QUALITY_RSSI_GOOD -72
+
+struct QualityLevel {
+  framesize_t frameSize;
+  uint8_t quality; // esp32-camera scale, lower is better
+};
+
+// Ordered from the cheapest to the most expensive stream
+static const QualityLevel QUALITY_LADDER[] = {
+    {FRAMESIZE_QVGA, 30},
+    {FRAMESIZE_QVGA, 20},
+    {FRAMESIZE_HVGA, 20},
+    {FRAMESIZE_HVGA, 14},
+    {FRAMESIZE_VGA, 20},
+    {FRAMESIZE_VGA, 14},
+    {FRAMESIZE_VGA, 10},
+    {FRAMESIZE_SVGA, 12},
+    {FRAMESIZE_SVGA, 10},
+    {FRAMESIZE_XGA, 12},
+    {FRAMESIZE_HD, 12},
+    {FRAMESIZE_UXGA, 12}};
+
+static const int QUALITY_LEVELS = sizeof(QUALITY_LADDER) / sizeof(QUALITY_LADDER[0]);
+
+// What one stream viewer achieved during the last window
+struct LinkSample {
+  uint32_t frames;
+  uint32_t bytes;
+  uint32_t sendUs; // total time spent inside send()
+  uint32_t windowUs;
+  uint32_t targetIntervalUs;
+  int rssi; // dBm, 0 when unknown
+};
+
+class QualityController {
+public:
+  enum class Reason : uint8_t {
+    NONE = 0,
+    LINK,
+    RSSI,
+    RECOVER
+  };
+
+  QualityController()
+      : _level(0),
+        _ceiling(QUALITY_LEVELS - 1),
+        _badWindows(0),
+        _goodWindows(0),
+        _upThreshold(QUALITY_UP_WINDOWS),
+        _reason(Reason::NONE) {}
+
+  // Starts from the ladder step closest to the current sensor settings
+  void reset(framesize_t frameSize, int quality) {
+    setCeiling(frameSize);
+
+    _level = 0;
+    for (int i = 0; i <= _ceiling; i++) {
+      if (QUALITY_LADDER[i].frameSize <= frameSize && QUALITY_LADDER[i].quality >= quality) {
+        _level = i;
+      }
+    }
+
+    _badWindows = 0;
+    _goodWindows = 0;
+    _upThreshold = QUALITY_UP_WINDOWS;
+    _reason = Reason::NONE;
+  }
+
+  // The largest frame size the controller may step up to
+  void setCeiling(framesize_t frameSize) {
+    _ceiling = 0;
+    for (int i = 0; i < QUALITY_LEVELS; i++) {
+      if (QUALITY_LADDER[i].frameSize <= frameSize) {
+        _ceiling = i;
+      }
+    }
+
+    if (_level > _ceiling) {
+      _level = _ceiling;
+    }
+  }
+
+  // Returns true when the ladder step changed
+  bool update(const LinkSample &sample) {
+    if (sample.windowUs == 0 || sample.targetIntervalUs == 0) {
+      return false;
+    }
+
+    // Everything below is in percent of the target rate / interval
+    uint32_t fpsPercent = (uint64_t)sample.frames * sample.targetIntervalUs * 100 / sample.windowUs;
+    uint32_t sendPercent = sample.frames
+                               ? (uint64_t)sample.sendUs * 100 / sample.frames / sample.targetIntervalUs
+                               : 100;
+    bool weakSignal = sample.rssi != 0 && sample.rssi < QUALITY_RSSI_WEAK;
+    bool severe = sample.frames == 0 || fpsPercent < 35;
+    bool bad = severe || fpsPercent < 70 || sendPercent > 90 || weakSignal;
+    bool good = fpsPercent >= 90 && sendPercent < 50 && (sample.rssi == 0 || sample.rssi > QUALITY_RSSI_GOOD);
+
+    if (bad) {
+      _goodWindows = 0;
+      _badWindows++;
+
+      // A stalled stream can't wait for the usual confirmation window
+      if (severe) {
+        return stepDown(2, Reason::LINK);
+      }
+
+      if (_badWindows >= QUALITY_DOWN_WINDOWS) {
+        return stepDown(1, weakSignal ? Reason::RSSI : Reason::LINK);
+      }
+
+      return false;
+    }
+
+    _badWindows = 0;
+
+    if (!good) {
+      _goodWindows = 0;
+      return false;
+    }
+
+    _goodWindows++;
+
+    if (_goodWindows < _upThreshold || _level >= _ceiling) {
+      return false;
+    }
+
+    _level++;
+    _goodWindows = 0;
+    _upThreshold = QUALITY_UP_WINDOWS;
+    _reason = Reason::RECOVER;
+
+    return true;
+  }
+
+  framesize_t getFrameSize() const {
+    return QUALITY_LADDER[_level].frameSize;
+  }
+
+  int getQuality() const {
+    return QUALITY_LADDER[_level].quality;
+  }
+
+  int getLevel() const {
+    return _level;
+  }
+
+  Reason getReason() const {
+    return _reason;
+  }
+
+  static const char *reasonToString(Reason reason) {
+    switch (reason) {
+    case Reason::LINK:
+      return "link";
+    case Reason::RSSI:
+      return "rssi";
+    case Reason::RECOVER:
+      return "recover";
+    default:
+      return "none";
+    }
+  }
+
+private:
+  int _level;
+  int _ceiling;
+  uint8_t _badWindows;
+  uint8_t _goodWindows;
+  uint8_t _upThreshold;
+  Reason _reason;
+
+  bool stepDown(int steps, Reason reason) {
+    _badWindows = 0;
+    _upThreshold = QUALITY_HOLDOFF_WINDOWS;
+
+    if (_level == 0) {
+      return false;
+    }
+
+    _level = _level > steps ? _level - steps : 0;
+    _reason = reason;
+
+    return true;
+  }
+};
+
+#endif
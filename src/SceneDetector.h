@@ -0,0 +1,196 @@
+#ifndef SCENE_DETECTOR_H
+#define SCENE_DETECTOR_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SCENE_REGIONS 16
+#define SCENE_STATIC_FRAMES 10 // unchanged frames in a row before the stream slows down
+#define SCENE_KEEPALIVE_US 1000000 // frame interval while the scene is static
+#define SCENE_TOTAL_TOLERANCE_PCT 2 // sensor noise moves the JPEG size about 1%
+#define SCENE_REGION_TOLERANCE_PCT 10
+#define SCENE_REGION_SLACK_BYTES 48 // keeps nearly empty regions from flapping
+
+// Compressed size of the whole frame and of horizontal bands of it. A JPEG
+// only grows or shrinks where the picture changed, so comparing sizes per
+// band catches a small object moving that the total alone would hide.
+struct SceneSignature {
+  uint32_t total;
+  uint16_t regionCount;
+  uint32_t regions[SCENE_REGIONS];
+};
+
+// Decides per captured frame whether it is worth sending to stream viewers.
+// After SCENE_STATIC_FRAMES frames without change only one frame per
+// SCENE_KEEPALIVE_US goes out; a changed frame or poke() restores the full
+// rate at once. Frames are compared with the last one sent, so slow drift
+// adds up until it counts as a change. Consumers on the car (sentry, the SD
+// recorder) are not subject to it.
+//
+// shouldPublish() belongs to the capture task, poke() is safe from any task.
+class SceneDetector {
+public:
+  SceneDetector()
+      : enabled(true),
+        poked(false),
+        staticScene(false),
+        suppressedFrames(0),
+        unchangedFrames(0),
+        lastPublishedUs(0),
+        haveReference(false) {
+    memset(&reference, 0, sizeof(reference));
+  }
+
+  bool shouldPublish(const uint8_t *jpeg, size_t len, int64_t nowUs) {
+    SceneSignature current;
+    sign(jpeg, len, current);
+
+    bool changed = !haveReference || differs(reference, current);
+
+    if (poked.exchange(false, std::memory_order_relaxed) || changed || !enabled.load(std::memory_order_relaxed)) {
+      unchangedFrames = 0;
+      staticScene.store(false, std::memory_order_relaxed);
+    } else if (unchangedFrames < SCENE_STATIC_FRAMES && ++unchangedFrames == SCENE_STATIC_FRAMES) {
+      staticScene.store(true, std::memory_order_relaxed);
+    }
+
+    if (staticScene.load(std::memory_order_relaxed) && nowUs - lastPublishedUs < SCENE_KEEPALIVE_US) {
+      suppressedFrames.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    reference = current;
+    haveReference = true;
+    lastPublishedUs = nowUs;
+    return true;
+  }
+
+  // A drive or camera command is about to change the picture
+  void poke() {
+    poked.store(true, std::memory_order_relaxed);
+  }
+
+  void setEnabled(bool on) {
+    enabled.store(on, std::memory_order_relaxed);
+  }
+
+  bool isEnabled() const {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  bool isStatic() const {
+    return staticScene.load(std::memory_order_relaxed);
+  }
+
+  uint32_t getSuppressedFrames() const {
+    return suppressedFrames.load(std::memory_order_relaxed);
+  }
+
+  // Bands are the restart intervals of the entropy-coded data, folded into
+  // SCENE_REGIONS groups. Encoders that emit no restart markers (the
+  // software frame2jpg among them) yield a single band, the total size.
+  static void sign(const uint8_t *jpeg, size_t len, SceneSignature &signature) {
+    memset(&signature, 0, sizeof(signature));
+    signature.total = len;
+
+    size_t start = scanStart(jpeg, len);
+    uint32_t markers = 0;
+
+    for (size_t i = nextRestart(jpeg, len, start); i < len; i = nextRestart(jpeg, len, i + 2)) {
+      markers++;
+    }
+
+    uint32_t intervals = markers + 1;
+    signature.regionCount = intervals < SCENE_REGIONS ? intervals : SCENE_REGIONS;
+
+    size_t segmentStart = start;
+    uint32_t segment = 0;
+
+    for (size_t i = nextRestart(jpeg, len, start);; i = nextRestart(jpeg, len, i + 2)) {
+      size_t end = i < len ? i : len;
+      signature.regions[(uint64_t)segment * signature.regionCount / intervals] += end - segmentStart;
+
+      if (i >= len) {
+        break;
+      }
+
+      segmentStart = i;
+      segment++;
+    }
+  }
+
+  static bool differs(const SceneSignature &a, const SceneSignature &b) {
+    if (a.regionCount != b.regionCount || exceeds(a.total, b.total, SCENE_TOTAL_TOLERANCE_PCT, 0)) {
+      return true;
+    }
+
+    for (int i = 0; i < a.regionCount; i++) {
+      if (exceeds(a.regions[i], b.regions[i], SCENE_REGION_TOLERANCE_PCT, SCENE_REGION_SLACK_BYTES)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+private:
+  std::atomic<bool> enabled;
+  std::atomic<bool> poked;
+  std::atomic<bool> staticScene;
+  std::atomic<uint32_t> suppressedFrames;
+  uint32_t unchangedFrames;
+  int64_t lastPublishedUs;
+  bool haveReference;
+  SceneSignature reference;
+
+  static bool exceeds(uint32_t a, uint32_t b, uint32_t tolerancePct, uint32_t slack) {
+    uint32_t diff = a > b ? a - b : b - a;
+    uint32_t larger = a > b ? a : b;
+
+    return diff > slack && (uint64_t)diff * 100 > (uint64_t)larger * tolerancePct;
+  }
+
+  // First byte after the start-of-scan header, 0 when there is none
+  static size_t scanStart(const uint8_t *jpeg, size_t len) {
+    // Walk the header segments after SOI by their lengths
+    size_t i = 2;
+
+    while (i + 3 < len && jpeg[i] == 0xFF) {
+      size_t segmentEnd = i + 2 + ((jpeg[i + 2] << 8) | jpeg[i + 3]);
+
+      if (jpeg[i + 1] == 0xDA) {
+        return segmentEnd < len ? segmentEnd : len;
+      }
+
+      i = segmentEnd;
+    }
+
+    return 0;
+  }
+
+  // Offset of the next RSTn marker at or after from, len if none
+  static size_t nextRestart(const uint8_t *jpeg, size_t len, size_t from) {
+    while (from + 1 < len) {
+      const uint8_t *ff = (const uint8_t *)memchr(jpeg + from, 0xFF, len - from - 1);
+
+      if (!ff) {
+        break;
+      }
+
+      size_t i = ff - jpeg;
+      if (jpeg[i + 1] >= 0xD0 && jpeg[i + 1] <= 0xD7) {
+        return i;
+      }
+
+      from = i + 1;
+    }
+
+    return len;
+  }
+};
+
+SceneDetector sceneDetector;
+
+#endif
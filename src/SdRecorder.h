@@ -0,0 +1,197 @@
+#ifndef SD_RECORDER_H
+#define SD_RECORDER_H
+
+#include "AviRecorder.h"
+#include "ControlLoop.h"
+#include "FrameHub.h"
+#include "FrameTrace.h"
+#include <Arduino.h>
+#include <SD_MMC.h>
+#include <atomic>
+#include <sys/stat.h>
+
+#define RECORDER_FPS 10
+#define RECORDER_MOUNT "/sdcard"
+#define RECORDER_DIR RECORDER_MOUNT "/car"
+#define RECORDER_SD_DAT3_PIN 13
+#define RECORDER_TASK_CORE 1
+#define RECORDER_TASK_PRIORITY 2 // below capture, the stream comes first
+// A control tick is 5 ms, the handover only waits for the queue to drain
+#define RECORDER_HANDOVER_TIMEOUT_MS 500
+
+// Events handed to the handler:
+//   RECORD-FAIL   the card could not be mounted or a write failed
+typedef void (*RecorderEventHandler)(const char *message);
+
+// Records the hub's frames to the SD card as MJPEG-AVI. Like sentry mode the
+// task has an internal hub slot, so it gets the latest frame at RECORDER_FPS
+// and never holds up capture or the stream; a slow card only means fewer
+// frames in the file. The card shares pins with the motors (see
+// Car::releaseSdPins), so the car does not drive while this runs. Only built
+// with -D SD_RECORDING.
+class SdRecorder {
+public:
+  SdRecorder()
+      : task(nullptr),
+        enabled(false),
+        eventHandler(nullptr) {}
+
+  bool start() {
+    if (xTaskCreatePinnedToCore(taskEntry, "RecorderTask", 4096, this, RECORDER_TASK_PRIORITY, &task, RECORDER_TASK_CORE) !=
+        pdPASS) {
+      DEBUG_PRINTLN("Failed to start recorder task");
+      return false;
+    }
+
+    return true;
+  }
+
+  void setEventHandler(RecorderEventHandler handler) {
+    eventHandler = handler;
+  }
+
+  void setEnabled(bool on) {
+    enabled = on;
+
+    if (on && task) {
+      xTaskNotifyGive(task);
+    }
+  }
+
+  bool isEnabled() const {
+    return enabled;
+  }
+
+  const AviRecorder &getRecorder() const {
+    return recorder;
+  }
+
+  // Muxing one frame, including the block writes it triggered
+  const LatencyHistogram &getFrameTime() const {
+    return frameTime;
+  }
+
+private:
+  TaskHandle_t task;
+  std::atomic<bool> enabled;
+  RecorderEventHandler eventHandler;
+  AviRecorder recorder;
+  LatencyHistogram frameTime;
+
+  static void taskEntry(void *arg) {
+    ((SdRecorder *)arg)->run();
+  }
+
+  static void *allocateBlock(size_t bytes) {
+    return heap_caps_malloc(bytes, MALLOC_CAP_DMA);
+  }
+
+  static void *allocateIndex(size_t bytes) {
+    return ps_malloc(bytes);
+  }
+
+  void run() {
+    for (;;) {
+      if (!enabled) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        continue;
+      }
+
+      if (!mount()) {
+        fail();
+        continue;
+      }
+
+      if (!recorder.begin(allocateBlock, allocateIndex) || !recorder.start(RECORDER_DIR) || !frameHub.subscribeInternal(task)) {
+        DEBUG_PRINTLN("Recorder: no memory or no free hub consumer slot");
+        recorder.stop();
+        recorder.end();
+        unmount();
+        fail();
+        continue;
+      }
+
+      frameHub.setViewerInterval(task, 1000000UL / RECORDER_FPS);
+      DEBUG_PRINTLN("Recording to SD card");
+
+      uint32_t lastSeq = 0;
+      int64_t nextFrameUs = 0;
+      bool ok = true;
+
+      while (enabled && ok) {
+        int64_t wait = nextFrameUs - esp_timer_get_time();
+        if (wait > 1000) {
+          delay(wait / 1000);
+        }
+
+        SharedFrame *frame = frameHub.acquire(lastSeq, pdMS_TO_TICKS(1000));
+        if (!frame) {
+          continue;
+        }
+
+        nextFrameUs = esp_timer_get_time() + 1000000UL / RECORDER_FPS;
+        lastSeq = frame->seq;
+
+        // The hub keeps a slot for every consumer, so holding the frame through
+        // a block write costs the others nothing
+        int64_t startUs = esp_timer_get_time();
+        ok = recorder.addFrame(frame->buf, frame->len, frame->width, frame->height,
+                               (int64_t)frame->timestamp.tv_sec * 1000000LL + frame->timestamp.tv_usec);
+        frameTime.record(esp_timer_get_time() - startUs);
+        frameHub.release(frame);
+      }
+
+      frameHub.unsubscribe(task);
+      ok = recorder.stop() && ok;
+      recorder.end();
+      unmount();
+      DEBUG_PRINTF_LN("Recording stopped, %u files closed", recorder.getFilesClosed());
+
+      if (!ok) {
+        fail();
+      }
+    }
+  }
+
+  // The pins change hands on the control task, between two ticks
+  bool mount() {
+    if (!controlLoop.handOverSdPins(true, RECORDER_HANDOVER_TIMEOUT_MS)) {
+      // It may still be applied late, the reclaim queues up behind it
+      controlLoop.handOverSdPins(false, RECORDER_HANDOVER_TIMEOUT_MS);
+      return false;
+    }
+
+    // A low DAT3 at card init selects SPI mode; the motor driver held it low
+    pinMode(RECORDER_SD_DAT3_PIN, INPUT_PULLUP);
+
+    if (!SD_MMC.begin(RECORDER_MOUNT, true)) {
+      DEBUG_PRINTLN("Recorder: no SD card");
+      controlLoop.handOverSdPins(false, RECORDER_HANDOVER_TIMEOUT_MS);
+      return false;
+    }
+
+    mkdir(RECORDER_DIR, 0755);
+    return true;
+  }
+
+  void unmount() {
+    SD_MMC.end();
+    controlLoop.handOverSdPins(false, RECORDER_HANDOVER_TIMEOUT_MS);
+  }
+
+  void fail() {
+    enabled = false;
+
+    if (eventHandler) {
+      eventHandler("RECORD-FAIL");
+    }
+  }
+};
+
+SdRecorder sdRecorder;
+
+bool startSdRecorder() {
+  return sdRecorder.start();
+}
+
+#endif
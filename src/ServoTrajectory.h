@@ -0,0 +1,119 @@
+#ifndef SERVO_TRAJECTORY_H
+#define SERVO_TRAJECTORY_H
+
+#include "MotionProfile.h"
+#include <stdint.h>
+
+#define SERVO_DEFAULT_MAX_VELOCITY 360 // deg / s
+#define SERVO_DEFAULT_MAX_ACCEL 2000   // deg / s^2
+
+// Time-based trajectory for one servo axis. Position is kept in millidegrees
+// and velocity in millidegrees per second; each update accelerates toward the
+// fastest speed from which the axis can still brake onto the target, so a new
+// target mid-motion is blended into the current velocity instead of
+// restarting from rest.
+class ServoTrajectory {
+public:
+  ServoTrajectory(int minAngle, int maxAngle, int initialAngle)
+      : minMdeg(minAngle * 1000L),
+        maxMdeg(maxAngle * 1000L),
+        maxVelocity(SERVO_DEFAULT_MAX_VELOCITY * 1000L),
+        maxAccel(SERVO_DEFAULT_MAX_ACCEL * 1000L) {
+    reset(initialAngle);
+  }
+
+  void setLimits(int32_t maxVelocityDegPerSec, int32_t maxAccelDegPerSec2) {
+    maxVelocity = (maxVelocityDegPerSec > 0 ? maxVelocityDegPerSec : 1) * 1000L;
+    maxAccel = (maxAccelDegPerSec2 > 0 ? maxAccelDegPerSec2 : 1) * 1000L;
+  }
+
+  void setTarget(int angle) {
+    target = clampMdeg(angle * 1000L);
+  }
+
+  // Jumps to angle and stops there
+  void reset(int angle) {
+    target = clampMdeg(angle * 1000L);
+    position = target;
+    velocity = 0;
+    output = getAngle();
+  }
+
+  // Advances by dtUs; returns true when the integer angle changed
+  bool update(uint32_t dtUs) {
+    int32_t error = target - position;
+
+    if (error == 0 && velocity == 0) {
+      return false;
+    }
+
+    // v^2 = 2 * a * d: the speed that still stops exactly at the target,
+    // from where the current speed leaves the axis after this tick
+    int32_t remaining = (error > 0 ? error : -error) - (int64_t)(velocity > 0 ? velocity : -velocity) * dtUs / 1000000;
+    int32_t wanted = remaining > 0 ? isqrt64((uint64_t)2 * maxAccel * (uint32_t)remaining) : 0;
+    if (wanted > maxVelocity) {
+      wanted = maxVelocity;
+    }
+    if (error < 0) {
+      wanted = -wanted;
+    }
+
+    int32_t accelStep = (int64_t)maxAccel * dtUs / 1000000;
+    int32_t previousVelocity = velocity;
+
+    if (velocity < wanted) {
+      velocity = velocity + accelStep < wanted ? velocity + accelStep : wanted;
+    } else if (velocity > wanted) {
+      velocity = velocity - accelStep > wanted ? velocity - accelStep : wanted;
+    }
+
+    // Mean speed over the tick, or the position runs ahead of the ramp
+    int32_t step = ((int64_t)previousVelocity + velocity) * dtUs / 2000000;
+    position += step;
+
+    // Land on the target once it is reached or passed while braking
+    if ((error >= 0 && position >= target && velocity >= 0) || (error <= 0 && position <= target && velocity <= 0)) {
+      position = target;
+      velocity = 0;
+    }
+
+    position = clampMdeg(position);
+
+    int angle = getAngle();
+    if (angle == output) {
+      return false;
+    }
+
+    output = angle;
+    return true;
+  }
+
+  // Rounded to the nearest degree
+  int getAngle() const {
+    return (position + 500) / 1000;
+  }
+
+  int getTargetAngle() const {
+    return (target + 500) / 1000;
+  }
+
+  bool isSettled() const {
+    return position == target && velocity == 0;
+  }
+
+private:
+  int32_t minMdeg;
+  int32_t maxMdeg;
+  int32_t maxVelocity; // mdeg / s
+  int32_t maxAccel;    // mdeg / s^2
+  int32_t position;    // mdeg
+  int32_t velocity;    // mdeg / s
+  int32_t target;      // mdeg
+  int output;          // last angle reported by update()
+
+  int32_t clampMdeg(int32_t mdeg) const {
+    return mdeg < minMdeg ? minMdeg : mdeg > maxMdeg ? maxMdeg : mdeg;
+  }
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef WS_RX_POOL_H
+#define WS_RX_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest WebSocket payload the control server accepts. Text commands are
+// well below this and binary frames are CAR_FRAME_SIZE bytes.
+#define WS_MAX_FRAME_LEN 128
+// One slot per socket httpd can keep open on the control port
+#define WS_RX_POOL_SIZE 8
+
+// Preallocated receive buffers keyed by socket fd. Only used from the httpd
+// task (handlers and the close callback), so it needs no locking.
+class WsRxPool {
+public:
+  WsRxPool()
+      : framesReceived(0),
+        slotClaims(0),
+        oversizeRejects(0),
+        exhaustedRejects(0) {
+    for (int i = 0; i < WS_RX_POOL_SIZE; i++) {
+      slots[i].fd = -1;
+    }
+  }
+
+  // Returns a buffer of WS_MAX_FRAME_LEN + 1 bytes owned by the socket, or
+  // nullptr if the frame is too large or every slot is taken
+  uint8_t *acquire(int fd, size_t len) {
+    if (len > WS_MAX_FRAME_LEN) {
+      oversizeRejects++;
+      return nullptr;
+    }
+
+    Slot *freeSlot = nullptr;
+
+    for (int i = 0; i < WS_RX_POOL_SIZE; i++) {
+      if (slots[i].fd == fd) {
+        framesReceived++;
+        return slots[i].data;
+      }
+
+      if (slots[i].fd < 0 && !freeSlot) {
+        freeSlot = &slots[i];
+      }
+    }
+
+    if (!freeSlot) {
+      exhaustedRejects++;
+      return nullptr;
+    }
+
+    freeSlot->fd = fd;
+    slotClaims++;
+    framesReceived++;
+
+    return freeSlot->data;
+  }
+
+  void release(int fd) {
+    for (int i = 0; i < WS_RX_POOL_SIZE; i++) {
+      if (slots[i].fd == fd) {
+        slots[i].fd = -1;
+      }
+    }
+  }
+
+  int slotsInUse() const {
+    int count = 0;
+
+    for (int i = 0; i < WS_RX_POOL_SIZE; i++) {
+      if (slots[i].fd >= 0) {
+        count++;
+      }
+    }
+
+    return count;
+  }
+
+  // Connections that got a slot, one per socket's first frame. Slots are
+  // part of the pool, so this counts sockets, not allocations; the pool
+  // never allocates (test/test_ws_rx_pool counts malloc calls to check).
+  uint32_t getSlotClaims() const {
+    return slotClaims;
+  }
+
+  uint32_t getFramesReceived() const {
+    return framesReceived;
+  }
+
+  uint32_t getOversizeRejects() const {
+    return oversizeRejects;
+  }
+
+  uint32_t getExhaustedRejects() const {
+    return exhaustedRejects;
+  }
+
+private:
+  struct Slot {
+    int fd;
+    uint8_t data[WS_MAX_FRAME_LEN + 1]; // room for a terminating NUL
+  };
+
+  Slot slots[WS_RX_POOL_SIZE];
+  uint32_t framesReceived;
+  uint32_t slotClaims;
+  uint32_t oversizeRejects;
+  uint32_t exhaustedRejects;
+};
+
+#endif
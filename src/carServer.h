@@ -1,10 +1,36 @@
-#include "LittleFS.h"
-#include "car.h"
+#include "AssetCache.h"
+#include "AviWriter.h"
+#include "CarProtocol.h"
+#include "ClipRing.h"
+#include "ControlLoop.h"
+#include "FrameHub.h"
+#include "FrameTrace.h"
+#include "Metrics.h"
+#include "MotionDetector.h"
+#include "QualityController.h"
+#ifdef SD_RECORDING
+#include "SdRecorder.h"
+#endif
+#include "WsRxPool.h"
+#include "Car.h"
 #include "esp_camera.h"
 #include "esp_http_server.h"
+#include "lwip/sockets.h"
 #include <WiFiManager.h>
-
-bool isClientActive = false;
+#include <atomic>
+
+std::atomic<uint8_t> streamTargetFps(STREAM_TARGET_FPS);
+std::atomic<bool> autoQualityEnabled(false);
+std::atomic<bool> autoQualityResetPending(false);
+static QualityController qualityController;
+static FrameTrace frameTrace;
+static WsRxPool wsRxPool;
+static AssetCache assetCache;
+static CounterMetric streamFramesSent("car_stream_frames_sent_total", "MJPEG frames written to stream viewers");
+static CounterMetric streamBytesSent("car_stream_bytes_sent_total", "MJPEG bytes written to stream viewers, part headers included");
+static CounterMetric wsTextCommands("car_ws_text_commands_total", "Text commands received on /ws");
+static CounterMetric wsBinaryCommands("car_ws_binary_commands_total", "Binary command frames received on /ws");
+static CounterMetric clipExports("car_clip_exports_total", "Clip exports served on /clip");
 static httpd_handle_t stream_httpd = NULL;
 static httpd_handle_t camera_httpd = NULL;
 extern Car car;
@@ -29,164 +55,389 @@ void sendResponse(httpd_req_t *req, const char *message) {
   }
 }
 
-static esp_err_t serveStaticFile(httpd_req_t *req, const char *filepath) {
-  String path = filepath;
+struct BroadcastMessage {
+  httpd_handle_t server;
+  int fd; // -1 for every /ws client
+  char text[64];
+};
+
+static void broadcastWork(void *arg) {
+  BroadcastMessage *message = (BroadcastMessage *)arg;
+  int fds[CONFIG_LWIP_MAX_SOCKETS];
+  size_t count = CONFIG_LWIP_MAX_SOCKETS;
+
+  if (message->fd >= 0) {
+    fds[0] = message->fd;
+    count = 1;
+  } else if (httpd_get_client_list(message->server, &count, fds) != ESP_OK) {
+    count = 0;
+  }
 
-  const char *type = "text/plain";
-  if (path.endsWith(".html"))
-    type = "text/html";
-  else if (path.endsWith(".js"))
-    type = "application/javascript";
-  else if (path.endsWith(".css"))
-    type = "text/css";
-  else if (path.endsWith(".png"))
-    type = "image/png";
-  else if (path.endsWith(".jpg") || path.endsWith(".jpeg"))
-    type = "image/jpeg";
-  else if (path.endsWith(".ico"))
-    type = "image/x-icon";
+  httpd_ws_frame_t res;
+  memset(&res, 0, sizeof(res));
+  res.payload = (uint8_t *)message->text;
+  res.len = strlen(message->text);
+  res.type = HTTPD_WS_TYPE_TEXT;
 
-  File file = LittleFS.open(path, "r");
-  if (!file) {
-    DEBUG_PRINTF_LN("404 Not Found: %s", path.c_str());
-    httpd_resp_send_404(req);
-    return ESP_FAIL;
+  for (size_t i = 0; i < count; i++) {
+    if (httpd_ws_get_fd_info(message->server, fds[i]) == HTTPD_WS_CLIENT_WEBSOCKET) {
+      httpd_ws_send_frame_async(message->server, fds[i], &res);
+    }
   }
 
-  httpd_resp_set_type(req, type);
+  free(message);
+}
 
-  char chunk[512];
-  size_t chunksize;
-  do {
-    chunksize = file.readBytes(chunk, sizeof(chunk));
-    if (chunksize > 0) {
-      if (httpd_resp_send_chunk(req, chunk, chunksize) != ESP_OK) {
-        file.close();
-        return ESP_FAIL;
-      }
+static void queueTextMessage(int fd, const char *text) {
+  if (!camera_httpd || !text) {
+    return;
+  }
+
+  BroadcastMessage *message = (BroadcastMessage *)malloc(sizeof(BroadcastMessage));
+  if (!message) {
+    return;
+  }
+
+  message->server = camera_httpd;
+  message->fd = fd;
+  strlcpy(message->text, text, sizeof(message->text));
+
+  if (httpd_queue_work(camera_httpd, broadcastWork, message) != ESP_OK) {
+    free(message);
+  }
+}
+
+// Sends a text message to every connected /ws client from any task
+void broadcastResponse(const char *text) {
+  DEBUG_PRINTF_LN("Broadcast: %s", text);
+  queueTextMessage(-1, text);
+}
+
+// Sockets that asked for ACK / NACK replies with OP_ACK. httpd task only.
+static int ackSockets[WS_RX_POOL_SIZE];
+
+static bool wantsAcks(int fd) {
+  for (int i = 0; i < WS_RX_POOL_SIZE; i++) {
+    if (ackSockets[i] == fd) {
+      return true;
     }
-  } while (chunksize > 0);
+  }
 
-  file.close();
-  httpd_resp_send_chunk(req, NULL, 0);
-  return ESP_OK;
+  return false;
 }
 
-void handleCarCommand(const char *command, httpd_req_t *req) {
-  DEBUG_PRINTF_LN("Command handler received: %s", command);
+static void setWantsAcks(int fd, bool enabled) {
+  for (int i = 0; i < WS_RX_POOL_SIZE; i++) {
+    if (ackSockets[i] == fd) {
+      ackSockets[i] = -1;
+    }
+  }
 
-  if (strcmp(command, "toggleFlash") == 0) {
-    car.toggleFlash();
+  for (int i = 0; i < WS_RX_POOL_SIZE && enabled; i++) {
+    if (ackSockets[i] < 0) {
+      ackSockets[i] = fd;
+      return;
+    }
+  }
+}
 
-    const char *response = car.getFlashState() ? "Flash-ON" : "Flash-OFF";
-    sendResponse(req, response);
+int readRSSI() {
+  return (WiFi.getMode() & WIFI_MODE_AP) ? getClientRSSI() : WiFi.RSSI();
+}
+
+void formatAutoQualityState(char *buffer, size_t size) {
+  sensor_t *s = halCameraSensor();
+  framesize_t frameSize = s ? s->status.framesize : FRAMESIZE_INVALID;
+  int quality = s ? s->status.quality : 0;
+
+  snprintf(buffer, size, "AUTOQ-%d-%s-%d-%s", (bool)autoQualityEnabled, frameSizeToString(frameSize), quality,
+           QualityController::reasonToString(qualityController.getReason()));
+}
+
+static void toggleFlash(httpd_req_t *req) {
+  car.toggleFlash();
 
+  const char *response = car.getFlashState() ? "Flash-ON" : "Flash-OFF";
+  sendResponse(req, response);
+}
+
+static void sendPong(httpd_req_t *req) {
+  int rssi = readRSSI();
+  const char *flashState = car.getFlashState() ? "ON" : "OFF";
+  char response[40];
+
+  snprintf(response, sizeof(response), "pong-%d-%s", abs(rssi), flashState);
+  sendResponse(req, response);
+}
+
+static void changeFrameSize(framesize_t newSize) {
+  sensor_t *s = halCameraSensor();
+
+  if (!s || newSize < 0 || newSize >= FRAMESIZE_INVALID) {
     return;
   }
 
+  s->set_framesize(s, newSize);
+  DEBUG_PRINTF_LN("✅ Frame size changed to %s", frameSizeToString(newSize));
+
+  // A manual choice becomes the new upper bound for the adaptive mode
+  autoQualityResetPending = true;
+}
+
+static void setAutoQuality(bool enabled, httpd_req_t *req) {
+  autoQualityEnabled = enabled;
+  autoQualityResetPending = true;
+
+  char response[64];
+  formatAutoQualityState(response, sizeof(response));
+  sendResponse(req, response);
+}
+
+// A drive or camera command is about to change the picture: restore the full
+// frame rate and relearn the motion background without waiting for either
+// detector to see it
+static void expectPictureChange() {
+  sceneDetector.poke();
+  motionDetector.rebase();
+}
+
+static void setSentry(bool enabled, httpd_req_t *req) {
+  motionDetector.setEnabled(enabled);
+  sendResponse(req, enabled ? "SENTRY-1" : "SENTRY-0");
+}
+
+#ifdef SD_RECORDING
+static void setRecording(bool enabled, httpd_req_t *req) {
+  sdRecorder.setEnabled(enabled);
+  sendResponse(req, enabled ? "RECORD-1" : "RECORD-0");
+}
+#endif
+
+static void setStaticSkip(bool enabled, httpd_req_t *req) {
+  sceneDetector.setEnabled(enabled);
+  sendResponse(req, enabled ? "STATICSKIP-1" : "STATICSKIP-0");
+}
+
+static void setTargetFps(int fps) {
+  streamTargetFps = constrain(fps, STREAM_MIN_FPS, STREAM_MAX_FPS);
+  DEBUG_PRINTF_LN("Stream target fps set to %d", (int)streamTargetFps);
+}
+
+struct MoveCommandName {
+  const char *name;
+  MoveDirection direction;
+};
+
+static const MoveCommandName MOVE_COMMAND_NAMES[] = {
+    {"forward", MOVE_FORWARD},
+    {"backward", MOVE_BACKWARD},
+    {"left", MOVE_LEFT},
+    {"right", MOVE_RIGHT},
+    {"forward-left", MOVE_FORWARD_LEFT},
+    {"forward-right", MOVE_FORWARD_RIGHT},
+    {"backward-left", MOVE_BACKWARD_LEFT},
+    {"backward-right", MOVE_BACKWARD_RIGHT},
+    {"stop", MOVE_STOP}};
+
+void handleCarCommand(const char *command, httpd_req_t *req) {
+  PERF_SCOPE(perfTextCommand);
+  DEBUG_PRINTF_LN("Command handler received: %s", command);
+
+  // Drag and movement arrive many times per second, check them first
   if (strncmp(command, "cameraDrag_", 11) == 0) {
     int x, y;
 
     if (sscanf(command + 11, "%d_%d", &x, &y) == 2) {
-      car.setCameraPosition(x, y);
+      expectPictureChange();
+      controlLoop.submit(CarCommandType::CAMERA, x, y);
     }
 
     return;
   }
 
-  if (strncmp(command, "frameSize_", 10) == 0) {
-    const char *sizeName = command + 10;
-    sensor_t *s = esp_camera_sensor_get();
+  for (const MoveCommandName &move : MOVE_COMMAND_NAMES) {
+    if (strcmp(command, move.name) == 0) {
+      expectPictureChange();
+      controlLoop.submit(CarCommandType::MOVE, move.direction);
 
-    if (!s) {
       return;
     }
+  }
 
-    framesize_t newSize = stringToFrameSize(sizeName);
-
-    s->set_framesize(s, newSize);
-    DEBUG_PRINTF_LN("✅ Frame size changed to %s", sizeName);
+  if (strcmp(command, "toggleFlash") == 0) {
+    toggleFlash(req);
 
     return;
   }
 
-  if (strcmp(command, "reset") == 0) {
-    wm.resetSettings();
-    ESP.restart();
+  if (strncmp(command, "frameSize_", 10) == 0) {
+    framesize_t frameSize;
+    {
+      PERF_SCOPE(perfFrameSizeLookup);
+      frameSize = stringToFrameSize(command + 10);
+    }
+    changeFrameSize(frameSize);
 
     return;
   }
 
-  if (strcmp(command, "ping") == 0) {
-    int rssi = (WiFi.getMode() & WIFI_MODE_AP) ? getClientRSSI() : WiFi.RSSI();
-    const char *flashState = car.getFlashState() ? "ON" : "OFF";
-    char response[40];
-    
-    snprintf(response, sizeof(response), "pong-%d-%s", abs(rssi), flashState);
-    sendResponse(req, response);
+  if (strncmp(command, "autoQuality_", 12) == 0) {
+    setAutoQuality(command[12] == '1', req);
+
     return;
   }
 
-  if (strcmp(command, "forward") == 0) {
-    car.moveForward();
+  if (strncmp(command, "sentry_", 7) == 0) {
+    setSentry(command[7] == '1', req);
 
     return;
   }
 
-  if (strcmp(command, "backward") == 0) {
-    car.moveBackward();
+#ifdef SD_RECORDING
+  if (strncmp(command, "record_", 7) == 0) {
+    setRecording(command[7] == '1', req);
 
     return;
   }
+#endif
 
-  if (strcmp(command, "left") == 0) {
-    car.turnLeft();
+  if (strncmp(command, "staticSkip_", 11) == 0) {
+    setStaticSkip(command[11] == '1', req);
 
     return;
   }
 
-  if (strcmp(command, "right") == 0) {
-    car.turnRight();
+  if (strncmp(command, "targetFps_", 10) == 0) {
+    setTargetFps(atoi(command + 10));
 
     return;
   }
 
-  if (strcmp(command, "forward-left") == 0) {
-    car.moveForwardLeft();
+  if (strcmp(command, "reset") == 0) {
+    wm.resetSettings();
+    ESP.restart();
 
     return;
   }
 
-  if (strcmp(command, "forward-right") == 0) {
-    car.moveForwardRight();
+  if (strcmp(command, "ping") == 0) {
+    sendPong(req);
 
     return;
   }
 
-  if (strcmp(command, "backward-left") == 0) {
-    car.moveBackwardLeft();
+  DEBUG_PRINTF_LN("Unknown command: %s", command);
+}
 
-    return;
-  }
 
-  if (strcmp(command, "backward-right") == 0) {
-    car.moveBackwardRight();
+static void onPingFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  sendPong(req);
+}
 
-    return;
+static void onToggleFlashFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  toggleFlash(req);
+}
+
+// Hands a binary command to the control loop. Sockets that enabled acks are
+// told right away when the queue is full, and later when the command acted.
+static void submitFrame(CarCommandType type, int16_t a, int16_t b, const CarCommandFrame &frame, httpd_req_t *req) {
+  int fd = httpd_req_to_sockfd(req);
+  bool acked = wantsAcks(fd);
+
+  expectPictureChange();
+
+  if (!controlLoop.submit(type, a, b, acked ? fd : -1, frame.seq) && acked) {
+    char message[16];
+    snprintf(message, sizeof(message), "NACK-%u", frame.seq);
+    sendResponse(req, message);
+  }
+}
+
+static void onMoveFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  if (frame.a >= 0 && frame.a < MOVE_COUNT) {
+    submitFrame(CarCommandType::MOVE, frame.a, 0, frame, req);
   }
+}
+
+static void onCameraFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  submitFrame(CarCommandType::CAMERA, frame.a, frame.b, frame, req);
+}
+
+static void onFrameSizeFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  changeFrameSize((framesize_t)frame.a);
+}
 
-  if (strcmp(command, "stop") == 0) {
-    car.stop();
+static void onTargetFpsFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  setTargetFps(frame.a);
+}
+
+static void onAutoQualityFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  setAutoQuality(frame.a != 0, req);
+}
 
+static void onDriveFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  submitFrame(CarCommandType::DRIVE, constrain(frame.a, -DRIVE_INPUT_MAX, DRIVE_INPUT_MAX),
+              constrain(frame.b, -DRIVE_INPUT_MAX, DRIVE_INPUT_MAX), frame, req);
+}
+
+static void onStaticSkipFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  setStaticSkip(frame.a != 0, req);
+}
+
+static void onSentryFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  setSentry(frame.a != 0, req);
+}
+
+#ifdef SD_RECORDING
+static void onRecordFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  setRecording(frame.a != 0, req);
+}
+#endif
+
+static void onAckFrame(const CarCommandFrame &frame, httpd_req_t *req) {
+  setWantsAcks(httpd_req_to_sockfd(req), frame.a != 0);
+  sendResponse(req, frame.a != 0 ? "ACKS-1" : "ACKS-0");
+}
+
+typedef void (*BinaryCommandHandler)(const CarCommandFrame &frame, httpd_req_t *req);
+
+// Indexed by CarOpcode
+static const BinaryCommandHandler binaryCommandHandlers[OP_COUNT] = {
+    nullptr,
+    onPingFrame,
+    onToggleFlashFrame,
+    onMoveFrame,
+    onCameraFrame,
+    onFrameSizeFrame,
+    onTargetFpsFrame,
+    onAutoQualityFrame,
+    onDriveFrame,
+    onAckFrame,
+    onStaticSkipFrame,
+    onSentryFrame,
+#ifdef SD_RECORDING
+    onRecordFrame};
+#else
+    nullptr};
+#endif
+
+void handleBinaryCommand(const uint8_t *data, size_t len, httpd_req_t *req) {
+  PERF_SCOPE(perfBinaryCommand);
+  CarCommandFrame frame;
+
+  if (!decodeCommandFrame(data, len, frame) || !binaryCommandHandlers[frame.opcode]) {
+    DEBUG_PRINTF_LN("Invalid binary command (%u bytes)", len);
     return;
   }
 
-  DEBUG_PRINTF_LN("Unknown command: %s", command);
+  binaryCommandHandlers[frame.opcode](frame, req);
 }
 
 static esp_err_t websocketHandler(httpd_req_t *req) {
   if (req->method == HTTP_GET) {
     DEBUG_PRINTLN("WebSocket connection requested" + String(WiFi.status()));
+    controlLoop.submit(CarCommandType::SESSION);
+
     const char *message = car.getFlashState() ? "Flash-ON" : "Flash-OFF";
 
     sendResponse(req, message);
@@ -197,13 +448,16 @@ static esp_err_t websocketHandler(httpd_req_t *req) {
     sendResponse(req, wifiStatus);
     vTaskDelay(300 / portTICK_PERIOD_MS);
 
-    sensor_t *s = esp_camera_sensor_get();
+    sensor_t *s = halCameraSensor();
     if (s) {
       const char *frameSizeName = frameSizeToString(s->status.framesize);
       char frameMsg[64];
       snprintf(frameMsg, sizeof(frameMsg), "FRAMESIZE-%s", frameSizeName);
       sendResponse(req, frameMsg);
       DEBUG_PRINTF_LN("📸 Current frame size: %s", frameSizeName);
+
+      formatAutoQualityState(frameMsg, sizeof(frameMsg));
+      sendResponse(req, frameMsg);
     } else {
       DEBUG_PRINTLN("⚠️ Camera sensor not found!");
     }
@@ -213,7 +467,6 @@ static esp_err_t websocketHandler(httpd_req_t *req) {
 
   httpd_ws_frame_t wsFrame;
   memset(&wsFrame, 0, sizeof(wsFrame));
-  wsFrame.type = HTTPD_WS_TYPE_TEXT;
 
   esp_err_t ret = httpd_ws_recv_frame(req, &wsFrame, 0);
   if (ret != ESP_OK)
@@ -222,109 +475,563 @@ static esp_err_t websocketHandler(httpd_req_t *req) {
   if (!wsFrame.len)
     return ESP_OK;
 
-  uint8_t *buffer = (uint8_t *)calloc(1, wsFrame.len + 1);
-  if (!buffer)
-    return ESP_ERR_NO_MEM;
+  uint8_t *buffer = wsRxPool.acquire(httpd_req_to_sockfd(req), wsFrame.len);
+  if (!buffer) {
+    // Returning an error makes httpd drop the connection along with the unread payload
+    DEBUG_PRINTF_LN("WS frame rejected: %u bytes", wsFrame.len);
+    sendResponse(req, wsFrame.len > WS_MAX_FRAME_LEN ? "ERROR-frame-too-large" : "ERROR-busy");
+    return ESP_ERR_INVALID_SIZE;
+  }
 
   wsFrame.payload = buffer;
   ret = httpd_ws_recv_frame(req, &wsFrame, wsFrame.len);
 
-  if (ret == ESP_OK) {
+  if (ret == ESP_OK && wsFrame.type == HTTPD_WS_TYPE_BINARY) {
+    wsBinaryCommands.inc();
+    handleBinaryCommand(buffer, wsFrame.len, req);
+  } else if (ret == ESP_OK) {
+    wsTextCommands.inc();
     buffer[wsFrame.len] = '\0';
     handleCarCommand((char *)buffer, req);
   }
 
-  free(buffer);
-
   return ret;
 }
 
-static esp_err_t streamHandler(httpd_req_t *req) {
-  if (isClientActive) {
-    DEBUG_PRINTLN("Stream rejected - client already active");
-    httpd_resp_send_404(req);
-    return ESP_FAIL;
+// Replaces httpd's default close so per-socket receive buffers are freed
+static void onControlSocketClosed(httpd_handle_t server, int sockfd) {
+  wsRxPool.release(sockfd);
+  setWantsAcks(sockfd, false);
+  close(sockfd);
+}
+
+struct StreamViewer {
+  int fd;
+  TaskHandle_t task;
+  std::atomic<bool> inUse;
+  std::atomic<bool> closed;
+
+  // Reset by the quality task every QUALITY_WINDOW_MS
+  std::atomic<uint32_t> windowFrames;
+  std::atomic<uint32_t> windowBytes;
+  std::atomic<uint32_t> windowSendUs;
+
+  // Since the viewer connected or the last /trace?reset=1. The 64-bit ones
+  // take the atomic helpers' spinlock on Xtensa, like histogram sums.
+  std::atomic<int64_t> statsSinceUs;
+  std::atomic<uint32_t> totalFrames;
+  std::atomic<uint64_t> totalBytes;
+};
+
+static StreamViewer streamViewers[FRAME_HUB_MAX_VIEWERS];
+
+// Last lines of every response the port 81 tasks write straight to the socket
+#define RAW_HEADER_TAIL "Access-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n"
+
+static const char *STREAM_HEADER =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=frame\r\n"
+    "Cache-Control: no-cache\r\n" RAW_HEADER_TAIL;
+
+static int activeViewerCount() {
+  int count = 0;
+
+  for (int i = 0; i < FRAME_HUB_MAX_VIEWERS; i++) {
+    if (streamViewers[i].inUse) {
+      count++;
+    }
   }
 
-  isClientActive = true;
-  DEBUG_PRINTLN("Stream started - client locked");
+  return count;
+}
 
-  camera_fb_t *frameBuffer = NULL;
-  esp_err_t res = ESP_OK;
-  size_t jpgBufferLength = 0;
-  uint8_t *jpgBuffer = NULL;
+static void resetViewerTotals(StreamViewer *viewer) {
+  viewer->statsSinceUs = esp_timer_get_time();
+  viewer->totalFrames = 0;
+  viewer->totalBytes = 0;
+}
+
+static StreamViewer *claimViewer() {
+  for (int i = 0; i < FRAME_HUB_MAX_VIEWERS; i++) {
+    bool expected = false;
+
+    if (streamViewers[i].inUse.compare_exchange_strong(expected, true)) {
+      streamViewers[i].closed = false;
+      streamViewers[i].windowFrames = 0;
+      streamViewers[i].windowBytes = 0;
+      streamViewers[i].windowSendUs = 0;
+      resetViewerTotals(&streamViewers[i]);
+      return &streamViewers[i];
+    }
+  }
+
+  return nullptr;
+}
+
+// Called by httpd when the viewer socket is closed from either side
+static void onViewerSessionClosed(void *ctx) {
+  StreamViewer *viewer = (StreamViewer *)ctx;
+  viewer->closed = true;
+}
+
+static esp_err_t sendAll(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    int sent = send(fd, data, len, 0);
+
+    if (sent <= 0) {
+      return ESP_FAIL;
+    }
+
+    data += sent;
+    len -= sent;
+  }
+
+  return ESP_OK;
+}
+
+static void releaseViewer(StreamViewer *viewer) {
+  if (!viewer->closed) {
+    httpd_sess_trigger_close(stream_httpd, viewer->fd);
+
+    // The session context must stay valid until httpd drops the socket
+    for (int i = 0; i < 100 && !viewer->closed; i++) {
+      delay(10);
+    }
+  }
+
+  viewer->inUse = false;
+
+  if (activeViewerCount() == 0) {
+    DEBUG_PRINTLN("Stream ended - last viewer left");
+    controlLoop.submit(CarCommandType::MOVE, MOVE_STOP);
+    car.turnFlashOff();
+  }
+}
+
+static void streamSenderTask(void *param) {
+  StreamViewer *viewer = (StreamViewer *)param;
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  FramePacer pacer(streamTargetFps);
+  uint32_t lastSeq = 0;
   char part_buf[64];
 
-  sensor_t *s = esp_camera_sensor_get();
-  if (!s) {
-    DEBUG_PRINTLN("NO SENSOR DETECTED");
+  esp_err_t res = sendAll(viewer->fd, STREAM_HEADER, strlen(STREAM_HEADER));
+
+  if (res == ESP_OK && !frameHub.subscribe(self)) {
+    res = ESP_FAIL;
+  }
+
+  while (res == ESP_OK && !viewer->closed) {
+    SharedFrame *frame = frameHub.acquire(lastSeq, pdMS_TO_TICKS(1000));
+
+    if (!frame) {
+      continue;
+    }
+
+    // Held back by static-scene suppression, only the car's own consumers take it
+    if (frame->suppressed) {
+      lastSeq = frame->seq;
+      frameHub.release(frame);
+      continue;
+    }
+
+    FrameTraceRecord trace;
+    trace.dequeuedUs = esp_timer_get_time();
+    trace.capturedUs = (int64_t)frame->timestamp.tv_sec * 1000000LL + frame->timestamp.tv_usec;
+    trace.seq = frame->seq;
+    trace.len = frame->len;
+    trace.viewer = viewer - streamViewers;
+
+    lastSeq = frame->seq;
+
+    size_t headerLength = snprintf(part_buf, 64, "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n", frame->len);
+    res = sendAll(viewer->fd, part_buf, headerLength);
+    trace.headerSentUs = esp_timer_get_time();
+
+    if (res == ESP_OK) {
+      res = sendAll(viewer->fd, (const char *)frame->buf, frame->len);
+    }
+
+    trace.payloadSentUs = esp_timer_get_time();
+    size_t sentBytes = headerLength + frame->len;
+    frameHub.release(frame);
+    trace.returnedUs = esp_timer_get_time();
+
+    if (res != ESP_OK) {
+      break;
+    }
+
+    frameTrace.record(trace);
+
+    uint32_t sendUs = trace.payloadSentUs - trace.dequeuedUs;
+    viewer->windowFrames++;
+    viewer->windowBytes += sentBytes;
+    viewer->windowSendUs += sendUs;
+    viewer->totalFrames++;
+    viewer->totalBytes += sentBytes;
+    streamFramesSent.inc();
+    streamBytesSent.inc(sentBytes);
+
+    pacer.setTargetFps(streamTargetFps);
+    pacer.onFrameSent(sendUs, sentBytes);
+    frameHub.setViewerInterval(self, pacer.getIntervalUs());
+
+    uint32_t delayMs = pacer.nextDelayUs() / 1000;
+    if (delayMs > 0) {
+      delay(delayMs);
+    }
+  }
+
+  frameHub.unsubscribe(self);
+  releaseViewer(viewer);
+  vTaskDelete(NULL);
+}
+
+static esp_err_t streamHandler(httpd_req_t *req) {
+  StreamViewer *viewer = claimViewer();
+
+  if (!viewer) {
+    DEBUG_PRINTLN("Stream rejected - viewer limit reached");
     httpd_resp_send_404(req);
     return ESP_FAIL;
   }
 
-  res = httpd_resp_set_type(req, "multipart/x-mixed-replace;boundary=frame");
+  viewer->fd = httpd_req_to_sockfd(req);
+
+  // The sender task owns the socket from here on, httpd only tells us when it closes
+  req->sess_ctx = viewer;
+  req->free_ctx = onViewerSessionClosed;
 
-  if (res != ESP_OK) {
-    isClientActive = false;
-    return res;
+  if (xTaskCreate(streamSenderTask, "StreamSender", 4096, viewer, 4, &viewer->task) != pdPASS) {
+    DEBUG_PRINTLN("Failed to start stream sender");
+    req->sess_ctx = NULL;
+    req->free_ctx = NULL;
+    viewer->inUse = false;
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
   }
 
-  while (true) {
-    frameBuffer = esp_camera_fb_get();
-    if (!frameBuffer) {
-      delay(100);
-      continue;
+  DEBUG_PRINTF_LN("Stream started - %d viewer(s)", activeViewerCount());
+
+  return ESP_OK;
+}
+
+struct ClipExport {
+  int fd;
+  bool avi;
+  int64_t fromUs;
+  int64_t toUs;
+  std::atomic<bool> inUse;
+  std::atomic<bool> closed;
+};
+
+// One export at a time; it reads the ring without stopping capture or the stream
+static ClipExport clipExport;
+
+static void onClipSessionClosed(void *ctx) {
+  ClipExport *clip = (ClipExport *)ctx;
+  clip->closed = true;
+}
+
+// Ring entries inside the export window, oldest first
+static uint32_t planClip(const ClipExport *clip, ClipFrame *frames) {
+  uint32_t count = 0;
+  uint32_t end = clipRing.endFrame();
+
+  for (uint32_t n = clipRing.firstFrame(); n != end && count < CLIP_INDEX_SIZE; n++) {
+    ClipFrame frame;
+
+    if (clipRing.readEntry(n, frame) && frame.capturedUs >= clip->fromUs && frame.capturedUs <= clip->toUs) {
+      frames[count++] = frame;
     }
+  }
 
-    if (frameBuffer->format != PIXFORMAT_JPEG) {
-      bool convertedJpeg = frame2jpg(frameBuffer, 80, &jpgBuffer, &jpgBufferLength);
+  return count;
+}
 
-      esp_camera_fb_return(frameBuffer);
-      frameBuffer = NULL;
+// Sizes are planned up front so the AVI headers and Content-Length are right.
+// A frame overwritten before it was sent becomes a JUNK chunk of the same size.
+static esp_err_t sendAviClip(int fd, const ClipFrame *frames, uint32_t count, uint8_t *jpeg) {
+  AviInfo info = {frames[0].width, frames[0].height, 1000000 / CLIP_FPS, count, 0, 0};
+  uint32_t filler[CLIP_INDEX_SIZE / 32] = {0};
+  uint8_t header[AVI_HEADER_SIZE];
+  char httpHeader[192];
+
+  for (uint32_t i = 0; i < count; i++) {
+    info.moviBytes += aviChunkBytes(frames[i].len);
+    info.maxFrameBytes = frames[i].len > info.maxFrameBytes ? frames[i].len : info.maxFrameBytes;
+  }
 
-      if (!convertedJpeg) {
-        continue;
-      }
+  if (count > 1) {
+    info.usPerFrame = (frames[count - 1].capturedUs - frames[0].capturedUs) / (count - 1);
+  }
+
+  snprintf(httpHeader, sizeof(httpHeader),
+           "HTTP/1.1 200 OK\r\nContent-Type: video/x-msvideo\r\nContent-Length: %u\r\n"
+           "Content-Disposition: attachment; filename=\"clip.avi\"\r\n" RAW_HEADER_TAIL,
+           aviFileBytes(info));
+  esp_err_t res = sendAll(fd, httpHeader, strlen(httpHeader));
+
+  if (res == ESP_OK) {
+    aviWriteHeader(header, info);
+    res = sendAll(fd, (const char *)header, AVI_HEADER_SIZE);
+  }
+
+  for (uint32_t i = 0; i < count && res == ESP_OK; i++) {
+    uint32_t len = frames[i].len;
+    uint32_t padded = len + (len & 1);
+
+    if (clipRing.copyFrame(frames[i], jpeg)) {
+      aviWriteFrameHeader(header, len);
+      jpeg[len] = 0;
     } else {
-      jpgBufferLength = frameBuffer->len;
-      jpgBuffer = frameBuffer->buf;
+      aviWriteFillerHeader(header, padded);
+      memset(jpeg, 0, padded);
+      filler[i / 32] |= 1u << (i % 32);
     }
 
+    res = sendAll(fd, (const char *)header, AVI_CHUNK_HEADER_SIZE);
+
     if (res == ESP_OK) {
-      size_t headerLength = snprintf(part_buf, 64, "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n", jpgBufferLength);
-      res = httpd_resp_send_chunk(req, part_buf, headerLength);
+      res = sendAll(fd, (const char *)jpeg, padded);
     }
+  }
 
-    if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, (const char *)jpgBuffer, jpgBufferLength);
+  if (res == ESP_OK) {
+    aviWriteIndexHeader(header, count);
+    res = sendAll(fd, (const char *)header, AVI_CHUNK_HEADER_SIZE);
+  }
+
+  uint32_t moviOffset = 4;
+
+  for (uint32_t i = 0; i < count && res == ESP_OK; i++) {
+    bool isFiller = filler[i / 32] & (1u << (i % 32));
+    uint32_t len = frames[i].len;
+
+    aviWriteIndexEntry(header, moviOffset, isFiller ? len + (len & 1) : len, isFiller);
+    res = sendAll(fd, (const char *)header, AVI_INDEX_ENTRY_SIZE);
+    moviOffset += aviChunkBytes(len);
+  }
+
+  return res;
+}
+
+// Concatenated JPEGs; frames overwritten meanwhile are left out
+static esp_err_t sendMjpegClip(int fd, const ClipFrame *frames, uint32_t count, uint8_t *jpeg) {
+  char httpHeader[192];
+
+  snprintf(httpHeader, sizeof(httpHeader),
+           "HTTP/1.1 200 OK\r\nContent-Type: video/x-motion-jpeg\r\n"
+           "Content-Disposition: attachment; filename=\"clip.mjpeg\"\r\n" RAW_HEADER_TAIL);
+  esp_err_t res = sendAll(fd, httpHeader, strlen(httpHeader));
+
+  for (uint32_t i = 0; i < count && res == ESP_OK; i++) {
+    if (clipRing.copyFrame(frames[i], jpeg)) {
+      res = sendAll(fd, (const char *)jpeg, frames[i].len);
     }
+  }
 
-    if (frameBuffer) {
-      esp_camera_fb_return(frameBuffer);
-      jpgBuffer = NULL;
-    } else if (jpgBuffer) {
-      free(jpgBuffer);
-      jpgBuffer = NULL;
+  return res;
+}
+
+static void clipSenderTask(void *param) {
+  ClipExport *clip = (ClipExport *)param;
+  ClipFrame *frames = (ClipFrame *)ps_malloc(CLIP_INDEX_SIZE * sizeof(ClipFrame));
+  uint32_t count = frames ? planClip(clip, frames) : 0;
+  uint32_t maxLen = 0;
+  uint8_t *jpeg = nullptr;
+
+  for (uint32_t i = 0; i < count; i++) {
+    maxLen = frames[i].len > maxLen ? frames[i].len : maxLen;
+  }
+
+  // One spare byte for the AVI padding
+  if (count > 0) {
+    jpeg = (uint8_t *)ps_malloc(maxLen + 1);
+  }
+
+  if (frames && count == 0) {
+    static const char *NO_FRAMES = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n"
+                                   "Content-Length: 19\r\n" RAW_HEADER_TAIL "No frames in range\n";
+    sendAll(clip->fd, NO_FRAMES, strlen(NO_FRAMES));
+  } else if (!jpeg) {
+    static const char *NO_MEMORY = "HTTP/1.1 503 Service Unavailable\r\nContent-Type: text/plain\r\n"
+                                   "Content-Length: 14\r\n" RAW_HEADER_TAIL "Out of memory\n";
+    sendAll(clip->fd, NO_MEMORY, strlen(NO_MEMORY));
+  } else if (clip->avi) {
+    sendAviClip(clip->fd, frames, count, jpeg);
+  } else {
+    sendMjpegClip(clip->fd, frames, count, jpeg);
+  }
+
+  DEBUG_PRINTF_LN("Clip export: %u frames as %s", count, clip->avi ? "AVI" : "MJPEG");
+  free(jpeg);
+  free(frames);
+  clipExports.inc();
+
+  if (!clip->closed) {
+    httpd_sess_trigger_close(stream_httpd, clip->fd);
+
+    for (int i = 0; i < 100 && !clip->closed; i++) {
+      delay(10);
     }
+  }
 
-    if (res != ESP_OK) {
-      break;
+  clip->inUse = false;
+  vTaskDelete(NULL);
+}
+
+// /clip?seconds=10&before_ms=0&format=mjpeg|avi exports the frames captured
+// in the seconds up to before_ms ago
+static esp_err_t clipHandler(httpd_req_t *req) {
+  char query[64];
+  char value[12];
+  int seconds = CLIP_SECONDS;
+  int beforeMs = 0;
+  bool avi = false;
+
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    if (httpd_query_key_value(query, "seconds", value, sizeof(value)) == ESP_OK) {
+      seconds = constrain(atoi(value), 1, CLIP_SECONDS);
+    }
+
+    if (httpd_query_key_value(query, "before_ms", value, sizeof(value)) == ESP_OK) {
+      beforeMs = constrain(atoi(value), 0, CLIP_SECONDS * 1000);
+    }
+
+    if (httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK) {
+      avi = strcmp(value, "avi") == 0;
+
+      if (!avi && strcmp(value, "mjpeg") != 0) {
+        httpd_resp_set_status(req, HTTPD_400);
+        return httpd_resp_sendstr(req, "format is mjpeg or avi");
+      }
     }
+  }
 
-    delay(50);
+  bool expected = false;
+
+  if (!clipRing.getCapacity() || !clipExport.inUse.compare_exchange_strong(expected, true)) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_sendstr(req, clipRing.getCapacity() ? "Clip export busy" : "No clip ring");
   }
 
-  isClientActive = false;
-  DEBUG_PRINTLN("Stream ended - client unlocked");
-  car.stop();
-  car.turnFlashOff();
-  return res;
+  clipExport.fd = httpd_req_to_sockfd(req);
+  clipExport.avi = avi;
+  clipExport.closed = false;
+  clipExport.toUs = esp_timer_get_time() - (int64_t)beforeMs * 1000;
+  clipExport.fromUs = clipExport.toUs - (int64_t)seconds * 1000000;
+
+  // Like the stream, the sender task owns the socket so httpd keeps serving
+  req->sess_ctx = &clipExport;
+  req->free_ctx = onClipSessionClosed;
+
+  if (xTaskCreate(clipSenderTask, "ClipSender", 4096, &clipExport, 3, nullptr) != pdPASS) {
+    DEBUG_PRINTLN("Failed to start clip sender");
+    req->sess_ctx = NULL;
+    req->free_ctx = NULL;
+    clipExport.inUse = false;
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+
+  return ESP_OK;
+}
+
+// Picks the viewer with the worst frame rate, one shared encoder has to suit it
+static bool collectLinkSample(LinkSample &sample, uint32_t windowUs) {
+  bool found = false;
+
+  for (int i = 0; i < FRAME_HUB_MAX_VIEWERS; i++) {
+    StreamViewer &viewer = streamViewers[i];
+    uint32_t frames = viewer.windowFrames.exchange(0);
+    uint32_t bytes = viewer.windowBytes.exchange(0);
+    uint32_t sendUs = viewer.windowSendUs.exchange(0);
+
+    if (!viewer.inUse || (found && frames >= sample.frames)) {
+      continue;
+    }
+
+    sample.frames = frames;
+    sample.bytes = bytes;
+    sample.sendUs = sendUs;
+    found = true;
+  }
+
+  sample.windowUs = windowUs;
+  sample.targetIntervalUs = 1000000UL / streamTargetFps;
+  sample.rssi = readRSSI();
+
+  return found;
+}
+
+static void qualityTask(void *param) {
+  int64_t lastWindow = esp_timer_get_time();
+  bool wasStatic = false;
+
+  for (;;) {
+    delay(QUALITY_WINDOW_MS);
+
+    int64_t now = esp_timer_get_time();
+    uint32_t windowUs = now - lastWindow;
+    lastWindow = now;
+
+    sensor_t *s = halCameraSensor();
+    if (!s) {
+      continue;
+    }
+
+    if (autoQualityResetPending.exchange(false)) {
+      qualityController.reset(s->status.framesize, s->status.quality);
+    }
+
+    // Keep-alive frames of a static scene say nothing about the link, skip
+    // every window that overlapped one
+    bool sceneStatic = sceneDetector.isStatic();
+    bool overlappedStatic = sceneStatic || wasStatic;
+    wasStatic = sceneStatic;
+
+    LinkSample sample;
+    if (!collectLinkSample(sample, windowUs) || !autoQualityEnabled || overlappedStatic) {
+      continue;
+    }
+
+    if (!qualityController.update(sample)) {
+      continue;
+    }
+
+    s->set_quality(s, qualityController.getQuality());
+    s->set_framesize(s, qualityController.getFrameSize());
+
+    char message[64];
+    formatAutoQualityState(message, sizeof(message));
+    broadcastResponse(message);
+  }
+}
+
+// Runs on the control task. Format: ACK-<seq>-<queue us>-<actuate us>, where
+// actuate is -1 when the command changed no output.
+static void onCommandAck(const CommandAck &ack) {
+  char message[48];
+
+  snprintf(message, sizeof(message), "ACK-%u-%u-%d", ack.seq, ack.queueUs, ack.actuateUs);
+  queueTextMessage(ack.fd, message);
+}
+
+// Runs on the control task, broadcastResponse only queues the send
+static void onAutoStop(uint32_t silenceUs, const CommandWatchdog &watchdog) {
+  char message[64];
+
+  // Format: AUTOSTOP-<silence ms>-<deadline ms>-<mean interval ms>-<jitter ms>
+  snprintf(message, sizeof(message), "AUTOSTOP-%u-%d-%d-%d", silenceUs / 1000, watchdog.getDeadlineUs() / 1000,
+           watchdog.getMeanUs() / 1000, watchdog.getDeviationUs() / 1000);
+  broadcastResponse(message);
 }
 
 static esp_err_t capturePhotoHandler(httpd_req_t *req) {
   camera_fb_t *fb = NULL;
   esp_err_t res = ESP_OK;
-  sensor_t *s = esp_camera_sensor_get();
+  sensor_t *s = halCameraSensor();
 
   if (!s) {
     DEBUG_PRINTLN("Camera sensor not found");
@@ -332,7 +1039,7 @@ static esp_err_t capturePhotoHandler(httpd_req_t *req) {
     return ESP_FAIL;
   }
 
-  fb = esp_camera_fb_get();
+  fb = halCameraGrab();
 
   if (!fb) {
     DEBUG_PRINTLN("Camera capture failed");
@@ -353,29 +1060,373 @@ static esp_err_t capturePhotoHandler(httpd_req_t *req) {
     DEBUG_PRINTF_LN("VGA JPEG sent: %u bytes", fb->len);
   }
 
-  esp_camera_fb_return(fb);
+  halCameraReturn(fb);
+  return res;
+}
+
+static esp_err_t sendTraceHistogram(httpd_req_t *req, const char *name, const LatencyHistogram &histogram, bool first) {
+  char line[160];
+
+  snprintf(line, sizeof(line), "%s\"%s\":{\"count\":%u,\"mean_us\":%u,\"p50_us\":%u,\"p90_us\":%u,\"p99_us\":%u,\"max_us\":%u,\"buckets\":[",
+           first ? "" : ",", name, histogram.count(), histogram.meanUs(),
+           histogram.percentileUs(50), histogram.percentileUs(90), histogram.percentileUs(99), histogram.getMaxUs());
+  esp_err_t res = httpd_resp_sendstr_chunk(req, line);
+
+  // Bucket i counts latencies in [2^i, 2^(i+1)) us
+  for (int i = 0; i < LATENCY_BUCKETS && res == ESP_OK; i++) {
+    snprintf(line, sizeof(line), "%s%u", i == 0 ? "" : ",", histogram.bucketCount(i));
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  if (res == ESP_OK) {
+    res = httpd_resp_sendstr_chunk(req, "]}");
+  }
+
+  return res;
+}
+
+static esp_err_t traceHandler(httpd_req_t *req) {
+  // httpd runs handlers one at a time, so a static snapshot is safe and keeps the stack small
+  static FrameTraceRecord records[FRAME_TRACE_RING_SIZE];
+  char line[320];
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  esp_err_t res = httpd_resp_sendstr_chunk(req, "{\"histograms\":{");
+
+  for (int stage = 0; stage < FrameTrace::STAGE_COUNT && res == ESP_OK; stage++) {
+    FrameTrace::Stage traceStage = (FrameTrace::Stage)stage;
+    res = sendTraceHistogram(req, FrameTrace::stageToString(traceStage), frameTrace.histogram(traceStage), stage == 0);
+  }
+
+  if (res == ESP_OK) {
+    snprintf(line, sizeof(line), "},\"control\":{\"rate_hz\":%d,\"ticks\":%u,\"overruns\":%u,\"dropped_commands\":%u,",
+             CONTROL_RATE_HZ, controlLoop.getTicks(), controlLoop.getOverruns(), controlLoop.getDroppedCommands());
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  if (res == ESP_OK) {
+    const CommandWatchdog &watchdog = car.getWatchdog();
+
+    snprintf(line, sizeof(line), "\"watchdog\":{\"trips\":%u,\"mean_us\":%d,\"deviation_us\":%d,\"deadline_us\":%d},",
+             watchdog.getTrips(), watchdog.getMeanUs(), watchdog.getDeviationUs(), watchdog.getDeadlineUs());
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  if (res == ESP_OK) {
+    res = sendTraceHistogram(req, "jitter", controlLoop.getJitter(), true);
+  }
+
+  if (res == ESP_OK) {
+    res = sendTraceHistogram(req, "tick", controlLoop.getTickTime(), false);
+  }
+
+  if (res == ESP_OK) {
+    res = sendTraceHistogram(req, "command_queue", controlLoop.getQueueDelay(), false);
+  }
+
+  if (res == ESP_OK) {
+    sensor_t *s = halCameraSensor();
+
+    snprintf(line, sizeof(line),
+             "},\"stream\":{\"frame_size\":\"%s\",\"quality\":%d,\"dropped_frames\":%u,\"pool_bytes\":%u,"
+             "\"high_water_bytes\":%u,\"slot_growths\":%u,\"static_skip\":%d,\"static_scene\":%d,"
+             "\"suppressed_frames\":%u,\"viewers\":[",
+             frameSizeToString(s ? s->status.framesize : FRAMESIZE_INVALID), s ? s->status.quality : 0,
+             frameHub.getDroppedFrames(), frameHub.getPoolBytes(), frameHub.getHighWaterBytes(), frameHub.getSlotGrowths(),
+             sceneDetector.isEnabled(), sceneDetector.isStatic(), sceneDetector.getSuppressedFrames());
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  int64_t now = esp_timer_get_time();
+  bool firstViewer = true;
+
+  for (int i = 0; i < FRAME_HUB_MAX_VIEWERS && res == ESP_OK; i++) {
+    StreamViewer &viewer = streamViewers[i];
+
+    if (!viewer.inUse) {
+      continue;
+    }
+
+    float seconds = (now - viewer.statsSinceUs) / 1000000.0f;
+    uint32_t frames = viewer.totalFrames;
+    uint64_t bytes = viewer.totalBytes;
+
+    snprintf(line, sizeof(line), "%s{\"viewer\":%d,\"seconds\":%.2f,\"frames\":%u,\"bytes\":%llu,\"fps\":%.2f,\"bytes_per_s\":%.0f}",
+             firstViewer ? "" : ",", i, seconds, frames, bytes, seconds > 0 ? frames / seconds : 0.0f,
+             seconds > 0 ? bytes / seconds : 0.0f);
+    res = httpd_resp_sendstr_chunk(req, line);
+    firstViewer = false;
+  }
+
+  if (res == ESP_OK) {
+    res = httpd_resp_sendstr_chunk(req, "],");
+  }
+
+  if (res == ESP_OK) {
+    res = sendTraceHistogram(req, "capture", frameHub.getCaptureTime(), true);
+  }
+
+  if (res == ESP_OK) {
+    res = httpd_resp_sendstr_chunk(req, "},\"frames\":[");
+  }
+
+  uint32_t count = frameTrace.snapshot(records);
+
+  for (uint32_t i = 0; i < count && res == ESP_OK; i++) {
+    const FrameTraceRecord &r = records[i];
+
+    // Stage times are offsets from the sensor timestamp
+    snprintf(line, sizeof(line), "%s{\"seq\":%u,\"viewer\":%u,\"len\":%u,\"captured_us\":%lld,\"dequeued\":%lld,\"header_sent\":%lld,\"payload_sent\":%lld,\"returned\":%lld}",
+             i == 0 ? "" : ",", r.seq, r.viewer, r.len, r.capturedUs, r.dequeuedUs - r.capturedUs,
+             r.headerSentUs - r.capturedUs, r.payloadSentUs - r.capturedUs, r.returnedUs - r.capturedUs);
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  if (res == ESP_OK) {
+    res = httpd_resp_sendstr_chunk(req, "]");
+  }
+
+#ifdef PERF_PROBES
+  if (res == ESP_OK) {
+    snprintf(line, sizeof(line), ",\"perf\":{\"cpu_mhz\":%u", getCpuFrequencyMhz());
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  for (int i = 0; i < PERF_PROBE_COUNT && res == ESP_OK; i++) {
+    const PerfProbe &probe = *perfProbes[i];
+
+    snprintf(line, sizeof(line), ",\"%s\":{\"calls\":%u,\"mean_cycles\":%u,\"max_cycles\":%u,\"allocs_per_100\":%u,\"prints_per_100\":%u}",
+             probe.getName(), probe.getCalls(), probe.getMeanCycles(), probe.getMaxCycles(), probe.getAllocsPer100(),
+             probe.getPrintsPer100());
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  if (res == ESP_OK) {
+    res = httpd_resp_sendstr_chunk(req, "}");
+  }
+#endif
+
+#ifdef HAL_RECORD_OUTPUTS
+  static HalOutputEvent outputs[HAL_RECORD_SIZE];
+
+  if (res == ESP_OK) {
+    res = httpd_resp_sendstr_chunk(req, ",\"outputs\":[");
+  }
+
+  count = halRecorder.snapshot(outputs);
+
+  for (uint32_t i = 0; i < count && res == ESP_OK; i++) {
+    const HalOutputEvent &e = outputs[i];
+
+    snprintf(line, sizeof(line), "%s{\"t_us\":%lld,\"kind\":\"%s\",\"channel\":%u,\"value\":%d}", i == 0 ? "" : ",",
+             e.timeUs, HalRecorder::kindToString(e.kind), e.channel, e.value);
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  if (res == ESP_OK) {
+    res = httpd_resp_sendstr_chunk(req, "]");
+  }
+#endif
+
+  if (res == ESP_OK) {
+    res = httpd_resp_sendstr_chunk(req, "}");
+  }
+
+  char query[16];
+  char value[4];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "reset", value, sizeof(value)) == ESP_OK && value[0] == '1') {
+    frameTrace.reset();
+    controlLoop.resetStats();
+    frameHub.getCaptureTime().reset();
+#ifdef PERF_PROBES
+    for (int i = 0; i < PERF_PROBE_COUNT; i++) {
+      perfProbes[i]->reset();
+    }
+#endif
+
+    for (int i = 0; i < FRAME_HUB_MAX_VIEWERS; i++) {
+      resetViewerTotals(&streamViewers[i]);
+    }
+#ifdef HAL_RECORD_OUTPUTS
+    halRecorder.reset();
+#endif
+  }
+
+  if (res == ESP_OK) {
+    res = httpd_resp_sendstr_chunk(req, NULL);
+  }
+
+  return res;
+}
+
+// Values other modules already track, read when /metrics is scraped
+static ReadoutMetric streamFramesDropped("car_stream_frames_dropped_total", "Captured frames replaced before any viewer took them",
+                                         MetricType::COUNTER, []() -> int64_t { return frameHub.getDroppedFrames(); });
+static ReadoutMetric streamPoolBytes("car_stream_pool_bytes", "PSRAM held by the frame slot buffers", MetricType::GAUGE,
+                                     []() -> int64_t { return frameHub.getPoolBytes(); });
+static ReadoutMetric streamHighWater("car_stream_frame_high_water_bytes", "Largest frame at the current resolution",
+                                     MetricType::GAUGE, []() -> int64_t { return frameHub.getHighWaterBytes(); });
+static ReadoutMetric streamSlotGrowths("car_stream_slot_growths_total", "Frame slot buffer reallocations",
+                                       MetricType::COUNTER, []() -> int64_t { return frameHub.getSlotGrowths(); });
+static ReadoutMetric streamSuppressedFrames("car_stream_static_suppressed_total", "Frames not sent because the scene was static",
+                                            MetricType::COUNTER, []() -> int64_t { return sceneDetector.getSuppressedFrames(); });
+static ReadoutMetric streamStaticScene("car_stream_static_scene", "1 while the stream runs at the keep-alive rate",
+                                       MetricType::GAUGE, []() -> int64_t { return sceneDetector.isStatic(); });
+static ReadoutMetric streamViewerCount("car_stream_viewers", "Connected MJPEG viewers", MetricType::GAUGE,
+                                       []() -> int64_t { return activeViewerCount(); });
+static ReadoutMetric wsFramesReceived("car_ws_frames_received_total", "WebSocket frames taken into receive buffers",
+                                      MetricType::COUNTER, []() -> int64_t { return wsRxPool.getFramesReceived(); });
+static ReadoutMetric wsSlotClaims("car_ws_rx_slot_claims_total", "Receive buffer slots claimed by new sockets",
+                                  MetricType::COUNTER, []() -> int64_t { return wsRxPool.getSlotClaims(); });
+static ReadoutMetric wsOversizeRejects("car_ws_oversize_rejects_total", "WebSocket frames rejected for length",
+                                       MetricType::COUNTER, []() -> int64_t { return wsRxPool.getOversizeRejects(); });
+static ReadoutMetric wsExhaustedRejects("car_ws_exhausted_rejects_total", "WebSocket frames rejected with every receive slot taken",
+                                        MetricType::COUNTER, []() -> int64_t { return wsRxPool.getExhaustedRejects(); });
+static ReadoutMetric controlDroppedCommands("car_control_dropped_commands_total", "Commands dropped on a full control queue",
+                                            MetricType::COUNTER, []() -> int64_t { return controlLoop.getDroppedCommands(); });
+static ReadoutMetric controlTicks("car_control_ticks_total", "Control loop ticks", MetricType::COUNTER,
+                                  []() -> int64_t { return controlLoop.getTicks(); });
+static ReadoutMetric controlOverruns("car_control_overruns_total", "Control periods that passed without their own tick",
+                                     MetricType::COUNTER, []() -> int64_t { return controlLoop.getOverruns(); });
+static ReadoutMetric controlPeriod("car_control_period_us", "Nominal control loop period", MetricType::GAUGE,
+                                   []() -> int64_t { return CONTROL_PERIOD_US; });
+static ReadoutMetric autoStops("car_autostops_total", "Times the command watchdog stopped the car", MetricType::COUNTER,
+                               []() -> int64_t { return car.getWatchdog().getTrips(); });
+static ReadoutMetric watchdogDeadline("car_watchdog_deadline_us", "Current auto-stop deadline", MetricType::GAUGE,
+                                      []() -> int64_t { return car.getWatchdog().getDeadlineUs(); });
+static ReadoutMetric heapFree("car_heap_free_bytes", "Free internal heap", MetricType::GAUGE,
+                              []() -> int64_t { return heap_caps_get_free_size(MALLOC_CAP_INTERNAL); });
+static ReadoutMetric heapMinFree("car_heap_min_free_bytes", "Lowest free internal heap since boot", MetricType::GAUGE,
+                                 []() -> int64_t { return heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL); });
+static ReadoutMetric psramFree("car_psram_free_bytes", "Free PSRAM", MetricType::GAUGE,
+                               []() -> int64_t { return heap_caps_get_free_size(MALLOC_CAP_SPIRAM); });
+static ReadoutMetric wifiRssi("car_wifi_rssi_dbm", "RSSI of the station link, or of the first client in AP mode",
+                              MetricType::GAUGE, []() -> int64_t { return readRSSI(); });
+static ReadoutMetric uptime("car_uptime_seconds", "Time since boot", MetricType::GAUGE,
+                            []() -> int64_t { return esp_timer_get_time() / 1000000; });
+static ReadoutMetric sentryEnabled("car_sentry_enabled", "1 while sentry motion detection runs", MetricType::GAUGE,
+                                   []() -> int64_t { return motionDetector.isEnabled(); });
+static ReadoutMetric motionFrames("car_motion_frames_total", "Frames checked for motion", MetricType::COUNTER,
+                                  []() -> int64_t { return motionDetector.getFrames(); });
+static ReadoutMetric motionEvents("car_motion_events_total", "MOTION events sent", MetricType::COUNTER,
+                                  []() -> int64_t { return motionDetector.getEvents(); });
+#ifdef SD_RECORDING
+static ReadoutMetric recorderEnabled("car_recorder_enabled", "1 while frames are recorded to the SD card", MetricType::GAUGE,
+                                     []() -> int64_t { return sdRecorder.isEnabled(); });
+static ReadoutMetric recorderFrames("car_recorder_frames_total", "Frames written to AVI files", MetricType::COUNTER,
+                                    []() -> int64_t { return sdRecorder.getRecorder().getTotalFrames(); });
+static ReadoutMetric recorderBytes("car_recorder_bytes_total", "Bytes written to the SD card", MetricType::COUNTER,
+                                   []() -> int64_t { return sdRecorder.getRecorder().getTotalBytes(); });
+static ReadoutMetric recorderBlockWrites("car_recorder_block_writes_total", "Sector-aligned block writes to the SD card",
+                                         MetricType::COUNTER,
+                                         []() -> int64_t { return sdRecorder.getRecorder().getBlockWrites(); });
+static ReadoutMetric recorderFiles("car_recorder_files_total", "AVI files closed with their index", MetricType::COUNTER,
+                                   []() -> int64_t { return sdRecorder.getRecorder().getFilesClosed(); });
+static HistogramMetric recorderFrameTime("car_recorder_frame_seconds", "Muxing one frame, block writes included",
+                                         sdRecorder.getFrameTime());
+#endif
+static ReadoutMetric clipRingBytes("car_clip_ring_bytes", "PSRAM held by the pre-event clip ring", MetricType::GAUGE,
+                                   []() -> int64_t { return clipRing.getCapacity(); });
+static ReadoutMetric clipFrames("car_clip_frames", "Frames currently held for clip export", MetricType::GAUGE,
+                                []() -> int64_t { return clipRing.getFrameCount(); });
+static ReadoutMetric clipTornReads("car_clip_torn_reads_total", "Clip frames overwritten while being exported",
+                                   MetricType::COUNTER, []() -> int64_t { return clipRing.getTornReads(); });
+static HistogramMetric motionDecodeTime("car_motion_decode_seconds", "Scaled JPEG decode to the motion grid",
+                                        motionDetector.getDecodeTime());
+static HistogramMetric motionDetectTime("car_motion_detect_seconds", "Block SAD and background update",
+                                        motionDetector.getDetectTime());
+static HistogramMetric controlJitter("car_control_jitter_seconds", "Control loop wakeup deviation from its period",
+                                     controlLoop.getJitter());
+static HistogramMetric controlTickTime("car_control_tick_seconds", "Control loop work per tick", controlLoop.getTickTime());
+static HistogramMetric controlQueueDelay("car_control_command_queue_seconds", "Command enqueue to control loop pickup",
+                                         controlLoop.getQueueDelay());
+static HistogramMetric streamCaptureTime("car_stream_capture_seconds", "Camera grab to frame published to viewers",
+                                         frameHub.getCaptureTime());
+static HistogramMetric streamSendTime("car_stream_payload_send_seconds", "Time to write one frame payload",
+                                      frameTrace.histogram(FrameTrace::PAYLOAD));
+static HistogramMetric streamLatency("car_stream_capture_to_wire_seconds", "Sensor timestamp to last payload byte sent",
+                                     frameTrace.histogram(FrameTrace::TOTAL));
+
+static esp_err_t sendMetricHistogram(httpd_req_t *req, const char *name, const LatencyHistogram &histogram) {
+  char line[128];
+  uint32_t cumulative = 0;
+  esp_err_t res = ESP_OK;
+
+  // The last bucket is open-ended and only shows up in +Inf
+  for (int i = 0; i < LATENCY_BUCKETS - 1 && res == ESP_OK; i++) {
+    cumulative += histogram.bucketCount(i);
+    snprintf(line, sizeof(line), "%s_bucket{le=\"%.6f\"} %u\n", name, (LatencyHistogram::bucketLimit(i) + 1) / 1e6, cumulative);
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  if (res == ESP_OK) {
+    uint32_t count = histogram.count();
+    snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %u\n%s_sum %.6f\n%s_count %u\n", name, count, name,
+             histogram.getSumUs() / 1e6, name, count);
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  return res;
+}
+
+// Prometheus text exposition format 0.0.4
+static esp_err_t metricsHandler(httpd_req_t *req) {
+  char line[160];
+  esp_err_t res = ESP_OK;
+
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+  for (const Metric *metric = Metric::first(); metric && res == ESP_OK; metric = metric->getNext()) {
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", metric->getName(), metric->getHelp(), metric->getName(),
+             Metric::typeToString(metric->getType()));
+    res = httpd_resp_sendstr_chunk(req, line);
+
+    if (res != ESP_OK) {
+      break;
+    }
+
+    if (metric->getType() == MetricType::HISTOGRAM) {
+      res = sendMetricHistogram(req, metric->getName(), static_cast<const HistogramMetric *>(metric)->get());
+      continue;
+    }
+
+    snprintf(line, sizeof(line), "%s %lld\n", metric->getName(), (long long)metric->getValue());
+    res = httpd_resp_sendstr_chunk(req, line);
+  }
+
+  if (res == ESP_OK) {
+    res = httpd_resp_sendstr_chunk(req, NULL);
+  }
+
   return res;
 }
 
 static esp_err_t indexHandler(httpd_req_t *req) {
   Serial.println("Index page requested");
-  Serial.println(isClientActive);
-  const char *htmlToSend = isClientActive ? "/busy.min.html" : "/index.min.html";
-  return serveStaticFile(req, htmlToSend);
+  const char *htmlToSend = activeViewerCount() >= FRAME_HUB_MAX_VIEWERS ? "/busy.html" : "/index.html";
+  return assetCache.serve(req, htmlToSend);
 }
 
 static esp_err_t styleHandler(httpd_req_t *req) {
-  return serveStaticFile(req, "/style.min.css");
+  return assetCache.serve(req, "/style.css");
 }
 
 static esp_err_t scriptHandler(httpd_req_t *req) {
-  return serveStaticFile(req, "/script.min.js");
+  return assetCache.serve(req, "/script.js");
 }
 
 void startCarServer() {
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.server_port = 82;
   config.ctrl_port = 32768;
+  config.close_fn = onControlSocketClosed;
+
+  for (int i = 0; i < WS_RX_POOL_SIZE; i++) {
+    ackSockets[i] = -1;
+  }
 
   httpd_uri_t index_uri = {
       .uri = "/",
@@ -403,6 +1454,16 @@ void startCarServer() {
       .method = HTTP_GET,
       .handler = styleHandler,
       .user_ctx = NULL};
+  httpd_uri_t trace_uri = {
+      .uri = "/trace",
+      .method = HTTP_GET,
+      .handler = traceHandler,
+      .user_ctx = NULL};
+  httpd_uri_t metrics_uri = {
+      .uri = "/metrics",
+      .method = HTTP_GET,
+      .handler = metricsHandler,
+      .user_ctx = NULL};
 
   DEBUG_PRINTF_LN("Starting web server on port: '%d'", config.server_port);
 
@@ -412,23 +1473,40 @@ void startCarServer() {
     httpd_register_uri_handler(camera_httpd, &ws_uri);
     httpd_register_uri_handler(camera_httpd, &script_uri);
     httpd_register_uri_handler(camera_httpd, &style_uri);
+    httpd_register_uri_handler(camera_httpd, &trace_uri);
+    httpd_register_uri_handler(camera_httpd, &metrics_uri);
     DEBUG_PRINTLN("WebSocket handler registered on /ws");
   }
 
   // Server for streaming on port 81
   config.server_port = 81;
   config.ctrl_port = 32769;
+  config.close_fn = NULL;
 
   httpd_uri_t stream_uri = {
       .uri = "/stream",
       .method = HTTP_GET,
       .handler = streamHandler,
       .user_ctx = NULL};
+  httpd_uri_t clip_uri = {
+      .uri = "/clip",
+      .method = HTTP_GET,
+      .handler = clipHandler,
+      .user_ctx = NULL};
 
   DEBUG_PRINTF_LN("Starting stream server on port: '%d'", config.server_port);
   
   if (httpd_start(&stream_httpd, &config) == ESP_OK) {
     httpd_register_uri_handler(stream_httpd, &stream_uri);
+    httpd_register_uri_handler(stream_httpd, &clip_uri);
     DEBUG_PRINTLN("Stream server started on port 81");
   }
+
+  car.setAutoStopHandler(onAutoStop);
+  controlLoop.setAckHandler(onCommandAck);
+  motionDetector.setEventHandler(broadcastResponse);
+#ifdef SD_RECORDING
+  sdRecorder.setEventHandler(broadcastResponse);
+#endif
+  xTaskCreate(qualityTask, "QualityTask", 3072, nullptr, 2, nullptr);
 }
\ No newline at end of file
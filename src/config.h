@@ -31,18 +31,27 @@
 // #define CAMERA_MODEL_DFRobot_Romeo_ESP32S3 // Has PSRAM
 
 //#define DEBUG 1 // Uncomment to enable debug output
+
+// Probe builds (Perf.h) count every debug print, also when DEBUG is off
+#ifdef PERF_PROBES
+  void perfCountDebugPrint();
+  #define DEBUG_COUNT() perfCountDebugPrint()
+#else
+  #define DEBUG_COUNT()
+#endif
+
 #ifdef DEBUG
   #define DEBUG_BEGIN() Serial.begin(115200)
-  #define DEBUG_PRINT(x) Serial.print(x)
-  #define DEBUG_PRINTLN(x) Serial.println(x)
-  #define DEBUG_PRINTF(...) Serial.printf(__VA_ARGS__)
-  #define DEBUG_PRINTF_LN(...) do { Serial.printf(__VA_ARGS__); Serial.println(); } while(0)
+  #define DEBUG_PRINT(x) do { DEBUG_COUNT(); Serial.print(x); } while(0)
+  #define DEBUG_PRINTLN(x) do { DEBUG_COUNT(); Serial.println(x); } while(0)
+  #define DEBUG_PRINTF(...) do { DEBUG_COUNT(); Serial.printf(__VA_ARGS__); } while(0)
+  #define DEBUG_PRINTF_LN(...) do { DEBUG_COUNT(); Serial.printf(__VA_ARGS__); Serial.println(); } while(0)
 #else
   #define DEBUG_BEGIN()
-  #define DEBUG_PRINT(x)
-  #define DEBUG_PRINTLN(x)
-  #define DEBUG_PRINTF(...)
-  #define DEBUG_PRINTF_LN(...)
+  #define DEBUG_PRINT(x) DEBUG_COUNT()
+  #define DEBUG_PRINTLN(x) DEBUG_COUNT()
+  #define DEBUG_PRINTF(...) DEBUG_COUNT()
+  #define DEBUG_PRINTF_LN(...) DEBUG_COUNT()
 #endif
 
 // Car pin definitions
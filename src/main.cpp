@@ -1,4 +1,3 @@
-#include "LittleFS.h"
 #include "esp_timer.h"
 #include "esp_camera.h"
 #include "fb_gfx.h"
@@ -10,13 +9,17 @@
 
 #include "config.h"
 #include "Car.h"
+#include "ControlLoop.h"
 #include "carServer.h"
 #include "customApSuccess.h"
 
+#define PORTAL_INTERVAL_MS 50
+
 Car car;
 WiFiManager wm;
 bool mDNSStarted = false;
-extern bool isClientActive;
+
+void portalTask(void *param);
 
 void ledTask(void *param) {
   unsigned long lastBlink = 0;
@@ -31,7 +34,7 @@ void ledTask(void *param) {
   for (;;) {
     unsigned long now = millis();
 
-    if (isClientActive) {
+    if (activeViewerCount() > 0) {
       if (now - lastFade >= fadeIntervalMs) {
         lastFade = now;
         fadeValue += fadeDirection * fadeStep;
@@ -78,15 +81,6 @@ void setup() {
   // blink indicate boot started
   blink(LED_PIN, 1, 1000);
 
-  if (!LittleFS.begin(true)) {
-    DEBUG_PRINTLN("LittleFS mount failed!");
-    blink(LED_PIN, 3); // error indication
-
-    return;
-  }
-
-  DEBUG_PRINTLN("LittleFS mounted successfully");
-
   if (car.init() != ESP_OK) {
     DEBUG_PRINTLN("Reboot in 3 seconds...");
     blink(LED_PIN, 3); // error indication
@@ -106,6 +100,13 @@ void setup() {
 
   wm.autoConnect("WiFi Car");
 
+  startControlLoop();
+  startClipRing();
+  startFrameCapture();
+  startMotionDetector();
+#ifdef SD_RECORDING
+  startSdRecorder();
+#endif
   startCarServer();
 
   blink(LED_PIN, 1, 1000); // successful boot indication
@@ -119,6 +120,13 @@ void setup() {
       nullptr,
       1,
       nullptr);
+  xTaskCreate(
+      portalTask,
+      "PortalTask",
+      4096,
+      nullptr,
+      1,
+      nullptr);
 }
 
 void setupMDNS() {
@@ -142,18 +150,27 @@ void setupMDNS() {
   DEBUG_PRINTLN("Error setting up MDNS responder!");
 }
 
-void loop() {
-  car.tick();
-  wm.process();
+// WiFiManager portal and mDNS upkeep, nothing here is time critical
+void portalTask(void *param) {
+  for (;;) {
+    wm.process();
 
-  if (WiFi.status() == WL_CONNECTED && !mDNSStarted) {
-    DEBUG_PRINT("WiFi connected! IP address: ");
-    DEBUG_PRINTLN(WiFi.localIP());
-    setupMDNS();
-  }
+    if (WiFi.status() == WL_CONNECTED && !mDNSStarted) {
+      DEBUG_PRINT("WiFi connected! IP address: ");
+      DEBUG_PRINTLN(WiFi.localIP());
+      setupMDNS();
+    }
 
-  if (WiFi.status() != WL_CONNECTED && mDNSStarted) {
-    mDNSStarted = false;
-    DEBUG_PRINTLN("WiFi disconnected, mDNS stopped");
+    if (WiFi.status() != WL_CONNECTED && mDNSStarted) {
+      mDNSStarted = false;
+      DEBUG_PRINTLN("WiFi disconnected, mDNS stopped");
+    }
+
+    vTaskDelay(PORTAL_INTERVAL_MS / portTICK_PERIOD_MS);
   }
-}
\ No newline at end of file
+}
+
+void loop() {
+  // Control runs in ControlLoop and the portal in portalTask
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,193 @@
+#ifndef FAKE_ARDUINO_H
+#define FAKE_ARDUINO_H
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <chrono>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The parts of the ESP32 Arduino core the car code uses. Time is the host
+// clock; pins and LEDC channels only remember what was last written to them,
+// so a test can read back what the firmware did to the hardware.
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define FAKE_PIN_COUNT 40
+#define FAKE_LEDC_CHANNELS 16
+
+#define PROGMEM
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+struct FakePins {
+  uint8_t mode[FAKE_PIN_COUNT];
+  uint8_t level[FAKE_PIN_COUNT];
+  int8_t ledcChannel[FAKE_PIN_COUNT]; // -1 while no LEDC channel drives the pin
+  uint32_t ledcDuty[FAKE_LEDC_CHANNELS];
+
+  FakePins() {
+    reset();
+  }
+
+  void reset() {
+    memset(mode, 0, sizeof(mode));
+    memset(level, 0, sizeof(level));
+    memset(ledcChannel, -1, sizeof(ledcChannel));
+    memset(ledcDuty, 0, sizeof(ledcDuty));
+  }
+};
+
+inline FakePins fakePins;
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+  fakePins.mode[pin] = mode;
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+  fakePins.level[pin] = level;
+}
+
+inline uint32_t ledcSetup(uint8_t channel, uint32_t freq, uint8_t resolutionBits) {
+  return freq;
+}
+
+inline void ledcAttachPin(uint8_t pin, uint8_t channel) {
+  fakePins.ledcChannel[pin] = channel;
+}
+
+inline void ledcDetachPin(uint8_t pin) {
+  fakePins.ledcChannel[pin] = -1;
+}
+
+inline void ledcWrite(uint8_t channel, uint32_t duty) {
+  fakePins.ledcDuty[channel] = duty;
+}
+
+inline void delay(uint32_t ms) {
+  vTaskDelay(ms);
+}
+
+inline unsigned long millis() {
+  return esp_timer_get_time() / 1000;
+}
+
+inline unsigned long micros() {
+  return esp_timer_get_time();
+}
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// PSRAM and the DMA-capable heap are all plain host memory
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT (1 << 2)
+
+inline void *heap_caps_malloc(size_t bytes, uint32_t caps) {
+  return malloc(bytes);
+}
+
+// Free heap as the metrics page reports it; the host has no figure to give
+inline size_t heap_caps_get_free_size(uint32_t caps) {
+  return 0;
+}
+
+inline size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+  return 0;
+}
+
+inline void *ps_malloc(size_t bytes) {
+  return malloc(bytes);
+}
+
+inline void *ps_calloc(size_t count, size_t bytes) {
+  return calloc(count, bytes);
+}
+
+inline void *ps_realloc(void *ptr, size_t bytes) {
+  return realloc(ptr, bytes);
+}
+
+// From newlib on the car; glibc only has it since 2.38
+inline size_t fakeStrlcpy(char *dst, const char *src, size_t size) {
+  size_t len = strlen(src);
+
+  if (size) {
+    size_t copied = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, copied);
+    dst[copied] = '\0';
+  }
+
+  return len;
+}
+
+#define strlcpy fakeStrlcpy
+
+class FakeSerial {
+public:
+  void begin(unsigned long baud) {}
+
+  void setDebugOutput(bool on) {}
+
+  void print(const char *text) {
+    fputs(text, stdout);
+  }
+
+  void print(long value) {
+    printf("%ld", value);
+  }
+
+  void println(const char *text = "") {
+    puts(text);
+  }
+
+  void println(long value) {
+    printf("%ld\n", value);
+  }
+
+  int printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vprintf(format, args);
+    va_end(args);
+    return written;
+  }
+};
+
+inline FakeSerial Serial;
+
+class FakeEsp {
+public:
+  // 240 MHz, like the car, counted from the host clock's nanoseconds so
+  // calls far shorter than a microsecond still measure
+  uint32_t getCycleCount() {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    return (uint32_t)(ns * 240 / 1000);
+  }
+
+  void restart() {
+    abort();
+  }
+};
+
+inline FakeEsp ESP;
+
+inline uint32_t getCpuFrequencyMhz() {
+  return 240;
+}
+
+#endif
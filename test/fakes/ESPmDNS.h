@@ -0,0 +1,20 @@
+#ifndef FAKE_ESP_MDNS_H
+#define FAKE_ESP_MDNS_H
+
+#include <stdint.h>
+
+// Nothing is announced on the host
+class FakeMdns {
+public:
+  bool begin(const char *hostname) {
+    return true;
+  }
+
+  void addService(const char *service, const char *proto, uint16_t port) {}
+
+  void addServiceTxt(const char *service, const char *proto, const char *key, const char *value) {}
+};
+
+inline FakeMdns MDNS;
+
+#endif
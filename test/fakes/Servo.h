@@ -0,0 +1,44 @@
+#ifndef FAKE_SERVO_H
+#define FAKE_SERVO_H
+
+#include "Arduino.h"
+
+// Remembers the pin and the last angle written
+class Servo {
+public:
+  Servo()
+      : pin(-1),
+        angle(-1) {}
+
+  bool attach(int servoPin, int channel) {
+    pin = servoPin;
+    ledcAttachPin(servoPin, channel);
+    return true;
+  }
+
+  void detach() {
+    if (pin >= 0) {
+      ledcDetachPin(pin);
+    }
+
+    pin = -1;
+  }
+
+  void write(int degrees) {
+    angle = degrees;
+  }
+
+  bool attached() const {
+    return pin >= 0;
+  }
+
+  int read() const {
+    return angle;
+  }
+
+private:
+  int pin;
+  int angle;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef FAKE_WIFI_H
+#define FAKE_WIFI_H
+
+#include "Arduino.h"
+#include "esp_wifi.h"
+
+// Always connected as a station; tests can switch the mode or status
+typedef enum {
+  WIFI_MODE_NULL = 0,
+  WIFI_MODE_STA,
+  WIFI_MODE_AP,
+  WIFI_MODE_APSTA
+} wifi_mode_t;
+
+#define WIFI_STA WIFI_MODE_STA
+#define WIFI_AP WIFI_MODE_AP
+
+#define WL_IDLE_STATUS 0
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+class FakeWiFi {
+public:
+  wifi_mode_t currentMode = WIFI_MODE_STA;
+  int currentStatus = WL_CONNECTED;
+  int rssi = -55;
+
+  bool mode(wifi_mode_t next) {
+    currentMode = next;
+    return true;
+  }
+
+  wifi_mode_t getMode() {
+    return currentMode;
+  }
+
+  int status() {
+    return currentStatus;
+  }
+
+  int RSSI() {
+    return rssi;
+  }
+
+  const char *localIP() {
+    return "127.0.0.1";
+  }
+};
+
+inline FakeWiFi WiFi;
+
+#endif
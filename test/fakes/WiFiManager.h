@@ -0,0 +1,30 @@
+#ifndef FAKE_WIFI_MANAGER_H
+#define FAKE_WIFI_MANAGER_H
+
+#include "WiFi.h"
+
+// The config portal never opens, autoConnect finds the fake network
+class WiFiManager {
+public:
+  void setConfigPortalBlocking(bool blocking) {}
+
+  void setCaptivePortalEnable(bool enabled) {}
+
+  void setConnectTimeout(unsigned long seconds) {}
+
+  void setDarkMode(bool enabled) {}
+
+  void setCustomHeadElement(const char *html) {}
+
+  bool autoConnect(const char *apName) {
+    return WiFi.status() == WL_CONNECTED;
+  }
+
+  bool process() {
+    return false;
+  }
+
+  void resetSettings() {}
+};
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef FAKE_ESP_CAMERA_H
+#define FAKE_ESP_CAMERA_H
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// esp32-camera types as the car code uses them, with no sensor behind
+// esp_camera_*: tests build with HAL_SYNTHETIC_CAMERA, so frames come from
+// Hal.h's SyntheticCamera through the fake encoder below.
+
+typedef enum {
+  PIXFORMAT_RGB565,
+  PIXFORMAT_YUV422,
+  PIXFORMAT_YUV420,
+  PIXFORMAT_GRAYSCALE,
+  PIXFORMAT_JPEG,
+  PIXFORMAT_RGB888,
+  PIXFORMAT_RAW,
+  PIXFORMAT_RGB444,
+  PIXFORMAT_RGB555
+} pixformat_t;
+
+typedef enum {
+  FRAMESIZE_96X96,
+  FRAMESIZE_QQVGA,
+  FRAMESIZE_QCIF,
+  FRAMESIZE_HQVGA,
+  FRAMESIZE_240X240,
+  FRAMESIZE_QVGA,
+  FRAMESIZE_CIF,
+  FRAMESIZE_HVGA,
+  FRAMESIZE_VGA,
+  FRAMESIZE_SVGA,
+  FRAMESIZE_XGA,
+  FRAMESIZE_HD,
+  FRAMESIZE_SXGA,
+  FRAMESIZE_UXGA,
+  FRAMESIZE_FHD,
+  FRAMESIZE_P_HD,
+  FRAMESIZE_P_3MP,
+  FRAMESIZE_QXGA,
+  FRAMESIZE_QHD,
+  FRAMESIZE_WQXGA,
+  FRAMESIZE_P_FHD,
+  FRAMESIZE_QSXGA,
+  FRAMESIZE_INVALID
+} framesize_t;
+
+typedef struct {
+  uint16_t width;
+  uint16_t height;
+} resolution_info_t;
+
+inline const resolution_info_t resolution[FRAMESIZE_INVALID] = {
+    {96, 96},    {160, 120},   {176, 144},   {240, 176},   {240, 240},   {320, 240},
+    {400, 296},  {480, 320},   {640, 480},   {800, 600},   {1024, 768},  {1280, 720},
+    {1280, 1024}, {1600, 1200}, {1920, 1080}, {720, 1280},  {864, 1536},  {2048, 1536},
+    {2560, 1440}, {2560, 1600}, {1080, 1920}, {2560, 1920}};
+
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  size_t width;
+  size_t height;
+  pixformat_t format;
+  struct timeval timestamp;
+} camera_fb_t;
+
+typedef enum { LEDC_TIMER_0 } ledc_timer_t;
+typedef enum { LEDC_CHANNEL_0 } ledc_channel_t;
+typedef enum { CAMERA_FB_IN_PSRAM, CAMERA_FB_IN_DRAM } camera_fb_location_t;
+typedef enum { CAMERA_GRAB_WHEN_EMPTY, CAMERA_GRAB_LATEST } camera_grab_mode_t;
+
+typedef struct {
+  int pin_pwdn;
+  int pin_reset;
+  int pin_xclk;
+  int pin_sscb_sda;
+  int pin_sscb_scl;
+  int pin_d7;
+  int pin_d6;
+  int pin_d5;
+  int pin_d4;
+  int pin_d3;
+  int pin_d2;
+  int pin_d1;
+  int pin_d0;
+  int pin_vsync;
+  int pin_href;
+  int pin_pclk;
+  int xclk_freq_hz;
+  ledc_timer_t ledc_timer;
+  ledc_channel_t ledc_channel;
+  pixformat_t pixel_format;
+  framesize_t frame_size;
+  int jpeg_quality;
+  size_t fb_count;
+  camera_fb_location_t fb_location;
+  camera_grab_mode_t grab_mode;
+} camera_config_t;
+
+typedef struct {
+  framesize_t framesize;
+  uint8_t quality;
+} camera_status_t;
+
+typedef struct _sensor sensor_t;
+
+struct _sensor {
+  camera_status_t status;
+  pixformat_t pixformat;
+  int (*set_framesize)(sensor_t *sensor, framesize_t framesize);
+  int (*set_quality)(sensor_t *sensor, int quality);
+};
+
+inline esp_err_t esp_camera_init(const camera_config_t *config) {
+  return ESP_ERR_NOT_FOUND;
+}
+
+inline sensor_t *esp_camera_sensor_get() {
+  return nullptr;
+}
+
+inline camera_fb_t *esp_camera_fb_get() {
+  return nullptr;
+}
+
+inline void esp_camera_fb_return(camera_fb_t *fb) {}
+
+// Stand-in for the esp32-camera JPEG encoder. Output has the shape of a
+// JPEG (SOI, entropy-coded bytes, EOI) and a size that grows with the pixel
+// count, the quality and the mean brightness, and it changes whenever the
+// source pixels change; it does not decode to a picture. Bytes go to the callback in 1 KB pieces
+// like the real encoder's output buffer.
+typedef size_t (*jpg_out_cb)(void *arg, size_t index, const void *data, size_t len);
+
+#define FAKE_JPEG_CHUNK 1024
+
+inline bool fmt2jpg_cb(uint8_t *src, size_t srcLen, uint16_t width, uint16_t height, pixformat_t format,
+                       uint8_t quality, jpg_out_cb cb, void *arg) {
+  if (!src || srcLen == 0 || quality == 0 || quality > 100) {
+    return false;
+  }
+
+  // Brighter pictures come out larger, so a changed scene changes the size
+  uint64_t sum = 0;
+  for (size_t i = 0; i < srcLen; i++) {
+    sum += src[i];
+  }
+
+  size_t payload = (size_t)((uint64_t)width * height * quality * (sum / srcLen + 128) / (800 * 256)) + 16;
+  size_t len = payload + 4;
+  uint8_t chunk[FAKE_JPEG_CHUNK];
+  size_t index = 0;
+
+  while (index < len) {
+    size_t fill = len - index < FAKE_JPEG_CHUNK ? len - index : FAKE_JPEG_CHUNK;
+
+    for (size_t i = 0; i < fill; i++) {
+      size_t at = index + i;
+
+      if (at < 2) {
+        chunk[i] = at == 0 ? 0xFF : 0xD8;
+      } else if (at >= len - 2) {
+        chunk[i] = at == len - 2 ? 0xFF : 0xD9;
+      } else {
+        // No 0xFF inside, so the only markers are SOI and EOI
+        chunk[i] = src[(at - 2) * srcLen / payload] & 0x7F;
+      }
+    }
+
+    if (cb(arg, index, chunk, fill) != fill) {
+      return false;
+    }
+
+    index += fill;
+  }
+
+  return true;
+}
+
+struct FakeJpegBuffer {
+  uint8_t *data;
+  size_t len;
+};
+
+inline size_t fakeJpegAppend(void *arg, size_t index, const void *data, size_t len) {
+  FakeJpegBuffer *out = (FakeJpegBuffer *)arg;
+  uint8_t *grown = (uint8_t *)realloc(out->data, index + len);
+
+  if (!grown) {
+    return 0;
+  }
+
+  memcpy(grown + index, data, len);
+  out->data = grown;
+  out->len = index + len;
+  return len;
+}
+
+inline bool fmt2jpg(uint8_t *src, size_t srcLen, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality,
+                    uint8_t **out, size_t *outLen) {
+  FakeJpegBuffer buffer = {nullptr, 0};
+
+  if (!fmt2jpg_cb(src, srcLen, width, height, format, quality, fakeJpegAppend, &buffer)) {
+    free(buffer.data);
+    return false;
+  }
+
+  *out = buffer.data;
+  *outLen = buffer.len;
+  return true;
+}
+
+inline bool frame2jpg_cb(camera_fb_t *fb, uint8_t quality, jpg_out_cb cb, void *arg) {
+  return fmt2jpg_cb(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, cb, arg);
+}
+
+inline bool frame2jpg(camera_fb_t *fb, uint8_t quality, uint8_t **out, size_t *outLen) {
+  return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, outLen);
+}
+
+#endif
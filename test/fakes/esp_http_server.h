@@ -0,0 +1,551 @@
+#ifndef FAKE_ESP_HTTP_SERVER_H
+#define FAKE_ESP_HTTP_SERVER_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "lwip/sockets.h"
+#include <ctype.h>
+#include <map>
+#include <mutex>
+#include <string.h>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+// Loopback esp_http_server: handlers register as on the car, and
+// loopbackRequest() feeds them a request in-process and hands back what they
+// answered. No sockets, no httpd task; a handler runs on the calling thread.
+// Each sockfd is a session that lives until httpd_sess_trigger_close(), and
+// loopbackWsFrame() delivers one WebSocket frame on an upgraded session.
+
+#define ESP_ERR_HTTPD_BASE 0xb000
+#define ESP_ERR_HTTPD_RESULT_TRUNC (ESP_ERR_HTTPD_BASE + 4)
+
+#define HTTPD_MAX_URI_LEN 512
+#define HTTPD_RESP_USE_STRLEN -1
+
+#define HTTPD_200 "200 OK"
+#define HTTPD_204 "204 No Content"
+#define HTTPD_400 "400 Bad Request"
+#define HTTPD_404 "404 Not Found"
+#define HTTPD_500 "500 Internal Server Error"
+
+typedef void *httpd_handle_t;
+typedef void (*httpd_free_ctx_fn_t)(void *ctx);
+typedef void (*httpd_close_func_t)(httpd_handle_t hd, int sockfd);
+typedef void (*httpd_work_fn_t)(void *arg);
+
+typedef enum {
+  HTTP_GET = 1,
+  HTTP_POST = 3
+} httpd_method_t;
+
+typedef struct httpd_req {
+  httpd_handle_t handle;
+  int method;
+  const char uri[HTTPD_MAX_URI_LEN + 1];
+  size_t content_len;
+  void *aux;
+  void *user_ctx;
+  void *sess_ctx;
+  httpd_free_ctx_fn_t free_ctx;
+  bool ignore_sess_ctx_changes;
+} httpd_req_t;
+
+typedef struct httpd_uri {
+  const char *uri;
+  httpd_method_t method;
+  esp_err_t (*handler)(httpd_req_t *req);
+  void *user_ctx;
+  bool is_websocket;
+  bool handle_ws_control_frames;
+  const char *supported_subprotocol;
+} httpd_uri_t;
+
+typedef struct {
+  unsigned task_priority;
+  size_t stack_size;
+  BaseType_t core_id;
+  uint16_t server_port;
+  uint16_t ctrl_port;
+  uint16_t max_open_sockets;
+  uint16_t max_uri_handlers;
+  uint16_t max_resp_headers;
+  uint16_t backlog_conn;
+  bool lru_purge_enable;
+  uint16_t recv_wait_timeout;
+  uint16_t send_wait_timeout;
+  httpd_close_func_t close_fn;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG()                                                                                         \
+  { 5, 4096, tskNO_AFFINITY, 80, 32768, 7, 8, 8, 5, false, 5, 5, NULL }
+
+typedef enum {
+  HTTPD_WS_TYPE_CONTINUE = 0x0,
+  HTTPD_WS_TYPE_TEXT = 0x1,
+  HTTPD_WS_TYPE_BINARY = 0x2,
+  HTTPD_WS_TYPE_CLOSE = 0x8,
+  HTTPD_WS_TYPE_PING = 0x9,
+  HTTPD_WS_TYPE_PONG = 0xA
+} httpd_ws_type_t;
+
+typedef struct httpd_ws_frame {
+  bool final;
+  bool fragmented;
+  httpd_ws_type_t type;
+  uint8_t *payload;
+  size_t len;
+} httpd_ws_frame_t;
+
+typedef enum {
+  HTTPD_WS_CLIENT_INVALID = 0x0,
+  HTTPD_WS_CLIENT_HTTP = 0x1,
+  HTTPD_WS_CLIENT_WEBSOCKET = 0x2
+} httpd_ws_client_info_t;
+
+typedef std::vector<std::pair<std::string, std::string>> LoopbackHeaders;
+
+// What a handler sent back
+struct LoopbackResponse {
+  esp_err_t result; // the handler's return value
+  std::string status;
+  std::string type;
+  LoopbackHeaders headers;
+  std::string body;
+  bool chunked;
+  bool sent;
+
+  // nullptr when the handler did not set it
+  const char *header(const char *name) const {
+    for (const auto &header : headers) {
+      if (strcasecmp(header.first.c_str(), name) == 0) {
+        return header.second.c_str();
+      }
+    }
+
+    return nullptr;
+  }
+};
+
+// A WebSocket frame the server sent, in order per server
+struct LoopbackWsMessage {
+  int fd;
+  httpd_ws_type_t type;
+  std::string payload;
+};
+
+struct LoopbackSession {
+  bool websocket = false;
+  void *ctx = nullptr;
+  httpd_free_ctx_fn_t freeCtx = nullptr;
+};
+
+struct LoopbackServer {
+  httpd_config_t config;
+  std::vector<httpd_uri_t> handlers;
+
+  // Handlers, sender tasks and queued work all touch these
+  std::mutex lock;
+  std::map<int, LoopbackSession> sessions;
+  std::vector<LoopbackWsMessage> wsSent;
+
+  // Benchmarks turn this off, so sends allocate nothing and are only counted
+  bool keepWsFrames = true;
+  uint32_t wsFramesSent = 0;
+
+  // httpd_queue_work() items run one at a time, as on the httpd task
+  std::mutex workLock;
+};
+
+struct LoopbackExchange {
+  std::string query;
+  LoopbackHeaders requestHeaders;
+  int sockfd;
+  LoopbackResponse response;
+
+  // The frame loopbackWsFrame() delivers
+  httpd_ws_type_t wsType;
+  std::string wsPayload;
+};
+
+inline LoopbackExchange *loopbackExchange(httpd_req_t *req) {
+  return (LoopbackExchange *)req->aux;
+}
+
+inline esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+  LoopbackServer *server = new LoopbackServer();
+  server->config = *config;
+  *handle = server;
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_stop(httpd_handle_t handle) {
+  delete (LoopbackServer *)handle;
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri) {
+  LoopbackServer *server = (LoopbackServer *)handle;
+
+  if (server->handlers.size() >= server->config.max_uri_handlers) {
+    return ESP_FAIL;
+  }
+
+  server->handlers.push_back(*uri);
+  return ESP_OK;
+}
+
+// Runs the handler registered for path on an open session, then keeps the
+// session context the handler left, as httpd does between requests
+inline void loopbackDispatch(LoopbackServer *server, httpd_req_t &req, const std::string &path, bool websocketFrame) {
+  LoopbackExchange &exchange = *(LoopbackExchange *)req.aux;
+  int fd = exchange.sockfd;
+
+  {
+    std::lock_guard<std::mutex> guard(server->lock);
+    LoopbackSession &session = server->sessions[fd];
+    req.sess_ctx = session.ctx;
+    req.free_ctx = session.freeCtx;
+  }
+
+  for (const httpd_uri_t &registered : server->handlers) {
+    bool matches = websocketFrame ? registered.is_websocket : registered.method == req.method;
+
+    if (matches && path == registered.uri) {
+      req.user_ctx = registered.user_ctx;
+      exchange.response.result = registered.handler(&req);
+
+      std::lock_guard<std::mutex> guard(server->lock);
+      auto session = server->sessions.find(fd);
+
+      if (session != server->sessions.end()) {
+        session->second.ctx = req.sess_ctx;
+        session->second.freeCtx = req.free_ctx;
+        session->second.websocket |= registered.is_websocket && exchange.response.result == ESP_OK;
+      }
+
+      return;
+    }
+  }
+
+  exchange.response.status = HTTPD_404;
+  exchange.response.result = ESP_FAIL;
+  exchange.response.sent = true;
+}
+
+// Runs the handler registered for method and uri (the path may carry a
+// query) with the given request headers, as httpd would for one request
+inline LoopbackResponse loopbackRequest(httpd_handle_t handle, httpd_method_t method, const char *uri,
+                                        const LoopbackHeaders &headers = {}, int sockfd = 54) {
+  LoopbackServer *server = (LoopbackServer *)handle;
+  LoopbackExchange exchange;
+  exchange.requestHeaders = headers;
+  exchange.sockfd = sockfd;
+  exchange.response = {ESP_OK, HTTPD_200, "text/html", {}, "", false, false};
+
+  std::string path = uri;
+  size_t queryStart = path.find('?');
+
+  if (queryStart != std::string::npos) {
+    exchange.query = path.substr(queryStart + 1);
+    path.resize(queryStart);
+  }
+
+  httpd_req_t req = {};
+  req.handle = handle;
+  req.method = method;
+  req.aux = &exchange;
+  strncpy((char *)req.uri, uri, HTTPD_MAX_URI_LEN);
+
+  loopbackDispatch(server, req, path, false);
+  return exchange.response;
+}
+
+// Delivers one frame to the WebSocket handler on uri; the handshake is a
+// loopbackRequest() GET on the same sockfd. Replies land in wsSent.
+inline esp_err_t loopbackWsFrame(httpd_handle_t handle, const char *uri, httpd_ws_type_t type, const void *payload,
+                                 size_t len, int sockfd = 54) {
+  LoopbackServer *server = (LoopbackServer *)handle;
+  LoopbackExchange exchange;
+  exchange.sockfd = sockfd;
+  exchange.response = {ESP_OK, HTTPD_200, "text/html", {}, "", false, false};
+  exchange.wsType = type;
+  exchange.wsPayload.assign((const char *)payload, len);
+
+  httpd_req_t req = {};
+  req.handle = handle;
+  req.method = 0; // only the handshake is a GET
+  req.aux = &exchange;
+  strncpy((char *)req.uri, uri, HTTPD_MAX_URI_LEN);
+
+  loopbackDispatch(server, req, uri, true);
+  return exchange.response.result;
+}
+
+// The text frames sent to fd so far
+inline std::vector<std::string> loopbackWsTexts(httpd_handle_t handle, int sockfd = 54) {
+  LoopbackServer *server = (LoopbackServer *)handle;
+  std::lock_guard<std::mutex> guard(server->lock);
+  std::vector<std::string> texts;
+
+  for (const LoopbackWsMessage &message : server->wsSent) {
+    if (message.fd == sockfd && message.type == HTTPD_WS_TYPE_TEXT) {
+      texts.push_back(message.payload);
+    }
+  }
+
+  return texts;
+}
+
+inline size_t httpd_req_get_hdr_value_len(httpd_req_t *req, const char *field) {
+  for (const auto &header : loopbackExchange(req)->requestHeaders) {
+    if (strcasecmp(header.first.c_str(), field) == 0) {
+      return header.second.size();
+    }
+  }
+
+  return 0;
+}
+
+// Like httpd, a value that does not fit is cut short and reported as such
+inline esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *req, const char *field, char *value, size_t size) {
+  for (const auto &header : loopbackExchange(req)->requestHeaders) {
+    if (strcasecmp(header.first.c_str(), field) == 0) {
+      snprintf(value, size, "%s", header.second.c_str());
+      return header.second.size() < size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+  }
+
+  return ESP_ERR_NOT_FOUND;
+}
+
+inline size_t httpd_req_get_url_query_len(httpd_req_t *req) {
+  return loopbackExchange(req)->query.size();
+}
+
+inline esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t size) {
+  const std::string &query = loopbackExchange(req)->query;
+
+  if (query.empty()) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  snprintf(buf, size, "%s", query.c_str());
+  return query.size() < size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+inline esp_err_t httpd_query_key_value(const char *query, const char *key, char *value, size_t size) {
+  size_t keyLen = strlen(key);
+  const char *p = query;
+
+  while (p && *p) {
+    const char *end = strchr(p, '&');
+    size_t pairLen = end ? (size_t)(end - p) : strlen(p);
+
+    if (pairLen > keyLen && strncmp(p, key, keyLen) == 0 && p[keyLen] == '=') {
+      size_t valueLen = pairLen - keyLen - 1;
+      snprintf(value, size, "%.*s", (int)valueLen, p + keyLen + 1);
+      return valueLen < size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+
+    p = end ? end + 1 : nullptr;
+  }
+
+  return ESP_ERR_NOT_FOUND;
+}
+
+inline int httpd_req_to_sockfd(httpd_req_t *req) {
+  return loopbackExchange(req)->sockfd;
+}
+
+inline esp_err_t httpd_resp_set_status(httpd_req_t *req, const char *status) {
+  loopbackExchange(req)->response.status = status;
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type) {
+  loopbackExchange(req)->response.type = type;
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value) {
+  loopbackExchange(req)->response.headers.emplace_back(field, value);
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_resp_send(httpd_req_t *req, const char *buf, ssize_t len) {
+  LoopbackResponse &response = loopbackExchange(req)->response;
+
+  if (len == HTTPD_RESP_USE_STRLEN) {
+    len = buf ? strlen(buf) : 0;
+  }
+
+  response.body.assign(buf ? buf : "", buf ? len : 0);
+  response.sent = true;
+  return ESP_OK;
+}
+
+// A zero-length chunk ends the response
+inline esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t len) {
+  LoopbackResponse &response = loopbackExchange(req)->response;
+
+  if (len == HTTPD_RESP_USE_STRLEN) {
+    len = buf ? strlen(buf) : 0;
+  }
+
+  response.chunked = true;
+
+  if (!buf || len == 0) {
+    response.sent = true;
+    return ESP_OK;
+  }
+
+  response.body.append(buf, len);
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_resp_sendstr(httpd_req_t *req, const char *str) {
+  return httpd_resp_send(req, str, HTTPD_RESP_USE_STRLEN);
+}
+
+inline esp_err_t httpd_resp_sendstr_chunk(httpd_req_t *req, const char *str) {
+  return httpd_resp_send_chunk(req, str, HTTPD_RESP_USE_STRLEN);
+}
+
+inline esp_err_t httpd_resp_send_404(httpd_req_t *req) {
+  httpd_resp_set_status(req, HTTPD_404);
+  return httpd_resp_send(req, "Nothing matches the given URI", HTTPD_RESP_USE_STRLEN);
+}
+
+inline esp_err_t httpd_resp_send_500(httpd_req_t *req) {
+  httpd_resp_set_status(req, HTTPD_500);
+  return httpd_resp_send(req, "Server has encountered an unexpected error", HTTPD_RESP_USE_STRLEN);
+}
+
+// Caller holds server->lock
+inline void loopbackKeepWsFrame(LoopbackServer *server, int fd, const httpd_ws_frame_t *frame) {
+  server->wsFramesSent++;
+
+  if (server->keepWsFrames) {
+    server->wsSent.push_back({fd, frame->type, std::string((const char *)frame->payload, frame->len)});
+  }
+}
+
+// With max_len 0 only reports the pending frame's type and length
+inline esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *frame, size_t max_len) {
+  LoopbackExchange *exchange = loopbackExchange(req);
+  frame->type = exchange->wsType;
+  frame->final = true;
+  frame->fragmented = false;
+
+  if (max_len == 0) {
+    frame->len = exchange->wsPayload.size();
+    return ESP_OK;
+  }
+
+  if (!frame->payload) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  frame->len = exchange->wsPayload.size() < max_len ? exchange->wsPayload.size() : max_len;
+  memcpy(frame->payload, exchange->wsPayload.data(), frame->len);
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_ws_send_frame_async(httpd_handle_t handle, int fd, httpd_ws_frame_t *frame) {
+  LoopbackServer *server = (LoopbackServer *)handle;
+  std::lock_guard<std::mutex> guard(server->lock);
+  auto session = server->sessions.find(fd);
+
+  if (session == server->sessions.end() || !session->second.websocket) {
+    return ESP_FAIL;
+  }
+
+  loopbackKeepWsFrame(server, fd, frame);
+  return ESP_OK;
+}
+
+// The handshake handler may already answer on its own session
+inline esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *frame) {
+  LoopbackServer *server = (LoopbackServer *)req->handle;
+  int fd = httpd_req_to_sockfd(req);
+  std::lock_guard<std::mutex> guard(server->lock);
+
+  if (!server->sessions.count(fd)) {
+    return ESP_FAIL;
+  }
+
+  loopbackKeepWsFrame(server, fd, frame);
+  return ESP_OK;
+}
+
+inline httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t handle, int fd) {
+  LoopbackServer *server = (LoopbackServer *)handle;
+  std::lock_guard<std::mutex> guard(server->lock);
+  auto session = server->sessions.find(fd);
+
+  if (session == server->sessions.end()) {
+    return HTTPD_WS_CLIENT_INVALID;
+  }
+
+  return session->second.websocket ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_HTTP;
+}
+
+inline esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *count, int *fds) {
+  LoopbackServer *server = (LoopbackServer *)handle;
+  std::lock_guard<std::mutex> guard(server->lock);
+
+  if (server->sessions.size() > *count) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  *count = 0;
+
+  for (const auto &session : server->sessions) {
+    fds[(*count)++] = session.first;
+  }
+
+  return ESP_OK;
+}
+
+// Runs the work on the calling thread, one item at a time
+inline esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+  LoopbackServer *server = (LoopbackServer *)handle;
+  std::lock_guard<std::mutex> guard(server->workLock);
+  work(arg);
+  return ESP_OK;
+}
+
+// Ends the session like httpd: its context is freed, then the socket closed
+inline esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int fd) {
+  LoopbackServer *server = (LoopbackServer *)handle;
+  LoopbackSession session;
+
+  {
+    std::lock_guard<std::mutex> guard(server->lock);
+    auto found = server->sessions.find(fd);
+
+    if (found == server->sessions.end()) {
+      return ESP_ERR_NOT_FOUND;
+    }
+
+    session = found->second;
+    server->sessions.erase(found);
+  }
+
+  if (session.freeCtx && session.ctx) {
+    session.freeCtx(session.ctx);
+  }
+
+  if (server->config.close_fn) {
+    server->config.close_fn(handle, fd);
+  } else {
+    close(fd);
+  }
+
+  return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef FAKE_ESP_TIMER_H
+#define FAKE_ESP_TIMER_H
+
+#include "esp_err.h"
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <thread>
+
+// Microseconds since the test started, on the host's monotonic clock
+inline int64_t esp_timer_get_time() {
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef struct {
+  esp_timer_cb_t callback;
+  void *arg;
+  int dispatch_method;
+  const char *name;
+  bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+// A periodic timer is a thread sleeping to absolute deadlines, so a late
+// callback does not push the later ones back, like the real esp_timer.
+// Stopping ends the thread; timers are never freed.
+struct FakeEspTimer {
+  esp_timer_create_args_t args;
+  std::atomic<uint64_t> periodUs{0};
+  std::atomic<uint32_t> generation{0};
+};
+
+typedef FakeEspTimer *esp_timer_handle_t;
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+  FakeEspTimer *timer = new FakeEspTimer();
+  timer->args = *args;
+  *handle = timer;
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+  if (timer->periodUs) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  uint32_t generation = ++timer->generation;
+  timer->periodUs = periodUs;
+
+  std::thread([timer, periodUs, generation]() {
+    auto next = std::chrono::steady_clock::now();
+
+    while (timer->generation == generation) {
+      next += std::chrono::microseconds(periodUs);
+      std::this_thread::sleep_until(next);
+
+      if (timer->generation == generation) {
+        timer->args.callback(timer->args.arg);
+      }
+    }
+  }).detach();
+
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!timer->periodUs) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  timer->generation++;
+  timer->periodUs = 0;
+  return ESP_OK;
+}
+
+#endif
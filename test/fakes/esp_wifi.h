@@ -0,0 +1,25 @@
+#ifndef FAKE_ESP_WIFI_H
+#define FAKE_ESP_WIFI_H
+
+#include "esp_err.h"
+#include <stdint.h>
+
+#define ESP_WIFI_MAX_CONN_NUM 10
+
+typedef struct {
+  uint8_t mac[6];
+  int8_t rssi;
+} wifi_sta_info_t;
+
+typedef struct {
+  wifi_sta_info_t sta[ESP_WIFI_MAX_CONN_NUM];
+  int num;
+} wifi_sta_list_t;
+
+// No stations are connected to the fake access point
+inline esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *list) {
+  list->num = 0;
+  return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef FAKE_FREERTOS_TASK_H
+#define FAKE_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <thread>
+
+// Tasks are host threads. Each one carries the notification counter the
+// firmware uses to wake tasks (xTaskNotifyGive / ulTaskNotifyTake); a plain
+// std::thread started by a test gets one the first time it asks for its handle.
+struct FakeTask {
+  std::mutex lock;
+  std::condition_variable wake;
+  uint32_t notifications = 0;
+};
+
+typedef FakeTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+inline FakeTask *&fakeCurrentTask() {
+  thread_local FakeTask *current = nullptr;
+  thread_local std::unique_ptr<FakeTask> implicit;
+
+  if (!current) {
+    implicit.reset(new FakeTask());
+    current = implicit.get();
+  }
+
+  return current;
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return fakeCurrentTask();
+}
+
+// Priority and core are ignored, the host schedules the threads. The task
+// state is never freed, a handle stays valid for the whole test.
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t entry, const char *name, uint32_t stackDepth, void *arg,
+                                          UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+  FakeTask *task = new FakeTask();
+
+  if (handle) {
+    *handle = task;
+  }
+
+  std::thread([entry, arg, task]() {
+    fakeCurrentTask() = task;
+    entry(arg);
+  }).detach();
+
+  return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t entry, const char *name, uint32_t stackDepth, void *arg,
+                              UBaseType_t priority, TaskHandle_t *handle) {
+  return xTaskCreatePinnedToCore(entry, name, stackDepth, arg, priority, handle, tskNO_AFFINITY);
+}
+
+// Only a task deleting itself is supported
+inline void vTaskDelete(TaskHandle_t task) {
+  if (!task || task == fakeCurrentTask()) {
+    pthread_exit(nullptr);
+  }
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+inline TickType_t xTaskGetTickCount() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifications++;
+  }
+
+  task->wake.notify_one();
+  return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  FakeTask *self = fakeCurrentTask();
+  std::unique_lock<std::mutex> guard(self->lock);
+  auto notified = [self]() { return self->notifications > 0; };
+
+  if (ticks == portMAX_DELAY) {
+    self->wake.wait(guard, notified);
+  } else {
+    self->wake.wait_for(guard, std::chrono::milliseconds(ticks), notified);
+  }
+
+  uint32_t value = self->notifications;
+
+  if (value) {
+    self->notifications = clearOnExit ? 0 : value - 1;
+  }
+
+  return value;
+}
+
+#endif
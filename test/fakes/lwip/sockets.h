@@ -0,0 +1,104 @@
+#ifndef FAKE_LWIP_SOCKETS_H
+#define FAKE_LWIP_SOCKETS_H
+
+#include "esp_timer.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+
+// Sockets the firmware writes to directly (stream and clip senders). Each fd
+// counts what it was sent and can keep a copy; a test can cap its bandwidth
+// like a slow Wi-Fi link, or hang up so the next send fails. None of them is
+// a host descriptor, so close() never reaches the host either.
+
+#define CONFIG_LWIP_MAX_SOCKETS 10
+
+struct FakeSocket {
+  uint64_t bytes = 0;
+  uint32_t sends = 0;
+  uint32_t bytesPerSecond = 0; // 0 for no limit
+  bool keepData = false;
+  bool hungUp = false;
+  int64_t busyUntilUs = 0;
+  std::string data;
+};
+
+struct FakeSockets {
+  std::mutex lock;
+  std::map<int, FakeSocket> sockets;
+
+  // Opens (or reopens) fd with a fresh history
+  void open(int fd, uint32_t bytesPerSecond = 0, bool keepData = false) {
+    std::lock_guard<std::mutex> guard(lock);
+    FakeSocket &socket = sockets[fd];
+    socket = FakeSocket();
+    socket.bytesPerSecond = bytesPerSecond;
+    socket.keepData = keepData;
+  }
+
+  void hangUp(int fd) {
+    std::lock_guard<std::mutex> guard(lock);
+    sockets[fd].hungUp = true;
+  }
+
+  // A copy, so the sender may keep going meanwhile
+  FakeSocket get(int fd) {
+    std::lock_guard<std::mutex> guard(lock);
+    return sockets[fd];
+  }
+};
+
+inline FakeSockets fakeSockets;
+
+// Takes all of data unless the peer hung up; a capped socket blocks the
+// sender as long as the link needs to carry it
+inline ssize_t lwip_send(int fd, const void *data, size_t len, int flags) {
+  int64_t readyAtUs = 0;
+
+  {
+    std::lock_guard<std::mutex> guard(fakeSockets.lock);
+    FakeSocket &socket = fakeSockets.sockets[fd];
+
+    if (socket.hungUp) {
+      return -1;
+    }
+
+    socket.bytes += len;
+    socket.sends++;
+
+    if (socket.keepData) {
+      socket.data.append((const char *)data, len);
+    }
+
+    if (socket.bytesPerSecond) {
+      int64_t now = esp_timer_get_time();
+      int64_t start = socket.busyUntilUs > now ? socket.busyUntilUs : now;
+      socket.busyUntilUs = start + (int64_t)len * 1000000 / socket.bytesPerSecond;
+      readyAtUs = socket.busyUntilUs;
+    }
+  }
+
+  int64_t waitUs = readyAtUs - esp_timer_get_time();
+
+  if (waitUs > 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds(waitUs));
+  }
+
+  return len;
+}
+
+inline int lwip_close(int fd) {
+  fakeSockets.hangUp(fd);
+  return 0;
+}
+
+// Like lwip with LWIP_COMPAT_SOCKETS; the host declarations come first
+#define send(s, data, len, flags) lwip_send(s, data, len, flags)
+#define close(s) lwip_close(s)
+
+#endif
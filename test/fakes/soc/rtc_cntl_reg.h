@@ -0,0 +1,6 @@
+#ifndef FAKE_RTC_CNTL_REG_H
+#define FAKE_RTC_CNTL_REG_H
+
+#define RTC_CNTL_BROWN_OUT_REG 0x3ff480d4
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef FAKE_SOC_H
+#define FAKE_SOC_H
+
+#include <stdint.h>
+
+// Peripheral registers are plain memory; writing one changes nothing
+inline uint32_t fakePeripheralRegister;
+
+#define WRITE_PERI_REG(addr, val) (fakePeripheralRegister = (uint32_t)(val))
+#define READ_PERI_REG(addr) (fakePeripheralRegister)
+
+#endif
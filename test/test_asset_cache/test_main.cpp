@@ -0,0 +1,148 @@
+// Embedded web assets over the loopback httpd: gzip negotiation, ETags and 304s
+#include <Arduino.h>
+#include "config.h"
+#include "AssetCache.h"
+#include "esp_http_server.h"
+#include <string>
+#include <unity.h>
+
+static AssetCache assetCache;
+static httpd_handle_t server;
+
+// Like scriptHandler and friends in carServer.h, one handler per path
+static esp_err_t assetHandler(httpd_req_t *req) {
+  return assetCache.serve(req, (const char *)req->user_ctx);
+}
+
+static const EmbeddedAsset &asset(const char *path) {
+  for (const EmbeddedAsset &candidate : WEB_ASSETS) {
+    if (strcmp(candidate.path, path) == 0) {
+      return candidate;
+    }
+  }
+
+  TEST_FAIL_MESSAGE("asset not embedded");
+  return WEB_ASSETS[0];
+}
+
+static LoopbackResponse get(const char *uri, const LoopbackHeaders &headers = {}) {
+  return loopbackRequest(server, HTTP_GET, uri, headers);
+}
+
+void setUp() {
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  httpd_start(&server, &config);
+
+  for (const EmbeddedAsset &embedded : WEB_ASSETS) {
+    httpd_uri_t uri = {embedded.path, HTTP_GET, assetHandler, (void *)embedded.path};
+    httpd_register_uri_handler(server, &uri);
+  }
+
+  httpd_uri_t missing = {"/missing.js", HTTP_GET, assetHandler, (void *)"/missing.js"};
+  httpd_register_uri_handler(server, &missing);
+}
+
+void tearDown() {
+  httpd_stop(server);
+}
+
+void test_every_asset_has_distinct_tags_and_a_gzip_copy() {
+  for (const EmbeddedAsset &embedded : WEB_ASSETS) {
+    TEST_ASSERT_GREATER_THAN(0, embedded.plain.len);
+    TEST_ASSERT_LESS_THAN(embedded.plain.len, embedded.gzip.len);
+    TEST_ASSERT_EQUAL_HEX8(0x1F, embedded.gzip.data[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x8B, embedded.gzip.data[1]);
+    TEST_ASSERT_EQUAL('"', embedded.plain.etag[0]);
+    TEST_ASSERT_TRUE(strcmp(embedded.plain.etag, embedded.gzip.etag) != 0);
+  }
+}
+
+void test_plain_body_without_accept_encoding() {
+  const EmbeddedAsset &script = asset("/script.js");
+  LoopbackResponse response = get("/script.js");
+
+  TEST_ASSERT_EQUAL_STRING("200 OK", response.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("application/javascript", response.type.c_str());
+  TEST_ASSERT_EQUAL_STRING(script.plain.etag, response.header("ETag"));
+  TEST_ASSERT_EQUAL_STRING("Accept-Encoding", response.header("Vary"));
+  TEST_ASSERT_EQUAL_STRING("no-cache", response.header("Cache-Control"));
+  TEST_ASSERT_NULL(response.header("Content-Encoding"));
+  TEST_ASSERT_TRUE(response.body == std::string((const char *)script.plain.data, script.plain.len));
+}
+
+void test_gzip_body_when_accepted() {
+  const EmbeddedAsset &style = asset("/style.css");
+  LoopbackResponse response = get("/style.css", {{"Accept-Encoding", "br, gzip, deflate"}});
+
+  TEST_ASSERT_EQUAL_STRING("200 OK", response.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("gzip", response.header("Content-Encoding"));
+  TEST_ASSERT_EQUAL_STRING(style.gzip.etag, response.header("ETag"));
+  TEST_ASSERT_TRUE(response.body == std::string((const char *)style.gzip.data, style.gzip.len));
+}
+
+void test_gzip_refused_with_q_zero() {
+  LoopbackResponse response = get("/style.css", {{"Accept-Encoding", "gzip;q=0, identity"}});
+
+  TEST_ASSERT_NULL(response.header("Content-Encoding"));
+  TEST_ASSERT_EQUAL_STRING(asset("/style.css").plain.etag, response.header("ETag"));
+
+  TEST_ASSERT_TRUE(acceptsGzip("gzip;q=0.5"));
+  TEST_ASSERT_FALSE(acceptsGzip("gzip;q=0.0"));
+  TEST_ASSERT_FALSE(acceptsGzip("deflate"));
+  TEST_ASSERT_FALSE(acceptsGzip(nullptr));
+}
+
+void test_matching_if_none_match_gets_304() {
+  const EmbeddedAsset &index = asset("/index.html");
+  LoopbackResponse response = get("/index.html", {{"If-None-Match", index.plain.etag}});
+
+  TEST_ASSERT_EQUAL_STRING("304 Not Modified", response.status.c_str());
+  TEST_ASSERT_EQUAL(0, response.body.size());
+  TEST_ASSERT_EQUAL_STRING(index.plain.etag, response.header("ETag"));
+
+  // The gzip tag only matches when the gzip copy would be sent
+  response = get("/index.html", {{"Accept-Encoding", "gzip"}, {"If-None-Match", index.gzip.etag}});
+  TEST_ASSERT_EQUAL_STRING("304 Not Modified", response.status.c_str());
+
+  response = get("/index.html", {{"If-None-Match", index.gzip.etag}});
+  TEST_ASSERT_EQUAL_STRING("200 OK", response.status.c_str());
+  TEST_ASSERT_EQUAL(index.plain.len, response.body.size());
+}
+
+void test_weak_lists_and_wildcards_match() {
+  const EmbeddedAsset &script = asset("/script.js");
+  std::string weak = std::string("W/") + script.plain.etag;
+  std::string list = std::string("\"00000000\",  ") + script.plain.etag + " , \"ffffffff\"";
+
+  const char *notModified[] = {weak.c_str(), list.c_str(), "*"};
+
+  for (const char *ifNoneMatch : notModified) {
+    LoopbackResponse response = get("/script.js", {{"If-None-Match", ifNoneMatch}});
+    TEST_ASSERT_EQUAL_STRING("304 Not Modified", response.status.c_str());
+  }
+
+  LoopbackResponse response = get("/script.js", {{"If-None-Match", "\"00000000\""}});
+  TEST_ASSERT_EQUAL_STRING("200 OK", response.status.c_str());
+
+  // A prefix of the tag is not the tag
+  std::string prefix(script.plain.etag, strlen(script.plain.etag) - 2);
+  TEST_ASSERT_FALSE(etagMatches(prefix.c_str(), script.plain.etag));
+  TEST_ASSERT_FALSE(etagMatches("", script.plain.etag));
+}
+
+void test_unknown_path_is_404() {
+  LoopbackResponse response = get("/missing.js");
+  TEST_ASSERT_EQUAL_STRING("404 Not Found", response.status.c_str());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_asset_has_distinct_tags_and_a_gzip_copy);
+  RUN_TEST(test_plain_body_without_accept_encoding);
+  RUN_TEST(test_gzip_body_when_accepted);
+  RUN_TEST(test_gzip_refused_with_q_zero);
+  RUN_TEST(test_matching_if_none_match_gets_304);
+  RUN_TEST(test_weak_lists_and_wildcards_match);
+  RUN_TEST(test_unknown_path_is_404);
+  return UNITY_END();
+}
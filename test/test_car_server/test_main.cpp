@@ -0,0 +1,184 @@
+// The whole firmware booted on the host, driven through its /ws endpoint
+#include <Arduino.h>
+#include "main.cpp"
+#include <string>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+#define WS_FD 61
+#define STREAM_FD 71
+
+static bool contains(const std::vector<std::string> &texts, const std::string &prefix) {
+  for (const std::string &text : texts) {
+    if (text.compare(0, prefix.size(), prefix) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void sendFrame(uint8_t opcode, uint16_t seq, int16_t a, int16_t b = 0) {
+  uint8_t data[CAR_FRAME_SIZE];
+  encodeCommandFrame({CAR_PROTOCOL_VERSION, opcode, seq, a, b}, data);
+  TEST_ASSERT_EQUAL(ESP_OK, loopbackWsFrame(camera_httpd, "/ws", HTTPD_WS_TYPE_BINARY, data, sizeof(data), WS_FD));
+}
+
+// Last duty written to a motor channel since the recorder was reset, -1 for none
+static int lastMotorDuty(uint8_t channel) {
+  static HalOutputEvent events[HAL_RECORD_SIZE];
+  uint32_t count = halRecorder.snapshot(events);
+  int duty = -1;
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (events[i].kind == HalOutput::PWM && events[i].channel == channel) {
+      duty = events[i].value;
+    }
+  }
+
+  return duty;
+}
+
+// Takes every frame like sentry does, on its own thread, until stopAtUs
+static void internalConsumer(bool *subscribed, uint32_t *frames, int64_t stopAtUs) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  *subscribed = frameHub.subscribeInternal(self);
+  uint32_t lastSeq = 0;
+
+  while (*subscribed && esp_timer_get_time() < stopAtUs) {
+    SharedFrame *frame = frameHub.acquire(lastSeq, pdMS_TO_TICKS(200));
+
+    if (frame) {
+      lastSeq = frame->seq;
+      (*frames)++;
+      frameHub.release(frame);
+    }
+  }
+
+  frameHub.unsubscribe(self);
+}
+
+static uint32_t viewerFrames(int fd) {
+  for (int i = 0; i < FRAME_HUB_MAX_VIEWERS; i++) {
+    if (streamViewers[i].inUse && streamViewers[i].fd == fd) {
+      return streamViewers[i].totalFrames;
+    }
+  }
+
+  return 0;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_setup_starts_both_servers() {
+  setup();
+
+  TEST_ASSERT_NOT_NULL(camera_httpd);
+  TEST_ASSERT_NOT_NULL(stream_httpd);
+}
+
+void test_handshake_reports_the_car_state() {
+  LoopbackResponse response = loopbackRequest(camera_httpd, HTTP_GET, "/ws", {}, WS_FD);
+  TEST_ASSERT_EQUAL(ESP_OK, response.result);
+  TEST_ASSERT_EQUAL(HTTPD_WS_CLIENT_WEBSOCKET, httpd_ws_get_fd_info(camera_httpd, WS_FD));
+
+  std::vector<std::string> texts = loopbackWsTexts(camera_httpd, WS_FD);
+  TEST_ASSERT_TRUE(contains(texts, "Flash-OFF"));
+  TEST_ASSERT_TRUE(contains(texts, "WIFI-1"));
+  TEST_ASSERT_TRUE(contains(texts, "FRAMESIZE-"));
+  TEST_ASSERT_TRUE(contains(texts, "AUTOQ-"));
+}
+
+void test_binary_move_frame_reaches_the_motor_pwm() {
+  sendFrame(OP_ACK, 1, 1);
+  halRecorder.reset();
+  uint32_t pwmBefore = halWriteCount(HalOutput::PWM);
+
+  sendFrame(OP_MOVE, 2, MOVE_FORWARD);
+
+  for (int i = 0; i < 100 && !contains(loopbackWsTexts(camera_httpd, WS_FD), "ACK-2-"); i++) {
+    delay(5);
+  }
+
+  TEST_ASSERT_TRUE(contains(loopbackWsTexts(camera_httpd, WS_FD), "ACK-2-"));
+
+  // The motion profile ramps the motors up over the following ticks
+  delay(200);
+  TEST_ASSERT_GREATER_THAN(pwmBefore, halWriteCount(HalOutput::PWM));
+  TEST_ASSERT_GREATER_THAN(0, lastMotorDuty(LEFT_MOTOR_PWM_CHANNEL_1) + lastMotorDuty(LEFT_MOTOR_PWM_CHANNEL_2));
+  TEST_ASSERT_GREATER_THAN(0, lastMotorDuty(RIGHT_MOTOR_PWM_CHANNEL_1) + lastMotorDuty(RIGHT_MOTOR_PWM_CHANNEL_2));
+
+  sendFrame(OP_MOVE, 3, MOVE_STOP);
+  delay(300);
+  TEST_ASSERT_EQUAL(0, lastMotorDuty(LEFT_MOTOR_PWM_CHANNEL_1) + lastMotorDuty(LEFT_MOTOR_PWM_CHANNEL_2));
+  TEST_ASSERT_EQUAL(0, lastMotorDuty(RIGHT_MOTOR_PWM_CHANNEL_1) + lastMotorDuty(RIGHT_MOTOR_PWM_CHANNEL_2));
+}
+
+void test_malformed_frame_moves_nothing() {
+  halRecorder.reset();
+  uint32_t pwmBefore = halWriteCount(HalOutput::PWM);
+  uint8_t data[CAR_FRAME_SIZE - 1] = {CAR_PROTOCOL_VERSION, OP_MOVE, 4, 0, MOVE_FORWARD, 0, 0};
+
+  loopbackWsFrame(camera_httpd, "/ws", HTTPD_WS_TYPE_BINARY, data, sizeof(data), WS_FD);
+  delay(100);
+
+  TEST_ASSERT_EQUAL(pwmBefore, halWriteCount(HalOutput::PWM));
+}
+
+// A parked car facing a wall: the browser gets keep-alives, sentry everything
+void test_static_scene_thins_only_the_browser_stream() {
+  const int measureMs = 3000;
+  syntheticCamera.setStill(true);
+  fakeSockets.open(STREAM_FD);
+  TEST_ASSERT_EQUAL(ESP_OK, loopbackRequest(stream_httpd, HTTP_GET, "/stream", {}, STREAM_FD).result);
+
+  bool subscribed = false;
+  uint32_t internalFrames = 0;
+  int64_t settleUs = esp_timer_get_time() + 1000000;
+  int64_t stopAtUs = settleUs + measureMs * 1000LL;
+  std::thread consumer(internalConsumer, &subscribed, &internalFrames, stopAtUs);
+
+  // Long enough for SCENE_STATIC_FRAMES unchanged frames
+  delay(1000);
+  uint32_t viewerBefore = viewerFrames(STREAM_FD);
+  uint32_t internalBefore = internalFrames;
+  delay(measureMs);
+  uint32_t viewerStatic = viewerFrames(STREAM_FD) - viewerBefore;
+
+  consumer.join();
+  uint32_t internalStatic = internalFrames - internalBefore;
+  bool sceneStatic = sceneDetector.isStatic();
+
+  // A changing picture brings the browser back to full rate
+  syntheticCamera.setStill(false);
+  delay(300);
+  viewerBefore = viewerFrames(STREAM_FD);
+  delay(1000);
+  uint32_t viewerMoving = viewerFrames(STREAM_FD) - viewerBefore;
+
+  fakeSockets.hangUp(STREAM_FD);
+  for (int i = 0; i < 200 && activeViewerCount() > 0; i++) {
+    delay(10);
+  }
+
+  TEST_ASSERT_TRUE(subscribed);
+  TEST_ASSERT_TRUE(sceneStatic);
+  TEST_ASSERT_GREATER_OR_EQUAL(measureMs * 1000 / SCENE_KEEPALIVE_US - 1, viewerStatic);
+  TEST_ASSERT_LESS_OR_EQUAL(measureMs * 1000 / SCENE_KEEPALIVE_US + 1, viewerStatic);
+  TEST_ASSERT_GREATER_OR_EQUAL(measureMs * HAL_SYNTHETIC_FPS / 1000 * 8 / 10, internalStatic);
+  TEST_ASSERT_GREATER_OR_EQUAL(STREAM_TARGET_FPS / 2, viewerMoving);
+  TEST_ASSERT_EQUAL(0, activeViewerCount());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_setup_starts_both_servers);
+  RUN_TEST(test_handshake_reports_the_car_state);
+  RUN_TEST(test_binary_move_frame_reaches_the_motor_pwm);
+  RUN_TEST(test_malformed_frame_moves_nothing);
+  RUN_TEST(test_static_scene_thins_only_the_browser_stream);
+  return UNITY_END();
+}
@@ -0,0 +1,289 @@
+// MpscQueue under many producers, and the control loop draining it on its timer
+#define SD_RECORDING 1 // the SD pin handover goes through the queue too
+#include <Arduino.h>
+#include "config.h"
+#include "ControlLoop.h"
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+Car car;
+
+static std::mutex ackLock;
+static std::vector<CommandAck> acks;
+
+static void onAck(const CommandAck &ack) {
+  std::lock_guard<std::mutex> guard(ackLock);
+  acks.push_back(ack);
+}
+
+static size_t ackCount() {
+  std::lock_guard<std::mutex> guard(ackLock);
+  return acks.size();
+}
+
+void setUp() {
+  std::lock_guard<std::mutex> guard(ackLock);
+  acks.clear();
+}
+
+void tearDown() {}
+
+void test_queue_fills_empties_and_wraps() {
+  MpscQueue<uint32_t, 8> queue;
+  uint32_t value = 0;
+
+  TEST_ASSERT_FALSE(queue.pop(value));
+
+  // Many laps, so positions run far past the cell count
+  for (uint32_t lap = 0; lap < 1000; lap++) {
+    for (uint32_t i = 0; i < 8; i++) {
+      TEST_ASSERT_TRUE(queue.push(lap * 8 + i));
+    }
+
+    TEST_ASSERT_FALSE(queue.push(0));
+
+    for (uint32_t i = 0; i < 8; i++) {
+      TEST_ASSERT_TRUE(queue.pop(value));
+      TEST_ASSERT_EQUAL(lap * 8 + i, value);
+    }
+
+    TEST_ASSERT_FALSE(queue.pop(value));
+  }
+}
+
+void test_many_producers_lose_and_reorder_nothing() {
+  const int producers = 4;
+  const uint32_t perProducer = 200000;
+  static MpscQueue<uint32_t, 16> queue;
+  std::atomic<uint32_t> fullPushes(0);
+  std::vector<std::thread> threads;
+
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([p, &fullPushes]() {
+      for (uint32_t i = 0; i < perProducer; i++) {
+        while (!queue.push((uint32_t)p << 24 | i)) {
+          fullPushes.fetch_add(1, std::memory_order_relaxed);
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // Each producer's values arrive in its own order, one after the other
+  uint32_t expected[producers] = {};
+  uint32_t received = 0;
+  uint32_t value;
+
+  while (received < producers * perProducer) {
+    if (!queue.pop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    int p = value >> 24;
+    TEST_ASSERT_LESS_THAN(producers, p);
+    TEST_ASSERT_EQUAL(expected[p], value & 0xFFFFFF);
+    expected[p]++;
+    received++;
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  TEST_ASSERT_FALSE(queue.pop(value));
+
+  for (int p = 0; p < producers; p++) {
+    TEST_ASSERT_EQUAL(perProducer, expected[p]);
+  }
+
+  // The queue was really contended, not drained as fast as it filled
+  TEST_ASSERT_GREATER_THAN(0, fullPushes.load());
+}
+
+void test_submit_refuses_and_counts_when_full() {
+  ControlLoop idle;
+
+  for (int i = 0; i < CONTROL_QUEUE_SIZE; i++) {
+    TEST_ASSERT_TRUE(idle.submit(CarCommandType::CAMERA, i, 0));
+  }
+
+  TEST_ASSERT_FALSE(idle.submit(CarCommandType::CAMERA, 0, 0));
+  TEST_ASSERT_FALSE(idle.submit(CarCommandType::MOVE, MOVE_STOP));
+  TEST_ASSERT_EQUAL(2, idle.getDroppedCommands());
+}
+
+void test_commands_from_many_tasks_are_all_applied_and_acked() {
+  const int senders = 4;
+  const int perSender = 50;
+  std::atomic<uint32_t> accepted(0);
+  std::vector<std::thread> threads;
+  uint32_t droppedBefore = controlLoop.getDroppedCommands();
+  uint32_t ticksBefore = controlLoop.getTicks();
+
+  // Camera drags from several sockets at a few hundred Hz each
+  for (int s = 0; s < senders; s++) {
+    threads.emplace_back([s, &accepted]() {
+      for (int i = 0; i < perSender; i++) {
+        int x = (i * 37 + s * 11) % 201 - 100;
+
+        if (controlLoop.submit(CarCommandType::CAMERA, x, -x, 60 + s, i)) {
+          accepted++;
+        }
+
+        delay(2);
+      }
+    });
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  // Camera acks wait at most CONTROL_ACK_TIMEOUT_US for the servos
+  for (int i = 0; i < 300 && ackCount() < accepted; i++) {
+    delay(10);
+  }
+
+  TEST_ASSERT_EQUAL(senders * perSender, accepted.load() + controlLoop.getDroppedCommands() - droppedBefore);
+  TEST_ASSERT_GREATER_THAN(senders * perSender * 9 / 10, accepted.load());
+  TEST_ASSERT_EQUAL(accepted.load(), ackCount());
+  TEST_ASSERT_GREATER_THAN(ticksBefore, controlLoop.getTicks());
+
+  std::set<std::pair<int, int>> seen;
+  std::lock_guard<std::mutex> guard(ackLock);
+
+  for (const CommandAck &ack : acks) {
+    TEST_ASSERT_TRUE(ack.type == CarCommandType::CAMERA);
+    TEST_ASSERT_TRUE(seen.insert({ack.fd, ack.seq}).second);
+
+    // Outputs move after the command left the queue, never before
+    if (ack.actuateUs >= 0) {
+      TEST_ASSERT_GREATER_OR_EQUAL((int32_t)ack.queueUs, ack.actuateUs);
+    }
+  }
+}
+
+void test_drive_reaches_the_motor_pwm() {
+  uint32_t pwmBefore = halWriteCount(HalOutput::PWM);
+
+  controlLoop.submit(CarCommandType::SESSION);
+  TEST_ASSERT_TRUE(controlLoop.submit(CarCommandType::DRIVE, 100, 0, 70, 1));
+
+  for (int i = 0; i < 100 && ackCount() < 1; i++) {
+    delay(5);
+  }
+
+  TEST_ASSERT_EQUAL(1, ackCount());
+  TEST_ASSERT_GREATER_THAN(pwmBefore, halWriteCount(HalOutput::PWM));
+
+  std::lock_guard<std::mutex> guard(ackLock);
+  TEST_ASSERT_EQUAL(70, acks[0].fd);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, acks[0].actuateUs);
+  TEST_ASSERT_LESS_THAN(100000, acks[0].actuateUs);
+}
+
+void test_sd_pin_handover_is_confirmed_by_the_control_task() {
+  ControlLoop idle;
+
+  // A stray notification must not pass for the confirmation
+  xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+  TEST_ASSERT_FALSE(idle.handOverSdPins(true, 50));
+
+  const uint8_t motorPins[] = {LEFT_MOTOR_IN1, LEFT_MOTOR_IN2, RIGHT_MOTOR_IN1, RIGHT_MOTOR_IN2};
+  for (uint8_t pin : motorPins) {
+    fakePins.level[pin] = HIGH;
+  }
+
+  TEST_ASSERT_TRUE(controlLoop.handOverSdPins(true, 500));
+
+  for (uint8_t pin : motorPins) {
+    TEST_ASSERT_EQUAL(-1, fakePins.ledcChannel[pin]);
+    TEST_ASSERT_EQUAL(LOW, fakePins.level[pin]);
+  }
+  TEST_ASSERT_EQUAL(-1, fakePins.ledcChannel[SERVO_X_PIN]);
+
+  // Driving goes nowhere while the card has the pins
+  uint32_t pwmBefore = halWriteCount(HalOutput::PWM);
+  controlLoop.submit(CarCommandType::SESSION);
+  controlLoop.submit(CarCommandType::DRIVE, 100, 0);
+  delay(50);
+  TEST_ASSERT_EQUAL(pwmBefore, halWriteCount(HalOutput::PWM));
+
+  TEST_ASSERT_TRUE(controlLoop.handOverSdPins(false, 500));
+  TEST_ASSERT_NOT_EQUAL(-1, fakePins.ledcChannel[LEFT_MOTOR_IN1]);
+  TEST_ASSERT_NOT_EQUAL(-1, fakePins.ledcChannel[SERVO_X_PIN]);
+
+  controlLoop.submit(CarCommandType::DRIVE, 0, 0);
+}
+
+// Runs before the control task starts: this test steps its own loop, and
+// through it the car, on this thread and a helper
+void test_late_release_does_not_confirm_the_reclaim() {
+  ControlLoop stepped;
+
+  // The release times out and lands on a later tick
+  TEST_ASSERT_FALSE(stepped.handOverSdPins(true, 0));
+  stepped.tick(1, esp_timer_get_time());
+  TEST_ASSERT_TRUE(car.hasReleasedSdPins());
+
+  // Drive commands meanwhile neither reach the watchdog nor leave targets
+  int64_t lastCommandUs = car.getWatchdog().getLastCommandUs();
+  stepped.submit(CarCommandType::SESSION);
+  stepped.submit(CarCommandType::DRIVE, 100, 0);
+  stepped.submit(CarCommandType::MOVE, MOVE_FORWARD);
+  stepped.tick(1, esp_timer_get_time());
+  TEST_ASSERT_EQUAL(lastCommandUs, car.getWatchdog().getLastCommandUs());
+  TEST_ASSERT_TRUE(car.isDriveSettled());
+
+  // Nothing ticks, so the reclaim is not applied and must not report it was
+  TEST_ASSERT_FALSE(stepped.handOverSdPins(false, 20));
+  stepped.tick(1, esp_timer_get_time());
+  TEST_ASSERT_FALSE(car.hasReleasedSdPins());
+  TEST_ASSERT_TRUE(car.isDriveSettled());
+
+  // A late release racing the next reclaim: a confirmed reclaim always
+  // finds the pins back with the car
+  std::atomic<bool> stop(false);
+  std::thread ticker([&] {
+    while (!stop) {
+      stepped.tick(1, esp_timer_get_time());
+      delay(1);
+    }
+  });
+
+  int confirmed = 0;
+  int stillReleased = 0;
+  for (int i = 0; i < 200; i++) {
+    stepped.handOverSdPins(true, 0);
+
+    if (stepped.handOverSdPins(false, 500)) {
+      confirmed++;
+      stillReleased += car.hasReleasedSdPins();
+    }
+  }
+
+  stop = true;
+  ticker.join();
+  TEST_ASSERT_EQUAL(200, confirmed);
+  TEST_ASSERT_EQUAL(0, stillReleased);
+}
+
+int main() {
+  controlLoop.setAckHandler(onAck);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_late_release_does_not_confirm_the_reclaim);
+  startControlLoop();
+
+  RUN_TEST(test_queue_fills_empties_and_wraps);
+  RUN_TEST(test_many_producers_lose_and_reorder_nothing);
+  RUN_TEST(test_submit_refuses_and_counts_when_full);
+  RUN_TEST(test_commands_from_many_tasks_are_all_applied_and_acked);
+  RUN_TEST(test_drive_reaches_the_motor_pwm);
+  RUN_TEST(test_sd_pin_handover_is_confirmed_by_the_control_task);
+  return UNITY_END();
+}
@@ -0,0 +1,209 @@
+// Dead-man watchdog replayed against the command timing script.js produces
+#include "CommandWatchdog.h"
+#include <unity.h>
+#include <vector>
+
+#define TICK_US 5000 // the control loop checks every tick
+#define FRAME_US 16660 // a 60.02 Hz display, so a 300 ms keepalive lands on frame 19 (317 ms)
+
+void setUp() {}
+
+void tearDown() {}
+
+// Browser frames at 60 Hz, like requestAnimationFrame
+static int64_t frameTime(int frame) {
+  return (int64_t)frame * FRAME_US;
+}
+
+struct Command {
+  int64_t us;
+  bool repeat; // a keepalive, the input did not change
+};
+
+// What update() in script.js sends: a frame where the input changed, and a
+// keepalive on the first frame keepaliveMs after the last send while moving.
+// The input keeps changing (a stick being moved) for the first changingMs of
+// every periodMs, or only at the start without a period.
+static std::vector<Command> driveTrace(int keepaliveMs, int changingMs, int totalMs, int periodMs = 0) {
+  std::vector<Command> sends;
+  int64_t lastSent = -1000000000;
+
+  for (int frame = 0; frameTime(frame) < totalMs * 1000LL; frame++) {
+    int64_t now = frameTime(frame);
+    int64_t phase = periodMs ? now % (periodMs * 1000LL) : now;
+    bool changed = frame == 0 || phase < changingMs * 1000LL;
+
+    if (changed || now - lastSent >= keepaliveMs * 1000LL) {
+      sends.push_back({now, !changed});
+      lastSent = now;
+    }
+  }
+
+  return sends;
+}
+
+// Arrival times after 2-30 ms of Wi-Fi and TCP delay per message, in order
+static std::vector<Command> overWifi(const std::vector<Command> &sends, uint32_t seed = 1) {
+  std::vector<Command> arrivals;
+  uint32_t rng = seed;
+  int64_t last = 0;
+
+  for (const Command &sent : sends) {
+    rng = rng * 1664525u + 1013904223u;
+    int64_t arrival = sent.us + 2000 + (rng >> 8) % 28000;
+    last = arrival > last ? arrival : last;
+    arrivals.push_back({last, sent.repeat});
+  }
+
+  return arrivals;
+}
+
+// Feeds the commands in at their times and runs check() every control tick
+static uint32_t replay(CommandWatchdog &watchdog, const std::vector<Command> &sends, int64_t startUs = 1000000) {
+  uint32_t tripsBefore = watchdog.getTrips();
+  size_t next = 0;
+  int64_t endUs = sends.back().us + TICK_US;
+
+  for (int64_t t = 0; t <= endUs; t += TICK_US) {
+    while (next < sends.size() && sends[next].us <= t) {
+      watchdog.onCommand(startUs + sends[next].us, sends[next].repeat);
+      next++;
+    }
+
+    watchdog.check(startUs + t);
+  }
+
+  return watchdog.getTrips() - tripsBefore;
+}
+
+#define SCRIPT_KEEPALIVE_MS 300 // KEEPALIVE_INTERVAL in lib/script.js
+
+// What script.js sends never trips, over many Wi-Fi delay patterns
+void test_held_key_never_trips() {
+  for (uint32_t seed = 1; seed <= 50; seed++) {
+    CommandWatchdog watchdog;
+    std::vector<Command> arrivals = overWifi(driveTrace(SCRIPT_KEEPALIVE_MS, 0, 10000), seed);
+
+    TEST_ASSERT_EQUAL(0, replay(watchdog, arrivals));
+  }
+}
+
+void test_held_stick_never_trips() {
+  for (uint32_t seed = 1; seed <= 50; seed++) {
+    CommandWatchdog watchdog;
+    std::vector<Command> arrivals = overWifi(driveTrace(SCRIPT_KEEPALIVE_MS, 1000, 10000), seed);
+
+    TEST_ASSERT_EQUAL(0, replay(watchdog, arrivals));
+  }
+}
+
+// Half a second of stick movement every two seconds, held in between: the
+// bursts at frame rate must not talk the deadline below the keepalive
+void test_moving_then_holding_over_and_over_never_trips() {
+  for (uint32_t seed = 1; seed <= 50; seed++) {
+    CommandWatchdog watchdog;
+    std::vector<Command> arrivals = overWifi(driveTrace(SCRIPT_KEEPALIVE_MS, 500, 20000, 2000), seed);
+
+    TEST_ASSERT_EQUAL(0, replay(watchdog, arrivals));
+  }
+}
+
+// Holding still is what saves messages, against 60 per second while moving
+void test_held_input_sends_a_few_messages_per_second() {
+  std::vector<Command> sends = driveTrace(SCRIPT_KEEPALIVE_MS, 0, 10000);
+
+  TEST_ASSERT_LESS_OR_EQUAL(10 * 4, sends.size());
+}
+
+// The learned deadline follows the keepalive, so a dropout still stops the
+// car within about half a second
+void test_deadline_settles_near_the_keepalive() {
+  CommandWatchdog watchdog;
+  replay(watchdog, overWifi(driveTrace(SCRIPT_KEEPALIVE_MS, 1000, 10000)));
+
+  TEST_ASSERT_GREATER_THAN(345000, watchdog.getDeadlineUs());
+  TEST_ASSERT_LESS_THAN(550000, watchdog.getDeadlineUs());
+}
+
+void test_gap_after_a_trip_is_learned_up_to_the_maximum() {
+  CommandWatchdog watchdog;
+  watchdog.onCommand(0);
+
+  TEST_ASSERT_FALSE(watchdog.check(WATCHDOG_MAX_MS * 1000L));
+  TEST_ASSERT_TRUE(watchdog.check(WATCHDOG_MAX_MS * 1000L + 1));
+  TEST_ASSERT_FALSE(watchdog.check(WATCHDOG_MAX_MS * 1000L + 100000)); // reported once
+
+  int32_t before = watchdog.getMeanUs();
+  watchdog.onCommand(5000000); // long silence, counted as WATCHDOG_MAX_MS
+  TEST_ASSERT_EQUAL(before + (WATCHDOG_MAX_MS * 1000L - before) / 8, watchdog.getMeanUs());
+  TEST_ASSERT_EQUAL(1, watchdog.getTrips());
+}
+
+void test_stop_and_reset_forget_a_trip() {
+  CommandWatchdog watchdog;
+  watchdog.onCommand(0);
+  TEST_ASSERT_TRUE(watchdog.check(900000));
+
+  int32_t mean = watchdog.getMeanUs();
+  watchdog.onStop();
+  watchdog.onCommand(1500000);
+  TEST_ASSERT_EQUAL(mean, watchdog.getMeanUs());
+
+  TEST_ASSERT_TRUE(watchdog.check(2400000));
+  watchdog.reset();
+  watchdog.onCommand(3000000);
+  TEST_ASSERT_EQUAL(WATCHDOG_INITIAL_INTERVAL_MS * 1000L, watchdog.getMeanUs());
+}
+
+void test_a_driver_that_goes_silent_is_still_stopped() {
+  CommandWatchdog watchdog;
+  std::vector<Command> arrivals = overWifi(driveTrace(SCRIPT_KEEPALIVE_MS, 0, 3000));
+  replay(watchdog, arrivals);
+
+  // Even with the longest learned deadline the car stops within the bound
+  int64_t last = 1000000 + arrivals.back().us;
+  TEST_ASSERT_FALSE(watchdog.check(last + watchdog.getDeadlineUs()));
+  TEST_ASSERT_TRUE(watchdog.check(last + WATCHDOG_MAX_MS * 1000L + 1));
+}
+
+// A moving stick sends a new value every frame, none of it is a keepalive
+void test_changing_input_does_not_teach_the_cadence() {
+  CommandWatchdog watchdog;
+  watchdog.onCommand(0);
+
+  for (int frame = 1; frame < 300; frame++) {
+    watchdog.onCommand(frameTime(frame), false);
+  }
+
+  TEST_ASSERT_EQUAL(WATCHDOG_INITIAL_INTERVAL_MS * 1000L, watchdog.getMeanUs());
+  TEST_ASSERT_FALSE(watchdog.check(frameTime(299) + SCRIPT_KEEPALIVE_MS * 1000L + 30000));
+}
+
+// A button client repeating the same command every 50 ms
+void test_steady_commands_keep_the_minimum_deadline() {
+  CommandWatchdog watchdog;
+
+  for (int i = 0; i < 200; i++) {
+    watchdog.onCommand(i * 50000LL);
+    TEST_ASSERT_FALSE(watchdog.check(i * 50000LL + 10000));
+  }
+
+  TEST_ASSERT_INT_WITHIN(2000, 50000, watchdog.getMeanUs());
+  TEST_ASSERT_EQUAL(WATCHDOG_MIN_MS * 1000L, watchdog.getDeadlineUs());
+  TEST_ASSERT_EQUAL(0, watchdog.getTrips());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_held_key_never_trips);
+  RUN_TEST(test_held_stick_never_trips);
+  RUN_TEST(test_moving_then_holding_over_and_over_never_trips);
+  RUN_TEST(test_held_input_sends_a_few_messages_per_second);
+  RUN_TEST(test_deadline_settles_near_the_keepalive);
+  RUN_TEST(test_gap_after_a_trip_is_learned_up_to_the_maximum);
+  RUN_TEST(test_stop_and_reset_forget_a_trip);
+  RUN_TEST(test_a_driver_that_goes_silent_is_still_stopped);
+  RUN_TEST(test_changing_input_does_not_teach_the_cadence);
+  RUN_TEST(test_steady_commands_keep_the_minimum_deadline);
+  return UNITY_END();
+}
@@ -0,0 +1,216 @@
+// Fan-out from the capture task to several viewers, fed by the synthetic
+// camera. A viewer that stops reading must not cost the others frames.
+#include <Arduino.h>
+#include "config.h"
+#include "FrameHub.h"
+#include <atomic>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+#define RUN_MS 1500
+
+struct ViewerStats {
+  bool subscribed = false;
+  uint32_t frames = 0;
+  uint32_t outOfOrder = 0;
+  uint32_t broken = 0;
+};
+
+static bool isJpeg(const SharedFrame *frame) {
+  return frame->len > 4 && frame->buf[0] == 0xFF && frame->buf[1] == 0xD8 && frame->buf[frame->len - 2] == 0xFF &&
+         frame->buf[frame->len - 1] == 0xD9;
+}
+
+// Takes every frame it is offered until stopAtUs, the way a stream sender
+// does. Runs on its own thread, so it only records and the test asserts.
+static void fastViewer(ViewerStats *stats, int64_t stopAtUs) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  stats->subscribed = frameHub.subscribe(self);
+
+  if (!stats->subscribed) {
+    return;
+  }
+
+  uint32_t lastSeq = 0;
+
+  while (esp_timer_get_time() < stopAtUs) {
+    SharedFrame *frame = frameHub.acquire(lastSeq, pdMS_TO_TICKS(200));
+
+    if (!frame) {
+      continue;
+    }
+
+    if (frame->seq <= lastSeq) {
+      stats->outOfOrder++;
+    }
+
+    if (!isJpeg(frame)) {
+      stats->broken++;
+    }
+
+    lastSeq = frame->seq;
+    stats->frames++;
+    frameHub.release(frame);
+  }
+
+  frameHub.unsubscribe(self);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_a_stalled_viewer_does_not_slow_the_others() {
+  const int fastViewers = FRAME_HUB_MAX_VIEWERS - 1;
+  TaskHandle_t stalled = xTaskGetCurrentTaskHandle();
+  TEST_ASSERT_TRUE(frameHub.subscribe(stalled));
+
+  // Hold one frame for the whole run and never ask for another
+  SharedFrame *held = frameHub.acquire(0, pdMS_TO_TICKS(1000));
+  TEST_ASSERT_NOT_NULL(held);
+
+  uint32_t droppedBefore = frameHub.getDroppedFrames();
+  uint32_t seqBefore = held->seq;
+  int64_t stopAtUs = esp_timer_get_time() + RUN_MS * 1000LL;
+  std::vector<ViewerStats> stats(fastViewers);
+  std::vector<std::thread> viewers;
+
+  for (int i = 0; i < fastViewers; i++) {
+    viewers.emplace_back(fastViewer, &stats[i], stopAtUs);
+  }
+
+  for (std::thread &viewer : viewers) {
+    viewer.join();
+  }
+
+  // Every viewer saw (nearly) every frame the camera produced meanwhile
+  uint32_t expected = RUN_MS * HAL_SYNTHETIC_FPS / 1000;
+
+  for (const ViewerStats &viewer : stats) {
+    TEST_ASSERT_TRUE(viewer.subscribed);
+    TEST_ASSERT_GREATER_OR_EQUAL(expected * 8 / 10, viewer.frames);
+    TEST_ASSERT_EQUAL(0, viewer.outOfOrder);
+    TEST_ASSERT_EQUAL(0, viewer.broken);
+  }
+
+  // The held frame was never recycled under the stalled viewer
+  TEST_ASSERT_EQUAL(seqBefore, held->seq);
+  TEST_ASSERT_TRUE(isJpeg(held));
+  TEST_ASSERT_EQUAL(droppedBefore, frameHub.getDroppedFrames());
+
+  frameHub.release(held);
+  frameHub.unsubscribe(stalled);
+}
+
+// Every viewer keeps the camera's frame rate, however many are watching
+void test_each_viewer_keeps_the_camera_rate_from_one_to_max_viewers() {
+  const int runMs = 600;
+  uint32_t expected = runMs * HAL_SYNTHETIC_FPS / 1000;
+
+  for (int count = 1; count <= FRAME_HUB_MAX_VIEWERS; count++) {
+    int64_t stopAtUs = esp_timer_get_time() + runMs * 1000LL;
+    std::vector<ViewerStats> stats(count);
+    std::vector<std::thread> viewers;
+
+    for (int i = 0; i < count; i++) {
+      viewers.emplace_back(fastViewer, &stats[i], stopAtUs);
+    }
+
+    for (std::thread &viewer : viewers) {
+      viewer.join();
+    }
+
+    for (const ViewerStats &viewer : stats) {
+      TEST_ASSERT_TRUE(viewer.subscribed);
+      TEST_ASSERT_GREATER_OR_EQUAL(expected * 8 / 10, viewer.frames);
+      TEST_ASSERT_LESS_OR_EQUAL(expected * 12 / 10 + 1, viewer.frames);
+      TEST_ASSERT_EQUAL(0, viewer.outOfOrder);
+      TEST_ASSERT_EQUAL(0, viewer.broken);
+    }
+  }
+}
+
+void test_a_viewer_that_resumes_gets_the_newest_frame() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  TEST_ASSERT_TRUE(frameHub.subscribe(self));
+
+  SharedFrame *first = frameHub.acquire(0, pdMS_TO_TICKS(1000));
+  TEST_ASSERT_NOT_NULL(first);
+  uint32_t firstSeq = first->seq;
+  frameHub.release(first);
+
+  // Stall for ten frame times, then read again
+  delay(10 * 1000 / HAL_SYNTHETIC_FPS);
+
+  SharedFrame *next = frameHub.acquire(firstSeq, pdMS_TO_TICKS(1000));
+  TEST_ASSERT_NOT_NULL(next);
+  TEST_ASSERT_GREATER_OR_EQUAL(firstSeq + 8, next->seq);
+  frameHub.release(next);
+
+  frameHub.unsubscribe(self);
+}
+
+void test_subscriptions_beyond_the_limit_are_refused() {
+  std::vector<FakeTask> tasks(FRAME_HUB_MAX_VIEWERS + 1);
+
+  for (int i = 0; i < FRAME_HUB_MAX_VIEWERS; i++) {
+    TEST_ASSERT_TRUE(frameHub.subscribe(&tasks[i]));
+  }
+
+  TEST_ASSERT_FALSE(frameHub.subscribe(&tasks[FRAME_HUB_MAX_VIEWERS]));
+  TEST_ASSERT_EQUAL(FRAME_HUB_MAX_VIEWERS, frameHub.viewerCount());
+
+  for (int i = 0; i < FRAME_HUB_MAX_VIEWERS; i++) {
+    frameHub.unsubscribe(&tasks[i]);
+  }
+
+  TEST_ASSERT_EQUAL(0, frameHub.viewerCount());
+}
+
+void test_internal_consumers_leave_every_viewer_slot_free() {
+  std::vector<FakeTask> internal(FRAME_HUB_INTERNAL_VIEWERS + 1);
+  std::vector<FakeTask> viewers(FRAME_HUB_MAX_VIEWERS);
+
+  for (int i = 0; i < FRAME_HUB_INTERNAL_VIEWERS; i++) {
+    TEST_ASSERT_TRUE(frameHub.subscribeInternal(&internal[i]));
+  }
+
+  TEST_ASSERT_FALSE(frameHub.subscribeInternal(&internal[FRAME_HUB_INTERNAL_VIEWERS]));
+
+  for (int i = 0; i < FRAME_HUB_MAX_VIEWERS; i++) {
+    TEST_ASSERT_TRUE(frameHub.subscribe(&viewers[i]));
+  }
+
+  TEST_ASSERT_EQUAL(FRAME_HUB_CONSUMERS, frameHub.viewerCount());
+
+  for (int i = 0; i < FRAME_HUB_INTERNAL_VIEWERS; i++) {
+    frameHub.unsubscribe(&internal[i]);
+  }
+
+  for (int i = 0; i < FRAME_HUB_MAX_VIEWERS; i++) {
+    frameHub.unsubscribe(&viewers[i]);
+  }
+
+  TEST_ASSERT_EQUAL(0, frameHub.viewerCount());
+}
+
+int main() {
+  camera_config_t config = {};
+  config.frame_size = FRAMESIZE_QVGA;
+  config.jpeg_quality = 12;
+  halCameraInit(&config);
+
+  // The synthetic patterns all encode to the same size, which the scene
+  // detector would take for a parked car
+  sceneDetector.setEnabled(false);
+  startFrameCapture();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_a_stalled_viewer_does_not_slow_the_others);
+  RUN_TEST(test_each_viewer_keeps_the_camera_rate_from_one_to_max_viewers);
+  RUN_TEST(test_a_viewer_that_resumes_gets_the_newest_frame);
+  RUN_TEST(test_subscriptions_beyond_the_limit_are_refused);
+  RUN_TEST(test_internal_consumers_leave_every_viewer_slot_free);
+  return UNITY_END();
+}
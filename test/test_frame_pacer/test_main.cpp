@@ -0,0 +1,133 @@
+// FramePacer against a throttled fake socket, on a simulated clock
+#include "FramePacer.h"
+#include <unity.h>
+
+#define FRAME_BYTES 20000
+
+// Drains at bytesPerSec; a send blocks until the last byte has left, like a
+// full lwip send buffer does
+class ThrottledSocket {
+public:
+  explicit ThrottledSocket(uint32_t rate)
+      : bytesPerSec(rate) {}
+
+  void setRate(uint32_t rate) {
+    bytesPerSec = rate;
+  }
+
+  uint32_t send(size_t bytes) {
+    return (uint64_t)bytes * 1000000 / bytesPerSec;
+  }
+
+private:
+  uint32_t bytesPerSec;
+};
+
+// What a stream sender loop achieves over a number of frames
+struct PacedRun {
+  uint32_t frames;
+  uint64_t elapsedUs;
+
+  uint32_t fpsTimes10() const {
+    return (uint64_t)frames * 10000000 / elapsedUs;
+  }
+};
+
+static PacedRun stream(FramePacer &pacer, ThrottledSocket &socket, uint32_t frames) {
+  PacedRun run = {frames, 0};
+
+  for (uint32_t i = 0; i < frames; i++) {
+    uint32_t sendUs = socket.send(FRAME_BYTES);
+    pacer.onFrameSent(sendUs, FRAME_BYTES);
+    run.elapsedUs += sendUs + pacer.nextDelayUs();
+  }
+
+  return run;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_a_fast_link_runs_at_the_target_rate() {
+  FramePacer pacer(20);
+  ThrottledSocket socket(4000000); // 5 ms per frame
+
+  PacedRun run = stream(pacer, socket, 100);
+
+  TEST_ASSERT_FALSE(pacer.isCongested());
+  TEST_ASSERT_EQUAL(50000, pacer.getIntervalUs());
+  TEST_ASSERT_INT_WITHIN(2, 200, run.fpsTimes10());
+}
+
+void test_a_slow_link_converges_to_its_own_rate() {
+  FramePacer pacer(20);
+  ThrottledSocket socket(200000); // 100 ms per frame, the link carries 10 fps
+
+  stream(pacer, socket, 10);
+  TEST_ASSERT_TRUE(pacer.isCongested());
+
+  // Settled: the interval is the send time plus a quarter headroom and the
+  // measured rate is the link's
+  PacedRun run = stream(pacer, socket, 100);
+
+  TEST_ASSERT_INT_WITHIN(1000, 125000, pacer.getIntervalUs());
+  TEST_ASSERT_INT_WITHIN(2000, 200000, pacer.getBytesPerSec());
+  TEST_ASSERT_INT_WITHIN(2, 80, run.fpsTimes10());
+}
+
+void test_the_interval_follows_bandwidth_steps() {
+  FramePacer pacer(20);
+  ThrottledSocket socket(4000000);
+
+  stream(pacer, socket, 20);
+  TEST_ASSERT_FALSE(pacer.isCongested());
+
+  // The link drops to a quarter of what 20 fps needs
+  socket.setRate(100000);
+  uint32_t framesToSettle = 0;
+
+  while (pacer.getIntervalUs() < 250000 * 9 / 10 && framesToSettle < 100) {
+    stream(pacer, socket, 1);
+    framesToSettle++;
+  }
+
+  // EWMA with alpha 1/8: within 90% after about 17 frames
+  TEST_ASSERT_LESS_OR_EQUAL(20, framesToSettle);
+  TEST_ASSERT_INT_WITHIN(3, 40, stream(pacer, socket, 100).fpsTimes10());
+
+  // And it recovers once the link is fast again
+  socket.setRate(4000000);
+  framesToSettle = 0;
+
+  while (pacer.isCongested() && framesToSettle < 100) {
+    stream(pacer, socket, 1);
+    framesToSettle++;
+  }
+
+  TEST_ASSERT_LESS_OR_EQUAL(30, framesToSettle);
+  TEST_ASSERT_EQUAL(50000, pacer.getIntervalUs());
+}
+
+void test_the_next_delay_never_goes_negative() {
+  FramePacer pacer(20);
+
+  // One send stalls far past the interval: take the next frame right away
+  pacer.onFrameSent(5000, FRAME_BYTES);
+  pacer.onFrameSent(200000, FRAME_BYTES);
+  TEST_ASSERT_EQUAL(0, pacer.nextDelayUs());
+
+  pacer.setTargetFps(0);
+  TEST_ASSERT_EQUAL(1000000 / STREAM_MIN_FPS, pacer.getTargetIntervalUs());
+  pacer.setTargetFps(200);
+  TEST_ASSERT_EQUAL(1000000 / STREAM_MAX_FPS, pacer.getTargetIntervalUs());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_a_fast_link_runs_at_the_target_rate);
+  RUN_TEST(test_a_slow_link_converges_to_its_own_rate);
+  RUN_TEST(test_the_interval_follows_bandwidth_steps);
+  RUN_TEST(test_the_next_delay_never_goes_negative);
+  return UNITY_END();
+}
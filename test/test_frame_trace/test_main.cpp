@@ -0,0 +1,188 @@
+// LatencyHistogram buckets and percentiles, and the FrameTrace record ring
+#include "FrameTrace.h"
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_buckets_are_powers_of_two() {
+  TEST_ASSERT_EQUAL(0, LatencyHistogram::bucketFor(0));
+  TEST_ASSERT_EQUAL(0, LatencyHistogram::bucketFor(1));
+  TEST_ASSERT_EQUAL(1, LatencyHistogram::bucketFor(2));
+  TEST_ASSERT_EQUAL(1, LatencyHistogram::bucketFor(3));
+  TEST_ASSERT_EQUAL(9, LatencyHistogram::bucketFor(1023));
+  TEST_ASSERT_EQUAL(10, LatencyHistogram::bucketFor(1024));
+  TEST_ASSERT_EQUAL(LATENCY_BUCKETS - 1, LatencyHistogram::bucketFor(UINT32_MAX));
+
+  // Every value is at most its bucket's limit and above the one before
+  for (uint32_t us = 1; us < (1UL << LATENCY_BUCKETS); us = us * 3 + 1) {
+    int bucket = LatencyHistogram::bucketFor(us);
+    TEST_ASSERT_LESS_OR_EQUAL(LatencyHistogram::bucketLimit(bucket), us);
+
+    if (bucket > 0) {
+      TEST_ASSERT_GREATER_THAN(LatencyHistogram::bucketLimit(bucket - 1), us);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(UINT32_MAX, LatencyHistogram::bucketLimit(LATENCY_BUCKETS - 1));
+}
+
+void test_count_mean_and_max() {
+  LatencyHistogram histogram;
+
+  TEST_ASSERT_EQUAL(0, histogram.count());
+  TEST_ASSERT_EQUAL(0, histogram.meanUs());
+  TEST_ASSERT_EQUAL(0, histogram.percentileUs(50));
+
+  histogram.record(100);
+  histogram.record(300);
+  histogram.record(2000);
+
+  TEST_ASSERT_EQUAL(3, histogram.count());
+  TEST_ASSERT_EQUAL(800, histogram.meanUs());
+  TEST_ASSERT_EQUAL(2400, histogram.getSumUs());
+  TEST_ASSERT_EQUAL(2000, histogram.getMaxUs());
+  TEST_ASSERT_EQUAL(1, histogram.bucketCount(LatencyHistogram::bucketFor(300)));
+
+  histogram.reset();
+  TEST_ASSERT_EQUAL(0, histogram.count());
+  TEST_ASSERT_EQUAL(0, histogram.getMaxUs());
+  TEST_ASSERT_EQUAL(0, histogram.bucketCount(LatencyHistogram::bucketFor(300)));
+}
+
+void test_percentiles_interpolate_inside_the_bucket() {
+  LatencyHistogram histogram;
+
+  // 100 samples spread evenly over [1024, 2047], one bucket
+  for (uint32_t i = 0; i < 100; i++) {
+    histogram.record(1024 + i * 1023 / 99);
+  }
+
+  // Linear inside [1024, max]: within the bucket's resolution of the truth
+  TEST_ASSERT_INT_WITHIN(20, 1024 + 1023 / 2, histogram.percentileUs(50));
+  TEST_ASSERT_INT_WITHIN(20, 1024 + 1023 * 9 / 10, histogram.percentileUs(90));
+  TEST_ASSERT_EQUAL(2047, histogram.percentileUs(100));
+}
+
+void test_percentiles_pick_the_right_bucket() {
+  LatencyHistogram histogram;
+
+  // 90 fast samples and 10 slow ones: p50 is fast, p95 and p99 are slow
+  for (int i = 0; i < 90; i++) {
+    histogram.record(200);
+  }
+
+  for (int i = 0; i < 10; i++) {
+    histogram.record(50000);
+  }
+
+  TEST_ASSERT_EQUAL(LatencyHistogram::bucketFor(200), LatencyHistogram::bucketFor(histogram.percentileUs(50)));
+  TEST_ASSERT_EQUAL(LatencyHistogram::bucketFor(200), LatencyHistogram::bucketFor(histogram.percentileUs(90)));
+  TEST_ASSERT_EQUAL(LatencyHistogram::bucketFor(50000), LatencyHistogram::bucketFor(histogram.percentileUs(95)));
+
+  // Never above what was actually recorded
+  TEST_ASSERT_LESS_OR_EQUAL(50000, histogram.percentileUs(99));
+  TEST_ASSERT_LESS_OR_EQUAL(200, histogram.percentileUs(50));
+}
+
+void test_records_from_many_threads_all_count() {
+  LatencyHistogram histogram;
+  const int threads = 4;
+  const int perThread = 50000;
+  std::vector<std::thread> workers;
+
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&histogram, t]() {
+      for (int i = 0; i < perThread; i++) {
+        histogram.record(t * 1000 + i % 1000);
+      }
+    });
+  }
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  uint32_t inBuckets = 0;
+
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    inBuckets += histogram.bucketCount(i);
+  }
+
+  TEST_ASSERT_EQUAL(threads * perThread, histogram.count());
+  TEST_ASSERT_EQUAL(threads * perThread, inBuckets);
+  TEST_ASSERT_EQUAL((threads - 1) * 1000 + 999, histogram.getMaxUs());
+}
+
+static FrameTraceRecord traceFor(uint32_t seq, int64_t capturedUs) {
+  FrameTraceRecord trace = {};
+  trace.seq = seq;
+  trace.capturedUs = capturedUs;
+  trace.dequeuedUs = capturedUs + 1000;
+  trace.headerSentUs = capturedUs + 1100;
+  trace.payloadSentUs = capturedUs + 9100;
+  trace.returnedUs = capturedUs + 9200;
+  return trace;
+}
+
+void test_stage_histograms_split_the_frame_time() {
+  FrameTrace trace;
+  trace.record(traceFor(1, 5000000));
+
+  TEST_ASSERT_EQUAL(1000, trace.histogram(FrameTrace::QUEUE).getMaxUs());
+  TEST_ASSERT_EQUAL(100, trace.histogram(FrameTrace::HEADER).getMaxUs());
+  TEST_ASSERT_EQUAL(8000, trace.histogram(FrameTrace::PAYLOAD).getMaxUs());
+  TEST_ASSERT_EQUAL(9100, trace.histogram(FrameTrace::TOTAL).getMaxUs());
+
+  // A capture stamp from a different clock than esp_timer must not wrap
+  FrameTraceRecord skewed = traceFor(2, 5000000);
+  skewed.capturedUs = skewed.payloadSentUs + 1;
+  trace.record(skewed);
+  TEST_ASSERT_EQUAL(0, trace.histogram(FrameTrace::QUEUE).bucketCount(LATENCY_BUCKETS - 1));
+  TEST_ASSERT_EQUAL(9100, trace.histogram(FrameTrace::TOTAL).getMaxUs());
+}
+
+void test_snapshot_keeps_the_newest_records_in_order() {
+  FrameTrace trace;
+  FrameTraceRecord out[FRAME_TRACE_RING_SIZE];
+
+  for (uint32_t seq = 1; seq <= 10; seq++) {
+    trace.record(traceFor(seq, seq * 50000));
+  }
+
+  TEST_ASSERT_EQUAL(10, trace.snapshot(out));
+  TEST_ASSERT_EQUAL(1, out[0].seq);
+  TEST_ASSERT_EQUAL(10, out[9].seq);
+
+  // Past the ring size only the last FRAME_TRACE_RING_SIZE remain
+  for (uint32_t seq = 11; seq <= FRAME_TRACE_RING_SIZE + 25; seq++) {
+    trace.record(traceFor(seq, seq * 50000));
+  }
+
+  TEST_ASSERT_EQUAL(FRAME_TRACE_RING_SIZE, trace.snapshot(out));
+  TEST_ASSERT_EQUAL(26, out[0].seq);
+
+  for (int i = 1; i < FRAME_TRACE_RING_SIZE; i++) {
+    TEST_ASSERT_EQUAL(out[i - 1].seq + 1, out[i].seq);
+  }
+
+  // reset() clears the histograms, the records stay for /trace
+  trace.reset();
+  TEST_ASSERT_EQUAL(0, trace.histogram(FrameTrace::TOTAL).count());
+  TEST_ASSERT_EQUAL(FRAME_TRACE_RING_SIZE, trace.snapshot(out));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_buckets_are_powers_of_two);
+  RUN_TEST(test_count_mean_and_max);
+  RUN_TEST(test_percentiles_interpolate_inside_the_bucket);
+  RUN_TEST(test_percentiles_pick_the_right_bucket);
+  RUN_TEST(test_records_from_many_threads_all_count);
+  RUN_TEST(test_stage_histograms_split_the_frame_time);
+  RUN_TEST(test_snapshot_keeps_the_newest_records_in_order);
+  return UNITY_END();
+}
@@ -0,0 +1,146 @@
+// The fake HAL itself: synthetic camera, recorded outputs and the loopback
+// httpd the other suites build on
+#include <Arduino.h>
+#include "config.h"
+#include "Hal.h"
+#include "esp_http_server.h"
+#include <unity.h>
+#include <string>
+
+void setUp() {
+  halRecorder.reset();
+  fakePins.reset();
+}
+
+void tearDown() {}
+
+static camera_config_t syntheticConfig(framesize_t frameSize) {
+  camera_config_t config = {};
+  config.frame_size = frameSize;
+  config.jpeg_quality = 12;
+  return config;
+}
+
+static bool isJpeg(const camera_fb_t *fb) {
+  return fb->len > 4 && fb->buf[0] == 0xFF && fb->buf[1] == 0xD8 && fb->buf[fb->len - 2] == 0xFF &&
+         fb->buf[fb->len - 1] == 0xD9;
+}
+
+void test_synthetic_camera_serves_jpeg_frames_at_its_rate() {
+  camera_config_t config = syntheticConfig(FRAMESIZE_QVGA);
+  TEST_ASSERT_EQUAL(ESP_OK, halCameraInit(&config));
+
+  camera_fb_t *first = halCameraGrab();
+  TEST_ASSERT_NOT_NULL(first);
+  TEST_ASSERT_TRUE(isJpeg(first));
+  TEST_ASSERT_EQUAL(320, first->width);
+  TEST_ASSERT_EQUAL(240, first->height);
+  halCameraReturn(first);
+
+  int64_t start = esp_timer_get_time();
+  const int frames = 10;
+  std::string previous;
+
+  for (int i = 0; i < frames; i++) {
+    camera_fb_t *fb = halCameraGrab();
+    TEST_ASSERT_NOT_NULL(fb);
+    TEST_ASSERT_TRUE(isJpeg(fb));
+
+    // Consecutive frames are different test patterns
+    std::string frame((const char *)fb->buf, fb->len);
+    halCameraReturn(fb);
+    TEST_ASSERT_TRUE(frame != previous);
+    previous = frame;
+  }
+
+  int64_t elapsedUs = esp_timer_get_time() - start;
+  TEST_ASSERT_GREATER_OR_EQUAL((frames - 1) * 1000000LL / HAL_SYNTHETIC_FPS, elapsedUs);
+}
+
+void test_synthetic_camera_follows_frame_size_changes() {
+  camera_config_t config = syntheticConfig(FRAMESIZE_QVGA);
+  halCameraInit(&config);
+
+  camera_fb_t *small = halCameraGrab();
+  size_t smallLen = small->len;
+  halCameraReturn(small);
+
+  sensor_t *sensor = halCameraSensor();
+  TEST_ASSERT_EQUAL(0, sensor->set_framesize(sensor, FRAMESIZE_VGA));
+
+  camera_fb_t *large = halCameraGrab();
+  TEST_ASSERT_EQUAL(640, large->width);
+  TEST_ASSERT_EQUAL(480, large->height);
+  TEST_ASSERT_GREATER_THAN(smallLen, large->len);
+  halCameraReturn(large);
+}
+
+void test_output_writes_are_recorded_and_reach_the_pins() {
+  uint32_t pwmBefore = halWriteCount(HalOutput::PWM);
+  Servo servo;
+  servo.attach(2, 6);
+
+  halPwmWrite(3, 200);
+  halServoWrite(servo, 6, 45);
+  halDigitalWrite(4, HIGH);
+
+  TEST_ASSERT_EQUAL(pwmBefore + 1, halWriteCount(HalOutput::PWM));
+  TEST_ASSERT_EQUAL(200, fakePins.ledcDuty[3]);
+  TEST_ASSERT_EQUAL(45, servo.read());
+  TEST_ASSERT_EQUAL(HIGH, fakePins.level[4]);
+
+  HalOutputEvent events[HAL_RECORD_SIZE];
+  TEST_ASSERT_EQUAL(3, halRecorder.snapshot(events));
+  TEST_ASSERT_TRUE(events[0].kind == HalOutput::PWM);
+  TEST_ASSERT_EQUAL(200, events[0].value);
+  TEST_ASSERT_TRUE(events[1].kind == HalOutput::SERVO);
+  TEST_ASSERT_EQUAL(6, events[1].channel);
+  TEST_ASSERT_TRUE(events[2].kind == HalOutput::GPIO);
+  TEST_ASSERT_LESS_OR_EQUAL(events[2].timeUs, events[0].timeUs);
+}
+
+static esp_err_t echoHandler(httpd_req_t *req) {
+  char query[32];
+  char name[16] = "nobody";
+  char agent[32] = "";
+
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    httpd_query_key_value(query, "name", name, sizeof(name));
+  }
+
+  httpd_req_get_hdr_value_str(req, "User-Agent", agent, sizeof(agent));
+
+  char body[64];
+  snprintf(body, sizeof(body), "%s via %s", name, agent);
+  httpd_resp_set_type(req, "text/plain");
+  httpd_resp_set_hdr(req, "X-Fd", httpd_req_to_sockfd(req) == 7 ? "7" : "?");
+  return httpd_resp_sendstr(req, body);
+}
+
+void test_loopback_server_runs_registered_handlers() {
+  httpd_handle_t server = nullptr;
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  TEST_ASSERT_EQUAL(ESP_OK, httpd_start(&server, &config));
+
+  httpd_uri_t echo = {"/echo", HTTP_GET, echoHandler, nullptr};
+  TEST_ASSERT_EQUAL(ESP_OK, httpd_register_uri_handler(server, &echo));
+
+  LoopbackResponse response = loopbackRequest(server, HTTP_GET, "/echo?name=car", {{"user-agent", "test"}}, 7);
+  TEST_ASSERT_EQUAL(ESP_OK, response.result);
+  TEST_ASSERT_EQUAL_STRING("200 OK", response.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("text/plain", response.type.c_str());
+  TEST_ASSERT_EQUAL_STRING("car via test", response.body.c_str());
+  TEST_ASSERT_EQUAL_STRING("7", response.header("x-fd"));
+
+  TEST_ASSERT_EQUAL_STRING("404 Not Found", loopbackRequest(server, HTTP_GET, "/missing").status.c_str());
+  httpd_stop(server);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_synthetic_camera_serves_jpeg_frames_at_its_rate);
+  RUN_TEST(test_synthetic_camera_follows_frame_size_changes);
+  RUN_TEST(test_output_writes_are_recorded_and_reach_the_pins);
+  RUN_TEST(test_loopback_server_runs_registered_handlers);
+  return UNITY_END();
+}
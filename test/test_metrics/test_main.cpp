@@ -0,0 +1,101 @@
+// Metrics registry: declaration order, readouts, and updates from many tasks at once
+#include "Metrics.h"
+#include <string.h>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+static int64_t readoutValue = 0;
+
+static CounterMetric requests("test_requests_total", "Requests");
+static GaugeMetric level("test_level", "Level");
+static LatencyHistogram latency;
+static HistogramMetric latencyMetric("test_latency_seconds", "Latency", latency);
+static ReadoutMetric readout("test_readout", "Read at scrape time", MetricType::GAUGE,
+                             []() -> int64_t { return readoutValue; });
+static CounterMetric wrapping("test_wrapping_total", "Wraps");
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_registry_lists_metrics_in_declaration_order() {
+  const char *expected[] = {"test_requests_total", "test_level", "test_latency_seconds", "test_readout",
+                            "test_wrapping_total"};
+  int i = 0;
+
+  for (const Metric *metric = Metric::first(); metric; metric = metric->getNext()) {
+    TEST_ASSERT_LESS_THAN(5, i);
+    TEST_ASSERT_EQUAL_STRING(expected[i++], metric->getName());
+  }
+
+  TEST_ASSERT_EQUAL(5, i);
+  TEST_ASSERT_EQUAL_STRING("histogram", Metric::typeToString(latencyMetric.getType()));
+}
+
+void test_readouts_are_read_at_scrape_time() {
+  readoutValue = 42;
+  TEST_ASSERT_EQUAL(42, readout.getValue());
+
+  readoutValue = -7;
+  TEST_ASSERT_EQUAL(-7, readout.getValue());
+}
+
+void test_counters_wrap_like_a_reset() {
+  wrapping.inc(UINT32_MAX);
+  wrapping.inc(3);
+
+  TEST_ASSERT_EQUAL(2, wrapping.get());
+}
+
+// Every update from every task lands, none waits on another
+void test_updates_from_many_tasks_lose_nothing() {
+  const int tasks = 4;
+  const int perTask = 100000;
+  std::vector<std::thread> threads;
+
+  uint32_t requestsBefore = requests.get();
+  latency.reset();
+
+  for (int t = 0; t < tasks; t++) {
+    threads.emplace_back([t]() {
+      for (int i = 0; i < perTask; i++) {
+        requests.inc();
+        level.set(t * perTask + i);
+        latency.record(1 + i % 1000);
+      }
+    });
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  TEST_ASSERT_EQUAL(requestsBefore + tasks * perTask, requests.get());
+  TEST_ASSERT_EQUAL(tasks * perTask, latency.count());
+  TEST_ASSERT_EQUAL((uint64_t)tasks * (perTask / 1000) * (1000 * 1001 / 2), latency.getSumUs());
+  TEST_ASSERT_EQUAL(1000, latency.getMaxUs());
+
+  // Some task's last value, never a torn mix of two
+  int32_t last = level.get();
+  TEST_ASSERT_EQUAL(perTask - 1, last % perTask);
+}
+
+// What the firmware relies on; Metrics.h checks the 32-bit case at compile time
+void test_32_bit_updates_are_lock_free() {
+  std::atomic<uint32_t> counter(0);
+  std::atomic<int32_t> gauge(0);
+
+  TEST_ASSERT_TRUE(counter.is_lock_free());
+  TEST_ASSERT_TRUE(gauge.is_lock_free());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_registry_lists_metrics_in_declaration_order);
+  RUN_TEST(test_readouts_are_read_at_scrape_time);
+  RUN_TEST(test_counters_wrap_like_a_reset);
+  RUN_TEST(test_updates_from_many_tasks_lose_nothing);
+  RUN_TEST(test_32_bit_updates_are_lock_free);
+  return UNITY_END();
+}
@@ -0,0 +1,147 @@
+// The SWAR SAD kernel against its scalar reference, and MotionModel on both
+#include "MotionKernel.h"
+#include <random>
+#include <unity.h>
+
+// Row strides from a single block up to a wide frame, all 4-byte multiples
+static const size_t STRIDES[] = {MOTION_BLOCK, 12, MOTION_WIDTH, 100, 1600};
+#define MAX_STRIDE 1600
+#define GRID_ROWS (2 * MOTION_BLOCK)
+
+alignas(4) static uint8_t gridA[GRID_ROWS * MAX_STRIDE];
+alignas(4) static uint8_t gridB[GRID_ROWS * MAX_STRIDE];
+alignas(4) static uint8_t luma[MOTION_WIDTH * MOTION_HEIGHT];
+
+static const uint8_t EDGES[] = {0, 1, 63, 64, 126, MOTION_LUMA_MAX};
+
+// Every 8x8 block of both grids at this stride, including the last column
+// that ends exactly at the row end
+static void assertKernelsAgree(size_t stride) {
+  for (size_t y = 0; y + MOTION_BLOCK <= GRID_ROWS; y += 4) {
+    for (size_t x = 0; x + MOTION_BLOCK <= stride; x += 4) {
+      size_t offset = y * stride + x;
+      uint32_t scalar = motionBlockSadScalar(gridA + offset, gridB + offset, stride);
+
+      TEST_ASSERT_EQUAL_UINT32(scalar, motionBlockSadSwar(gridA + offset, gridB + offset, stride));
+      TEST_ASSERT_EQUAL_UINT32(scalar, motionBlockSadSwar(gridB + offset, gridA + offset, stride));
+    }
+  }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_random_grids_match() {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> byte(0, MOTION_LUMA_MAX);
+
+  for (size_t stride : STRIDES) {
+    for (int round = 0; round < 20; round++) {
+      for (size_t i = 0; i < GRID_ROWS * stride; i++) {
+        gridA[i] = byte(rng);
+        gridB[i] = byte(rng);
+      }
+
+      assertKernelsAgree(stride);
+    }
+  }
+}
+
+void test_edge_value_grids_match() {
+  std::mt19937 rng(2);
+  std::uniform_int_distribution<int> pick(0, sizeof(EDGES) - 1);
+
+  for (size_t stride : STRIDES) {
+    for (int round = 0; round < 20; round++) {
+      for (size_t i = 0; i < GRID_ROWS * stride; i++) {
+        gridA[i] = EDGES[pick(rng)];
+        gridB[i] = EDGES[pick(rng)];
+      }
+
+      assertKernelsAgree(stride);
+    }
+  }
+}
+
+// The largest possible SAD, 64 * 127, in every block, and zero
+void test_extreme_grids_match() {
+  for (size_t stride : STRIDES) {
+    for (size_t i = 0; i < GRID_ROWS * stride; i++) {
+      gridA[i] = (i + i / stride) & 1 ? MOTION_LUMA_MAX : 0;
+      gridB[i] = MOTION_LUMA_MAX - gridA[i];
+    }
+
+    assertKernelsAgree(stride);
+    TEST_ASSERT_EQUAL_UINT32(MOTION_BLOCK * MOTION_BLOCK * MOTION_LUMA_MAX, motionBlockSadSwar(gridA, gridB, stride));
+    TEST_ASSERT_EQUAL_UINT32(0, motionBlockSadSwar(gridA, gridA, stride));
+  }
+}
+
+// Every pair of 7-bit values in every lane, next to lanes going the other way
+void test_every_pixel_pair_matches() {
+  for (uint32_t a = 0; a <= MOTION_LUMA_MAX; a++) {
+    for (uint32_t b = 0; b <= MOTION_LUMA_MAX; b++) {
+      uint32_t expected = a > b ? a - b : b - a;
+
+      for (int lane = 0; lane < 4; lane++) {
+        uint32_t wordA = 0, wordB = 0;
+
+        for (int i = 0; i < 4; i++) {
+          wordA |= (i == lane ? a : (i & 1 ? 0 : MOTION_LUMA_MAX)) << (8 * i);
+          wordB |= (i == lane ? b : (i & 1 ? MOTION_LUMA_MAX : 0)) << (8 * i);
+        }
+
+        TEST_ASSERT_EQUAL_UINT32(expected, (swarAbsDiff7(wordA, wordB) >> (8 * lane)) & 0xFF);
+      }
+    }
+  }
+}
+
+// A bright square crossing a noisy frame: both kernels see the same motion
+void test_models_agree_frame_by_frame() {
+  static MotionModel scalarModel(motionBlockSadScalar);
+  static MotionModel swarModel(motionBlockSadSwar);
+  std::mt19937 rng(3);
+  std::uniform_int_distribution<int> noise(0, 6);
+  int motionFrames = 0;
+
+  for (int frame = 0; frame < 60; frame++) {
+    int squareX = frame * (MOTION_WIDTH - 20) / 60;
+
+    for (int y = 0; y < MOTION_HEIGHT; y++) {
+      for (int x = 0; x < MOTION_WIDTH; x++) {
+        bool inSquare = frame >= MOTION_WARMUP_FRAMES && x >= squareX && x < squareX + 20 && y >= 20 && y < 40;
+        luma[y * MOTION_WIDTH + x] = inSquare ? MOTION_LUMA_MAX : 40 + noise(rng);
+      }
+    }
+
+    MotionResult scalar = scalarModel.update(luma);
+    MotionResult swar = swarModel.update(luma);
+
+    TEST_ASSERT_EQUAL(scalar.activeBlocks, swar.activeBlocks);
+    TEST_ASSERT_EQUAL(scalar.left, swar.left);
+    TEST_ASSERT_EQUAL(scalar.top, swar.top);
+    TEST_ASSERT_EQUAL(scalar.right, swar.right);
+    TEST_ASSERT_EQUAL(scalar.bottom, swar.bottom);
+
+    for (int block = 0; block < MOTION_BLOCKS; block++) {
+      TEST_ASSERT_EQUAL_UINT32(scalarModel.blockSad(block), swarModel.blockSad(block));
+    }
+
+    motionFrames += swar.isMotion();
+  }
+
+  // The square is seen, so the comparison covered active blocks too
+  TEST_ASSERT_GREATER_THAN(40, motionFrames);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_random_grids_match);
+  RUN_TEST(test_edge_value_grids_match);
+  RUN_TEST(test_extreme_grids_match);
+  RUN_TEST(test_every_pixel_pair_matches);
+  RUN_TEST(test_models_agree_frame_by_frame);
+  return UNITY_END();
+}
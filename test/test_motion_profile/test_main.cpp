@@ -0,0 +1,235 @@
+// Motion profiles against their closed forms, and Motor's deadband mapping
+#include <Arduino.h>
+#include "config.h"
+#include "Motor.h"
+#include <math.h>
+#include <unity.h>
+
+#define TICK_US 5000
+
+void setUp() {
+  fakePins.reset();
+}
+
+void tearDown() {}
+
+// Constant acceleration a from rest: v = a t until the target
+static double trapezoid(double t, double a, double target) {
+  return fmin(a * t, target);
+}
+
+// Jerk-limited from rest to target with acceleration limit a and jerk j:
+// a jerk ramp up, an optional constant-acceleration stretch, a ramp down
+static double sCurve(double t, double a, double j, double target) {
+  double ramp = a / j;
+
+  // Too short to reach a: a triangular acceleration peaking at sqrt(target * j)
+  if (a * ramp > target) {
+    ramp = sqrt(target / j);
+    a = j * ramp;
+  }
+
+  double cruise = (target - a * ramp) / a;
+  double total = 2 * ramp + cruise;
+
+  if (t >= total) {
+    return target;
+  }
+
+  if (t < ramp) {
+    return j * t * t / 2;
+  }
+
+  if (t < ramp + cruise) {
+    return a * ramp / 2 + a * (t - ramp);
+  }
+
+  double left = total - t;
+  return target - j * left * left / 2;
+}
+
+void test_trapezoid_follows_constant_acceleration() {
+  MotionProfile profile;
+  profile.configure(ProfileShape::TRAPEZOID, 2500, 25000);
+  profile.setTarget(255);
+
+  for (int tick = 1; tick <= 40; tick++) {
+    int16_t effort = profile.update(TICK_US);
+    double expected = trapezoid(tick * TICK_US / 1e6, 2500, 255);
+    TEST_ASSERT_INT_WITHIN(1, (int)ceil(expected), effort);
+  }
+
+  TEST_ASSERT_TRUE(profile.isSettled());
+  TEST_ASSERT_EQUAL(255, profile.getEffort());
+}
+
+void test_s_curve_follows_the_jerk_limited_profile() {
+  const int targets[] = {255, 120, 40};
+
+  for (int target : targets) {
+    MotionProfile profile;
+    profile.setTarget(target);
+    int tick = 0;
+
+    while (!profile.isSettled() && tick < 200) {
+      tick++;
+      int16_t effort = profile.update(TICK_US);
+      double expected = sCurve(tick * TICK_US / 1e6, MOTION_DEFAULT_ACCEL, MOTION_DEFAULT_JERK, target);
+      TEST_ASSERT_INT_WITHIN(3, (int)round(expected), effort);
+    }
+
+    // Settles within two ticks of the analytic end time
+    double ramp = fmin(MOTION_DEFAULT_ACCEL / (double)MOTION_DEFAULT_JERK, sqrt(target / (double)MOTION_DEFAULT_JERK));
+    double peak = MOTION_DEFAULT_JERK * ramp;
+    double total = 2 * ramp + (target - peak * ramp) / peak;
+    TEST_ASSERT_INT_WITHIN(2, (int)ceil(total * 1e6 / TICK_US), tick);
+    TEST_ASSERT_EQUAL(target, profile.getEffort());
+  }
+}
+
+void test_s_curve_respects_acceleration_and_jerk_limits() {
+  MotionProfile profile;
+  profile.setTarget(255);
+  int32_t lastEffort = 0;
+  int32_t lastStep = 0;
+
+  for (int tick = 0; tick < 100; tick++) {
+    int32_t effort = profile.update(TICK_US);
+    int32_t step = effort - lastEffort;
+
+    // Per tick: accel * dt = 12.5 effort, its change jerk * dt^2 = 0.625;
+    // a step is rounded to whole efforts, so allow one for each
+    TEST_ASSERT_LESS_OR_EQUAL(MOTION_DEFAULT_ACCEL * TICK_US / 1000000 + 1, step);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, step);
+    TEST_ASSERT_LESS_OR_EQUAL(2, abs(step - lastStep));
+
+    lastStep = step;
+    lastEffort = effort;
+  }
+}
+
+void test_never_overshoots_and_reverses_through_zero() {
+  MotionProfile profile;
+  profile.reset(200);
+  profile.setTarget(-200);
+  int16_t last = 200;
+
+  // Down through zero without a jump, and never past the new target
+  for (int tick = 0; tick < 200; tick++) {
+    int16_t effort = profile.update(TICK_US);
+
+    TEST_ASSERT_LESS_OR_EQUAL(last, effort);
+    TEST_ASSERT_LESS_OR_EQUAL(MOTION_DEFAULT_ACCEL * TICK_US / 1000000 + 1, last - effort);
+    TEST_ASSERT_GREATER_OR_EQUAL(-200, effort);
+    last = effort;
+  }
+
+  TEST_ASSERT_EQUAL(-200, profile.getEffort());
+  TEST_ASSERT_TRUE(profile.isSettled());
+}
+
+void test_effort_is_zero_only_at_rest() {
+  MotionProfile profile;
+  TEST_ASSERT_EQUAL(0, profile.getEffort());
+
+  // A tick this short moves by a fraction of one effort step
+  profile.setTarget(100);
+  profile.update(10);
+  TEST_ASSERT_FALSE(profile.isSettled());
+  TEST_ASSERT_EQUAL(1, profile.getEffort());
+
+  profile.reset(0);
+  profile.setTarget(-100);
+  profile.update(10);
+  TEST_ASSERT_EQUAL(-1, profile.getEffort());
+
+  // Coming down, the last fraction still counts as moving
+  profile.reset(1);
+  profile.setTarget(0);
+  profile.update(10);
+  TEST_ASSERT_FALSE(profile.isSettled());
+  TEST_ASSERT_EQUAL(1, profile.getEffort());
+}
+
+void test_targets_are_clamped() {
+  MotionProfile profile;
+  profile.setTarget(1000);
+  TEST_ASSERT_EQUAL(MOTION_MAX_EFFORT, profile.getTarget());
+
+  profile.reset(-1000);
+  TEST_ASSERT_EQUAL(-MOTION_MAX_EFFORT, profile.getEffort());
+}
+
+void test_motor_starts_above_the_deadband() {
+  Motor motor(14, 15, 4, 5);
+  motor.begin();
+  motor.setMinPwm(200);
+  motor.setProfile(ProfileShape::TRAPEZOID, 2500, 25000);
+  motor.drive(MOTION_MAX_EFFORT);
+
+  // The first tick already drives at the lowest PWM that turns the wheels
+  motor.tick(TICK_US);
+  TEST_ASSERT_GREATER_OR_EQUAL(200, fakePins.ledcDuty[4]);
+  TEST_ASSERT_EQUAL(0, fakePins.ledcDuty[5]);
+
+  for (int tick = 0; tick < 40; tick++) {
+    motor.tick(TICK_US);
+  }
+
+  TEST_ASSERT_EQUAL(255, fakePins.ledcDuty[4]);
+
+  // Reversing ramps down to the deadband before the other pin drives
+  motor.drive(-MOTION_MAX_EFFORT);
+  uint32_t lastForward = 255;
+
+  for (int tick = 0; tick < 80; tick++) {
+    motor.tick(TICK_US);
+    TEST_ASSERT_TRUE(fakePins.ledcDuty[4] == 0 || fakePins.ledcDuty[5] == 0);
+
+    if (fakePins.ledcDuty[4] > 0) {
+      lastForward = fakePins.ledcDuty[4];
+    }
+  }
+
+  // The last forward duty is at most one profile step above the deadband
+  TEST_ASSERT_LESS_OR_EQUAL(200 + (MOTION_DEFAULT_ACCEL * TICK_US / 1000000 + 1) * 55 / 254 + 1, lastForward);
+  TEST_ASSERT_EQUAL(255, fakePins.ledcDuty[5]);
+
+  motor.stop();
+  TEST_ASSERT_EQUAL(0, fakePins.ledcDuty[4]);
+  TEST_ASSERT_EQUAL(0, fakePins.ledcDuty[5]);
+}
+
+void test_motor_speed_maps_back_onto_pwm() {
+  Motor motor(14, 15, 4, 5);
+  motor.begin();
+  motor.setMinPwm(200);
+
+  // moveForward(speed) asks for the smallest effort giving at least that PWM
+  const uint8_t speeds[] = {0, 150, 200, 201, 230, 254, 255};
+
+  for (uint8_t speed : speeds) {
+    motor.stop();
+    motor.moveForward(speed);
+
+    for (int tick = 0; tick < 60; tick++) {
+      motor.tick(TICK_US);
+    }
+
+    TEST_ASSERT_GREATER_OR_EQUAL(speed > 200 ? speed : 200, fakePins.ledcDuty[4]);
+    TEST_ASSERT_LESS_OR_EQUAL((speed > 200 ? speed : 200) + 1, fakePins.ledcDuty[4]);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_trapezoid_follows_constant_acceleration);
+  RUN_TEST(test_s_curve_follows_the_jerk_limited_profile);
+  RUN_TEST(test_s_curve_respects_acceleration_and_jerk_limits);
+  RUN_TEST(test_never_overshoots_and_reverses_through_zero);
+  RUN_TEST(test_effort_is_zero_only_at_rest);
+  RUN_TEST(test_targets_are_clamped);
+  RUN_TEST(test_motor_starts_above_the_deadband);
+  RUN_TEST(test_motor_speed_maps_back_onto_pwm);
+  return UNITY_END();
+}
@@ -0,0 +1,166 @@
+// QualityController replaying a simulated bandwidth trace: one-second
+// windows, frames paced by FramePacer over a link of the given rate
+#include "FramePacer.h"
+#include "QualityController.h"
+#include <unity.h>
+
+#define TARGET_FPS 20
+#define WINDOW_US 1000000
+
+struct TracePhase {
+  uint32_t seconds;
+  uint32_t bytesPerSec;
+};
+
+// Rough size of an OV2640 JPEG: bits per pixel fall with the quality number
+static uint32_t frameBytes(const QualityController &controller) {
+  const resolution_info_t &size = resolution[controller.getFrameSize()];
+  return (uint64_t)size.width * size.height * 12 / (controller.getQuality() * 8);
+}
+
+// One window of streaming at the controller's current step
+static LinkSample streamWindow(const QualityController &controller, FramePacer &pacer, uint32_t bytesPerSec) {
+  LinkSample sample = {0, 0, 0, WINDOW_US, pacer.getTargetIntervalUs(), 0};
+  uint32_t bytes = frameBytes(controller);
+  uint64_t elapsedUs = 0;
+
+  if (bytesPerSec == 0) {
+    return sample;
+  }
+
+  while (true) {
+    uint32_t sendUs = (uint64_t)bytes * 1000000 / bytesPerSec;
+
+    if (elapsedUs + sendUs > WINDOW_US) {
+      break;
+    }
+
+    pacer.onFrameSent(sendUs, bytes);
+    sample.frames++;
+    sample.bytes += bytes;
+    sample.sendUs += sendUs;
+    elapsedUs += sendUs + pacer.nextDelayUs();
+  }
+
+  return sample;
+}
+
+struct Replay {
+  uint32_t changes;
+  uint32_t slowWindows; // below 70% of the target rate
+  int finalLevel;
+};
+
+static Replay replay(QualityController &controller, FramePacer &pacer, const TracePhase &phase) {
+  Replay result = {0, 0, controller.getLevel()};
+
+  for (uint32_t second = 0; second < phase.seconds; second++) {
+    LinkSample sample = streamWindow(controller, pacer, phase.bytesPerSec);
+
+    if (sample.frames * 10 < TARGET_FPS * 7) {
+      result.slowWindows++;
+    }
+
+    if (controller.update(sample)) {
+      result.changes++;
+    }
+  }
+
+  result.finalLevel = controller.getLevel();
+  return result;
+}
+
+static int levelOf(framesize_t frameSize, int quality) {
+  for (int i = 0; i < QUALITY_LEVELS; i++) {
+    if (QUALITY_LADDER[i].frameSize == frameSize && QUALITY_LADDER[i].quality == quality) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_a_bandwidth_drop_steps_down_and_settles() {
+  QualityController controller;
+  FramePacer pacer(TARGET_FPS);
+  controller.reset(FRAMESIZE_VGA, 10);
+  int top = levelOf(FRAMESIZE_VGA, 10);
+  TEST_ASSERT_EQUAL(top, controller.getLevel());
+
+  // 16 Mbit/s carries VGA at quality 10 at the full rate
+  Replay fast = replay(controller, pacer, {10, 2000000});
+  TEST_ASSERT_EQUAL(0, fast.changes);
+  TEST_ASSERT_EQUAL(0, fast.slowWindows);
+
+  // 1.6 Mbit/s: a step down every QUALITY_DOWN_WINDOWS slow windows (two
+  // at once for the first, nearly stalled one) until QVGA at quality 20,
+  // which the link carries at the full rate
+  Replay drop = replay(controller, pacer, {10, 200000});
+  TEST_ASSERT_EQUAL(levelOf(FRAMESIZE_QVGA, 20), drop.finalLevel);
+  TEST_ASSERT_LESS_OR_EQUAL(4, drop.changes);
+  TEST_ASSERT_LESS_OR_EQUAL(8, drop.slowWindows);
+
+  // And stays there without hunting
+  Replay settled = replay(controller, pacer, {60, 200000});
+  TEST_ASSERT_EQUAL(0, settled.changes);
+  TEST_ASSERT_EQUAL(0, settled.slowWindows);
+
+  // Back to 16 Mbit/s: the first step up waits out the hold-off, the rest
+  // come every QUALITY_UP_WINDOWS good windows
+  uint32_t steps = top - settled.finalLevel;
+  Replay recovery =
+      replay(controller, pacer, {QUALITY_HOLDOFF_WINDOWS + (steps - 1) * QUALITY_UP_WINDOWS, 2000000});
+  TEST_ASSERT_EQUAL(top, recovery.finalLevel);
+  TEST_ASSERT_EQUAL(steps, recovery.changes);
+  TEST_ASSERT_EQUAL(0, recovery.slowWindows);
+}
+
+void test_a_stalled_link_drops_two_steps_at_once() {
+  QualityController controller;
+  FramePacer pacer(TARGET_FPS);
+  controller.reset(FRAMESIZE_VGA, 10);
+  int top = controller.getLevel();
+
+  Replay stall = replay(controller, pacer, {1, 0});
+  TEST_ASSERT_EQUAL(1, stall.changes);
+  TEST_ASSERT_EQUAL(top - 2, controller.getLevel());
+  TEST_ASSERT_TRUE(controller.getReason() == QualityController::Reason::LINK);
+}
+
+void test_weak_signal_steps_down_even_on_a_fast_link() {
+  QualityController controller;
+  FramePacer pacer(TARGET_FPS);
+  controller.reset(FRAMESIZE_VGA, 10);
+  int top = controller.getLevel();
+
+  for (int i = 0; i < QUALITY_DOWN_WINDOWS; i++) {
+    LinkSample sample = streamWindow(controller, pacer, 2000000);
+    sample.rssi = QUALITY_RSSI_WEAK - 5;
+    controller.update(sample);
+  }
+
+  TEST_ASSERT_EQUAL(top - 1, controller.getLevel());
+  TEST_ASSERT_TRUE(controller.getReason() == QualityController::Reason::RSSI);
+}
+
+void test_the_ceiling_caps_recovery() {
+  QualityController controller;
+  FramePacer pacer(TARGET_FPS);
+  controller.reset(FRAMESIZE_HVGA, 20);
+
+  Replay run = replay(controller, pacer, {60, 4000000});
+  TEST_ASSERT_EQUAL(levelOf(FRAMESIZE_HVGA, 14), run.finalLevel);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_a_bandwidth_drop_steps_down_and_settles);
+  RUN_TEST(test_a_stalled_link_drops_two_steps_at_once);
+  RUN_TEST(test_weak_signal_steps_down_even_on_a_fast_link);
+  RUN_TEST(test_the_ceiling_caps_recovery);
+  return UNITY_END();
+}
@@ -0,0 +1,188 @@
+// Servo trajectories against the velocity-limited closed form, retargeting and limits
+#include "ServoTrajectory.h"
+#include <math.h>
+#include <stdlib.h>
+#include <unity.h>
+
+#define TICK_US 5000
+#define VMAX SERVO_DEFAULT_MAX_VELOCITY
+#define AMAX SERVO_DEFAULT_MAX_ACCEL
+
+void setUp() {}
+
+void tearDown() {}
+
+// Distance covered at t on a rest-to-rest move of d degrees: accelerate at
+// AMAX, cruise at VMAX if there is room, brake at AMAX
+static double travelled(double t, double d) {
+  double ramp = fmin(VMAX / (double)AMAX, sqrt(d / AMAX));
+  double peak = AMAX * ramp;
+  double cruise = (d - peak * ramp) / peak;
+  double total = 2 * ramp + cruise;
+
+  if (t >= total) {
+    return d;
+  }
+
+  if (t < ramp) {
+    return AMAX * t * t / 2;
+  }
+
+  if (t < ramp + cruise) {
+    return peak * ramp / 2 + peak * (t - ramp);
+  }
+
+  double left = total - t;
+  return d - AMAX * left * left / 2;
+}
+
+static double moveTime(double d) {
+  double ramp = fmin(VMAX / (double)AMAX, sqrt(d / AMAX));
+  double peak = AMAX * ramp;
+  return 2 * ramp + (d - peak * ramp) / peak;
+}
+
+static int runToTarget(ServoTrajectory &axis, int from, int distance) {
+  int ticks = 0;
+
+  while (!axis.isSettled() && ticks < 1000) {
+    ticks++;
+    axis.update(TICK_US);
+
+    double expected = from + travelled(ticks * TICK_US / 1e6, distance);
+    TEST_ASSERT_INT_WITHIN(2, (int)round(expected), axis.getAngle());
+  }
+
+  return ticks;
+}
+
+void test_long_move_cruises_at_the_velocity_limit() {
+  ServoTrajectory axis(0, 180, 0);
+  axis.setTarget(180);
+
+  int ticks = runToTarget(axis, 0, 180);
+  TEST_ASSERT_INT_WITHIN(2, (int)ceil(moveTime(180) * 1e6 / TICK_US), ticks);
+  TEST_ASSERT_EQUAL(180, axis.getAngle());
+}
+
+void test_short_move_never_reaches_the_velocity_limit() {
+  ServoTrajectory axis(0, 180, 90);
+  axis.setTarget(100);
+
+  int ticks = runToTarget(axis, 90, 10);
+  TEST_ASSERT_INT_WITHIN(2, (int)ceil(moveTime(10) * 1e6 / TICK_US), ticks);
+  TEST_ASSERT_EQUAL(100, axis.getAngle());
+}
+
+void test_speed_and_acceleration_stay_within_limits() {
+  ServoTrajectory axis(0, 180, 0);
+  axis.setTarget(180);
+  int lastMdeg = 0;
+  int lastStep = 0;
+
+  // Angles are whole degrees, so measure with the millidegree slope instead:
+  // a degree of rounding either way on each side
+  for (int tick = 0; tick < 200; tick++) {
+    axis.update(TICK_US);
+    int mdeg = axis.getAngle() * 1000;
+    int step = mdeg - lastMdeg;
+
+    TEST_ASSERT_GREATER_OR_EQUAL(0, step);
+    TEST_ASSERT_LESS_OR_EQUAL(VMAX * TICK_US / 1000 + 1000, step);
+    TEST_ASSERT_LESS_OR_EQUAL(AMAX * TICK_US / 1000 * TICK_US / 1000000 + 2000, abs(step - lastStep));
+
+    lastStep = step;
+    lastMdeg = mdeg;
+  }
+}
+
+void test_retarget_mid_motion_blends_without_a_jump() {
+  ServoTrajectory axis(0, 180, 0);
+  axis.setTarget(180);
+
+  for (int tick = 0; tick < 40; tick++) {
+    axis.update(TICK_US);
+  }
+
+  // Turn around: keeps moving forward while braking, then comes back
+  int turnedAt = axis.getAngle();
+  axis.setTarget(20);
+  int furthest = turnedAt;
+  int last = turnedAt;
+
+  for (int tick = 0; tick < 400 && !axis.isSettled(); tick++) {
+    axis.update(TICK_US);
+    TEST_ASSERT_LESS_OR_EQUAL(VMAX * TICK_US / 1000000 + 1, abs(axis.getAngle() - last));
+    furthest = axis.getAngle() > furthest ? axis.getAngle() : furthest;
+    last = axis.getAngle();
+  }
+
+  // Braking distance from full speed is v^2 / 2a = 32.4 degrees
+  TEST_ASSERT_GREATER_THAN(turnedAt, furthest);
+  TEST_ASSERT_LESS_OR_EQUAL(turnedAt + 34, furthest);
+  TEST_ASSERT_TRUE(axis.isSettled());
+  TEST_ASSERT_EQUAL(20, axis.getAngle());
+}
+
+void test_update_reports_only_changed_angles() {
+  ServoTrajectory axis(0, 180, 90);
+  axis.setTarget(92);
+  int last = axis.getAngle();
+  int reported = 0;
+
+  for (int tick = 0; tick < 100; tick++) {
+    bool changed = axis.update(TICK_US);
+    TEST_ASSERT_EQUAL(axis.getAngle() != last, changed);
+    reported += changed;
+    last = axis.getAngle();
+  }
+
+  // Two one-degree steps, and nothing once settled
+  TEST_ASSERT_EQUAL(2, reported);
+  TEST_ASSERT_FALSE(axis.update(TICK_US));
+}
+
+void test_targets_and_positions_stay_inside_the_limits() {
+  ServoTrajectory axis(70, 180, 135);
+
+  axis.setTarget(0);
+  TEST_ASSERT_EQUAL(70, axis.getTargetAngle());
+
+  for (int tick = 0; tick < 400; tick++) {
+    axis.update(TICK_US);
+    TEST_ASSERT_GREATER_OR_EQUAL(70, axis.getAngle());
+  }
+
+  TEST_ASSERT_EQUAL(70, axis.getAngle());
+
+  axis.reset(500);
+  TEST_ASSERT_EQUAL(180, axis.getAngle());
+  TEST_ASSERT_TRUE(axis.isSettled());
+}
+
+void test_slower_limits_take_proportionally_longer() {
+  ServoTrajectory axis(0, 180, 0);
+  axis.setLimits(VMAX / 2, AMAX);
+  axis.setTarget(180);
+  int ticks = 0;
+
+  while (!axis.isSettled() && ticks < 1000) {
+    axis.update(TICK_US);
+    ticks++;
+  }
+
+  // 180 / 180 + 180 / 2000 s
+  TEST_ASSERT_INT_WITHIN(2, (int)ceil((180.0 / (VMAX / 2) + (VMAX / 2) / (double)AMAX) * 1e6 / TICK_US), ticks);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_long_move_cruises_at_the_velocity_limit);
+  RUN_TEST(test_short_move_never_reaches_the_velocity_limit);
+  RUN_TEST(test_speed_and_acceleration_stay_within_limits);
+  RUN_TEST(test_retarget_mid_motion_blends_without_a_jump);
+  RUN_TEST(test_update_reports_only_changed_angles);
+  RUN_TEST(test_targets_and_positions_stay_inside_the_limits);
+  RUN_TEST(test_slower_limits_take_proportionally_longer);
+  return UNITY_END();
+}
@@ -0,0 +1,155 @@
+// WebSocket receive pool: frames from open sockets never touch the heap
+#include "CarProtocol.h"
+#include "WsRxPool.h"
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+// Counts every heap allocation in the process. glibc lets the executable
+// replace malloc and keeps the originals under __libc_*.
+static std::atomic<uint32_t> heapAllocations(0);
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+  heapAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  heapAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  heapAllocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+}
+
+static WsRxPool *pool;
+static uint32_t commandsDecoded;
+static uint32_t textCommands;
+
+void setUp() {
+  pool = new WsRxPool();
+  commandsDecoded = 0;
+  textCommands = 0;
+}
+
+void tearDown() {
+  delete pool;
+}
+
+// What websocketHandler does with a frame once httpd reported its length
+static bool receive(int fd, const uint8_t *payload, size_t len, bool binary) {
+  uint8_t *buffer = pool->acquire(fd, len);
+
+  if (!buffer) {
+    return false;
+  }
+
+  memcpy(buffer, payload, len);
+
+  if (binary) {
+    CarCommandFrame frame;
+    commandsDecoded += decodeCommandFrame(buffer, len, frame);
+  } else {
+    buffer[len] = '\0';
+    textCommands += strncmp((char *)buffer, "cameraDrag_", 11) == 0;
+  }
+
+  return true;
+}
+
+void test_steady_state_receives_do_not_allocate() {
+  uint8_t frame[CAR_FRAME_SIZE];
+  const char *drag = "cameraDrag_-40_25";
+  const int sockets = WS_RX_POOL_SIZE / 2;
+
+  encodeCommandFrame({CAR_PROTOCOL_VERSION, OP_DRIVE, 1, 60, -20}, frame);
+
+  // The sanity check: the counter sees allocations at all
+  uint32_t before = heapAllocations;
+  free(malloc(16));
+  TEST_ASSERT_EQUAL(before + 1, heapAllocations.load());
+
+  before = heapAllocations;
+
+  for (int i = 0; i < 20000; i++) {
+    int fd = 50 + i % sockets;
+    TEST_ASSERT_TRUE(receive(fd, frame, sizeof(frame), true));
+    TEST_ASSERT_TRUE(receive(fd, (const uint8_t *)drag, strlen(drag), false));
+  }
+
+  TEST_ASSERT_EQUAL(before, heapAllocations.load());
+  TEST_ASSERT_EQUAL(20000, commandsDecoded);
+  TEST_ASSERT_EQUAL(20000, textCommands);
+  TEST_ASSERT_EQUAL(40000, pool->getFramesReceived());
+  TEST_ASSERT_EQUAL(sockets, pool->getSlotClaims());
+}
+
+void test_connection_churn_does_not_allocate() {
+  uint8_t frame[CAR_FRAME_SIZE];
+  encodeCommandFrame({CAR_PROTOCOL_VERSION, OP_PING, 1, 0, 0}, frame);
+
+  uint32_t before = heapAllocations;
+
+  // Sockets open, send a few frames and close, as reconnecting browsers do
+  for (int fd = 50; fd < 5050; fd++) {
+    for (int i = 0; i < 3; i++) {
+      TEST_ASSERT_TRUE(receive(fd, frame, sizeof(frame), true));
+    }
+
+    pool->release(fd);
+  }
+
+  TEST_ASSERT_EQUAL(before, heapAllocations.load());
+  TEST_ASSERT_EQUAL(0, pool->slotsInUse());
+  TEST_ASSERT_EQUAL(5000, pool->getSlotClaims());
+}
+
+void test_rejects_oversize_frames_and_a_full_pool() {
+  uint8_t big[WS_MAX_FRAME_LEN + 1] = {};
+  uint8_t frame[CAR_FRAME_SIZE];
+  encodeCommandFrame({CAR_PROTOCOL_VERSION, OP_PING, 1, 0, 0}, frame);
+
+  TEST_ASSERT_TRUE(receive(50, big, WS_MAX_FRAME_LEN, false));
+  TEST_ASSERT_FALSE(receive(50, big, sizeof(big), false));
+  TEST_ASSERT_EQUAL(1, pool->getOversizeRejects());
+
+  for (int fd = 51; fd < 50 + WS_RX_POOL_SIZE; fd++) {
+    TEST_ASSERT_TRUE(receive(fd, frame, sizeof(frame), true));
+  }
+
+  TEST_ASSERT_EQUAL(WS_RX_POOL_SIZE, pool->slotsInUse());
+  TEST_ASSERT_FALSE(receive(99, frame, sizeof(frame), true));
+  TEST_ASSERT_EQUAL(1, pool->getExhaustedRejects());
+
+  // A closed socket frees its slot for the next one
+  pool->release(53);
+  TEST_ASSERT_TRUE(receive(99, frame, sizeof(frame), true));
+}
+
+void test_each_socket_keeps_its_own_buffer() {
+  uint8_t *a = pool->acquire(50, 4);
+  uint8_t *b = pool->acquire(51, 4);
+
+  TEST_ASSERT_NOT_NULL(a);
+  TEST_ASSERT_NOT_NULL(b);
+  TEST_ASSERT_TRUE(a != b);
+  TEST_ASSERT_TRUE(a == pool->acquire(50, 8));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_steady_state_receives_do_not_allocate);
+  RUN_TEST(test_connection_churn_does_not_allocate);
+  RUN_TEST(test_rejects_oversize_frames_and_a_full_pool);
+  RUN_TEST(test_each_socket_keeps_its_own_buffer);
+  return UNITY_END();
+}
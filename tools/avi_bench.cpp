@@ -0,0 +1,181 @@
+// Host benchmark for the SD recorder in src/AviRecorder.h, writing into a
+// regular directory. Frames come from a directory of JPEGs recorded with
+// tools/record_frames.py, or are generated (VGA-sized, random content).
+//
+//   g++ -O2 -std=c++17 -I src tools/avi_bench.cpp -o avi_bench
+//   ./avi_bench out/ [--frames 3000] [--fps 20] [--rotate-mb 16] [--source parked/]
+//   python tools/avi_check.py out/*.avi
+//
+// Reports, as JSON, the recorder's write rate, blocks written and files
+// produced, next to a baseline that hands every chunk header, JPEG and pad
+// byte to an unbuffered file as its own write, which is what recording
+// without batching would cost. Point it at a mounted SD card to measure the
+// card instead of the page cache.
+
+#include "AviRecorder.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+static std::vector<std::vector<uint8_t>> loadFrames(const std::string &directory) {
+  std::vector<std::string> paths;
+  std::vector<std::vector<uint8_t>> frames;
+  DIR *dir = opendir(directory.c_str());
+
+  if (!dir) {
+    return frames;
+  }
+
+  while (dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".jpg") == 0) {
+      paths.push_back(directory + "/" + name);
+    }
+  }
+
+  closedir(dir);
+  std::sort(paths.begin(), paths.end());
+
+  for (const std::string &path : paths) {
+    std::ifstream file(path, std::ios::binary);
+    frames.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  return frames;
+}
+
+// Random bytes between SOI and EOI, 20-60 KB like VGA at quality 10
+static std::vector<std::vector<uint8_t>> syntheticFrames(int count) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> length(20000, 60000);
+  std::vector<std::vector<uint8_t>> frames;
+
+  for (int i = 0; i < count; i++) {
+    std::vector<uint8_t> frame(length(rng));
+
+    for (uint8_t &b : frame) {
+      b = rng();
+    }
+
+    frame[0] = 0xFF;
+    frame[1] = 0xD8;
+    frame[frame.size() - 2] = 0xFF;
+    frame[frame.size() - 1] = 0xD9;
+    frames.push_back(std::move(frame));
+  }
+
+  return frames;
+}
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Unbatched: every piece of every frame is a write of its own
+static double baselineSeconds(const std::string &path, const std::vector<std::vector<uint8_t>> &frames, int count) {
+  FILE *file = fopen(path.c_str(), "wb");
+
+  if (!file) {
+    return 0;
+  }
+
+  setvbuf(file, nullptr, _IONBF, 0);
+  auto start = std::chrono::steady_clock::now();
+  uint8_t header[AVI_CHUNK_HEADER_SIZE];
+  const uint8_t pad = 0;
+
+  for (int i = 0; i < count; i++) {
+    const std::vector<uint8_t> &frame = frames[i % frames.size()];
+
+    aviWriteFrameHeader(header, frame.size());
+    fwrite(header, 1, sizeof(header), file);
+    fwrite(frame.data(), 1, frame.size(), file);
+
+    if (frame.size() & 1) {
+      fwrite(&pad, 1, 1, file);
+    }
+  }
+
+  fclose(file);
+  double elapsed = seconds(start);
+  remove(path.c_str());
+  return elapsed;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <output dir> [--frames N] [--fps N] [--rotate-mb N] [--source DIR]\n", argv[0]);
+    return 1;
+  }
+
+  std::string out = argv[1];
+  int count = 3000;
+  int fps = 20;
+  int rotateMb = 16;
+  std::string source;
+
+  for (int i = 2; i + 1 < argc; i += 2) {
+    std::string flag = argv[i];
+
+    if (flag == "--frames") {
+      count = std::max(1, atoi(argv[i + 1]));
+    } else if (flag == "--fps") {
+      fps = std::max(1, atoi(argv[i + 1]));
+    } else if (flag == "--rotate-mb") {
+      rotateMb = std::max(1, atoi(argv[i + 1]));
+    } else if (flag == "--source") {
+      source = argv[i + 1];
+    }
+  }
+
+  mkdir(out.c_str(), 0755);
+  std::vector<std::vector<uint8_t>> frames = source.empty() ? syntheticFrames(64) : loadFrames(source);
+
+  if (frames.empty()) {
+    fprintf(stderr, "%s: no .jpg frames\n", source.c_str());
+    return 1;
+  }
+
+  AviRecorder recorder;
+  recorder.setRotation(rotateMb * 1024UL * 1024, AVI_ROTATE_SECONDS);
+
+  if (!recorder.begin(malloc, malloc) || !recorder.start(out.c_str())) {
+    fprintf(stderr, "cannot record into %s\n", out.c_str());
+    return 1;
+  }
+
+  std::vector<double> frameUs;
+  uint64_t payload = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < count; i++) {
+    const std::vector<uint8_t> &frame = frames[i % frames.size()];
+    auto before = std::chrono::steady_clock::now();
+
+    if (!recorder.addFrame(frame.data(), frame.size(), 640, 480, (int64_t)i * 1000000 / fps)) {
+      fprintf(stderr, "write failed at frame %d\n", i);
+      return 1;
+    }
+
+    frameUs.push_back(seconds(before) * 1e6);
+    payload += frame.size();
+  }
+
+  bool closed = recorder.stop();
+  double elapsed = seconds(start);
+  double baseline = baselineSeconds(out + "/baseline.tmp", frames, count);
+
+  std::sort(frameUs.begin(), frameUs.end());
+  printf("{\"frames\":%d,\"payload_mb\":%.1f,\"files\":%u,\"block_bytes\":%d,\"block_writes\":%u,\"closed_ok\":%s,"
+         "\"mb_s\":%.1f,\"frame_us_p50\":%.1f,\"frame_us_p99\":%.1f,\"frame_us_max\":%.1f,\"unbatched_mb_s\":%.1f}\n",
+         count, payload / 1e6, recorder.getFilesClosed(), AVI_BLOCK_BYTES, recorder.getBlockWrites(),
+         closed ? "true" : "false", recorder.getTotalBytes() / 1e6 / elapsed, frameUs[frameUs.size() / 2],
+         frameUs[frameUs.size() * 99 / 100], frameUs.back(), baseline > 0 ? payload / 1e6 / baseline : 0.0);
+  return closed ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+"""Checks that MJPEG-AVI files from the recorder or /clip parse.
+
+    python tools/avi_check.py recordings/*.avi
+
+Walks the RIFF tree and checks that every chunk fits its parent, that the
+avih and strh frame counts match idx1, and that every idx1 entry points at a
+chunk of the same id and size holding a complete JPEG (SOI ... EOI). JUNK
+chunks from /clip exports are allowed. Prints one JSON line per file and
+exits with 1 if any file is broken.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+HEADER_SIZE = 224
+
+
+def walk(data, start, end, chunks, errors):
+    pos = start
+
+    while pos + 8 <= end:
+        fourcc = data[pos:pos + 4]
+        size = struct.unpack_from("<I", data, pos + 4)[0]
+
+        if pos + 8 + size > end:
+            errors.append(f"{fourcc!r} at {pos} runs past its parent ({size} bytes)")
+            return
+
+        if fourcc in (b"RIFF", b"LIST"):
+            kind = data[pos + 8:pos + 12]
+            chunks.append((fourcc + b":" + kind, pos, size))
+            walk(data, pos + 12, pos + 8 + size, chunks, errors)
+        else:
+            chunks.append((fourcc, pos, size))
+
+        pos += 8 + size + (size & 1)
+
+    if pos != end and pos != end + 1:
+        errors.append(f"{end - pos} stray bytes before offset {end}")
+
+
+def check(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    errors = []
+    chunks = []
+
+    if len(data) < HEADER_SIZE or data[0:4] != b"RIFF" or data[8:12] != b"AVI ":
+        return {"file": path, "ok": False, "errors": ["not a RIFF AVI file"]}
+
+    riff_size = struct.unpack_from("<I", data, 4)[0]
+    if riff_size + 8 != len(data):
+        errors.append(f"RIFF size {riff_size + 8} but file has {len(data)} bytes")
+
+    walk(data, 0, len(data), chunks, errors)
+    ids = {c[0]: c for c in chunks}
+
+    for needed in (b"LIST:hdrl", b"avih", b"strh", b"strf", b"LIST:movi", b"idx1"):
+        if needed not in ids:
+            errors.append(f"no {needed.decode()} chunk")
+
+    if errors:
+        return {"file": path, "ok": False, "errors": errors}
+
+    avih = ids[b"avih"][1] + 8
+    us_per_frame, _, _, _, avih_frames = struct.unpack_from("<5I", data, avih)
+    width, height = struct.unpack_from("<2I", data, avih + 32)
+    strh = ids[b"strh"][1] + 8
+    handler = data[strh + 4:strh + 8]
+    strh_length = struct.unpack_from("<I", data, strh + 32)[0]
+    movi = ids[b"LIST:movi"][1] + 8  # the 'movi' fourcc, idx1 offsets count from here
+    idx1_pos, idx1_size = ids[b"idx1"][1], ids[b"idx1"][2]
+
+    if handler != b"MJPG":
+        errors.append(f"stream handler {handler!r}, expected MJPG")
+
+    if idx1_size % 16:
+        errors.append(f"idx1 size {idx1_size} is not a multiple of 16")
+
+    frames = 0
+    filler = 0
+    sizes = []
+
+    for i in range(idx1_size // 16):
+        fourcc, flags, offset, size = struct.unpack_from("<4sIII", data, idx1_pos + 8 + 16 * i)
+        chunk = movi + offset
+
+        if chunk + 8 > len(data) or data[chunk:chunk + 4] != fourcc or struct.unpack_from("<I", data, chunk + 4)[0] != size:
+            errors.append(f"index entry {i} does not match the chunk at {chunk}")
+            break
+
+        if fourcc == b"JUNK":
+            filler += 1
+            continue
+
+        if fourcc != b"00dc":
+            errors.append(f"index entry {i} is {fourcc!r}")
+            break
+
+        jpeg = data[chunk + 8:chunk + 8 + size]
+        if jpeg[:2] != b"\xff\xd8" or jpeg[-2:] != b"\xff\xd9":
+            errors.append(f"frame {frames} is not a complete JPEG")
+            break
+
+        frames += 1
+        sizes.append(size)
+
+    if avih_frames != frames + filler or strh_length != frames + filler:
+        errors.append(f"headers say {avih_frames}/{strh_length} frames, idx1 has {frames + filler}")
+
+    return {
+        "file": path,
+        "ok": not errors,
+        "errors": errors,
+        "frames": frames,
+        "filler": filler,
+        "width": width,
+        "height": height,
+        "fps": round(1e6 / us_per_frame, 2) if us_per_frame else 0,
+        "bytes": len(data),
+        "mean_frame_bytes": sum(sizes) // len(sizes) if sizes else 0,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("files", nargs="+")
+    args = parser.parse_args()
+
+    ok = True
+    for path in args.files:
+        result = check(path)
+        ok = ok and result["ok"]
+        print(json.dumps(result))
+
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,311 @@
+// Host benchmark for the control hot paths that Perf.h probes on the car:
+// text and binary commands through the firmware's own handleCarCommand and
+// binaryCommandHandlers, the frame size name lookups, and the control step
+// with Motor::tick and Car::updateServos. Built against test/fakes:
+//
+//   g++ -O2 -std=gnu++17 -pthread -static-libstdc++ -I src -I test/fakes -D HAL_SYNTHETIC_CAMERA \
+//       -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc tools/control_bench.cpp -o control_bench
+//   ./control_bench [iterations]
+//
+// libstdc++ is linked statically so operator new goes through the wrapped
+// malloc too, as it does in the firmware image.
+//
+// Fixed, seeded command mixes are replayed on this thread, which also steps
+// the control loop in place of its task, so nothing else runs meanwhile and
+// the heap and DEBUG_PRINT* counters belong to the ops measured. Prints one
+// JSON object: ns, mallocs and debug prints per op for every mix and form.
+
+#define PERF_PROBES
+#define PERF_COUNT_ALLOCS
+#include <Arduino.h>
+#include "config.h"
+#include "carServer.h"
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+Car car;
+WiFiManager wm;
+
+#define BENCH_FD 60
+#define COMMANDS_PER_TICK 4 // well inside CONTROL_QUEUE_SIZE
+
+struct Command {
+  char text[40];
+  uint8_t frame[CAR_FRAME_SIZE];
+};
+
+struct Cost {
+  double ns;
+  uint64_t ops;
+  uint64_t allocs;
+  uint64_t prints;
+};
+
+static const char *const MOVE_TEXT[MOVE_COUNT] = {"stop",          "forward",       "backward",
+                                                  "left",          "right",         "forward-left",
+                                                  "forward-right", "backward-left", "backward-right"};
+
+static Command makeCommand(uint8_t opcode, uint16_t seq, int16_t a, int16_t b, const char *text) {
+  Command command;
+  snprintf(command.text, sizeof(command.text), "%s", text);
+  encodeCommandFrame({CAR_PROTOCOL_VERSION, opcode, seq, a, b}, command.frame);
+  return command;
+}
+
+// Roughly what script.js sends while driving with the buttons and dragging
+// the camera, as in dispatch_bench.cpp
+static std::vector<Command> drivingMix(int count) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<int> axis(-100, 100);
+  std::uniform_int_distribution<int> move(0, MOVE_COUNT - 1);
+  std::vector<Command> commands;
+  char text[40];
+
+  for (int i = 0; i < count; i++) {
+    int pick = percent(rng);
+
+    if (pick < 60) {
+      int x = axis(rng), y = axis(rng);
+      snprintf(text, sizeof(text), "cameraDrag_%d_%d", x, y);
+      commands.push_back(makeCommand(OP_CAMERA, i, x, y, text));
+    } else if (pick < 90) {
+      int direction = move(rng);
+      commands.push_back(makeCommand(OP_MOVE, i, direction, 0, MOVE_TEXT[direction]));
+    } else if (pick < 97) {
+      commands.push_back(makeCommand(OP_PING, i, 0, 0, "ping"));
+    } else if (pick < 98) {
+      commands.push_back(makeCommand(OP_TOGGLE_FLASH, i, 0, 0, "toggleFlash"));
+    } else if (pick < 99) {
+      int fps = 5 + percent(rng) % 26;
+      snprintf(text, sizeof(text), "targetFps_%d", fps);
+      commands.push_back(makeCommand(OP_TARGET_FPS, i, fps, 0, text));
+    } else {
+      int enabled = percent(rng) & 1;
+      snprintf(text, sizeof(text), "autoQuality_%d", enabled);
+      commands.push_back(makeCommand(OP_AUTO_QUALITY, i, enabled, 0, text));
+    }
+  }
+
+  return commands;
+}
+
+// The analog stick: DRIVE frames with a few camera drags and pings. Binary
+// only, there is no text form of DRIVE.
+static std::vector<Command> stickMix(int count) {
+  std::mt19937 rng(2);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<int> stick(-DRIVE_INPUT_MAX, DRIVE_INPUT_MAX);
+  std::uniform_int_distribution<int> axis(-100, 100);
+  std::vector<Command> commands;
+
+  for (int i = 0; i < count; i++) {
+    int pick = percent(rng);
+
+    if (pick < 80) {
+      commands.push_back(makeCommand(OP_DRIVE, i, stick(rng), stick(rng), ""));
+    } else if (pick < 95) {
+      commands.push_back(makeCommand(OP_CAMERA, i, axis(rng), axis(rng), ""));
+    } else {
+      commands.push_back(makeCommand(OP_PING, i, 0, 0, ""));
+    }
+  }
+
+  return commands;
+}
+
+// Settings panel use: frame size changes, which take the name lookup, and
+// the other toggles
+static std::vector<Command> settingsMix(int count) {
+  std::mt19937 rng(3);
+  std::uniform_int_distribution<int> pick(0, 3);
+  std::uniform_int_distribution<int> size(0, FRAMESIZE_INVALID - 1);
+  std::vector<Command> commands;
+  char text[40];
+
+  for (int i = 0; i < count; i++) {
+    switch (pick(rng)) {
+    case 0: {
+      framesize_t frameSize = (framesize_t)size(rng);
+      snprintf(text, sizeof(text), "frameSize_%s", frameSizeToString(frameSize));
+      commands.push_back(makeCommand(OP_FRAME_SIZE, i, frameSize, 0, text));
+      break;
+    }
+    case 1:
+      snprintf(text, sizeof(text), "targetFps_%d", 5 + i % 26);
+      commands.push_back(makeCommand(OP_TARGET_FPS, i, 5 + i % 26, 0, text));
+      break;
+    case 2:
+      snprintf(text, sizeof(text), "autoQuality_%d", i & 1);
+      commands.push_back(makeCommand(OP_AUTO_QUALITY, i, i & 1, 0, text));
+      break;
+    default:
+      snprintf(text, sizeof(text), "staticSkip_%d", i & 1);
+      commands.push_back(makeCommand(OP_STATIC_SKIP, i, i & 1, 0, text));
+      break;
+    }
+  }
+
+  return commands;
+}
+
+static uint64_t allocCount() {
+  return perfAllocations.load(std::memory_order_relaxed);
+}
+
+static uint64_t printCount() {
+  return perfDebugPrints.load(std::memory_order_relaxed);
+}
+
+// Times run() and counts what it allocated and printed
+template <typename F>
+static void measure(Cost &cost, uint64_t ops, F run) {
+  uint64_t allocs = allocCount();
+  uint64_t prints = printCount();
+  auto start = std::chrono::steady_clock::now();
+
+  run();
+
+  cost.ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  cost.allocs += allocCount() - allocs;
+  cost.prints += printCount() - prints;
+  cost.ops += ops;
+}
+
+// One control period as the task runs it: ramps advance by the nominal
+// period, the watchdog sees the clock the commands were stamped with
+static void step(Cost &tickCost) {
+  measure(tickCost, 1, [] { controlLoop.tick(1, esp_timer_get_time()); });
+}
+
+// Dispatches every command, stepping the control loop after each handful
+// like its timer would, and keeps the dispatch and step costs apart
+template <typename F>
+static void replay(const std::vector<Command> &commands, int iterations, Cost &dispatchCost, Cost &tickCost,
+                   F dispatch) {
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    for (size_t i = 0; i < commands.size(); i += COMMANDS_PER_TICK) {
+      size_t end = std::min(commands.size(), i + COMMANDS_PER_TICK);
+
+      measure(dispatchCost, end - i, [&] {
+        for (size_t j = i; j < end; j++) {
+          dispatch(commands[j]);
+        }
+      });
+
+      step(tickCost);
+    }
+  }
+}
+
+static void printCost(const char *name, const Cost &cost, bool last = false) {
+  double ops = cost.ops ? (double)cost.ops : 1.0;
+
+  printf("\"%s\":{\"ops\":%llu,\"ns_per_op\":%.1f,\"mallocs_per_op\":%.4f,\"prints_per_op\":%.4f}%s", name,
+         (unsigned long long)cost.ops, cost.ns / ops, cost.allocs / ops, cost.prints / ops, last ? "" : ",");
+}
+
+// A probe inside car.tick: ns from the fake's 240 MHz cycle counter
+static void printProbe(const PerfProbe &probe, bool last = false) {
+  printf("\"%s\":{\"ops\":%u,\"ns_per_op\":%.1f,\"mallocs_per_op\":%.2f,\"prints_per_op\":%.2f}%s", probe.getName(),
+         probe.getCalls(), probe.getMeanCycles() * 1000.0 / 240, probe.getAllocsPer100() / 100.0,
+         probe.getPrintsPer100() / 100.0, last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 20;
+
+  if (car.init() != ESP_OK) {
+    fprintf(stderr, "car init failed\n");
+    return 1;
+  }
+
+  // A /ws session of its own, the replies of pings and settings go there
+  httpd_handle_t server = nullptr;
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  httpd_uri_t wsUri = {.uri = "/ws", .method = HTTP_GET, .handler = websocketHandler, .user_ctx = NULL, .is_websocket = true};
+
+  if (httpd_start(&server, &config) != ESP_OK || httpd_register_uri_handler(server, &wsUri) != ESP_OK ||
+      loopbackRequest(server, HTTP_GET, "/ws", {}, BENCH_FD).result != ESP_OK) {
+    fprintf(stderr, "no /ws session\n");
+    return 1;
+  }
+
+  ((LoopbackServer *)server)->keepWsFrames = false;
+
+  LoopbackExchange exchange;
+  exchange.sockfd = BENCH_FD;
+  httpd_req_t req = {};
+  req.handle = server;
+  req.aux = &exchange;
+
+  struct Mix {
+    const char *name;
+    std::vector<Command> commands;
+    bool text;
+  };
+
+  const Mix mixes[] = {{"driving", drivingMix(2000), true}, {"stick", stickMix(2000), false}, {"settings", settingsMix(400), true}};
+
+  printf("{\"iterations\":%d,\"commands_per_tick\":%d,", iterations, COMMANDS_PER_TICK);
+
+  for (const Mix &mix : mixes) {
+    Cost text = {}, binary = {}, tick = {};
+
+    for (int i = 0; i < PERF_PROBE_COUNT; i++) {
+      perfProbes[i]->reset();
+    }
+
+    if (mix.text) {
+      replay(mix.commands, iterations, text, tick, [&](const Command &command) { handleCarCommand(command.text, &req); });
+    }
+
+    replay(mix.commands, iterations, binary, tick,
+           [&](const Command &command) { handleBinaryCommand(command.frame, CAR_FRAME_SIZE, &req); });
+
+    printf("\"%s\":{", mix.name);
+
+    if (mix.text) {
+      printCost("text_command", text);
+    }
+
+    printCost("binary_command", binary);
+    printCost("control_tick", tick);
+    printProbe(perfMotorTick);
+    printProbe(perfServoUpdate, true);
+    printf("},");
+
+    // Stop between mixes, so each starts from a car at rest
+    controlLoop.submit(CarCommandType::MOVE, MOVE_STOP);
+    controlLoop.submit(CarCommandType::SESSION);
+    for (int i = 0; i < CONTROL_RATE_HZ; i++) {
+      controlLoop.tick(1, esp_timer_get_time());
+    }
+  }
+
+  // Every name both ways, as the frame size commands and replies use them
+  Cost toName = {}, fromName = {};
+  volatile int sink = 0;
+
+  for (int iteration = 0; iteration < iterations * 100; iteration++) {
+    measure(toName, FRAMESIZE_INVALID, [&] {
+      for (int size = 0; size < FRAMESIZE_INVALID; size++) {
+        sink = sink + frameSizeToString((framesize_t)size)[10];
+      }
+    });
+
+    measure(fromName, FRAMESIZE_INVALID, [&] {
+      for (int size = 0; size < FRAMESIZE_INVALID; size++) {
+        sink = sink + stringToFrameSize(frameSizeToString((framesize_t)size));
+      }
+    });
+  }
+
+  printf("\"frame_size_names\":{");
+  printCost("frame_size_to_string", toName);
+  printCost("string_to_frame_size", fromName, true);
+  printf("},\"ws_replies\":%u}\n", ((LoopbackServer *)server)->wsFramesSent);
+  return 0;
+}
@@ -0,0 +1,237 @@
+// Host benchmark for command dispatch: the binary frames of src/CarProtocol.h
+// through an opcode-indexed table against the strcmp chain that parsed the
+// text commands before them.
+//
+//   g++ -O2 -std=c++17 -I src tools/dispatch_bench.cpp -o dispatch_bench
+//   ./dispatch_bench [iterations]
+//
+// Both sides replay the same mix a driving session sends: mostly camera
+// drags and moves, some pings and the odd setting. Each command is first
+// checked to reach the same action with the same operands both ways; exits
+// with 1 on a mismatch. Then reports, as JSON, ns per command for each.
+
+#include "CarProtocol.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// What a handler would have done, in place of touching the car
+struct Action {
+  uint8_t opcode;
+  int a;
+  int b;
+};
+
+static Action lastAction;
+
+static void act(uint8_t opcode, int a = 0, int b = 0) {
+  lastAction = {opcode, a, b};
+}
+
+static const char *const MOVE_NAMES[MOVE_COUNT] = {"stop",         "forward",       "backward",
+                                                   "left",         "right",         "forward-left",
+                                                   "forward-right", "backward-left", "backward-right"};
+
+// The text dispatch as it was: settings first, moves last
+static void dispatchText(const char *command) {
+  if (strcmp(command, "toggleFlash") == 0) {
+    act(OP_TOGGLE_FLASH);
+    return;
+  }
+
+  if (strncmp(command, "cameraDrag_", 11) == 0) {
+    int x, y;
+
+    if (sscanf(command + 11, "%d_%d", &x, &y) == 2) {
+      act(OP_CAMERA, x, y);
+    }
+
+    return;
+  }
+
+  // The name lookup behind it is timed separately by the perf probes
+  if (strncmp(command, "frameSize_", 10) == 0) {
+    act(OP_FRAME_SIZE);
+    return;
+  }
+
+  if (strncmp(command, "autoQuality_", 12) == 0) {
+    act(OP_AUTO_QUALITY, command[12] == '1');
+    return;
+  }
+
+  if (strncmp(command, "targetFps_", 10) == 0) {
+    act(OP_TARGET_FPS, atoi(command + 10));
+    return;
+  }
+
+  if (strcmp(command, "reset") == 0) {
+    return;
+  }
+
+  if (strcmp(command, "ping") == 0) {
+    act(OP_PING);
+    return;
+  }
+
+  for (int i = MOVE_FORWARD; i < MOVE_COUNT; i++) {
+    if (strcmp(command, MOVE_NAMES[i]) == 0) {
+      act(OP_MOVE, i);
+      return;
+    }
+  }
+
+  if (strcmp(command, "stop") == 0) {
+    act(OP_MOVE, MOVE_STOP);
+  }
+}
+
+typedef void (*FrameHandler)(const CarCommandFrame &frame);
+
+static void onPing(const CarCommandFrame &frame) {
+  act(OP_PING);
+}
+
+static void onToggleFlash(const CarCommandFrame &frame) {
+  act(OP_TOGGLE_FLASH);
+}
+
+static void onMove(const CarCommandFrame &frame) {
+  if (frame.a >= 0 && frame.a < MOVE_COUNT) {
+    act(OP_MOVE, frame.a);
+  }
+}
+
+static void onCamera(const CarCommandFrame &frame) {
+  act(OP_CAMERA, frame.a, frame.b);
+}
+
+static void onFrameSize(const CarCommandFrame &frame) {
+  act(OP_FRAME_SIZE, frame.a);
+}
+
+static void onTargetFps(const CarCommandFrame &frame) {
+  act(OP_TARGET_FPS, frame.a);
+}
+
+static void onAutoQuality(const CarCommandFrame &frame) {
+  act(OP_AUTO_QUALITY, frame.a != 0);
+}
+
+// Same layout as binaryCommandHandlers in carServer.h
+static const FrameHandler frameHandlers[OP_COUNT] = {nullptr,     onPing,      onToggleFlash, onMove,
+                                                     onCamera,    onFrameSize, onTargetFps,   onAutoQuality};
+
+static void dispatchBinary(const uint8_t *data, size_t len) {
+  CarCommandFrame frame;
+
+  if (decodeCommandFrame(data, len, frame) && frameHandlers[frame.opcode]) {
+    frameHandlers[frame.opcode](frame);
+  }
+}
+
+struct Command {
+  char text[32];
+  uint8_t frame[CAR_FRAME_SIZE];
+};
+
+// Roughly what script.js sends while driving with the camera moving
+static std::vector<Command> commandMix(int count) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<int> axis(-100, 100);
+  std::uniform_int_distribution<int> move(0, MOVE_COUNT - 1);
+  std::vector<Command> commands(count);
+
+  for (int i = 0; i < count; i++) {
+    Command &command = commands[i];
+    CarCommandFrame frame = {CAR_PROTOCOL_VERSION, 0, (uint16_t)i, 0, 0};
+    int pick = percent(rng);
+
+    if (pick < 60) {
+      frame.opcode = OP_CAMERA;
+      frame.a = axis(rng);
+      frame.b = axis(rng);
+      snprintf(command.text, sizeof(command.text), "cameraDrag_%d_%d", frame.a, frame.b);
+    } else if (pick < 90) {
+      frame.opcode = OP_MOVE;
+      frame.a = move(rng);
+      snprintf(command.text, sizeof(command.text), "%s", MOVE_NAMES[frame.a]);
+    } else if (pick < 97) {
+      frame.opcode = OP_PING;
+      snprintf(command.text, sizeof(command.text), "ping");
+    } else if (pick < 98) {
+      frame.opcode = OP_TOGGLE_FLASH;
+      snprintf(command.text, sizeof(command.text), "toggleFlash");
+    } else if (pick < 99) {
+      frame.opcode = OP_TARGET_FPS;
+      frame.a = 5 + percent(rng) % 26;
+      snprintf(command.text, sizeof(command.text), "targetFps_%d", frame.a);
+    } else {
+      frame.opcode = OP_AUTO_QUALITY;
+      frame.a = percent(rng) & 1;
+      snprintf(command.text, sizeof(command.text), "autoQuality_%d", frame.a);
+    }
+
+    encodeCommandFrame(frame, command.frame);
+  }
+
+  return commands;
+}
+
+static bool checkEquivalent(const std::vector<Command> &commands) {
+  for (size_t i = 0; i < commands.size(); i++) {
+    lastAction = {0, 0, 0};
+    dispatchText(commands[i].text);
+    Action text = lastAction;
+
+    lastAction = {0, 0, 0};
+    dispatchBinary(commands[i].frame, CAR_FRAME_SIZE);
+
+    if (text.opcode != lastAction.opcode || text.a != lastAction.a || text.b != lastAction.b) {
+      fprintf(stderr, "\"%s\" dispatched as %u(%d, %d), its frame as %u(%d, %d)\n", commands[i].text, text.opcode,
+              text.a, text.b, lastAction.opcode, lastAction.a, lastAction.b);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template <typename F>
+static double nsPerCommand(const std::vector<Command> &commands, int iterations, F dispatch) {
+  volatile int sink = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < iterations; i++) {
+    for (const Command &command : commands) {
+      dispatch(command);
+      sink = sink + lastAction.a;
+    }
+  }
+
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  return ns / ((double)iterations * commands.size());
+}
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 200;
+  std::vector<Command> commands = commandMix(10000);
+
+  if (!checkEquivalent(commands)) {
+    return 1;
+  }
+
+  double textNs = nsPerCommand(commands, iterations, [](const Command &command) { dispatchText(command.text); });
+  double binaryNs = nsPerCommand(commands, iterations,
+                                 [](const Command &command) { dispatchBinary(command.frame, CAR_FRAME_SIZE); });
+
+  printf("{\"equivalent\":true,\"commands\":%zu,\"iterations\":%d,\"text_ns\":%.1f,\"binary_ns\":%.1f,"
+         "\"speedup\":%.1f}\n",
+         commands.size(), iterations, textNs, binaryNs, textNs / binaryNs);
+  return 0;
+}
@@ -0,0 +1,133 @@
+"""Pre-build step: embeds the web UI from lib/ into the firmware.
+
+Every file is minified, gzipped and written to src/generated/webAssets.h as
+constexpr byte arrays with their lengths and ETags, so the server can answer
+straight from flash without a filesystem. Runs from platformio.ini
+(extra_scripts = pre:tools/embed_assets.py) or by hand:
+
+    python tools/embed_assets.py
+"""
+
+import gzip
+import os
+import re
+import sys
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(sys.argv[0])))
+
+sys.path.insert(0, os.path.join(PROJECT_DIR, "tools"))
+import jsmin  # noqa: E402
+
+SOURCE_DIR = os.path.join(PROJECT_DIR, "lib")
+OUTPUT = os.path.join(PROJECT_DIR, "src", "generated", "webAssets.h")
+
+# URL path, source file, content type
+ASSETS = [
+    ("/index.html", "index.html", "text/html"),
+    ("/busy.html", "busy.html", "text/html"),
+    ("/script.js", "script.js", "application/javascript"),
+    ("/style.css", "style.css", "text/css"),
+]
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{};,>])\s*", r"\1", text)
+    text = re.sub(r"([{;])\s*([\w-]+)\s*:\s*", r"\1\2:", text)
+    return text.replace(";}", "}").strip()
+
+
+def minify_html(text):
+    text = re.sub(
+        r"(<style[^>]*>)(.*?)(</style>)",
+        lambda m: m.group(1) + minify_css(m.group(2)) + m.group(3),
+        text,
+        flags=re.S,
+    )
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    # Whitespace that spans lines is indentation, a single space between
+    # inline elements on one line is kept
+    text = re.sub(r">\s*\n\s*<", "><", text)
+    text = re.sub(r"\s*\n\s*", " ", text)
+    return text.strip()
+
+
+MINIFIERS = {
+    ".html": minify_html,
+    ".css": minify_css,
+    ".js": jsmin.minify,
+}
+
+
+def fnv1a(data):
+    h = 2166136261
+    for byte in data:
+        h = ((h ^ byte) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def c_identifier(name):
+    return "ASSET_" + re.sub(r"\W", "_", name).upper()
+
+
+def c_array(name, data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "static constexpr uint8_t %s[%d] = {\n%s\n};\n" % (name, len(data), "\n".join(lines))
+
+
+def c_variant(name, data):
+    return '{%s, %d, "\\"%08x\\""}' % (name, len(data), fnv1a(data))
+
+
+def generate():
+    arrays = []
+    entries = []
+
+    for path, source, content_type in ASSETS:
+        with open(os.path.join(SOURCE_DIR, source), encoding="utf-8") as f:
+            text = f.read()
+
+        plain = MINIFIERS[os.path.splitext(source)[1]](text).encode("utf-8")
+        packed = gzip.compress(plain, 9, mtime=0)
+        name = c_identifier(source)
+
+        arrays.append(c_array(name, plain))
+        arrays.append(c_array(name + "_GZ", packed))
+        entries.append(
+            '    {"%s", "%s", %s, %s},'
+            % (path, content_type, c_variant(name, plain), c_variant(name + "_GZ", packed))
+        )
+        print("embed_assets: %s %d -> %d bytes (%d gzipped)" % (source, len(text), len(plain), len(packed)))
+
+    return (
+        "// Generated by tools/embed_assets.py from lib/, do not edit\n"
+        "#pragma once\n\n"
+        + "\n".join(arrays)
+        + "\nstatic constexpr EmbeddedAsset WEB_ASSETS[] = {\n"
+        + "\n".join(entries)
+        + "\n};\n"
+    )
+
+
+def main():
+    header = generate()
+
+    # Leave the file alone when nothing changed so it doesn't force a rebuild
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, encoding="utf-8") as f:
+            if f.read() == header:
+                return
+
+    os.makedirs(os.path.dirname(OUTPUT), exist_ok=True)
+    with open(OUTPUT, "w", encoding="utf-8", newline="\n") as f:
+        f.write(header)
+
+
+main()
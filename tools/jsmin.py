@@ -0,0 +1,135 @@
+"""Python port of Douglas Crockford's JSMin, used by embed_assets.py."""
+
+import re
+import sys
+
+EOF = None
+
+
+def is_alnum(c):
+    return c is not EOF and (c.isalnum() or c in "_$\\" or ord(c) > 126)
+
+
+class JsMin:
+    def __init__(self, text):
+        self.src = text
+        self.pos = 0
+        self.out = []
+        self.look = EOF
+        self.a = "\n"
+        self.b = EOF
+
+    def get(self):
+        c = self.look
+        self.look = EOF
+        if c is EOF:
+            if self.pos < len(self.src):
+                c = self.src[self.pos]
+                self.pos += 1
+        if c is EOF or c >= " " or c == "\n":
+            return c
+        if c == "\r":
+            return "\n"
+        return " "
+
+    def peek(self):
+        self.look = self.get()
+        return self.look
+
+    def next(self):
+        c = self.get()
+        if c == "/":
+            p = self.peek()
+            if p == "/":
+                while True:
+                    c = self.get()
+                    if c is EOF or c == "\n":
+                        return c
+            if p == "*":
+                self.get()
+                while True:
+                    c = self.get()
+                    if c == "*" and self.peek() == "/":
+                        self.get()
+                        return " "
+                    if c is EOF:
+                        raise ValueError("unterminated comment")
+        return c
+
+    def action(self, d):
+        if d <= 1:
+            self.out.append(self.a)
+        if d <= 2:
+            self.a = self.b
+            if self.a in ("'", '"', "`"):
+                while True:
+                    self.out.append(self.a)
+                    self.a = self.get()
+                    if self.a == self.b:
+                        break
+                    if self.a is EOF:
+                        raise ValueError("unterminated string")
+                    if self.a == "\\":
+                        self.out.append(self.a)
+                        self.a = self.get()
+        self.b = self.next()
+        if self.b == "/" and self.a in tuple("(,=:[!&|?+-~*{;}\n"):
+            self.out.append(self.a)
+            if self.a in ("/", "*"):
+                self.out.append(" ")
+            self.out.append(self.b)
+            while True:
+                self.a = self.get()
+                if self.a == "[":
+                    while True:
+                        self.out.append(self.a)
+                        self.a = self.get()
+                        if self.a == "]":
+                            break
+                        if self.a == "\\":
+                            self.out.append(self.a)
+                            self.a = self.get()
+                elif self.a == "/":
+                    break
+                elif self.a == "\\":
+                    self.out.append(self.a)
+                    self.a = self.get()
+                self.out.append(self.a)
+            self.b = self.next()
+
+    def run(self):
+        self.action(3)
+        while self.a is not EOF:
+            a, b = self.a, self.b
+            if a == " ":
+                self.action(1 if is_alnum(b) else 2)
+            elif a == "\n":
+                if b is not EOF and b in "{[(+-!~":
+                    self.action(1)
+                elif b == " ":
+                    self.action(3)
+                else:
+                    self.action(1 if is_alnum(b) else 2)
+            else:
+                if b == " ":
+                    self.action(1 if is_alnum(a) else 3)
+                elif b == "\n":
+                    if a in "}])+-\"'`":
+                        self.action(1)
+                    else:
+                        self.action(1 if is_alnum(a) else 3)
+                elif a == ";" and b == "}":
+                    self.action(2)
+                else:
+                    self.action(1)
+        return "".join(c for c in self.out if c is not EOF).lstrip("\n")
+
+
+def minify(text):
+    out = JsMin(text).run()
+    out = re.sub(r"(?<![\w$.'\"])true(?![\w$'\"])", "!0", out)
+    return re.sub(r"(?<![\w$.'\"])false(?![\w$'\"])", "!1", out)
+
+
+if __name__ == "__main__":
+    sys.stdout.write(minify(open(sys.argv[1], encoding="utf-8").read()))
@@ -0,0 +1,180 @@
+// Host check and benchmark for the motion kernels in src/MotionKernel.h.
+//
+//   g++ -O2 -std=c++17 -I src tools/motion_bench.cpp -o motion_bench
+//   ./motion_bench [iterations]
+//
+// First verifies that the SWAR SAD kernel matches the scalar reference on
+// random, extreme and edge-value 7-bit blocks and that both drive MotionModel to
+// identical results; exits with 1 on any mismatch. Then times both kernels
+// over the full block grid and one model update per frame, as JSON.
+
+#include "MotionKernel.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+
+alignas(4) static uint8_t frameA[MOTION_WIDTH * MOTION_HEIGHT];
+alignas(4) static uint8_t frameB[MOTION_WIDTH * MOTION_HEIGHT];
+
+static bool checkBlocks(std::mt19937 &rng, int rounds) {
+  std::uniform_int_distribution<int> byte(0, MOTION_LUMA_MAX);
+  const uint8_t edges[] = {0, 1, 63, 64, 126, 127};
+
+  for (int round = 0; round < rounds; round++) {
+    for (int i = 0; i < MOTION_WIDTH * MOTION_HEIGHT; i++) {
+      switch (round % 3) {
+      case 0:
+        frameA[i] = byte(rng);
+        frameB[i] = byte(rng);
+        break;
+      case 1:
+        frameA[i] = edges[byte(rng) % sizeof(edges)];
+        frameB[i] = edges[byte(rng) % sizeof(edges)];
+        break;
+      default:
+        frameA[i] = byte(rng) & 1 ? MOTION_LUMA_MAX : 0;
+        frameB[i] = MOTION_LUMA_MAX - frameA[i];
+        break;
+      }
+    }
+
+    for (int by = 0; by < MOTION_BLOCKS_Y; by++) {
+      for (int bx = 0; bx < MOTION_BLOCKS_X; bx++) {
+        size_t offset = (size_t)by * MOTION_BLOCK * MOTION_WIDTH + bx * MOTION_BLOCK;
+        uint32_t scalar = motionBlockSadScalar(frameA + offset, frameB + offset, MOTION_WIDTH);
+        uint32_t swar = motionBlockSadSwar(frameA + offset, frameB + offset, MOTION_WIDTH);
+
+        if (scalar != swar) {
+          fprintf(stderr, "SAD mismatch in round %d block %d,%d: scalar %u, swar %u\n", round, bx, by, scalar, swar);
+          return false;
+        }
+      }
+    }
+  }
+
+  // Every pair of 7-bit values, in every lane, next to lanes going the
+  // other way so a carry or borrow would show up
+  for (uint32_t a = 0; a <= MOTION_LUMA_MAX; a++) {
+    for (uint32_t b = 0; b <= MOTION_LUMA_MAX; b++) {
+      uint32_t expected = a > b ? a - b : b - a;
+      uint32_t got = swarAbsDiff7(a * 0x01010101u ^ 0x007F007F, b * 0x01010101u ^ 0x7F007F00);
+
+      for (int lane = 0; lane < 4; lane++) {
+        uint32_t la = (a * 0x01010101u ^ 0x007F007F) >> (8 * lane) & 0xFF;
+        uint32_t lb = (b * 0x01010101u ^ 0x7F007F00) >> (8 * lane) & 0xFF;
+        uint32_t want = la > lb ? la - lb : lb - la;
+
+        if ((got >> (8 * lane) & 0xFF) != want) {
+          fprintf(stderr, "swarAbsDiff7 lane %d of (%u, %u) = %u, expected %u\n", lane, a, b, got >> (8 * lane) & 0xFF,
+                  want);
+          return false;
+        }
+      }
+
+      if (swarAbsDiff7(a << 24, b << 24) >> 24 != expected) {
+        fprintf(stderr, "swarAbsDiff7(%u, %u) top lane wrong\n", a, b);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// A moving bright square over a noisy gradient
+static void drawScene(std::mt19937 &rng, uint8_t *frame, int t) {
+  std::uniform_int_distribution<int> noise(-3, 3);
+  int squareX = (t * 3) % (MOTION_WIDTH - 16);
+  int squareY = MOTION_HEIGHT / 3;
+
+  for (int y = 0; y < MOTION_HEIGHT; y++) {
+    for (int x = 0; x < MOTION_WIDTH; x++) {
+      int value = 30 + x / 4 + noise(rng);
+      bool inSquare = t >= 20 && x >= squareX && x < squareX + 16 && y >= squareY && y < squareY + 16;
+      frame[y * MOTION_WIDTH + x] = inSquare ? 110 : value;
+    }
+  }
+}
+
+static bool checkModels(std::mt19937 &rng, int frames, uint32_t &motionFrames) {
+  static MotionModel scalarModel(motionBlockSadScalar);
+  static MotionModel swarModel(motionBlockSadSwar);
+  motionFrames = 0;
+
+  for (int t = 0; t < frames; t++) {
+    drawScene(rng, frameA, t);
+    MotionResult a = scalarModel.update(frameA);
+    MotionResult b = swarModel.update(frameA);
+
+    if (a.activeBlocks != b.activeBlocks || a.left != b.left || a.top != b.top || a.right != b.right ||
+        a.bottom != b.bottom) {
+      fprintf(stderr, "model mismatch at frame %d\n", t);
+      return false;
+    }
+
+    if (t >= 20 && !b.isMotion()) {
+      fprintf(stderr, "moving square missed at frame %d\n", t);
+      return false;
+    }
+
+    if (t < 20 && b.isMotion()) {
+      fprintf(stderr, "motion reported on a static scene at frame %d\n", t);
+      return false;
+    }
+
+    motionFrames += b.isMotion();
+  }
+
+  return true;
+}
+
+template <typename F>
+static double timeNs(int iterations, F body) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < iterations; i++) {
+    body();
+  }
+
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+static double gridNs(MotionSadKernel kernel, int iterations) {
+  volatile uint32_t sink = 0;
+
+  return timeNs(iterations, [&]() {
+    uint32_t total = 0;
+
+    for (int by = 0; by < MOTION_BLOCKS_Y; by++) {
+      for (int bx = 0; bx < MOTION_BLOCKS_X; bx++) {
+        size_t offset = (size_t)by * MOTION_BLOCK * MOTION_WIDTH + bx * MOTION_BLOCK;
+        total += kernel(frameA + offset, frameB + offset, MOTION_WIDTH);
+      }
+    }
+
+    sink = sink + total;
+  });
+}
+
+int main(int argc, char **argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+  std::mt19937 rng(1);
+  uint32_t motionFrames = 0;
+
+  if (!checkBlocks(rng, 300) || !checkModels(rng, 200, motionFrames)) {
+    return 1;
+  }
+
+  double scalarNs = gridNs(motionBlockSadScalar, iterations);
+  double swarNs = gridNs(motionBlockSadSwar, iterations);
+
+  static MotionModel model;
+  double updateNs = timeNs(iterations / 10 + 1, [&]() { model.update(frameA); });
+
+  printf("{\"equivalent\":true,\"motion_frames\":%u,\"grid\":\"%dx%d blocks of %dx%d\",\"iterations\":%d,"
+         "\"scalar_grid_ns\":%.0f,\"swar_grid_ns\":%.0f,\"speedup\":%.2f,\"model_update_ns\":%.0f}\n",
+         motionFrames, MOTION_BLOCKS_X, MOTION_BLOCKS_Y, MOTION_BLOCK, MOTION_BLOCK, iterations, scalarNs, swarNs,
+         scalarNs / swarNs, updateNs);
+  return 0;
+}
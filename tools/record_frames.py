@@ -0,0 +1,61 @@
+"""Records the car's MJPEG stream as numbered JPEG files.
+
+Static-scene suppression is switched off while recording so every captured
+frame is kept, and switched back on afterwards. The directory is the input
+of tools/scene_bench.cpp:
+
+    python tools/record_frames.py car.local parked --seconds 20 --size VGA
+"""
+
+import argparse
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from stream_bench import SIZES, read_stream  # noqa: E402
+from ws_client import ControlSocket  # noqa: E402
+
+
+def set_static_skip(host, enabled, size=None):
+    control = ControlSocket(host)
+    try:
+        control.send_text(f"staticSkip_{int(enabled)}")
+        if size:
+            control.send_text("autoQuality_0")
+            control.send_text(f"frameSize_FRAMESIZE_{size}")
+    finally:
+        control.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("host", help="car address, e.g. car.local or 192.168.4.1")
+    parser.add_argument("directory", help="where the frames go, created if missing")
+    parser.add_argument("--seconds", type=float, default=20, help="recording time")
+    parser.add_argument("--size", help="frame size to record at, from " + ",".join(SIZES))
+    args = parser.parse_args()
+
+    size = args.size.upper() if args.size else None
+    if size and size not in SIZES:
+        parser.error("unknown frame size: " + size)
+
+    os.makedirs(args.directory, exist_ok=True)
+    count = 0
+
+    def save(jpeg):
+        nonlocal count
+        with open(os.path.join(args.directory, f"{count:05d}.jpg"), "wb") as f:
+            f.write(jpeg)
+        count += 1
+
+    set_static_skip(args.host, False, size)
+    try:
+        stats = read_stream(args.host, args.seconds, 0, save)
+    finally:
+        set_static_skip(args.host, True)
+
+    print(f"{count} frames at {stats['fps']} fps in {args.directory}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
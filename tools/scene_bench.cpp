@@ -0,0 +1,116 @@
+// Replays recorded frame sequences through SceneDetector on the host and
+// reports how many frames it would have sent, plus the cost per frame.
+// Record sequences with tools/record_frames.py, then:
+//
+//   g++ -O2 -std=c++17 -I src tools/scene_bench.cpp -o scene_bench
+//   ./scene_bench --fps 20 parked/ driving/
+//
+// Output is one JSON object per sequence.
+
+#include "SceneDetector.h"
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <fstream>
+#include <iterator>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> listFrames(const std::string &directory) {
+  std::vector<std::string> paths;
+  DIR *dir = opendir(directory.c_str());
+
+  if (!dir) {
+    return paths;
+  }
+
+  while (dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".jpg") == 0) {
+      paths.push_back(directory + "/" + name);
+    }
+  }
+
+  closedir(dir);
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+static std::vector<uint8_t> readFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void replay(const std::string &directory, int fps) {
+  std::vector<std::vector<uint8_t>> frames;
+
+  for (const std::string &path : listFrames(directory)) {
+    frames.push_back(readFile(path));
+  }
+
+  if (frames.empty()) {
+    fprintf(stderr, "%s: no .jpg frames\n", directory.c_str());
+    return;
+  }
+
+  SceneDetector detector;
+  int64_t intervalUs = 1000000 / fps;
+  uint32_t published = 0;
+  uint32_t longestGap = 0;
+  uint32_t gap = 0;
+  int firstStatic = -1;
+  uint32_t regions = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < frames.size(); i++) {
+    bool send = detector.shouldPublish(frames[i].data(), frames[i].size(), (int64_t)(i + 1) * intervalUs);
+
+    if (send) {
+      published++;
+      gap = 0;
+    } else if (++gap > longestGap) {
+      longestGap = gap;
+    }
+
+    if (firstStatic < 0 && detector.isStatic()) {
+      firstStatic = i;
+    }
+  }
+
+  double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  SceneSignature signature;
+  SceneDetector::sign(frames[0].data(), frames[0].size(), signature);
+  regions = signature.regionCount;
+
+  printf("{\"sequence\":\"%s\",\"frames\":%zu,\"published\":%u,\"suppressed\":%u,\"airtime_saved_pct\":%.1f,"
+         "\"first_static_frame\":%d,\"longest_skip_frames\":%u,\"regions\":%u,\"ns_per_frame\":%.0f}\n",
+         directory.c_str(), frames.size(), published, detector.getSuppressedFrames(),
+         100.0 * detector.getSuppressedFrames() / frames.size(), firstStatic, longestGap, regions,
+         elapsedNs / frames.size());
+}
+
+int main(int argc, char **argv) {
+  int fps = 20;
+  int first = 1;
+
+  if (argc > 2 && std::string(argv[1]) == "--fps") {
+    fps = std::max(1, atoi(argv[2]));
+    first = 3;
+  }
+
+  if (first >= argc) {
+    fprintf(stderr, "usage: %s [--fps N] <frame directory>...\n", argv[0]);
+    return 1;
+  }
+
+  for (int i = first; i < argc; i++) {
+    replay(argv[i], fps);
+  }
+
+  return 0;
+}
@@ -0,0 +1,60 @@
+"""Turns on sentry mode and prints the car's motion events as JSON lines.
+
+Each MOTION-<blocks>-<x>-<y>-<w>-<h> event becomes one line with the
+bounding box in percent of the frame; MOTION-END closes an event. Sentry
+mode is switched off again on exit unless --keep is given:
+
+    python tools/sentry_watch.py car.local
+"""
+
+import argparse
+import json
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from ws_client import OPCODE_TEXT, ControlSocket  # noqa: E402
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("host", help="car address, e.g. car.local or 192.168.4.1")
+    parser.add_argument("--keep", action="store_true", help="leave sentry mode on when exiting")
+    args = parser.parse_args()
+
+    ws = ControlSocket(args.host)
+    ws.sock.settimeout(None)
+    ws.send_text("sentry_1")
+
+    try:
+        while True:
+            message = ws.recv()
+            if message is None:
+                print("connection closed", file=sys.stderr)
+                return
+
+            opcode, payload = message
+            text = payload.decode(errors="replace")
+            if opcode != OPCODE_TEXT or not text.startswith("MOTION-"):
+                continue
+
+            event = {"time": round(time.time(), 3)}
+            parts = text.split("-")
+            if parts[1] == "END":
+                event["end"] = True
+            else:
+                blocks, x, y, w, h = (int(v) for v in parts[1:6])
+                event.update(blocks=blocks, x=x, y=y, w=w, h=h)
+
+            print(json.dumps(event), flush=True)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if not args.keep:
+            ws.send_text("sentry_0")
+        ws.close()
+
+
+if __name__ == "__main__":
+    main()
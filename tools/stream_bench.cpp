@@ -0,0 +1,208 @@
+// Host counterpart of stream_bench.py: runs the firmware's own stream path,
+// captureTask -> FrameHub -> streamSenderTask with its FramePacer, against
+// the synthetic camera and fake sockets capped to a link bandwidth. Settings
+// go over /ws as text commands, viewers connect through /stream, all on the
+// loopback httpd of test/fakes.
+//
+//   g++ -O2 -std=gnu++17 -pthread -I src -I test/fakes -D HAL_SYNTHETIC_CAMERA tools/stream_bench.cpp -o stream_bench
+//   ./stream_bench --sizes QVGA,VGA,UXGA --fps 10,25 --kbps 0,2000 --viewers 1 --seconds 5
+//
+// The camera delivers HAL_SYNTHETIC_FPS (25 unless set with -D). Prints one
+// JSON report: per run the fps and bytes/s every viewer's socket got, and
+// the device-side stage times from frameTrace and the capture histogram.
+
+#include <Arduino.h>
+#include "config.h"
+#include "carServer.h"
+#include <string>
+#include <vector>
+
+Car car;
+WiFiManager wm;
+
+#define CONTROL_FD 60
+#define FIRST_VIEWER_FD 70
+
+static std::vector<std::string> split(const std::string &list) {
+  std::vector<std::string> items;
+  size_t start = 0;
+
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    end = end == std::string::npos ? list.size() : end;
+
+    if (end > start) {
+      items.push_back(list.substr(start, end - start));
+    }
+
+    start = end + 1;
+  }
+
+  return items;
+}
+
+static void sendText(const std::string &command) {
+  loopbackWsFrame(camera_httpd, "/ws", HTTPD_WS_TYPE_TEXT, command.data(), command.size(), CONTROL_FD);
+}
+
+static StreamViewer *viewerOn(int fd) {
+  for (int i = 0; i < FRAME_HUB_MAX_VIEWERS; i++) {
+    if (streamViewers[i].inUse && streamViewers[i].fd == fd) {
+      return &streamViewers[i];
+    }
+  }
+
+  return nullptr;
+}
+
+static void printHistogram(const char *name, const LatencyHistogram &histogram, bool last) {
+  printf("\"%s\":{\"count\":%u,\"mean_us\":%u,\"p50_us\":%u,\"p90_us\":%u,\"p99_us\":%u,\"max_us\":%u}%s", name,
+         histogram.count(), histogram.meanUs(), histogram.percentileUs(50), histogram.percentileUs(90),
+         histogram.percentileUs(99), histogram.getMaxUs(), last ? "" : ",");
+}
+
+struct ViewerStart {
+  uint64_t bytes;
+  uint32_t frames;
+};
+
+// One run: viewers connect, settle for warmupMs, then are measured for seconds
+static bool run(const std::string &size, int fps, int kbps, int viewers, double seconds, int warmupMs, bool first) {
+  sendText("frameSize_FRAMESIZE_" + size);
+  sendText("targetFps_" + std::to_string(fps));
+
+  for (int i = 0; i < viewers; i++) {
+    fakeSockets.open(FIRST_VIEWER_FD + i, kbps * 1000 / 8);
+
+    if (loopbackRequest(stream_httpd, HTTP_GET, "/stream", {}, FIRST_VIEWER_FD + i).result != ESP_OK) {
+      fprintf(stderr, "viewer %d was refused\n", i);
+      return false;
+    }
+  }
+
+  delay(warmupMs);
+
+  std::vector<ViewerStart> starts;
+  for (int i = 0; i < viewers; i++) {
+    StreamViewer *viewer = viewerOn(FIRST_VIEWER_FD + i);
+    starts.push_back({fakeSockets.get(FIRST_VIEWER_FD + i).bytes, viewer ? (uint32_t)viewer->totalFrames : 0});
+  }
+
+  frameTrace.reset();
+  frameHub.getCaptureTime().reset();
+  uint32_t droppedBefore = frameHub.getDroppedFrames();
+  int64_t startUs = esp_timer_get_time();
+
+  delay(seconds * 1000);
+
+  double elapsed = (esp_timer_get_time() - startUs) / 1e6;
+  sensor_t *s = halCameraSensor();
+
+  printf("%s{\"frame_size\":\"%s\",\"target_fps\":%d,\"link_kbps\":%d,\"viewers\":[", first ? "" : ",", size.c_str(),
+         fps, kbps);
+
+  for (int i = 0; i < viewers; i++) {
+    StreamViewer *viewer = viewerOn(FIRST_VIEWER_FD + i);
+    uint32_t frames = viewer ? viewer->totalFrames - starts[i].frames : 0;
+    uint64_t bytes = fakeSockets.get(FIRST_VIEWER_FD + i).bytes - starts[i].bytes;
+
+    printf("%s{\"frames\":%u,\"fps\":%.2f,\"bytes_per_s\":%.0f,\"frame_bytes_mean\":%.0f}", i ? "," : "", frames,
+           frames / elapsed, bytes / elapsed, frames ? (double)bytes / frames : 0.0);
+  }
+
+  printf("],\"device\":{\"frame_size\":\"%s\",\"quality\":%d,\"dropped_frames\":%u,",
+         frameSizeToString(s ? s->status.framesize : FRAMESIZE_INVALID), s ? s->status.quality : 0,
+         frameHub.getDroppedFrames() - droppedBefore);
+
+  for (int stage = 0; stage < FrameTrace::STAGE_COUNT; stage++) {
+    FrameTrace::Stage traceStage = (FrameTrace::Stage)stage;
+    printHistogram(FrameTrace::stageToString(traceStage), frameTrace.histogram(traceStage), false);
+  }
+
+  printHistogram("capture_cpu", frameHub.getCaptureTime(), true);
+  printf("}}");
+  fflush(stdout);
+
+  // Hanging up makes every sender fail its next send and leave
+  for (int i = 0; i < viewers; i++) {
+    fakeSockets.hangUp(FIRST_VIEWER_FD + i);
+  }
+
+  for (int i = 0; i < 300 && activeViewerCount() > 0; i++) {
+    delay(10);
+  }
+
+  return activeViewerCount() == 0;
+}
+
+int main(int argc, char **argv) {
+  std::string sizes = "QVGA,VGA,SVGA,XGA,UXGA";
+  std::string fpsList = "25";
+  std::string kbpsList = "0";
+  int viewers = 1;
+  double seconds = 5;
+  int warmupMs = 1000;
+  bool staticSkip = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+
+    if (flag == "--static-skip") {
+      staticSkip = true;
+    } else if (i + 1 >= argc) {
+      break;
+    } else if (flag == "--sizes") {
+      sizes = argv[++i];
+    } else if (flag == "--fps") {
+      fpsList = argv[++i];
+    } else if (flag == "--kbps") {
+      kbpsList = argv[++i];
+    } else if (flag == "--viewers") {
+      viewers = constrain(atoi(argv[++i]), 1, FRAME_HUB_MAX_VIEWERS);
+    } else if (flag == "--seconds") {
+      seconds = std::max(0.5, atof(argv[++i]));
+    } else if (flag == "--warmup-ms") {
+      warmupMs = std::max(0, atoi(argv[++i]));
+    } else {
+      fprintf(stderr,
+              "usage: %s [--sizes QVGA,VGA] [--fps 10,25] [--kbps 0,2000] [--viewers N] [--seconds S] [--warmup-ms MS] "
+              "[--static-skip]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  if (car.init() != ESP_OK || !startControlLoop() || !startFrameCapture()) {
+    fprintf(stderr, "boot failed\n");
+    return 1;
+  }
+
+  startCarServer();
+
+  // The handshake's pauses are part of the firmware, they only cost a second here
+  loopbackRequest(camera_httpd, HTTP_GET, "/ws", {}, CONTROL_FD);
+  sendText("autoQuality_0");
+  sendText(staticSkip ? "staticSkip_1" : "staticSkip_0");
+
+  printf("{\"camera_fps\":%d,\"seconds\":%.1f,\"runs\":[", HAL_SYNTHETIC_FPS, seconds);
+  bool first = true;
+  bool ok = true;
+
+  for (const std::string &size : split(sizes)) {
+    if (stringToFrameSize(("FRAMESIZE_" + size).c_str()) == FRAMESIZE_INVALID) {
+      fprintf(stderr, "unknown frame size: %s\n", size.c_str());
+      return 1;
+    }
+
+    for (const std::string &fps : split(fpsList)) {
+      for (const std::string &kbps : split(kbpsList)) {
+        fprintf(stderr, "%s @ %s fps, link %s kbit/s\n", size.c_str(), fps.c_str(), kbps == "0" ? "unlimited" : kbps.c_str());
+        ok = run(size, atoi(fps.c_str()), atoi(kbps.c_str()), viewers, seconds, warmupMs, first) && ok;
+        first = false;
+      }
+    }
+  }
+
+  printf("]}\n");
+  return ok ? 0 : 1;
+}
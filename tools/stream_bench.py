@@ -0,0 +1,190 @@
+"""Streaming throughput benchmark for the MJPEG path.
+
+Drives the real stream loop on the car: for every combination of frame size,
+target fps and link bandwidth it sets the camera over /ws, reads /stream for a
+fixed time and merges what the client saw with the device-side numbers from
+/trace. The link limit is simulated by reading the socket no faster than the
+given rate, so the car sees the same TCP backpressure as on a slow link.
+
+Build the firmware with -D HAL_SYNTHETIC_CAMERA for a fixed scene that does
+not depend on lighting. Results go to stdout (or --output) as JSON:
+
+    python tools/stream_bench.py car.local --sizes QVGA,VGA,UXGA --fps 10,25 --kbps 0,2000
+"""
+
+import argparse
+import json
+import os
+import re
+import socket
+import sys
+import time
+import urllib.request
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from ws_client import CONTROL_PORT, ControlSocket  # noqa: E402
+
+STREAM_PORT = 81
+RECV_CHUNK = 4096
+# A small receive window keeps the simulated link honest, the kernel would
+# otherwise buffer a few frames ahead of the reader
+THROTTLED_RCVBUF = 16 * 1024
+
+SIZES = ["QVGA", "CIF", "HVGA", "VGA", "SVGA", "XGA", "HD", "SXGA", "UXGA"]
+
+
+def fetch_trace(host, reset=False):
+    url = f"http://{host}:{CONTROL_PORT}/trace" + ("?reset=1" if reset else "")
+    with urllib.request.urlopen(url, timeout=10) as response:
+        return json.load(response)
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))]
+
+
+def read_stream(host, seconds, kbps, on_frame=None):
+    """Reads multipart frames for `seconds`, at most `kbps` (0 = unlimited).
+
+    on_frame, if given, is called with every complete JPEG."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    if kbps:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, THROTTLED_RCVBUF)
+    sock.settimeout(5)
+    sock.connect((host, STREAM_PORT))
+    sock.sendall(f"GET /stream HTTP/1.1\r\nHost: {host}:{STREAM_PORT}\r\n\r\n".encode())
+
+    rate = kbps * 1000 / 8
+    buffer = bytearray()
+    pending = None  # payload length of the part being read, None while in a header
+    received = 0
+    frame_bytes = []
+    arrivals = []
+
+    start = time.monotonic()
+    while time.monotonic() - start < seconds:
+        chunk = sock.recv(RECV_CHUNK)
+        if not chunk:
+            break
+
+        received += len(chunk)
+        buffer += chunk
+
+        if rate:
+            ahead = received / rate - (time.monotonic() - start)
+            if ahead > 0:
+                time.sleep(ahead)
+
+        while True:
+            if pending is None:
+                end = buffer.find(b"\r\n\r\n")
+                if end < 0:
+                    break
+                match = re.search(rb"Content-Length: (\d+)", bytes(buffer[:end]))
+                del buffer[: end + 4]
+                if match:
+                    pending = int(match.group(1))
+            elif len(buffer) >= pending:
+                if on_frame:
+                    on_frame(bytes(buffer[:pending]))
+                del buffer[:pending]
+                frame_bytes.append(pending)
+                arrivals.append(time.monotonic())
+                pending = None
+            else:
+                break
+
+    elapsed = time.monotonic() - start
+    sock.close()
+
+    intervals = [(b - a) * 1000 for a, b in zip(arrivals, arrivals[1:])]
+    return {
+        "seconds": round(elapsed, 3),
+        "frames": len(frame_bytes),
+        "fps": round(len(frame_bytes) / elapsed, 2) if elapsed else 0,
+        "bytes_per_s": round(received / elapsed) if elapsed else 0,
+        "frame_bytes_mean": round(sum(frame_bytes) / len(frame_bytes)) if frame_bytes else 0,
+        "frame_interval_ms": {
+            "p50": round(percentile(intervals, 50), 1),
+            "p90": round(percentile(intervals, 90), 1),
+            "p99": round(percentile(intervals, 99), 1),
+        },
+    }
+
+
+def summarize_histogram(histogram):
+    return {key: histogram[key] for key in ("count", "mean_us", "p50_us", "p90_us", "p99_us", "max_us")}
+
+
+def run(host, size, fps, kbps, seconds, warmup, static_skip):
+    control = ControlSocket(host)
+    try:
+        control.send_text("autoQuality_0")
+        control.send_text(f"staticSkip_{int(static_skip)}")
+        control.send_text(f"frameSize_FRAMESIZE_{size}")
+        control.send_text(f"targetFps_{fps}")
+    finally:
+        control.close()
+
+    time.sleep(warmup)
+    fetch_trace(host, reset=True)
+
+    client = read_stream(host, seconds, kbps)
+    trace = fetch_trace(host)
+    stream = trace.get("stream", {})
+
+    return {
+        "frame_size": size,
+        "target_fps": fps,
+        "link_kbps": kbps,
+        "client": client,
+        "device": {
+            "frame_size": stream.get("frame_size"),
+            "quality": stream.get("quality"),
+            "dropped_frames": stream.get("dropped_frames"),
+            "viewers": stream.get("viewers", []),
+            "send_us": summarize_histogram(trace["histograms"]["payload"]),
+            "capture_to_wire_us": summarize_histogram(trace["histograms"]["capture_to_wire"]),
+            "capture_cpu_us": summarize_histogram(stream["capture"]) if "capture" in stream else None,
+        },
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("host", help="car address, e.g. car.local or 192.168.4.1")
+    parser.add_argument("--sizes", default="QVGA,VGA,SVGA,XGA,UXGA", help="comma separated, from " + ",".join(SIZES))
+    parser.add_argument("--fps", default="25", help="comma separated stream target fps values")
+    parser.add_argument("--kbps", default="0", help="comma separated link limits in kbit/s, 0 = unlimited")
+    parser.add_argument("--seconds", type=float, default=10, help="measurement time per run")
+    parser.add_argument("--warmup", type=float, default=1.5, help="settle time after a camera change")
+    parser.add_argument("--static-skip", action="store_true", help="leave static-scene suppression on")
+    parser.add_argument("--output", help="write the JSON here instead of stdout")
+    args = parser.parse_args()
+
+    sizes = [s.strip().upper() for s in args.sizes.split(",")]
+    unknown = [s for s in sizes if s not in SIZES]
+    if unknown:
+        parser.error("unknown frame size: " + ", ".join(unknown))
+
+    runs = []
+    for size in sizes:
+        for fps in [int(v) for v in args.fps.split(",")]:
+            for kbps in [int(v) for v in args.kbps.split(",")]:
+                print(f"{size} @ {fps} fps, link {kbps or 'unlimited'} kbit/s", file=sys.stderr)
+                runs.append(run(args.host, size, fps, kbps, args.seconds, args.warmup, args.static_skip))
+
+    report = json.dumps({"host": args.host, "seconds": args.seconds, "runs": runs}, indent=2)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(report + "\n")
+    else:
+        print(report)
+
+
+if __name__ == "__main__":
+    main()
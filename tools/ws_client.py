@@ -0,0 +1,99 @@
+"""Minimal blocking WebSocket client for the car's /ws endpoint.
+
+Only what the tools need: the opening handshake, masked text and binary
+frames from the client, and unfragmented frames from the server.
+"""
+
+import base64
+import os
+import socket
+import struct
+
+CONTROL_PORT = 82
+
+OPCODE_TEXT = 0x1
+OPCODE_BINARY = 0x2
+OPCODE_CLOSE = 0x8
+
+
+class ControlSocket:
+    def __init__(self, host, port=CONTROL_PORT, timeout=5):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        key = base64.b64encode(os.urandom(16)).decode()
+        request = (
+            "GET /ws HTTP/1.1\r\n"
+            f"Host: {host}:{port}\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            f"Sec-WebSocket-Key: {key}\r\n"
+            "Sec-WebSocket-Version: 13\r\n\r\n"
+        )
+        self.sock.sendall(request.encode())
+
+        response = b""
+        while b"\r\n\r\n" not in response:
+            chunk = self.sock.recv(1024)
+            if not chunk:
+                raise ConnectionError("/ws closed during the handshake")
+            response += chunk
+
+        head, self.pending = response.split(b"\r\n\r\n", 1)
+        if b" 101 " not in head.split(b"\r\n", 1)[0]:
+            raise ConnectionError("/ws refused the upgrade")
+
+    def send_text(self, text):
+        self._send(OPCODE_TEXT, text.encode())
+
+    def send_binary(self, payload):
+        self._send(OPCODE_BINARY, payload)
+
+    def recv(self):
+        """Returns (opcode, payload) of the next frame, None once closed."""
+        header = self._read(2)
+        if header is None:
+            return None
+
+        opcode = header[0] & 0x0F
+        length = header[1] & 0x7F
+        if length == 126:
+            length = struct.unpack("!H", self._read(2))[0]
+        elif length == 127:
+            length = struct.unpack("!Q", self._read(8))[0]
+
+        payload = self._read(length) if length else b""
+        if payload is None or opcode == OPCODE_CLOSE:
+            return None
+
+        return opcode, payload
+
+    def close(self):
+        try:
+            self.sock.shutdown(socket.SHUT_RDWR)
+        except OSError:
+            pass
+        self.sock.close()
+
+    def _send(self, opcode, payload):
+        mask = os.urandom(4)
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+
+        if len(payload) < 126:
+            header = struct.pack("!BB", 0x80 | opcode, 0x80 | len(payload))
+        else:
+            header = struct.pack("!BBH", 0x80 | opcode, 0x80 | 126, len(payload))
+
+        self.sock.sendall(header + mask + masked)
+
+    def _read(self, count):
+        while len(self.pending) < count:
+            try:
+                chunk = self.sock.recv(4096)
+            except OSError:
+                return None
+            if not chunk:
+                return None
+            self.pending += chunk
+
+        data, self.pending = self.pending[:count], self.pending[count:]
+        return data
@@ -0,0 +1,246 @@
+"""WebSocket load generator for the control path.
+
+Opens several /ws sessions and replays driving plus camera-drag traffic as
+binary command frames at the given rates. Each session enables OP_ACK, so the
+car answers every command with ACK-<seq>-<queue us>-<actuate us> once it
+reached the PWM or servo outputs (actuate is -1 when nothing had to move), or
+NACK-<seq> when the control queue was full.
+
+For every drag rate in --drag-hz one run is made, and the JSON report lists
+per command kind:
+- round trip to the ACK,
+- the device-side enqueue -> actuation time,
+- an estimate of send -> actuation (half the network part of the round trip
+  plus the device part),
+- NACKed and lost commands,
+together with the control loop stats from /trace.
+
+Drive traffic only turns the wheels with a non-zero --drive-amplitude, so put
+the car on a stand for that:
+
+    python tools/ws_load.py car.local --sessions 2 --drag-hz 0,30,60,120 --drive-amplitude 40
+"""
+
+import argparse
+import json
+import math
+import os
+import random
+import struct
+import sys
+import threading
+import time
+import urllib.request
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from ws_client import CONTROL_PORT, OPCODE_TEXT, ControlSocket  # noqa: E402
+
+PROTOCOL_VERSION = 1
+OP_CAMERA = 0x04
+OP_DRIVE = 0x08
+OP_ACK = 0x09
+
+# Replies still in flight when the traffic stops
+DRAIN_SECONDS = 1.5
+
+
+def encode_frame(opcode, seq, a=0, b=0):
+    return struct.pack("<BBHhh", PROTOCOL_VERSION, opcode, seq & 0xFFFF, a, b)
+
+
+class Session:
+    def __init__(self, host, drive_hz, drag_hz, amplitude):
+        self.ws = ControlSocket(host)
+        self.ws.sock.settimeout(None)
+        self.drive_hz = drive_hz
+        self.drag_hz = drag_hz
+        self.amplitude = amplitude
+        self.lock = threading.Lock()
+        self.seq = 0
+        self.in_flight = {}  # seq -> (kind, sent at)
+        self.sent = {"drive": 0, "drag": 0}
+        self.nacked = {"drive": 0, "drag": 0}
+        self.samples = {"drive": [], "drag": []}
+
+        self.ws.send_binary(encode_frame(OP_ACK, 0, 1))
+        self.receiver = threading.Thread(target=self.receive, daemon=True)
+        self.receiver.start()
+
+    def send(self, kind, opcode, a, b):
+        with self.lock:
+            self.seq = (self.seq + 1) & 0xFFFF
+            self.in_flight[self.seq] = (kind, time.monotonic())
+            self.sent[kind] += 1
+            seq = self.seq
+
+        self.ws.send_binary(encode_frame(opcode, seq, a, b))
+
+    def receive(self):
+        while True:
+            message = self.ws.recv()
+            if message is None:
+                return
+
+            opcode, payload = message
+            if opcode != OPCODE_TEXT:
+                continue
+
+            now = time.monotonic()
+            parts = payload.decode(errors="replace").split("-", 3)
+
+            if parts[0] == "NACK" and len(parts) == 2:
+                with self.lock:
+                    entry = self.in_flight.pop(int(parts[1]), None)
+                    if entry:
+                        self.nacked[entry[0]] += 1
+                continue
+
+            if parts[0] != "ACK" or len(parts) != 4:
+                continue
+
+            seq, queue_us, actuate_us = int(parts[1]), int(parts[2]), int(parts[3])
+
+            with self.lock:
+                entry = self.in_flight.pop(seq, None)
+                if entry:
+                    kind, sent_at = entry
+                    self.samples[kind].append((now - sent_at, queue_us, actuate_us))
+
+    def run(self, seconds):
+        start = time.monotonic()
+        next_drive = start
+        next_drag = start
+        x, y = 0, 0
+
+        while True:
+            now = time.monotonic()
+            t = now - start
+            if t >= seconds:
+                break
+
+            if self.drive_hz and now >= next_drive:
+                throttle = round(self.amplitude * math.sin(2 * math.pi * t / 4))
+                steer = round(self.amplitude / 2 * math.sin(2 * math.pi * t / 3))
+                self.send("drive", OP_DRIVE, throttle, steer)
+                next_drive += 1 / self.drive_hz
+
+            if self.drag_hz and now >= next_drag:
+                x = max(-100, min(100, x + random.randint(-10, 10)))
+                y = max(-100, min(100, y + random.randint(-10, 10)))
+                self.send("drag", OP_CAMERA, x, y)
+                next_drag += 1 / self.drag_hz
+
+            due = min(next_drive if self.drive_hz else math.inf, next_drag if self.drag_hz else math.inf)
+            if due == math.inf:
+                time.sleep(seconds - t)
+            elif due > now:
+                time.sleep(due - now)
+
+        if self.drive_hz:
+            self.send("drive", OP_DRIVE, 0, 0)
+
+    def close(self):
+        self.ws.close()
+
+
+def percentiles(values, scale=1.0):
+    if not values:
+        return None
+    ordered = sorted(values)
+    pick = lambda p: round(ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))] * scale, 2)  # noqa: E731
+    return {"p50": pick(50), "p90": pick(90), "p99": pick(99), "max": round(ordered[-1] * scale, 2)}
+
+
+def summarize(sessions, kind):
+    samples = [s for session in sessions for s in session.samples[kind]]
+    sent = sum(session.sent[kind] for session in sessions)
+    nacked = sum(session.nacked[kind] for session in sessions)
+    actuated = [s for s in samples if s[2] >= 0]
+
+    # The ACK leaves the car right after actuation, so the network share of the
+    # round trip is rtt - actuate, split evenly between the two directions
+    estimates = [(rtt - act / 1e6) / 2 + act / 1e6 for rtt, _, act in actuated]
+
+    return {
+        "sent": sent,
+        "acked": len(samples),
+        "nacked": nacked,
+        "lost": sent - len(samples) - nacked,
+        "actuated": len(actuated),
+        "unchanged": len(samples) - len(actuated),
+        "rtt_ms": percentiles([rtt for rtt, _, _ in samples], 1000),
+        "device_queue_us": percentiles([queue for _, queue, _ in samples]),
+        "device_actuate_us": percentiles([act for _, _, act in actuated]),
+        "send_to_actuation_ms": percentiles(estimates, 1000),
+    }
+
+
+def fetch_trace(host, reset=False):
+    url = f"http://{host}:{CONTROL_PORT}/trace" + ("?reset=1" if reset else "")
+    with urllib.request.urlopen(url, timeout=10) as response:
+        return json.load(response)
+
+
+def run(host, sessions_count, drive_hz, drag_hz, amplitude, seconds):
+    fetch_trace(host, reset=True)
+    sessions = [Session(host, drive_hz, drag_hz, amplitude) for _ in range(sessions_count)]
+    threads = [threading.Thread(target=session.run, args=(seconds,)) for session in sessions]
+
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    time.sleep(DRAIN_SECONDS)
+    for session in sessions:
+        session.close()
+
+    control = fetch_trace(host).get("control", {})
+
+    return {
+        "sessions": sessions_count,
+        "drive_hz": drive_hz,
+        "drag_hz": drag_hz,
+        "drive": summarize(sessions, "drive"),
+        "drag": summarize(sessions, "drag"),
+        "device": {
+            "dropped_commands": control.get("dropped_commands"),
+            "overruns": control.get("overruns"),
+            "jitter_p99_us": control.get("jitter", {}).get("p99_us"),
+            "tick_p99_us": control.get("tick", {}).get("p99_us"),
+            "command_queue_p99_us": control.get("command_queue", {}).get("p99_us"),
+        },
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("host", help="car address, e.g. car.local or 192.168.4.1")
+    parser.add_argument("--sessions", type=int, default=1, help="concurrent /ws sessions")
+    parser.add_argument("--drive-hz", type=float, default=20, help="drive frames per second per session, 0 = none")
+    parser.add_argument("--drag-hz", default="30", help="comma separated camera-drag rates per session, one run each")
+    parser.add_argument("--drive-amplitude", type=int, default=0, help="peak throttle in [0, 127]; 0 keeps the wheels still")
+    parser.add_argument("--seconds", type=float, default=15, help="traffic time per run")
+    parser.add_argument("--output", help="write the JSON here instead of stdout")
+    args = parser.parse_args()
+
+    amplitude = max(0, min(127, args.drive_amplitude))
+    if amplitude == 0 and args.drive_hz:
+        print("drive amplitude is 0: drive commands will be ACKed as unchanged", file=sys.stderr)
+
+    runs = []
+    for drag_hz in [float(v) for v in args.drag_hz.split(",")]:
+        print(f"{args.sessions} session(s): drive {args.drive_hz} Hz, drag {drag_hz} Hz", file=sys.stderr)
+        runs.append(run(args.host, args.sessions, args.drive_hz, drag_hz, amplitude, args.seconds))
+
+    report = json.dumps({"host": args.host, "seconds": args.seconds, "runs": runs}, indent=2)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(report + "\n")
+    else:
+        print(report)
+
+
+if __name__ == "__main__":
+    main()